@@ -0,0 +1,76 @@
+// Throughput of base64_codec against websocketpp::base64 (old legacy file path).
+// Usage: base64_benchmark [megabytes]
+
+#include "base64.hpp"
+#include "base64_codec.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <vector>
+
+template <typename Function>
+static double measureSeconds(Function function, int repeats)
+{
+    double best = INFINITY;
+    for (int i = 0; i < repeats; ++i) {
+        auto start = std::chrono::steady_clock::now();
+        function();
+        best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    }
+    return best;
+}
+
+static void printResult(const char* name, size_t bytes, double seconds)
+{
+    std::cout << name << ": " << bytes / seconds / (1 << 20) << " MB/s" << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+    const size_t size = size_t(argc > 1 ? std::max(1, atoi(argv[1])) : 64) << 20;
+    std::vector<uint8_t> data(size);
+    std::mt19937 random(1);
+    for (uint8_t& byte : data)
+        byte = uint8_t(random());
+
+    std::string encoded;
+    std::string legacyEncoded;
+    const int fastRepeats = 5;
+    const int legacyRepeats = 1;
+
+    printResult("encode, websocketpp", size, measureSeconds([&]() { legacyEncoded = websocketpp::base64_encode(data.data(), size); }, legacyRepeats));
+    printResult("encode, base64_codec", size, measureSeconds([&]() { encoded = base64Encode(data.data(), size); }, fastRepeats));
+    if (encoded != legacyEncoded) {
+        std::cout << "Encoded text differs" << std::endl;
+        return 1;
+    }
+
+    std::string legacyDecoded;
+    printResult("decode, websocketpp", size, measureSeconds([&]() { legacyDecoded = websocketpp::base64_decode(encoded); }, legacyRepeats));
+
+    // straight into the destination, in 64KB pieces like a file stream
+    std::vector<uint8_t> decoded(size);
+    bool valid = true;
+    auto decodeInPieces = [&]() {
+        Base64Decoder decoder;
+        size_t position = 0;
+        for (size_t i = 0; i < encoded.size() && valid; i += 1 << 16) {
+            size_t written;
+            valid = decoder.decode(encoded.data() + i, std::min<size_t>(1 << 16, encoded.size() - i),
+                decoded.data() + position, size - position, written);
+            position += written;
+        }
+        size_t written;
+        valid = valid && decoder.finish(decoded.data() + position, size - position, written) && position + written == size;
+    };
+    printResult("decode, base64_codec", size, measureSeconds(decodeInPieces, fastRepeats));
+
+    if (!valid || std::memcmp(decoded.data(), data.data(), size) != 0 || std::memcmp(legacyDecoded.data(), data.data(), size) != 0) {
+        std::cout << "Decoded data differs" << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,148 @@
+// Core library timings on synthetic trees, ns per operation.
+// Fixed seeds and the median of several rounds, so numbers compare between releases.
+// Usage: uvbsp_benchmark [max nodes]
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <random>
+#include <uvbsp/uvbsp.h>
+#include <uvbsp/uvbsp_file.h>
+
+namespace {
+
+constexpr int s_rounds = 5;
+constexpr double s_minRoundSeconds = 0.05; // short operations are repeated up to this
+
+std::vector<UVBSPSplit> makeSplits(size_t count)
+{
+    std::mt19937 random(12345);
+    std::uniform_real_distribution<float> unit(0.f, 1.f);
+    std::vector<UVBSPSplit> splits;
+    splits.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        const float angle = unit(random) * 6.2831853f;
+        splits.emplace_back(bsp::vec2(unit(random), unit(random)), bsp::vec2(std::cos(angle), std::sin(angle)),
+            int(2 * i), int(2 * i + 1)); // distinct colors, no leaves merge
+    }
+    return splits;
+}
+
+std::vector<bsp::vec2> makeSamples(size_t count)
+{
+    std::mt19937 random(54321);
+    std::uniform_real_distribution<float> unit(0.f, 1.f);
+    std::vector<bsp::vec2> samples(count);
+    for (bsp::vec2& sample : samples)
+        sample = bsp::vec2(unit(random), unit(random));
+    return samples;
+}
+
+// run() does opsPerRun operations, returns median ns per operation of all rounds
+template <typename Run>
+double measure(Run&& run, size_t opsPerRun)
+{
+    std::vector<double> nsPerOp;
+    run(); // warm up caches and lazy state
+    for (int round = 0; round < s_rounds; ++round) {
+        size_t runs = 0;
+        auto start = std::chrono::steady_clock::now();
+        double seconds = 0;
+        do {
+            run();
+            runs++;
+            seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        } while (seconds < s_minRoundSeconds);
+        nsPerOp.push_back(seconds * 1e9 / (double(runs) * std::max<size_t>(opsPerRun, 1)));
+    }
+    std::nth_element(nsPerOp.begin(), nsPerOp.begin() + s_rounds / 2, nsPerOp.end());
+    return nsPerOp[s_rounds / 2];
+}
+
+void printResult(const char* name, const char* op, size_t nodes, double nsPerOp)
+{
+    std::printf("%-28s %-8s %10zu %14.2f\n", name, op, nodes, nsPerOp);
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    const size_t maxNodes = argc > 1 ? std::max(10l, atol(argv[1])) : 1000000;
+    const std::vector<bsp::vec2> samples = makeSamples(1 << 16);
+    const std::string path = (std::filesystem::temp_directory_path() / "uvbsp_benchmark.uvbsp").string();
+    const std::string jsonPath = (std::filesystem::temp_directory_path() / "uvbsp_benchmark.json").string();
+
+    std::printf("%-28s %-8s %10s %14s\n", "benchmark", "op", "nodes", "ns/op");
+    for (size_t nodeCount = 10; nodeCount <= maxNodes; nodeCount *= 10) {
+        const std::vector<UVBSPSplit> splits = makeSplits(nodeCount);
+
+        UVBSP uvbsp;
+        auto addSplits = [&]() {
+            uvbsp.reset();
+            for (const UVBSPSplit& split : splits)
+                uvbsp.addSplit(split);
+        };
+        printResult("addSplit", "split", nodeCount, measure(addSplits, splits.size()));
+        const size_t treeNodes = uvbsp.getNumNodes();
+
+        auto classifySingle = [&]() {
+            int sum = 0;
+            for (const bsp::vec2& sample : samples)
+                sum += uvbsp.classify(sample);
+            volatile int sink = sum;
+            (void)sink;
+        };
+        printResult("classify, single", "sample", treeNodes, measure(classifySingle, samples.size()));
+
+        std::vector<int> colors(samples.size());
+        const std::pair<const char*, UVBSP::ClassifyMode> modes[] = {
+            { "classify, batch scalar", UVBSP::ClassifyMode::Scalar },
+            { "classify, batch simd", UVBSP::ClassifyMode::Simd },
+            { "classify, batch coherent", UVBSP::ClassifyMode::Coherent },
+        };
+        for (const auto& [name, mode] : modes) {
+            auto classifyBatch = [&, mode = mode]() { uvbsp.classify(samples.data(), samples.size(), colors.data(), mode); };
+            printResult(name, "sample", treeNodes, measure(classifyBatch, samples.size()));
+        }
+
+        UVBSPCompiledTree compiledTree;
+        auto compile = [&]() { compiledTree.compile(uvbsp.getNodes()); };
+        printResult("compile (pack all)", "node", treeNodes, measure(compile, treeNodes));
+
+        // rotation of the last split while drawing: repack and upload of the touched nodes
+        auto upload = [](int, const bsp::Vec4*, size_t) {};
+        uvbsp.updateUniforms(upload);
+        uvbsp.addSplit(UVBSPSplit(bsp::vec2(0.5f, 0.5f), bsp::vec2(1.f, 0.f), 0, 1));
+        float angle = 0;
+        auto adjustAndUpload = [&]() {
+            angle += 0.01f;
+            uvbsp.adjustSplit(bsp::vec2(std::cos(angle), std::sin(angle)));
+            uvbsp.updateUniforms(upload);
+        };
+        printResult("adjustSplit + updateUniforms", "edit", treeNodes, measure(adjustAndUpload, 1));
+
+        auto generateShader = [&]() {
+            volatile size_t size = uvbsp.generateShader(UVBSP::ShaderType::GLSL).str().size();
+            (void)size;
+        };
+        printResult("generateShader", "node", treeNodes, measure(generateShader, treeNodes));
+
+        auto write = [&]() { uvbsp.writeToFile(path); };
+        printResult("writeToFile", "node", treeNodes, measure(write, treeNodes));
+        UVBSP loaded;
+        auto read = [&]() { loaded.readFromFile(path); };
+        printResult("readFromFile", "node", treeNodes, measure(read, treeNodes));
+
+        auto writeJson = [&]() { uvbsp.writeToJson(jsonPath); };
+        printResult("writeToJson", "node", treeNodes, measure(writeJson, treeNodes));
+        auto readJson = [&]() { loaded.readFromJson(jsonPath); };
+        printResult("readFromJson", "node", treeNodes, measure(readJson, treeNodes));
+        printResult("JSON file size", "MB", treeNodes, std::filesystem::file_size(jsonPath) / 1e6);
+    }
+    std::filesystem::remove(path);
+    std::filesystem::remove(jsonPath);
+    return 0;
+}
@@ -14,25 +14,62 @@ vec3 rainbow(float val){
     return result * result;
 }
 
-#define MAX_DEPTH 64
+uniform int maxDepth; // of the current tree
 uniform vec4 nodes[512];
+uniform bool halfNodes; // two nodes per vec4, see UVBSPHalfNodes
+
+// Large trees: nodes as raw bytes of RGBA8 texels, 4 texels (16 bytes) per node
+#define NODES_PER_ROW 512
+uniform bool largeTree;
+uniform sampler2D nodeTexture;
+
+// Preview check: color index as bytes of texel centers of an indexResolution^2 target
+uniform bool indexOutput;
+uniform float indexResolution;
 
 /// Node or color indices are represented in nodes.zw
 /// node(less than 0) or color(greater equal 0)
 
+int fetchBits(int x, int y){
+  ivec4 bytes = ivec4(texelFetch2D(nodeTexture, ivec2(x, y), 0) * 255.0 + 0.5);
+  return bytes.r | (bytes.g << 8) | (bytes.b << 16) | (bytes.a << 24);
+}
+
+// half nodes xy: direction | offset << 16 (16 bit fixed point), zw: int16 left | int16 right << 16,
+// returned as direction, offset and the child bits
+vec4 getNode(int index){
+  if(largeTree) {
+    int x = (index - index / NODES_PER_ROW * NODES_PER_ROW) * 4;
+    int y = index / NODES_PER_ROW;
+    return intBitsToFloat(ivec4(fetchBits(x, y), fetchBits(x + 1, y), fetchBits(x + 2, y), fetchBits(x + 3, y)));
+  }
+  if(!halfNodes)
+    return nodes[index];
+  vec4 pair = nodes[index / 2];
+  ivec2 bits = floatBitsToInt((index & 1) == 0 ? pair.xy : pair.zw);
+  return vec4(float(bits.x & 65535) * (1.0 / 32768.0), (float(bits.x >> 16) + 0.5) * (1.0 / 32768.0),
+              intBitsToFloat((bits.y << 16) >> 16), intBitsToFloat(bits.y >> 16));
+}
+
 int traverseTree(vec2 uv){
   int currentIndex = 0;
 
   //float distance = 99999999.f;
 
-  for(int iteration = 0; iteration < MAX_DEPTH; ++iteration) {
-    vec2 pos = vec2(nodes[currentIndex].x, 0.0);
-    vec2 dir = vec2(nodes[currentIndex].y, 1.0);
-    //distance = min(distance, abs(dot(pos - uv, normalize(dir))));
-    bool isLeftPixel = dot(pos - uv, dir) < 0.0;
+  for(int iteration = 0; iteration < maxDepth; ++iteration) {
+    vec4 node = getNode(currentIndex);
+    bool isLeftPixel;
+    if(halfNodes && !largeTree) {
+      vec2 normal = vec2(1.0 - node.x, node.x < 1.0 ? node.x : 2.0 - node.x);
+      isLeftPixel = (uv.x - 0.5) * normal.x + (uv.y - 0.5) * normal.y > node.y;
+    } else {
+      vec2 pos = vec2(node.x, 0.0);
+      vec2 dir = vec2(node.y, 1.0);
+      //distance = min(distance, abs(dot(pos - uv, normalize(dir))));
+      isLeftPixel = dot(pos - uv, dir) < 0.0;
+    }
 
-    int indexOfProperSide = floatBitsToInt(isLeftPixel ?
-              nodes[currentIndex].z : nodes[currentIndex].w);
+    int indexOfProperSide = floatBitsToInt(isLeftPixel ? node.z : node.w);
     
     if(indexOfProperSide < 0) {
       currentIndex = -indexOfProperSide;
@@ -46,6 +83,12 @@ int traverseTree(vec2 uv){
 
 void main() {
   vec2 uv = gl_TexCoord[0].xy;
+  if(indexOutput) {
+    // same uv as getTexelCenter(), indexResolution is a power of two so the division is exact
+    int index = traverseTree((floor(uv * indexResolution) + 0.5) * (1.0 / indexResolution));
+    gl_FragColor = vec4(float(index & 255), float((index >> 8) & 255), float((index >> 16) & 255), 255.0) / 255.0;
+    return;
+  }
   float index = traverseTree(uv);
   vec3 hint = rainbow(0.5 * float(index));
   vec3 textureColor = texture2D(texture, uv).rgb;
@@ -0,0 +1,362 @@
+// Headless batch tool: shader export, index maps and stats of .uvbsp files.
+// No window or GL context is created, files are processed in parallel.
+// .obj inputs are built into a tree from their UV islands first.
+
+#include "parallel_for.h"
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <uvbsp/uvbsp.h>
+#include <uvbsp/uvbsp_bake.h>
+#include <uvbsp/uvbsp_build.h>
+#include <uvbsp/uvbsp_conformance.h>
+#include <uvbsp/uvbsp_divergence.h>
+#include <uvbsp/uvbsp_export.h>
+#include <uvbsp/uvbsp_json.h>
+#include <uvbsp/uvbsp_mesh.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+struct Options {
+    std::vector<UVBSP::ShaderType> shaderTypes;
+    UVBSP::ShaderCodeForm shaderCodeForm = UVBSP::ShaderCodeForm::NodeArray;
+    uint32_t bakeWidth {}, bakeHeight {}; // 0 - no index map
+    bool bake8Bit {};
+    uint32_t antialiasedWidth {}, antialiasedHeight {}; // 0 - no image
+    uint32_t divergenceWidth {}, divergenceHeight {}; // 0 - no simulation
+    uint32_t blockWidth = 8, blockHeight = 4;
+    fs::path meshPath; // lanes of the simulation, .obj inputs use their own mesh
+    UVBSPMesh mesh;
+    std::string comparePath; // {name} is the input name, no comparison if empty
+    uint32_t compareWidth = 4096, compareHeight = 4096; // against a tree
+    bool stats {};
+    bool simplify {};
+    bool rebalance {};
+    bool json {};
+    bool byMaterial {}; // .obj inputs
+    unsigned threadCount {}; // all cores
+    fs::path outputDir; // next to the input file if empty
+    std::vector<fs::path> inputs;
+};
+
+void printUsage()
+{
+    std::cout
+        << "Usage: uvbsp_cli [options] file.uvbsp|file.json|file.obj...\n"
+           "  --shader glsl|hlsl|unreal   write generated shader code (<name>.glsl, .hlsl, .unreal.hlsl)\n"
+           "  --unrolled                  shader as literal branches instead of a node array\n"
+           "  --half                      shader with two 16 bit nodes per vector, fails if a split moves too far\n"
+           "  --bake WIDTHxHEIGHT         bake index map <name>_index.png (16 bit)\n"
+           "  --8bit                      8 bit index map\n"
+           "  --antialiased WIDTHxHEIGHT  export antialiased image <name>_antialiased.png\n"
+           "  --divergence WIDTHxHEIGHT   simulate GPU blocks running the shader, node array and unrolled,\n"
+           "                              heatmap of block costs <name>_divergence.png for the chosen form\n"
+           "  --block WIDTHxHEIGHT        texels of one block, 8x4 by default (2x2 for pixel quads)\n"
+           "  --mesh FILE.obj             simulate texels covered by its UV triangles only\n"
+           "  --compare FILE              compare with an index map (.png, .tga) or a tree (.uvbsp, .json),\n"
+           "                              {name} in FILE is the input name, difference image <name>_diff.png,\n"
+           "                              fails if any texel changed segment\n"
+           "  --compare-size WIDTHxHEIGHT texels compared against a tree, 4096x4096 by default\n"
+           "  --stats                     print nodes, depth, leaves and color areas\n"
+           "  --simplify                  remove splits that change nothing, before rebalance\n"
+           "  --rebalance                 rebalance the tree before anything else\n"
+           "  --json                      write the project as JSON <name>.json\n"
+           "  --by-material               .obj leaves by material instead of UV island\n"
+           "  --threads N                 worker threads, all cores by default\n"
+           "  --out DIR                   output directory, next to the input by default\n";
+}
+
+bool parseSize(const std::string& text, uint32_t& width, uint32_t& height)
+{
+    char separator {};
+    std::istringstream stream(text);
+    return (stream >> width >> separator >> height) && separator == 'x' && width && height;
+}
+
+bool parseOptions(int argc, char** argv, Options& options)
+{
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        const bool hasValue = i + 1 < argc;
+
+        if (arg == "--shader" && hasValue) {
+            const std::string type = argv[++i];
+            if (type == "glsl")
+                options.shaderTypes.push_back(UVBSP::ShaderType::GLSL);
+            else if (type == "hlsl")
+                options.shaderTypes.push_back(UVBSP::ShaderType::HLSL);
+            else if (type == "unreal")
+                options.shaderTypes.push_back(UVBSP::ShaderType::UnrealCustomNode);
+            else
+                return false;
+        } else if (arg == "--bake" && hasValue) {
+            if (!parseSize(argv[++i], options.bakeWidth, options.bakeHeight))
+                return false;
+        } else if (arg == "--antialiased" && hasValue) {
+            if (!parseSize(argv[++i], options.antialiasedWidth, options.antialiasedHeight))
+                return false;
+        } else if (arg == "--divergence" && hasValue) {
+            if (!parseSize(argv[++i], options.divergenceWidth, options.divergenceHeight))
+                return false;
+        } else if (arg == "--block" && hasValue) {
+            if (!parseSize(argv[++i], options.blockWidth, options.blockHeight))
+                return false;
+        } else if (arg == "--mesh" && hasValue) {
+            options.meshPath = argv[++i];
+        } else if (arg == "--compare" && hasValue) {
+            options.comparePath = argv[++i];
+        } else if (arg == "--compare-size" && hasValue) {
+            if (!parseSize(argv[++i], options.compareWidth, options.compareHeight))
+                return false;
+        } else if (arg == "--unrolled") {
+            options.shaderCodeForm = UVBSP::ShaderCodeForm::Unrolled;
+        } else if (arg == "--half") {
+            options.shaderCodeForm = UVBSP::ShaderCodeForm::HalfPacked;
+        } else if (arg == "--8bit") {
+            options.bake8Bit = true;
+        } else if (arg == "--stats") {
+            options.stats = true;
+        } else if (arg == "--simplify") {
+            options.simplify = true;
+        } else if (arg == "--rebalance") {
+            options.rebalance = true;
+        } else if (arg == "--json") {
+            options.json = true;
+        } else if (arg == "--by-material") {
+            options.byMaterial = true;
+        } else if (arg == "--threads" && hasValue) {
+            options.threadCount = std::max(1, atoi(argv[++i]));
+        } else if (arg == "--out" && hasValue) {
+            options.outputDir = argv[++i];
+        } else if (!arg.empty() && arg[0] != '-') {
+            options.inputs.push_back(arg);
+        } else {
+            return false;
+        }
+    }
+    return !options.inputs.empty();
+}
+
+const char* getShaderExtension(UVBSP::ShaderType shaderType)
+{
+    switch (shaderType) {
+    case UVBSP::ShaderType::GLSL:
+        return ".glsl";
+    case UVBSP::ShaderType::HLSL:
+        return ".hlsl";
+    case UVBSP::ShaderType::UnrealCustomNode:
+        return ".unreal.hlsl";
+    }
+    return ".txt";
+}
+
+// Log of one file, printed when all files are done so lines do not interleave
+bool processFile(const fs::path& input, const Options& options, unsigned threadCount, std::ostream& log)
+{
+    UVBSP uvbsp;
+    UVBSPEditorState state;
+    UVBSPProjectInfo info; // palette of JSON projects
+    bool isRead;
+    UVBSPMesh mesh;
+    if (input.extension() == ".obj") {
+        UVBSPMeshBuilder::Settings settings;
+        settings.groupBy = options.byMaterial ? UVBSPMeshBuilder::GroupBy::Material : UVBSPMeshBuilder::GroupBy::Island;
+        settings.threadCount = threadCount;
+        UVBSPMeshBuilder::Stats stats;
+        isRead = mesh.loadObj(input.string()) && UVBSPMeshBuilder(mesh).build(uvbsp, settings, &stats);
+        if (isRead)
+            log << "Mesh build: " << stats.getInfo() << "\n";
+    } else {
+        isRead = isUVBSPJsonFile(input) ? uvbsp.readFromJson(input, &state, &info) : uvbsp.readFromFile(input, &state);
+    }
+    if (!isRead) {
+        log << "Failed to read: " << input << "\n";
+        return false;
+    }
+
+    const fs::path outputDir = options.outputDir.empty() ? input.parent_path() : options.outputDir;
+    const std::string name = input.stem().string();
+    bool success = true;
+
+    if (options.simplify)
+        log << "Simplify: " << uvbsp.simplify().getInfo() << "\n";
+    if (options.rebalance)
+        log << "Rebalance: " << uvbsp.rebalance().getInfo() << "\n";
+    if (options.simplify || options.rebalance) { // node indices changed
+        state.history.clear();
+        state.historyIndex = 0;
+    }
+
+    if (options.json) {
+        const fs::path path = outputDir / (name + ".json");
+        if (path == input) {
+            log << "JSON output would overwrite the input: " << path << "\n";
+            success = false;
+        } else if (uvbsp.writeToJson(path, &state, &info)) {
+            log << "JSON project: " << path.string() << "\n";
+        } else {
+            log << "Failed to write: " << path << "\n";
+            success = false;
+        }
+    }
+
+    for (UVBSP::ShaderType shaderType : options.shaderTypes) {
+        const fs::path path = outputDir / (name + getShaderExtension(shaderType));
+        const std::string shaderText = uvbsp.generateShader(shaderType, options.shaderCodeForm).str();
+        if (shaderText.empty()) {
+            log << "Half nodes refused, a split moves too far or an index needs more than 16 bits: " << path << "\n";
+            success = false;
+            continue;
+        }
+        std::ofstream file(path);
+        file << shaderText;
+        if (!file) {
+            log << "Failed to write: " << path << "\n";
+            success = false;
+        }
+    }
+
+    if (options.bakeWidth) {
+        UVBSPIndexBaker::Settings settings;
+        settings.width = options.bakeWidth;
+        settings.height = options.bakeHeight;
+        settings.is16Bit = !options.bake8Bit;
+        settings.threadCount = threadCount;
+        UVBSPIndexBaker::Stats stats;
+        const fs::path path = outputDir / (name + "_index.png");
+        if (UVBSPIndexBaker(uvbsp).bake(path, settings, &stats)) {
+            log << "Index map: " << path.string() << "   " << stats.getInfo() << "\n";
+        } else {
+            log << "Failed to bake: " << path << "\n";
+            success = false;
+        }
+    }
+
+    if (options.antialiasedWidth) {
+        UVBSPAntialiasedExporter::Settings settings;
+        settings.width = options.antialiasedWidth;
+        settings.height = options.antialiasedHeight;
+        settings.threadCount = threadCount;
+        settings.palette = info.palette;
+        const fs::path path = outputDir / (name + "_antialiased.png");
+        if (UVBSPAntialiasedExporter(uvbsp).exportImage(path, settings)) {
+            log << "Antialiased image: " << path.string() << "\n";
+        } else {
+            log << "Failed to export: " << path << "\n";
+            success = false;
+        }
+    }
+
+    if (options.divergenceWidth) {
+        UVBSPDivergenceSimulator::Settings settings;
+        settings.width = options.divergenceWidth;
+        settings.height = options.divergenceHeight;
+        settings.blockWidth = options.blockWidth;
+        settings.blockHeight = options.blockHeight;
+        settings.mesh = !mesh.triangles.empty() ? &mesh : !options.mesh.triangles.empty() ? &options.mesh : nullptr;
+        settings.threadCount = threadCount;
+        const fs::path path = outputDir / (name + "_divergence.png");
+        for (UVBSP::ShaderCodeForm codeForm : { UVBSP::ShaderCodeForm::NodeArray, UVBSP::ShaderCodeForm::Unrolled }) {
+            settings.codeForm = codeForm;
+            // half nodes walk the same tree as the node array
+            const bool isChosen = codeForm == options.shaderCodeForm
+                || (codeForm == UVBSP::ShaderCodeForm::NodeArray && options.shaderCodeForm == UVBSP::ShaderCodeForm::HalfPacked);
+            UVBSPDivergenceSimulator::Stats stats;
+            if (UVBSPDivergenceSimulator(uvbsp).simulate(settings, &stats, isChosen ? path.string() : "")) {
+                log << (codeForm == UVBSP::ShaderCodeForm::Unrolled ? "Divergence, unrolled: " : "Divergence, node array: ")
+                    << stats.getInfo() << "\n";
+            } else {
+                log << "Failed to simulate: " << path << "\n";
+                success = false;
+            }
+        }
+    }
+
+    if (!options.comparePath.empty()) {
+        std::string referencePath = options.comparePath;
+        for (size_t pos; (pos = referencePath.find("{name}")) != std::string::npos;)
+            referencePath.replace(pos, 6, name);
+        const fs::path reference = referencePath;
+        UVBSPConformanceChecker::Settings settings;
+        settings.width = options.compareWidth;
+        settings.height = options.compareHeight;
+        settings.threadCount = threadCount;
+        UVBSPConformanceChecker::Report report;
+        const fs::path path = outputDir / (name + "_diff.png");
+        bool isCompared;
+        if (reference.extension() == ".uvbsp" || reference.extension() == ".json") {
+            UVBSP referenceTree;
+            isCompared = referenceTree.readFromFile(reference.string())
+                && UVBSPConformanceChecker(uvbsp).compare(referenceTree, settings, &report, path.string());
+        } else {
+            UVBSPLabelImage referenceImage;
+            isCompared = UVBSPLabelImage::readIndexMap(reference.string(), referenceImage)
+                && UVBSPConformanceChecker(uvbsp).compare(referenceImage, settings, &report, path.string());
+        }
+        if (isCompared) {
+            log << "Conformance with " << reference.string() << ": " << report.getInfo() << "\n"
+                << "Difference image: " << path.string() << "\n";
+            for (const UVBSPConformanceChecker::Confusion& change : report.getLargestChanges(8))
+                log << "  segment " << change.reference << " -> " << change.tested << ": " << change.texels << " texels\n";
+            success &= report.changedTexels == 0;
+        } else {
+            log << "Failed to compare with: " << reference << "\n";
+            success = false;
+        }
+    }
+
+    if (options.stats) {
+        const UVBSPTreeStats& treeStats = uvbsp.getTreeStats();
+        log << uvbsp.getBasicInfo()
+            << "   Reachable nodes: " << uvbsp.getCompiledTree().size()
+            << "   Average leaf depth: " << treeStats.getAverageLeafDepth()
+            << "   Colors: " << uvbsp.getColorCount() << " (" << treeStats.getUsedColorCount() << " used)\n";
+        const std::vector<int>& colorLeafCounts = treeStats.getColorLeafCounts();
+        for (int colorIndex = 0; colorIndex < uvbsp.getColorCount(); ++colorIndex) {
+            const double area = uvbsp.getColorArea(colorIndex);
+            if (area > 0)
+                log << "  color " << colorIndex << ": " << area * 100.0 << "%, "
+                    << (colorIndex < int(colorLeafCounts.size()) ? colorLeafCounts[colorIndex] : 0) << " leaves\n";
+        }
+    }
+    return success;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        printUsage();
+        return 2;
+    }
+    if (!options.meshPath.empty() && !options.mesh.loadObj(options.meshPath.string())) {
+        std::cout << "Failed to read: " << options.meshPath << std::endl;
+        return 1;
+    }
+
+    // files are spread over threads, one file alone uses them for its images
+    const unsigned fileThreads = std::min<size_t>(getThreadCount(options.threadCount), options.inputs.size());
+    const unsigned imageThreads = fileThreads > 1 ? 1 : options.threadCount;
+
+    std::vector<std::ostringstream> logs(options.inputs.size());
+    std::vector<char> results(options.inputs.size());
+    parallelFor(
+        options.inputs.size(), [&](size_t i) {
+            results[i] = processFile(options.inputs[i], options, imageThreads, logs[i]);
+        },
+        fileThreads);
+
+    int failed = 0;
+    for (size_t i = 0; i < options.inputs.size(); ++i) {
+        std::cout << "== " << options.inputs[i].string() << (results[i] ? "" : " (failed)") << "\n"
+                  << logs[i].str();
+        failed += !results[i];
+    }
+    std::cout << options.inputs.size() - failed << "/" << options.inputs.size() << " files processed" << std::endl;
+    return failed ? 1 : 0;
+}
@@ -1,10 +1,14 @@
 #ifndef APP_ABSTRACT_H
 #define APP_ABSTRACT_H
+#include "frame_profiler.h"
 #include "window.h"
 
 class Application {
 protected:
     Window m_window;
+    FrameProfiler m_profiler; // stages of the main loop, derived classes add their own
+    const int m_eventsStage = m_profiler.addStage("processEvents");
+    const int m_displayStage = m_profiler.addStage("display");
 
 public:
     Application()
@@ -14,17 +18,27 @@ public:
     virtual ~Application() {};
     virtual void drawContext() = 0;
 
+    // Draws and swaps only when something changed, processEvents() sleeps otherwise.
+    // While the profiler is on every frame is drawn, so the graph keeps rolling.
     void mainLoop()
     {
         while (m_window.isOpen()) {
-            m_window.processEvents();
+            if (m_profiler.isEnabled())
+                m_window.requestRedraw(1);
+            {
+                FrameProfiler::ScopedTimer timer(m_profiler, m_eventsStage);
+                m_window.processEvents();
+            }
             // m_window.setTitle(std::to_string(m_window.windowMayBeDirty()));
 
-            if (m_window.windowMayBeDirty()) {
+            if (m_window.isOpen() && m_window.windowMayBeDirty()) {
                 drawContext();
+                {
+                    FrameProfiler::ScopedTimer timer(m_profiler, m_displayStage);
+                    m_window.display();
+                }
+                m_profiler.endFrame();
             }
-
-            m_window.display();
         }
     }
 };
@@ -0,0 +1,217 @@
+#include "base64_codec.h"
+
+#include <array>
+
+#if defined(__GNUC__) && defined(__SSE2__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define BASE64_X86_SIMD
+#endif
+
+static const char s_alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+enum : int8_t {
+    Invalid = -1,
+    Whitespace = -2,
+    Padding = -3
+};
+
+static const std::array<int8_t, 256> s_decodeTable = []() {
+    std::array<int8_t, 256> table;
+    table.fill(Invalid);
+    for (int i = 0; i < 64; ++i)
+        table[uint8_t(s_alphabet[i])] = int8_t(i);
+    for (char c : { ' ', '\t', '\r', '\n' })
+        table[uint8_t(c)] = Whitespace;
+    table[uint8_t('=')] = Padding;
+    return table;
+}();
+
+// both characters of 12 bits at once
+static const std::array<std::array<char, 2>, 4096> s_encodePairTable = []() {
+    std::array<std::array<char, 2>, 4096> table;
+    for (int i = 0; i < 4096; ++i)
+        table[i] = { s_alphabet[i >> 6], s_alphabet[i & 63] };
+    return table;
+}();
+
+////////////////////////////////// SIMD //////////////////////////////
+
+#ifdef BASE64_X86_SIMD
+
+// 12 bytes -> 16 characters per step, reads 16 bytes, so stops 4 bytes before the end
+__attribute__((target("ssse3"))) static size_t encodeSSSE3(const uint8_t* data, size_t size, char* out)
+{
+    size_t i = 0;
+    for (; i + 16 <= size; i += 12, out += 16) {
+        __m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        // every 32 bit lane gets bytes b1 b0 b2 b1 of its 3 bytes
+        in = _mm_shuffle_epi8(in, _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+        // sextets to separate bytes with multiplies instead of variable shifts
+        __m128i t0 = _mm_mulhi_epu16(_mm_and_si128(in, _mm_set1_epi32(0x0FC0FC00)), _mm_set1_epi32(0x04000040));
+        __m128i t1 = _mm_mullo_epi16(_mm_and_si128(in, _mm_set1_epi32(0x003F03F0)), _mm_set1_epi32(0x01000010));
+        __m128i indices = _mm_or_si128(t0, t1);
+
+        // offset from sextet to ASCII by range: 0..25 'A', 26..51 'a', 52..61 '0', 62 '+', 63 '/'
+        __m128i range = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+        __m128i isUpper = _mm_cmpgt_epi8(_mm_set1_epi8(26), indices);
+        range = _mm_or_si128(range, _mm_and_si128(isUpper, _mm_set1_epi8(13)));
+        const __m128i offsets = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+            '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+        __m128i result = _mm_add_epi8(_mm_shuffle_epi8(offsets, range), indices);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out), result);
+    }
+    return i;
+}
+
+// 16 characters -> 12 bytes per step while all of them are in the alphabet.
+// Writes 16 bytes, so stops when less than 16 bytes of out are left.
+__attribute__((target("ssse3"))) static size_t decodeSSSE3(
+    const char* text, size_t size, uint8_t* out, size_t outCapacity, size_t& written)
+{
+    const __m128i mask2F = _mm_set1_epi8(0x2F);
+    // bit sets by low and high nibble, any common bit marks a character out of the alphabet
+    const __m128i lowNibbleBits = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+        0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+    const __m128i highNibbleBits = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+        0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+    // ASCII to sextet offset by high nibble, '/' shares it with '+' and gets index 1
+    const __m128i offsets = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+
+    size_t i = 0;
+    written = 0;
+    for (; i + 16 <= size && written + 16 <= outCapacity; i += 16, written += 12) {
+        __m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text + i));
+        __m128i highNibbles = _mm_and_si128(_mm_srli_epi32(in, 4), mask2F);
+        __m128i lowNibbles = _mm_and_si128(in, mask2F);
+        __m128i invalid = _mm_and_si128(_mm_shuffle_epi8(lowNibbleBits, lowNibbles), _mm_shuffle_epi8(highNibbleBits, highNibbles));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(invalid, _mm_setzero_si128())) != 0xFFFF)
+            break; // padding, whitespace or garbage, the scalar path decides
+
+        __m128i isSlash = _mm_cmpeq_epi8(in, mask2F);
+        __m128i sextets = _mm_add_epi8(in, _mm_shuffle_epi8(offsets, _mm_add_epi8(isSlash, highNibbles)));
+
+        // 4 sextets -> 24 bits per lane, then drop the top byte of every lane
+        __m128i pairs = _mm_maddubs_epi16(sextets, _mm_set1_epi32(0x01400140));
+        __m128i lanes = _mm_madd_epi16(pairs, _mm_set1_epi32(0x00011000));
+        __m128i bytes = _mm_shuffle_epi8(lanes, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + written), bytes);
+    }
+    return i;
+}
+
+static bool hasSSSE3()
+{
+    static const bool supported = __builtin_cpu_supports("ssse3");
+    return supported;
+}
+
+#endif // BASE64_X86_SIMD
+
+////////////////////////////////// ENCODE //////////////////////////////
+
+size_t getBase64EncodedSize(size_t size)
+{
+    return (size + 2) / 3 * 4;
+}
+
+size_t getBase64MaxDecodedSize(size_t encodedSize)
+{
+    return (encodedSize + 3) / 4 * 3;
+}
+
+void base64Encode(const uint8_t* data, size_t size, char* out)
+{
+    size_t i = 0;
+#ifdef BASE64_X86_SIMD
+    if (hasSSSE3()) {
+        i = encodeSSSE3(data, size, out);
+        out += i / 3 * 4;
+    }
+#endif
+    for (; i + 3 <= size; i += 3, out += 4) {
+        const uint32_t bits = uint32_t(data[i]) << 16 | uint32_t(data[i + 1]) << 8 | data[i + 2];
+        const auto& high = s_encodePairTable[bits >> 12];
+        const auto& low = s_encodePairTable[bits & 0xFFF];
+        out[0] = high[0];
+        out[1] = high[1];
+        out[2] = low[0];
+        out[3] = low[1];
+    }
+
+    if (i < size) {
+        const uint32_t bits = uint32_t(data[i]) << 16 | (i + 1 < size ? uint32_t(data[i + 1]) << 8 : 0);
+        out[0] = s_alphabet[bits >> 18];
+        out[1] = s_alphabet[(bits >> 12) & 63];
+        out[2] = i + 1 < size ? s_alphabet[(bits >> 6) & 63] : '=';
+        out[3] = '=';
+    }
+}
+
+std::string base64Encode(const uint8_t* data, size_t size)
+{
+    std::string result(getBase64EncodedSize(size), '\0');
+    base64Encode(data, size, result.data());
+    return result;
+}
+
+////////////////////////////////// DECODE //////////////////////////////
+
+bool Base64Decoder::decode(const char* text, size_t size, uint8_t* out, size_t outCapacity, size_t& written)
+{
+    written = 0;
+    size_t i = 0;
+    while (i < size) {
+#ifdef BASE64_X86_SIMD
+        if (m_count == 0 && !m_finished && hasSSSE3()) {
+            size_t blockWritten;
+            i += decodeSSSE3(text + i, size - i, out + written, outCapacity - written, blockWritten);
+            written += blockWritten;
+            if (i == size)
+                break;
+        }
+#endif
+        // one character, then back to full blocks once a quad is complete
+        const int8_t value = s_decodeTable[uint8_t(text[i++])];
+        if (value == Whitespace)
+            continue;
+        if (value == Padding) {
+            size_t tailWritten = 0;
+            if (!m_finished && !finish(out + written, outCapacity - written, tailWritten))
+                return false;
+            written += tailWritten;
+            continue;
+        }
+        if (value == Invalid || m_finished)
+            return false;
+
+        m_bits = m_bits << 6 | uint32_t(value);
+        if (++m_count == 4) {
+            if (written + 3 > outCapacity)
+                return false;
+            out[written++] = uint8_t(m_bits >> 16);
+            out[written++] = uint8_t(m_bits >> 8);
+            out[written++] = uint8_t(m_bits);
+            m_bits = 0;
+            m_count = 0;
+        }
+    }
+    return true;
+}
+
+bool Base64Decoder::finish(uint8_t* out, size_t outCapacity, size_t& written)
+{
+    written = 0;
+    m_finished = true;
+    if (m_count == 1)
+        return false; // 6 bits are not a byte
+
+    const size_t tailSize = m_count ? m_count - 1 : 0;
+    if (tailSize > outCapacity)
+        return false;
+    const uint32_t bits = m_bits << (6 * (4 - m_count));
+    for (size_t j = 0; j < tailSize; ++j)
+        out[written++] = uint8_t(bits >> (16 - 8 * j));
+    m_bits = 0;
+    m_count = 0;
+    return true;
+}
@@ -0,0 +1,35 @@
+#ifndef BASE64_CODEC_H
+#define BASE64_CODEC_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Standard alphabet base64 with '=' padding.
+// Lookup tables, SSSE3 for 12 bytes <-> 16 characters when the CPU has it.
+
+size_t getBase64EncodedSize(size_t size);
+size_t getBase64MaxDecodedSize(size_t encodedSize);
+
+// out needs getBase64EncodedSize(size) characters, no terminating zero is written
+void base64Encode(const uint8_t* data, size_t size, char* out);
+std::string base64Encode(const uint8_t* data, size_t size);
+
+// Decodes text passed in pieces of any size, bytes go straight to the caller buffer.
+// Whitespace is skipped, decoding stops at padding.
+class Base64Decoder {
+public:
+    // Writes decoded bytes to out, written is their count.
+    // False on a character out of the alphabet or when outCapacity is too small.
+    bool decode(const char* text, size_t size, uint8_t* out, size_t outCapacity, size_t& written);
+    // Bytes of an unpadded tail, false if the text ends in the middle of a byte
+    bool finish(uint8_t* out, size_t outCapacity, size_t& written);
+    void reset() { *this = Base64Decoder(); }
+
+private:
+    uint32_t m_bits {}; // sextets of the current quad
+    int m_count {};
+    bool m_finished {}; // after padding
+};
+
+#endif // BASE64_CODEC_H
@@ -0,0 +1,82 @@
+#include "frame_profiler.h"
+#include "imgui/imgui.h"
+#include <algorithm>
+#include <cstdio>
+
+namespace {
+
+struct Summary {
+    float last {}, average {}, p99 {};
+};
+
+Summary summarize(const std::vector<float>& history, size_t count, size_t nextFrame)
+{
+    Summary summary;
+    if (!count)
+        return summary;
+    std::vector<float> values(history.begin(), history.begin() + count);
+    summary.last = history[(nextFrame + history.size() - 1) % history.size()];
+    for (float value : values)
+        summary.average += value;
+    summary.average /= count;
+    const size_t p99Index = std::min(count - 1, count * 99 / 100);
+    std::nth_element(values.begin(), values.begin() + p99Index, values.end());
+    summary.p99 = values[p99Index];
+    return summary;
+}
+
+} // namespace
+
+void FrameProfiler::setEnabled(bool enabled)
+{
+    if (enabled && !m_isEnabled) {
+        m_frameCount = m_nextFrame = 0;
+        for (Series& series : m_series)
+            series.current = 0;
+        m_frameStart = std::chrono::steady_clock::now();
+    }
+    m_isEnabled = enabled;
+}
+
+void FrameProfiler::endFrame()
+{
+    if (!m_isEnabled)
+        return;
+    const auto now = std::chrono::steady_clock::now();
+    m_frameTimes[m_nextFrame] = std::chrono::duration<float, std::milli>(now - m_frameStart).count();
+    m_frameStart = now;
+    for (Series& series : m_series) {
+        series.history[m_nextFrame] = float(series.current);
+        series.current = 0;
+    }
+    m_nextFrame = (m_nextFrame + 1) % s_historySize;
+    m_frameCount = std::min(m_frameCount + 1, s_historySize);
+}
+
+void FrameProfiler::showInImGui() const
+{
+    const Summary frame = summarize(m_frameTimes, m_frameCount, m_nextFrame);
+    char overlay[64];
+    snprintf(overlay, sizeof(overlay), "%.2f ms avg, %.2f ms p99", frame.average, frame.p99);
+    // oldest frame first once the ring is full
+    const int offset = m_frameCount == s_historySize ? int(m_nextFrame) : 0;
+    ImGui::PlotLines("##frame time", m_frameTimes.data(), int(m_frameCount), offset, overlay,
+        0.f, std::max(frame.p99 * 1.5f, 1.f), ImVec2(s_historySize * 1.5f, 80.f));
+
+    if (!ImGui::BeginTable("profiler series", 4))
+        return;
+    for (const char* header : { "", "last", "avg", "p99" })
+        ImGui::TableSetupColumn(header);
+    ImGui::TableHeadersRow();
+    for (const Series& series : m_series) {
+        const Summary summary = summarize(series.history, m_frameCount, m_nextFrame);
+        const char* format = series.isTime ? "%.3f ms" : "%.0f";
+        ImGui::TableNextColumn();
+        ImGui::TextUnformatted(series.name.c_str());
+        for (float value : { summary.last, summary.average, summary.p99 }) {
+            ImGui::TableNextColumn();
+            ImGui::Text(format, value);
+        }
+    }
+    ImGui::EndTable();
+}
@@ -0,0 +1,79 @@
+#ifndef FRAME_PROFILER_H
+#define FRAME_PROFILER_H
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+//////////////////// FRAME PROFILER ///////////////////
+
+// Rolling history of the main loop: frame time, time of named stages and per frame counters.
+// Disabled profiler does nothing, timers don't even read the clock.
+
+class FrameProfiler {
+public:
+    static constexpr size_t s_historySize = 240; // frames
+
+    class ScopedTimer {
+    public:
+        ScopedTimer(FrameProfiler& profiler, int stage)
+            : m_profiler(profiler.isEnabled() ? &profiler : nullptr)
+            , m_stage(stage)
+        {
+            if (m_profiler)
+                m_start = std::chrono::steady_clock::now();
+        }
+        ~ScopedTimer()
+        {
+            if (m_profiler)
+                m_profiler->addValue(m_stage, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - m_start).count());
+        }
+
+    private:
+        FrameProfiler* m_profiler;
+        int m_stage;
+        std::chrono::steady_clock::time_point m_start;
+    };
+
+    // Series are summed over a frame: stages in ms, counters in their own units
+    int addStage(const std::string& name) { return addSeries(name, true); }
+    int addCounter(const std::string& name) { return addSeries(name, false); }
+
+    void addValue(int series, double value)
+    {
+        if (m_isEnabled)
+            m_series[series].current += value;
+    }
+
+    void setEnabled(bool enabled);
+    bool isEnabled() const { return m_isEnabled; }
+
+    // Closes the frame, values go to the history
+    void endFrame();
+
+    // Frame time graph and a row per series: last, average, p99. Call inside an ImGui window.
+    void showInImGui() const;
+
+private:
+    struct Series {
+        std::string name;
+        bool isTime;
+        double current {};
+        std::vector<float> history;
+    };
+
+    int addSeries(const std::string& name, bool isTime)
+    {
+        m_series.push_back({ name, isTime, 0, std::vector<float>(s_historySize) });
+        return int(m_series.size() - 1);
+    }
+
+    std::vector<Series> m_series;
+    std::vector<float> m_frameTimes = std::vector<float>(s_historySize); // ms
+    size_t m_frameCount {}; // recorded since enabled
+    size_t m_nextFrame {}; // ring buffer position
+    std::chrono::steady_clock::time_point m_frameStart;
+    bool m_isEnabled = false;
+};
+
+#endif // FRAME_PROFILER_H
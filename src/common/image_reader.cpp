@@ -0,0 +1,422 @@
+#include "image_reader.h"
+#include "mapped_file.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+
+namespace {
+
+////////////////////////////////// INFLATE //////////////////////////////
+
+// LSB first bit stream of deflate, reads zero bytes past the end, isOverrun() tells
+class BitReader {
+public:
+    BitReader(const uint8_t* data, size_t size)
+        : m_data(data)
+        , m_size(size)
+    {
+    }
+
+    uint32_t peek(int count)
+    {
+        if (m_count < count)
+            refill();
+        return uint32_t(m_bits & ((uint64_t(1) << count) - 1));
+    }
+
+    void consume(int count)
+    {
+        m_bits >>= count;
+        m_count -= count;
+    }
+
+    uint32_t read(int count)
+    {
+        const uint32_t value = peek(count);
+        consume(count);
+        return value;
+    }
+
+    // Drops the bits of the current byte, byte position of what comes next
+    size_t alignToByte()
+    {
+        consume(m_count % 8);
+        const size_t position = m_position - m_count / 8;
+        m_bits = 0;
+        m_count = 0;
+        m_position = position;
+        return position;
+    }
+
+    void seek(size_t position) { m_position = position; }
+
+    bool isOverrun() const { return m_position - m_count / 8 > m_size; }
+
+private:
+    void refill()
+    {
+        while (m_count <= 56) {
+            const uint64_t byte = m_position < m_size ? m_data[m_position] : 0;
+            m_position++;
+            m_bits |= byte << m_count;
+            m_count += 8;
+        }
+    }
+
+    const uint8_t* m_data;
+    size_t m_size;
+    size_t m_position {};
+    uint64_t m_bits {};
+    int m_count {};
+};
+
+// Canonical Huffman code decoded by one lookup of all s_maxCodeLength bits
+class HuffmanTable {
+public:
+    static constexpr int s_maxCodeLength = 15;
+
+    // false for an over-subscribed code, incomplete ones fail when a missing code is read
+    bool build(const uint8_t* lengths, int count)
+    {
+        int lengthCounts[s_maxCodeLength + 1] = {};
+        for (int i = 0; i < count; ++i)
+            lengthCounts[lengths[i]]++;
+        lengthCounts[0] = 0;
+
+        int left = 1, nextCodes[s_maxCodeLength + 1] = {};
+        for (int length = 1, code = 0; length <= s_maxCodeLength; ++length) {
+            left = (left << 1) - lengthCounts[length];
+            if (left < 0)
+                return false;
+            code = (code + lengthCounts[length - 1]) << 1;
+            nextCodes[length] = code;
+        }
+
+        m_entries.assign(size_t(1) << s_maxCodeLength, 0);
+        for (int symbol = 0; symbol < count; ++symbol) {
+            const int length = lengths[symbol];
+            if (!length)
+                continue;
+            // codes are stored MSB first, the stream is read LSB first
+            uint32_t code = nextCodes[length]++, reversed = 0;
+            for (int bit = 0; bit < length; ++bit, code >>= 1)
+                reversed = reversed << 1 | (code & 1);
+            for (uint32_t index = reversed; index < m_entries.size(); index += 1u << length)
+                m_entries[index] = uint16_t(symbol << 4 | length);
+        }
+        return true;
+    }
+
+    // -1 for a missing code
+    int decode(BitReader& reader) const
+    {
+        const uint16_t entry = m_entries[reader.peek(s_maxCodeLength)];
+        if (!(entry & 15))
+            return -1;
+        reader.consume(entry & 15);
+        return entry >> 4;
+    }
+
+private:
+    std::vector<uint16_t> m_entries; // symbol << 4 | code length
+};
+
+bool inflateBlock(BitReader& reader, const HuffmanTable& literals, const HuffmanTable& distances,
+    std::vector<uint8_t>& out, size_t maxSize)
+{
+    static const uint16_t lengthBases[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+        35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+    static const uint8_t lengthExtraBits[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+        3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+    static const uint16_t distanceBases[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+        257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+    static const uint8_t distanceExtraBits[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+        7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+    for (;;) {
+        const int symbol = literals.decode(reader);
+        if (symbol < 0 || reader.isOverrun())
+            return false;
+        if (symbol < 256) {
+            if (out.size() == maxSize)
+                return false;
+            out.push_back(uint8_t(symbol));
+            continue;
+        }
+        if (symbol == 256)
+            return true;
+
+        // length extra bits come before the distance code
+        const int lengthCode = symbol - 257;
+        if (lengthCode >= 29)
+            return false;
+        const size_t length = lengthBases[lengthCode] + reader.read(lengthExtraBits[lengthCode]);
+        const int distanceCode = distances.decode(reader);
+        if (distanceCode < 0 || distanceCode >= 30)
+            return false;
+        const size_t distance = distanceBases[distanceCode] + reader.read(distanceExtraBits[distanceCode]);
+        if (distance > out.size() || out.size() + length > maxSize)
+            return false;
+        const size_t from = out.size() - distance;
+        for (size_t i = 0; i < length; ++i) { // overlapping copies repeat the last bytes
+            const uint8_t byte = out[from + i];
+            out.push_back(byte);
+        }
+    }
+}
+
+// Raw deflate stream (RFC 1951), at most maxSize bytes out
+bool inflate(const uint8_t* data, size_t size, std::vector<uint8_t>& out, size_t maxSize)
+{
+    static const int codeLengthOrder[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+    static const auto fixedTables = []() {
+        uint8_t lengths[288 + 30];
+        std::fill(lengths, lengths + 144, 8);
+        std::fill(lengths + 144, lengths + 256, 9);
+        std::fill(lengths + 256, lengths + 280, 7);
+        std::fill(lengths + 280, lengths + 288, 8);
+        std::fill(lengths + 288, lengths + 318, 5);
+        std::pair<HuffmanTable, HuffmanTable> tables;
+        tables.first.build(lengths, 288);
+        tables.second.build(lengths + 288, 30);
+        return tables;
+    }();
+
+    out.clear();
+    out.reserve(maxSize);
+    BitReader reader(data, size);
+    HuffmanTable literals, distances;
+    for (bool isFinal = false; !isFinal;) {
+        isFinal = reader.read(1);
+        const uint32_t type = reader.read(2);
+        if (type == 0) { // stored
+            size_t position = reader.alignToByte();
+            if (position + 4 > size)
+                return false;
+            const uint16_t length = uint16_t(data[position] | data[position + 1] << 8);
+            const uint16_t lengthComplement = uint16_t(data[position + 2] | data[position + 3] << 8);
+            position += 4;
+            if (length != uint16_t(~lengthComplement) || position + length > size || out.size() + length > maxSize)
+                return false;
+            out.insert(out.end(), data + position, data + position + length);
+            reader.seek(position + length);
+        } else if (type == 1) {
+            if (!inflateBlock(reader, fixedTables.first, fixedTables.second, out, maxSize))
+                return false;
+        } else if (type == 2) {
+            const int literalCount = int(reader.read(5)) + 257, distanceCount = int(reader.read(5)) + 1;
+            const int codeLengthCount = int(reader.read(4)) + 4;
+            uint8_t codeLengths[19] = {};
+            for (int i = 0; i < codeLengthCount; ++i)
+                codeLengths[codeLengthOrder[i]] = uint8_t(reader.read(3));
+            HuffmanTable codeLengthTable;
+            if (!codeLengthTable.build(codeLengths, 19))
+                return false;
+
+            uint8_t lengths[288 + 32] = {};
+            const int total = literalCount + distanceCount;
+            for (int count = 0; count < total;) {
+                const int symbol = codeLengthTable.decode(reader);
+                if (symbol < 0 || reader.isOverrun())
+                    return false;
+                if (symbol < 16) {
+                    lengths[count++] = uint8_t(symbol);
+                    continue;
+                }
+                if (symbol == 16 && count == 0)
+                    return false;
+                const uint8_t value = symbol == 16 ? lengths[count - 1] : 0;
+                const int repeat = symbol == 16 ? 3 + int(reader.read(2)) : symbol == 17 ? 3 + int(reader.read(3)) : 11 + int(reader.read(7));
+                if (count + repeat > total)
+                    return false;
+                std::fill_n(lengths + count, repeat, value);
+                count += repeat;
+            }
+            if (!lengths[256] || !literals.build(lengths, literalCount) || !distances.build(lengths + literalCount, distanceCount))
+                return false;
+            if (!inflateBlock(reader, literals, distances, out, maxSize))
+                return false;
+        } else {
+            return false;
+        }
+        if (reader.isOverrun())
+            return false;
+    }
+    return true;
+}
+
+////////////////////////////////// PNG //////////////////////////////
+
+uint32_t readBigEndian32(const uint8_t* data)
+{
+    return uint32_t(data[0]) << 24 | uint32_t(data[1]) << 16 | uint32_t(data[2]) << 8 | data[3];
+}
+
+uint8_t getPaethPredictor(int a, int b, int c)
+{
+    const int p = a + b - c, pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+    return uint8_t(pa <= pb && pa <= pc ? a : pb <= pc ? b : c);
+}
+
+bool readPng(const uint8_t* data, size_t size, GrayImage& image)
+{
+    static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    if (size < 8 + 25 || std::memcmp(data, signature, 8) != 0)
+        return false;
+
+    uint32_t width = 0, height = 0;
+    int bitDepth = 0;
+    std::vector<uint8_t> compressed;
+    bool hasEnd = false;
+    for (size_t position = 8; position + 12 <= size && !hasEnd;) {
+        const uint32_t length = readBigEndian32(data + position);
+        const uint8_t* type = data + position + 4;
+        const uint8_t* chunk = type + 4;
+        if (length > size - position - 12)
+            return false;
+        if (std::memcmp(type, "IHDR", 4) == 0) {
+            if (length != 13)
+                return false;
+            width = readBigEndian32(chunk);
+            height = readBigEndian32(chunk + 4);
+            bitDepth = chunk[8];
+            const int colorType = chunk[9], interlace = chunk[12];
+            if (colorType != 0 || (bitDepth != 8 && bitDepth != 16) || interlace != 0)
+                return false;
+        } else if (std::memcmp(type, "IDAT", 4) == 0) {
+            compressed.insert(compressed.end(), chunk, chunk + length);
+        } else if (std::memcmp(type, "IEND", 4) == 0) {
+            hasEnd = true;
+        }
+        position += size_t(length) + 12;
+    }
+    if (!width || !height || !hasEnd || size_t(width) * height > (size_t(1) << 30) || compressed.size() < 2)
+        return false;
+
+    // zlib header: deflate, no preset dictionary, adler32 is not checked
+    if ((compressed[0] & 0x0F) != 8 || (compressed[0] << 8 | compressed[1]) % 31 != 0 || (compressed[1] & 0x20))
+        return false;
+    const size_t bytesPerSample = bitDepth / 8;
+    const size_t rowSize = size_t(width) * bytesPerSample;
+    const size_t rawSize = size_t(height) * (rowSize + 1);
+    std::vector<uint8_t> raw;
+    if (!inflate(compressed.data() + 2, compressed.size() - 2, raw, rawSize) || raw.size() != rawSize)
+        return false;
+
+    // filters are undone in place, byte by byte, a pixel is bytesPerSample bytes
+    image.samples.resize(size_t(width) * height);
+    std::vector<uint8_t> previous(rowSize);
+    for (uint32_t y = 0; y < height; ++y) {
+        const uint8_t filter = raw[y * (rowSize + 1)];
+        uint8_t* row = raw.data() + y * (rowSize + 1) + 1;
+        for (size_t i = 0; i < rowSize; ++i) {
+            const int left = i >= bytesPerSample ? row[i - bytesPerSample] : 0;
+            const int up = previous[i], upLeft = i >= bytesPerSample ? previous[i - bytesPerSample] : 0;
+            switch (filter) {
+            case 0:
+                break;
+            case 1:
+                row[i] = uint8_t(row[i] + left);
+                break;
+            case 2:
+                row[i] = uint8_t(row[i] + up);
+                break;
+            case 3:
+                row[i] = uint8_t(row[i] + (left + up) / 2);
+                break;
+            case 4:
+                row[i] = uint8_t(row[i] + getPaethPredictor(left, up, upLeft));
+                break;
+            default:
+                image.samples.clear();
+                return false;
+            }
+        }
+        std::memcpy(previous.data(), row, rowSize);
+
+        uint16_t* samples = image.samples.data() + size_t(y) * width;
+        for (uint32_t x = 0; x < width; ++x) // big endian
+            samples[x] = bytesPerSample == 2 ? uint16_t(row[2 * x] << 8 | row[2 * x + 1]) : row[x];
+    }
+    image.width = width;
+    image.height = height;
+    return true;
+}
+
+////////////////////////////////// TGA //////////////////////////////
+
+bool readTga(const uint8_t* data, size_t size, GrayImage& image)
+{
+    if (size < 18)
+        return false;
+    const int idLength = data[0], colorMapType = data[1], imageType = data[2];
+    const uint32_t width = data[12] | data[13] << 8, height = data[14] | data[15] << 8;
+    const int pixelDepth = data[16], descriptor = data[17];
+    if (colorMapType != 0 || (imageType != 3 && imageType != 11) || pixelDepth != 8 || !width || !height)
+        return false;
+
+    const size_t texelCount = size_t(width) * height;
+    std::vector<uint16_t> samples(texelCount);
+    size_t position = 18 + idLength;
+    if (imageType == 3) {
+        if (position + texelCount > size)
+            return false;
+        std::copy(data + position, data + position + texelCount, samples.begin());
+    } else { // RLE packets: repeated value or raw values, 1..128 texels each
+        for (size_t texel = 0; texel < texelCount;) {
+            if (position >= size)
+                return false;
+            const uint8_t header = data[position++];
+            const size_t count = std::min<size_t>((header & 0x7F) + 1, texelCount - texel);
+            if (header & 0x80) {
+                if (position >= size)
+                    return false;
+                std::fill_n(samples.begin() + texel, count, data[position++]);
+            } else {
+                if (position + count > size)
+                    return false;
+                std::copy(data + position, data + position + count, samples.begin() + texel);
+                position += count;
+            }
+            texel += count;
+        }
+    }
+
+    // stored bottom-up and left to right unless the descriptor says otherwise
+    const bool isTopDown = descriptor & 0x20, isRightToLeft = descriptor & 0x10;
+    image.samples.resize(texelCount);
+    for (uint32_t y = 0; y < height; ++y) {
+        const uint16_t* source = samples.data() + size_t(isTopDown ? y : height - 1 - y) * width;
+        uint16_t* target = image.samples.data() + size_t(y) * width;
+        if (isRightToLeft)
+            std::reverse_copy(source, source + width, target);
+        else
+            std::copy(source, source + width, target);
+    }
+    image.width = width;
+    image.height = height;
+    return true;
+}
+
+} // namespace
+
+bool readGrayImage(const std::string& path, GrayImage& image)
+{
+    image = {};
+    MappedFile file;
+    if (!file.open(path))
+        return false;
+
+    std::string extension = std::filesystem::path(path).extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+    bool isRead = false;
+    if (extension == ".png")
+        isRead = readPng(file.data(), file.size(), image);
+    else if (extension == ".tga")
+        isRead = readTga(file.data(), file.size(), image);
+    if (!isRead)
+        image = {};
+    return isRead;
+}
@@ -0,0 +1,21 @@
+#ifndef IMAGE_READER_H
+#define IMAGE_READER_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Reads single channel images, the index maps StreamingImageWriter writes
+// and the ones image tools export. Top-left origin, one sample per texel.
+// Png: gray, 8 or 16 bit, any deflate compression, not interlaced.
+// Tga: 8 bit gray, uncompressed or RLE, any origin.
+
+struct GrayImage {
+    uint32_t width {}, height {};
+    std::vector<uint16_t> samples; // row by row
+};
+
+// false for other formats and for corrupted files, image is left empty then
+bool readGrayImage(const std::string& path, GrayImage& image);
+
+#endif // IMAGE_READER_H
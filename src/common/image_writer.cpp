@@ -0,0 +1,200 @@
+#include "image_writer.h"
+
+#include <algorithm>
+#include <filesystem>
+
+static uint32_t updateCrc32(uint32_t crc, const uint8_t* data, size_t size)
+{
+    static const auto table = []() {
+        std::vector<uint32_t> result(256);
+        for (uint32_t n = 0; n < 256; ++n) {
+            uint32_t c = n;
+            for (int k = 0; k < 8; ++k)
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            result[n] = c;
+        }
+        return result;
+    }();
+
+    crc = ~crc;
+    for (size_t i = 0; i < size; ++i)
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+static uint32_t updateAdler32(uint32_t adler, const uint8_t* data, size_t size)
+{
+    uint32_t a = adler & 0xFFFF, b = adler >> 16;
+    while (size) {
+        size_t blockSize = std::min<size_t>(size, 5552); // no overflow before modulo
+        for (size_t i = 0; i < blockSize; ++i) {
+            a += data[i];
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+        data += blockSize;
+        size -= blockSize;
+    }
+    return b << 16 | a;
+}
+
+static void appendBigEndian32(std::vector<uint8_t>& out, uint32_t value)
+{
+    out.push_back(value >> 24);
+    out.push_back(value >> 16);
+    out.push_back(value >> 8);
+    out.push_back(value);
+}
+
+StreamingImageWriter::Format StreamingImageWriter::getFormatFromPath(const std::string& path)
+{
+    std::string ext = std::filesystem::path(path).extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    if (ext == ".png")
+        return Format::Png;
+    if (ext == ".tga")
+        return Format::Tga;
+    return Format::Raw;
+}
+
+bool StreamingImageWriter::open(const std::string& path, Format format, uint32_t width, uint32_t height, int channels, int bitDepth)
+{
+    close();
+    if (!width || !height || (bitDepth != 8 && bitDepth != 16)
+        || (channels != 1 && channels != 3 && channels != 4))
+        return false;
+    if (format == Format::Tga && (bitDepth != 8 || width > 0xFFFF || height > 0xFFFF))
+        return false;
+
+    m_file.open(path, std::ios::out | std::ios::binary);
+    if (!m_file)
+        return false;
+
+    m_format = format;
+    m_width = width;
+    m_height = height;
+    m_channels = channels;
+    m_bitDepth = bitDepth;
+    m_rowsWritten = 0;
+    m_adler32 = 1;
+    m_zlibStarted = false;
+
+    if (format == Format::Tga) {
+        uint8_t header[18] {};
+        header[2] = channels == 1 ? 3 : 2; // uncompressed gray or true color
+        header[12] = width & 0xFF;
+        header[13] = width >> 8;
+        header[14] = height & 0xFF;
+        header[15] = height >> 8;
+        header[16] = channels * 8;
+        header[17] = 0x20 | (channels == 4 ? 8 : 0); // top-left origin, alpha bits
+        m_file.write((const char*)header, sizeof(header));
+
+    } else if (format == Format::Png) {
+        const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+        m_file.write((const char*)signature, sizeof(signature));
+
+        std::vector<uint8_t> header;
+        appendBigEndian32(header, width);
+        appendBigEndian32(header, height);
+        header.push_back(bitDepth);
+        header.push_back(channels == 1 ? 0 : channels == 3 ? 2 : 6); // gray, RGB, RGBA
+        header.insert(header.end(), { 0, 0, 0 }); // deflate, adaptive filter, no interlace
+        writePngChunk("IHDR", header.data(), header.size());
+    }
+    return bool(m_file);
+}
+
+bool StreamingImageWriter::writeRows(const void* rows, uint32_t rowCount)
+{
+    if (!m_file.is_open() || m_rowsWritten + rowCount > m_height)
+        return false;
+
+    const size_t rowSize = getRowSize();
+    const uint8_t* src = (const uint8_t*)rows;
+    m_buffer.clear();
+
+    if (m_format == Format::Raw) {
+        m_file.write((const char*)src, rowSize * rowCount);
+
+    } else if (m_format == Format::Tga) {
+        if (m_channels == 1) {
+            m_file.write((const char*)src, rowSize * rowCount);
+        } else {
+            m_buffer.assign(src, src + rowSize * rowCount);
+            for (size_t i = 0; i < m_buffer.size(); i += m_channels)
+                std::swap(m_buffer[i], m_buffer[i + 2]); // RGB -> BGR
+            m_file.write((const char*)m_buffer.data(), m_buffer.size());
+        }
+
+    } else {
+        // filter byte + big endian samples per row
+        std::vector<uint8_t> filtered;
+        filtered.reserve((rowSize + 1) * rowCount);
+        for (uint32_t y = 0; y < rowCount; ++y) {
+            const uint8_t* row = src + rowSize * y;
+            filtered.push_back(0);
+            if (m_bitDepth == 8) {
+                filtered.insert(filtered.end(), row, row + rowSize);
+            } else {
+                const uint16_t* samples = (const uint16_t*)row;
+                for (size_t i = 0; i < rowSize / 2; ++i) {
+                    filtered.push_back(samples[i] >> 8);
+                    filtered.push_back(samples[i] & 0xFF);
+                }
+            }
+        }
+        m_adler32 = updateAdler32(m_adler32, filtered.data(), filtered.size());
+
+        if (!m_zlibStarted)
+            m_buffer.insert(m_buffer.end(), { 0x78, 0x01 }); // zlib header, no compression
+        m_zlibStarted = true;
+
+        // stored (not final) deflate blocks, final empty block is written in close()
+        for (size_t offset = 0; offset < filtered.size(); offset += 0xFFFF) {
+            uint16_t blockSize = (uint16_t)std::min<size_t>(0xFFFF, filtered.size() - offset);
+            m_buffer.insert(m_buffer.end(), { 0, uint8_t(blockSize), uint8_t(blockSize >> 8),
+                                                uint8_t(~blockSize), uint8_t(~blockSize >> 8) });
+            m_buffer.insert(m_buffer.end(), filtered.begin() + offset, filtered.begin() + offset + blockSize);
+        }
+        writePngChunk("IDAT", m_buffer.data(), m_buffer.size());
+    }
+
+    m_rowsWritten += rowCount;
+    return bool(m_file);
+}
+
+bool StreamingImageWriter::close()
+{
+    if (!m_file.is_open())
+        return false;
+
+    bool complete = m_rowsWritten == m_height;
+    if (m_format == Format::Png && complete) {
+        m_buffer.clear();
+        m_buffer.insert(m_buffer.end(), { 1, 0, 0, 0xFF, 0xFF }); // final empty stored block
+        appendBigEndian32(m_buffer, m_adler32);
+        writePngChunk("IDAT", m_buffer.data(), m_buffer.size());
+        writePngChunk("IEND", nullptr, 0);
+    }
+    bool valid = complete && bool(m_file);
+    m_file.close();
+    return valid;
+}
+
+void StreamingImageWriter::writePngChunk(const char* type, const uint8_t* data, size_t size)
+{
+    std::vector<uint8_t> header;
+    appendBigEndian32(header, (uint32_t)size);
+    header.insert(header.end(), type, type + 4);
+    m_file.write((const char*)header.data(), header.size());
+    if (size)
+        m_file.write((const char*)data, size);
+
+    uint32_t crc = updateCrc32(0, (const uint8_t*)type, 4);
+    crc = updateCrc32(crc, data, size);
+    std::vector<uint8_t> footer;
+    appendBigEndian32(footer, crc);
+    m_file.write((const char*)footer.data(), footer.size());
+}
@@ -0,0 +1,47 @@
+#ifndef IMAGE_WRITER_H
+#define IMAGE_WRITER_H
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Writes an image row by row, nothing but the current rows is kept in memory.
+// Raw: samples as they are (16 bit little endian), no header.
+// Tga: 8 bit only, gray / BGR / BGRA, top-left origin.
+// Png: uncompressed deflate blocks, one IDAT chunk per writeRows() call.
+
+class StreamingImageWriter {
+public:
+    enum class Format {
+        Raw,
+        Tga,
+        Png
+    };
+
+    // by file extension, Raw for unknown
+    static Format getFormatFromPath(const std::string& path);
+
+    ~StreamingImageWriter() { close(); }
+
+    // channels: 1 - gray, 3 - RGB, 4 - RGBA; bitDepth: 8 or 16
+    bool open(const std::string& path, Format format, uint32_t width, uint32_t height, int channels, int bitDepth);
+    // rows are tightly packed, 16 bit samples in native endianness
+    bool writeRows(const void* rows, uint32_t rowCount);
+    bool close();
+
+    size_t getRowSize() const { return size_t(m_width) * m_channels * (m_bitDepth / 8); }
+
+private:
+    void writePngChunk(const char* type, const uint8_t* data, size_t size);
+
+    std::ofstream m_file;
+    std::vector<uint8_t> m_buffer;
+    Format m_format = Format::Raw;
+    uint32_t m_width {}, m_height {}, m_rowsWritten {};
+    int m_channels {}, m_bitDepth {};
+    uint32_t m_adler32 = 1;
+    bool m_zlibStarted {};
+};
+
+#endif // IMAGE_WRITER_H
@@ -0,0 +1,64 @@
+#include "mapped_file.h"
+
+#include <fstream>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define MAPPED_FILE_MMAP
+#endif
+
+bool MappedFile::open(const std::string& path)
+{
+    close();
+
+#ifdef MAPPED_FILE_MMAP
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) != 0) {
+        ::close(fd);
+        return false;
+    }
+    m_size = fileStat.st_size;
+    if (m_size) {
+        void* mapping = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping == MAP_FAILED) {
+            ::close(fd);
+            m_size = 0;
+            return false;
+        }
+        m_data = static_cast<const uint8_t*>(mapping);
+        m_mapped = true;
+    }
+    ::close(fd); // mapping stays valid
+    return true;
+#else
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file)
+        return false;
+    m_buffer.resize(file.tellg());
+    file.seekg(0);
+    if (!file.read(reinterpret_cast<char*>(m_buffer.data()), m_buffer.size()))
+        return false;
+    m_data = m_buffer.data();
+    m_size = m_buffer.size();
+    return true;
+#endif
+}
+
+void MappedFile::close()
+{
+#ifdef MAPPED_FILE_MMAP
+    if (m_mapped)
+        munmap(const_cast<uint8_t*>(m_data), m_size);
+#endif
+    m_mapped = false;
+    m_data = nullptr;
+    m_size = 0;
+    m_buffer.clear();
+}
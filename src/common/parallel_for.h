@@ -0,0 +1,42 @@
+#ifndef PARALLEL_FOR_H
+#define PARALLEL_FOR_H
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+inline unsigned getThreadCount(unsigned requested = 0)
+{
+    if (requested)
+        return requested;
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+// Calls func(index) for index in [0, count), items are taken one by one,
+// so uneven items (tiles, files) balance themselves.
+template <typename Func>
+void parallelFor(size_t count, Func&& func, unsigned threadCount = 0)
+{
+    threadCount = (unsigned)std::min<size_t>(getThreadCount(threadCount), count);
+    if (threadCount <= 1) {
+        for (size_t i = 0; i < count; ++i)
+            func(i);
+        return;
+    }
+
+    std::atomic<size_t> nextIndex { 0 };
+    auto worker = [&]() {
+        for (size_t i = nextIndex++; i < count; i = nextIndex++)
+            func(i);
+    };
+
+    std::vector<std::thread> threads;
+    for (unsigned i = 1; i < threadCount; ++i)
+        threads.emplace_back(worker);
+    worker();
+    for (auto& thread : threads)
+        thread.join();
+}
+
+#endif // PARALLEL_FOR_H
@@ -3,6 +3,7 @@
 #include <SFML/System/Vector2.hpp>
 #include <SFML/Window/Event.hpp>
 #include <math.h>
+#include <uvbsp/uvbsp_math.h>
 
 typedef sf::Vector2f vec2;
 typedef sf::Vector2u uvec2;
@@ -43,6 +44,10 @@ inline vec2 normalized(const vec2& v0)
     return v0;
 }
 
+// core library types
+inline bsp::vec2 toBSP(const vec2& v) { return { v.x, v.y }; }
+inline vec2 fromBSP(const bsp::vec2& v) { return { v.x, v.y }; }
+
 inline void printVec(const vec2& v0)
 {
     std::printf("Vec2: %.3f, %.3f", v0.x, v0.y);
@@ -39,139 +39,203 @@ void Window::processEvents()
             MAX_DIRTY(10);
         else if (imContext->LastActiveIdTimer == 0.f)
             MAX_DIRTY(2);
+        if (ImGui::GetIO().WantTextInput)
+            MAX_DIRTY(1); // blinking cursor
     }
 
-    while (pollEvent(event)) {
-        ImGui::SFML::ProcessEvent(event);
-        ImGuiIO& io = ImGui::GetIO();
+    // nothing to draw, sleep until the next event instead of spinning
+    if (!windowMayBeDirty()) {
+        const sf::Time waitStart = m_schedulerClock.getElapsedTime();
+        const bool hasEvent = waitEvent(event);
+        m_schedulerStats.waitSeconds += (m_schedulerClock.getElapsedTime() - waitStart).asSeconds();
+        if (hasEvent)
+            handleEvent(event);
+    }
+    while (pollEvent(event))
+        handleEvent(event);
+    flushMouseMove();
 
-        switch (event.type) {
-        case sf::Event::Closed:
-            exit();
-            break;
-
-        case sf::Event::Resized: {
-            auto oldScreenSize = m_windowSize;
-            const auto& newSize = toUInt(event.size);
-            m_windowSize = newSize;
-            applyScaleAndOffset();
-
-            ivec2 offset = toInt(m_windowSize - oldScreenSize);
-
-            if (offset.x != 0) {
-                if (ImGuiContext* g = ImGui::GetCurrentContext()) {
-                    for (auto& w : g->Windows) {
-                        vec2 windowHalfSize(w->Size.x * 0.5f, w->Size.y * 0.5f);
-                        if (w->Pos.x + windowHalfSize.x > oldScreenSize.x / 2.f) {
-                            w->Pos.x += offset.x;
-                            if (w->Pos.x + windowHalfSize.x < newSize.x / 2.f)
-                                w->Pos.x = newSize.x / 2.f - windowHalfSize.x;
-                        }
-                    }
-                }
-            }
+    if (!windowMayBeDirty())
+        m_inputTime.reset(); // nothing changed, no frame to wait for
+}
 
-            if (m_screenResizeEvent)
-                m_screenResizeEvent(oldScreenSize, m_windowSize);
-        } break;
-
-        case sf::Event::LostFocus:
-            break;
-
-        case sf::Event::GainedFocus:
-            io.WantCaptureMouse = true;
-            break;
-
-        case sf::Event::TextEntered:
-            break;
-
-        case sf::Event::KeyPressed: {
-            if (event.key.control && event.key.code == sf::Keyboard::Key::Q)
-                exit();
-
-            else if (!io.WantCaptureKeyboard) {
-                KeyWithModifier currentKey(event.key.code,
-                    makeModifier(
-                        event.key.alt,
-                        event.key.control,
-                        event.key.shift,
-                        event.key.system),
-                    true);
-
-                if (m_anyKeyDownReason) {
-                    const auto& foundEvent = m_anyKeyDownEvents.find(*m_anyKeyDownReason);
-                    if (foundEvent != m_anyKeyDownEvents.end()) {
-                        foundEvent->second(currentKey);
+void Window::handleEvent(const sf::Event& event)
+{
+    ImGui::SFML::ProcessEvent(event);
+    ImGuiIO& io = ImGui::GetIO();
+    m_schedulerStats.events++;
+    if (!m_inputTime)
+        m_inputTime = m_schedulerClock.getElapsedTime();
+
+    // a burst of moves becomes one callback, other events see the latest position
+    if (event.type == sf::Event::MouseMoved) {
+        m_pendingMousePos = toInt(event.mouseMove);
+        m_schedulerStats.mouseMoves++;
+        return;
+    }
+    flushMouseMove();
+
+    switch (event.type) {
+    case sf::Event::Closed:
+        exit();
+        break;
+
+    case sf::Event::Resized: {
+        auto oldScreenSize = m_windowSize;
+        const auto& newSize = toUInt(event.size);
+        m_windowSize = newSize;
+        applyScaleAndOffset();
+
+        ivec2 offset = toInt(m_windowSize - oldScreenSize);
+
+        if (offset.x != 0) {
+            if (ImGuiContext* g = ImGui::GetCurrentContext()) {
+                for (auto& w : g->Windows) {
+                    vec2 windowHalfSize(w->Size.x * 0.5f, w->Size.y * 0.5f);
+                    if (w->Pos.x + windowHalfSize.x > oldScreenSize.x / 2.f) {
+                        w->Pos.x += offset.x;
+                        if (w->Pos.x + windowHalfSize.x < newSize.x / 2.f)
+                            w->Pos.x = newSize.x / 2.f - windowHalfSize.x;
                     }
-                    m_anyKeyDownReason = {};
-                } else {
-                    auto keyEventIter = m_keyMap.find(currentKey);
-                    if (keyEventIter != m_keyMap.end())
-                        keyEventIter->second();
                 }
             }
-        } break;
-
-        case sf::Event::KeyReleased: {
-            if (!io.WantCaptureKeyboard) {
-                KeyWithModifier currentKey(event.key.code,
-                    makeModifier(
-                        event.key.alt,
-                        event.key.control,
-                        event.key.shift,
-                        event.key.system),
-                    false);
+        }
+
+        if (m_screenResizeEvent)
+            m_screenResizeEvent(oldScreenSize, m_windowSize);
+    } break;
 
+    case sf::Event::LostFocus:
+        break;
+
+    case sf::Event::GainedFocus:
+        io.WantCaptureMouse = true;
+        break;
+
+    case sf::Event::TextEntered:
+        break;
+
+    case sf::Event::KeyPressed: {
+        if (event.key.control && event.key.code == sf::Keyboard::Key::Q)
+            exit();
+
+        else if (!io.WantCaptureKeyboard) {
+            KeyWithModifier currentKey(event.key.code,
+                makeModifier(
+                    event.key.alt,
+                    event.key.control,
+                    event.key.shift,
+                    event.key.system),
+                true);
+
+            if (m_anyKeyDownReason) {
+                const auto& foundEvent = m_anyKeyDownEvents.find(*m_anyKeyDownReason);
+                if (foundEvent != m_anyKeyDownEvents.end()) {
+                    foundEvent->second(currentKey);
+                }
+                m_anyKeyDownReason = {};
+            } else {
                 auto keyEventIter = m_keyMap.find(currentKey);
                 if (keyEventIter != m_keyMap.end())
                     keyEventIter->second();
             }
-        } break;
+        }
+    } break;
+
+    case sf::Event::KeyReleased: {
+        if (!io.WantCaptureKeyboard) {
+            KeyWithModifier currentKey(event.key.code,
+                makeModifier(
+                    event.key.alt,
+                    event.key.control,
+                    event.key.shift,
+                    event.key.system),
+                false);
+
+            auto keyEventIter = m_keyMap.find(currentKey);
+            if (keyEventIter != m_keyMap.end())
+                keyEventIter->second();
+        }
+    } break;
 
-        case sf::Event::MouseWheelScrolled: {
-            if (!io.WantCaptureMouse) {
-                if (m_mouseScrollEvent)
-                    m_mouseScrollEvent(event.mouseWheelScroll.delta, m_mousePos);
-            } else {
-            }
+    case sf::Event::MouseWheelScrolled: {
+        if (!io.WantCaptureMouse) {
+            if (m_mouseScrollEvent)
+                m_mouseScrollEvent(event.mouseWheelScroll.delta, m_mousePos);
+        } else {
+        }
 
-        } break;
+    } break;
 
-        case sf::Event::MouseButtonPressed: {
-            if (!io.WantCaptureMouse) {
-                auto mouseEventData = getMouseEventData(event.mouseButton.button);
-                if (mouseEventData)
-                    mouseEventData->mouseDown(m_mousePos, true);
-            }
-        } break;
+    case sf::Event::MouseButtonPressed: {
+        if (!io.WantCaptureMouse) {
+            auto mouseEventData = getMouseEventData(event.mouseButton.button);
+            if (mouseEventData)
+                mouseEventData->mouseDown(m_mousePos, true);
+        }
+    } break;
 
-        case sf::Event::MouseButtonReleased: {
-            if (!io.WantCaptureMouse) {
-                auto mouseEventData = getMouseEventData(event.mouseButton.button);
-                if (mouseEventData)
-                    mouseEventData->mouseDown(m_mousePos, false);
-            }
-        } break;
+    case sf::Event::MouseButtonReleased: {
+        if (!io.WantCaptureMouse) {
+            auto mouseEventData = getMouseEventData(event.mouseButton.button);
+            if (mouseEventData)
+                mouseEventData->mouseDown(m_mousePos, false);
+        }
+    } break;
 
-        case sf::Event::MouseMoved: {
-            ivec2 prevPos = m_mousePos;
-            m_mousePos = toInt(event.mouseMove);
-            m_mouseEventLMB.runMouseMoveEvents(m_mousePos, m_mousePos - prevPos);
-            m_mouseEventMMB.runMouseMoveEvents(m_mousePos, m_mousePos - prevPos);
-            m_mouseEventRMB.runMouseMoveEvents(m_mousePos, m_mousePos - prevPos);
-        } break;
+    case sf::Event::MouseEntered:
+        break;
 
-        case sf::Event::MouseEntered:
-            break;
+    case sf::Event::MouseLeft:
+        break;
 
-        case sf::Event::MouseLeft:
-            break;
+    default: {
+    }
+    }
+    MAX_DIRTY(2);
+}
 
-        default: {
-        }
-        }
+void Window::flushMouseMove()
+{
+    if (!m_pendingMousePos)
+        return;
+    const ivec2 prevPos = m_mousePos;
+    m_mousePos = *m_pendingMousePos;
+    m_pendingMousePos.reset();
+    m_schedulerStats.mouseMoveUpdates++;
+
+    bool isHandled = m_mouseEventLMB.runMouseMoveEvents(m_mousePos, m_mousePos - prevPos);
+    isHandled |= m_mouseEventMMB.runMouseMoveEvents(m_mousePos, m_mousePos - prevPos);
+    isHandled |= m_mouseEventRMB.runMouseMoveEvents(m_mousePos, m_mousePos - prevPos);
+    // io.WantCaptureMouse is only updated by NewFrame(), so leaving a window needs last frame's state
+    // and entering one needs the window rects
+    if (isHandled || m_imguiHadMouse || isOverImGuiWindow(m_mousePos))
         MAX_DIRTY(2);
+}
+
+bool Window::isOverImGuiWindow(ivec2 pos) const
+{
+    ImGuiContext* g = ImGui::GetCurrentContext();
+    if (!g)
+        return false;
+    for (const ImGuiWindow* w : g->Windows) {
+        if (!w->Active || w->Hidden)
+            continue;
+        if (pos.x >= w->Pos.x && pos.y >= w->Pos.y && pos.x < w->Pos.x + w->Size.x && pos.y < w->Pos.y + w->Size.y)
+            return true;
     }
+    return false;
+}
+
+SchedulerStats Window::takeSchedulerStats()
+{
+    SchedulerStats stats = m_schedulerStats;
+    stats.seconds = m_schedulerClock.restart().asSeconds();
+    stats.cpuSeconds = double(std::clock() - m_schedulerCpuStart) / CLOCKS_PER_SEC;
+    m_schedulerCpuStart = std::clock();
+    m_schedulerStats = {};
+    m_inputTime.reset();
+    return stats;
 }
 
 void Window::setMouseDragEvent(sf::Mouse::Button button, MouseDragEvent event)
@@ -210,11 +274,13 @@ void Window::addKeyUpEvent(sf::Keyboard::Key key, ModifierKey modifier, KeyEvent
 
 void Window::drawImGuiContext(ImGuiContextFunctions imguiFunctions)
 {
-    ImGui::SFML::Update(*this, m_deltaClock.restart());
+    // the first frame after waitEvent() would otherwise step ImGui animations by the whole idle time
+    ImGui::SFML::Update(*this, std::min(m_deltaClock.restart(), s_maxImGuiDelta));
     ImGui::PushFont(m_robotoFont);
     imguiFunctions();
     ImGui::PopFont();
     ImGui::SFML::Render(*this);
+    m_imguiHadMouse = ImGui::GetIO().WantCaptureMouse;
 }
 
 void Window::display()
@@ -225,6 +291,15 @@ void Window::display()
         m_showDisplayDirtyLevel = 0;
     }
     sf::Window::display();
+
+    m_schedulerStats.frames++;
+    if (m_inputTime) {
+        const double latency = (m_schedulerClock.getElapsedTime() - *m_inputTime).asSeconds();
+        m_schedulerStats.latencySum += latency;
+        m_schedulerStats.latencyMax = std::max(m_schedulerStats.latencyMax, latency);
+        m_schedulerStats.latencyFrames++;
+        m_inputTime.reset();
+    }
 }
 
 void Window::exit()
@@ -2,6 +2,8 @@
 #define WINDOW_H
 
 #include <SFML/Graphics.hpp>
+#include <algorithm>
+#include <ctime>
 #include <functional>
 #include <iostream>
 #include <optional>
@@ -77,8 +79,10 @@ class MouseEventData {
     bool m_buttomPressed = false;
 
 public:
-    void runMouseMoveEvents(ivec2 currentPos, ivec2 delta)
+    // True if a callback ran
+    bool runMouseMoveEvents(ivec2 currentPos, ivec2 delta)
     {
+        const bool hasCallback = m_mouseMoveEvent || (m_mouseDragEvent && m_buttomPressed);
         if (m_mouseMoveEvent) {
             m_mouseMoveEvent(currentPos, delta);
         }
@@ -87,6 +91,7 @@ public:
         }
         if (m_dragState == DragState::StartDrag)
             m_dragState = DragState::ContinueDrag;
+        return hasCallback;
     }
 
     void setMouseMoveEvent(const MouseMoveEvent& event) { m_mouseMoveEvent = event; }
@@ -110,6 +115,25 @@ public:
     // operator bool() { return !!m_event; }
 };
 
+// Main loop numbers since the previous takeSchedulerStats()
+struct SchedulerStats {
+    double seconds {}, cpuSeconds {}, waitSeconds {}; // wall, process CPU, blocked in waitEvent
+    size_t frames {}, events {};
+    size_t mouseMoves {}, mouseMoveUpdates {}; // events, callbacks after merging
+    double latencySum {}, latencyMax {}; // first input event of a frame to display(), seconds
+    size_t latencyFrames {};
+
+    std::string getInfo() const
+    {
+        const auto percent = [](double part, double whole) { return std::to_string(int(whole > 0 ? 100 * part / whole : 0)) + "%"; };
+        const auto ms = [](double seconds) { return std::to_string(seconds * 1000) + "ms"; };
+        return "CPU: " + percent(cpuSeconds, seconds) + "   Idle: " + percent(waitSeconds, seconds)
+            + "   Frames: " + std::to_string(frames) + "   Events: " + std::to_string(events)
+            + "   Mouse moves: " + std::to_string(mouseMoves) + " -> " + std::to_string(mouseMoveUpdates)
+            + "   Latency: " + ms(latencyFrames ? latencySum / latencyFrames : 0) + " avg, " + ms(latencyMax) + " max";
+    }
+};
+
 // kinda window wrapper, you can wrap SDL window the same way
 
 class Window : public sf::RenderWindow {
@@ -126,6 +150,8 @@ public:
     }
     ~Window();
 
+    // Blocks in waitEvent() when nothing is left to draw.
+    // Mouse moves are merged, callbacks get one move per call with the summed delta.
     void processEvents();
 
     void setScale(float scale) { m_scale = scale, applyScaleAndOffset(); }
@@ -156,10 +182,16 @@ public:
     void display();
 
     bool windowMayBeDirty() { return !!m_showDisplayDirtyLevel; }
+    // For changes that don't come from events of this window
+    void requestRedraw(int frames = 2) { m_showDisplayDirtyLevel = std::max(m_showDisplayDirtyLevel, frames); }
+    SchedulerStats takeSchedulerStats();
     void exit();
 
 private:
     void init();
+    void handleEvent(const sf::Event& event);
+    void flushMouseMove();
+    bool isOverImGuiWindow(ivec2 pos) const; // window rects of the last ImGui frame
     MouseEventData* getMouseEventData(sf::Mouse::Button button)
     {
         switch (button) {
@@ -186,15 +218,22 @@ private:
     ScreenResizeEvent m_screenResizeEvent;
 
     ivec2 m_mousePos {};
+    std::optional<ivec2> m_pendingMousePos; // merged moves, not given to callbacks yet
     uvec2 m_windowSize {};
     float m_scale = 1.f;
     vec2 m_viewOffset {};
 
     sf::Clock m_deltaClock;
+    static inline const sf::Time s_maxImGuiDelta = sf::milliseconds(100);
+    bool m_imguiHadMouse = false; // io.WantCaptureMouse of the last ImGui frame
 
     class ImFont* m_robotoFont;
 
     int m_showDisplayDirtyLevel = 10;
+    sf::Clock m_schedulerClock; // since takeSchedulerStats()
+    std::clock_t m_schedulerCpuStart = std::clock();
+    std::optional<sf::Time> m_inputTime; // first input not displayed yet
+    SchedulerStats m_schedulerStats;
     static uint32_t s_instanceCounter;
 };
 
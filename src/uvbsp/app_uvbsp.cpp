@@ -1,5 +1,12 @@
 #include "app_uvbsp.h"
 #include "imgui/imgui.h"
+#include "uvbsp_bake.h"
+#include "uvbsp_build.h"
+#include "uvbsp_export.h"
+#include "uvbsp_file.h"
+#include "uvbsp_json.h"
+#include "uvbsp_mesh.h"
+#include "uvbsp_traversal.h"
 #include <SFML/Graphics.hpp>
 #include <SFML/Window/Clipboard.hpp>
 #include <filesystem>
@@ -30,7 +37,7 @@ Application_UVBSP::Application_UVBSP()
     m_BSPShader.loadFromFile(shaderPath / "BSPshader.frag", sf::Shader::Type::Fragment);
     m_BSPShader.setUniform("texture", m_texture);
     m_BSPShader.setUniform("transparency", m_backgroundTransparency);
-    m_uvSplit.updateUniforms(m_BSPShader);
+    uploadAllNodes();
 
     bindActions();
 
@@ -51,13 +58,256 @@ void Application_UVBSP::drawContext()
                 m_fsNavigator.reset();
             }
         }
+        if (m_hoverMousePos && !ImGui::GetIO().WantCaptureMouse) {
+            const vec2 uv = m_window.mapPixelToCoords(*m_hoverMousePos) / toFloat(m_texture.getSize());
+            if (uv.x >= 0 && uv.x <= 1 && uv.y >= 0 && uv.y <= 1) {
+                const UVBSPPointLocation location = m_uvSplit.locate(toBSP(uv));
+                ImGui::BeginTooltip();
+                ImGui::TextUnformatted(location.getInfo().c_str());
+                ImGui::Text("UV: %.4f, %.4f   Walk from node %d", uv.x, uv.y, location.startNodeIndex);
+                ImGui::EndTooltip();
+            }
+        }
+        if (m_isTreeStatsPanel)
+            showTreeStats();
+        if (m_profiler.isEnabled()) {
+            bool isOpen = true;
+            ImGui::Begin("Frame profiler", &isOpen, ImGuiWindowFlags_AlwaysAutoResize);
+            m_profiler.showInImGui();
+            ImGui::End();
+            m_profiler.setEnabled(isOpen);
+        }
     };
 
     m_window.clear(sf::Color(50, 50, 50));
-    sf::Shader::bind(&m_BSPShader);
-    m_window.draw(m_backgroundSprite);
-    sf::Shader::bind(nullptr);
-    m_window.drawImGuiContext(imguiFunctions);
+    {
+        // CPU side of the draw call, the GPU time shows up in display
+        FrameProfiler::ScopedTimer timer(m_profiler, m_drawSceneStage);
+        sf::Shader::bind(&m_BSPShader);
+        m_window.draw(m_backgroundSprite);
+        sf::Shader::bind(nullptr);
+    }
+    {
+        FrameProfiler::ScopedTimer timer(m_profiler, m_drawImGuiStage);
+        m_window.drawImGuiContext(imguiFunctions);
+    }
+
+    m_frameUploadStats = m_uvSplit.takeUploadStats();
+    if (m_profiler.isEnabled()) {
+        const UVBSPCompiledTree& compiledTree = m_uvSplit.getCompiledTree();
+        m_profiler.addValue(m_nodesCounter, double(compiledTree.size()));
+        m_profiler.addValue(m_depthCounter, compiledTree.getMaxDepth());
+        m_profiler.addValue(m_uploadedBytesCounter, double(m_frameUploadStats.bytesUploaded));
+    }
+}
+
+void Application_UVBSP::updateUniforms()
+{
+    FrameProfiler::ScopedTimer timer(m_profiler, m_updateUniformsStage);
+    static_assert(sizeof(bsp::Vec4) == sizeof(sf::Glsl::Vec4), "nodes are uploaded as they are");
+    const UVBSPCompiledTree& compiledTree = m_uvSplit.getCompiledTree();
+    const bool isLargeTree = compiledTree.size() > s_uniformNodeCapacity;
+    const size_t textureRows = (compiledTree.size() + s_nodesPerTextureRow - 1) / s_nodesPerTextureRow;
+    if (isLargeTree != m_isLargeTree || (isLargeTree && textureRows > m_nodeTexture.getSize().y)) {
+        uploadAllNodes();
+        return;
+    }
+    m_BSPShader.setUniform("maxDepth", compiledTree.getMaxDepth());
+
+    bool isHalfNodesRefused = false;
+    m_uvSplit.updateUniforms([this, &isHalfNodesRefused](int firstIndex, const bsp::Vec4* nodes, size_t count) {
+        if (m_isLargeTree) {
+            updateNodeTexture(firstIndex, nodes, count);
+        } else if (m_isHalfNodesPreview) {
+            // nearest values of the changed nodes only, samples are checked when the preview is turned on
+            isHalfNodesRefused |= !m_halfNodes.packRange(m_uvSplit.getCompiledTree(), firstIndex, count, UVBSPHalfNodes::Settings());
+            const size_t firstPair = firstIndex / 2, endPair = (firstIndex + count + 1) / 2;
+            const std::string name = firstPair ? "nodes[" + std::to_string(firstPair) + "]" : "nodes";
+            m_BSPShader.setUniformArray(name, reinterpret_cast<const sf::Glsl::Vec4*>(m_halfNodes.getPacked().data() + firstPair),
+                endPair - firstPair);
+        } else {
+            // location of "nodes[k]" is the k-th element, count continues from there
+            const std::string name = firstIndex ? "nodes[" + std::to_string(firstIndex) + "]" : "nodes";
+            m_BSPShader.setUniformArray(name, reinterpret_cast<const sf::Glsl::Vec4*>(nodes), count);
+        }
+    });
+    if (isHalfNodesRefused) {
+        LOG("Half nodes preview off: a split can't be packed");
+        m_window.setTitle("Half nodes preview off: a split can't be packed");
+        m_isHalfNodesPreview = false;
+        uploadAllNodes();
+    }
+}
+
+void Application_UVBSP::uploadAllNodes()
+{
+    m_uvSplit.updateUniforms([](int, const bsp::Vec4*, size_t) {}); // everything is uploaded below
+    const UVBSPCompiledTree& compiledTree = m_uvSplit.getCompiledTree();
+    m_isLargeTree = compiledTree.size() > s_uniformNodeCapacity;
+    m_BSPShader.setUniform("largeTree", m_isLargeTree);
+    m_BSPShader.setUniform("maxDepth", compiledTree.getMaxDepth());
+
+    if (m_isLargeTree) {
+        m_isHalfNodesPreview = false;
+        m_BSPShader.setUniform("halfNodes", false);
+        // rows grow by doubling, so a drawing session recreates the texture a few times only
+        const size_t textureRows = (compiledTree.size() + s_nodesPerTextureRow - 1) / s_nodesPerTextureRow;
+        if (textureRows > m_nodeTexture.getSize().y) {
+            unsigned rows = std::max(1u, m_nodeTexture.getSize().y);
+            while (rows < textureRows)
+                rows *= 2;
+            if (!m_nodeTexture.create(s_nodesPerTextureRow * 4, rows))
+                LOG("Failed to create node texture with " << rows << " rows");
+            m_BSPShader.setUniform("nodeTexture", m_nodeTexture);
+        }
+        updateNodeTexture(0, compiledTree.data(), compiledTree.size());
+        return;
+    }
+
+    if (m_isHalfNodesPreview) {
+        UVBSPHalfNodes::Settings settings;
+        settings.checkResolution = 0; // the same nearest values as updateUniforms() repacks
+        UVBSPHalfNodes::Report report;
+        m_isHalfNodesPreview = m_halfNodes.pack(m_uvSplit, settings, &report);
+        if (!m_isHalfNodesPreview) {
+            m_window.setTitle(report.getInfo());
+            LOG("Half nodes preview off: " << report.getInfo());
+        }
+    }
+    m_BSPShader.setUniform("halfNodes", m_isHalfNodesPreview);
+
+    const bsp::Vec4* nodes = m_isHalfNodesPreview ? m_halfNodes.getPacked().data() : compiledTree.data();
+    const size_t count = m_isHalfNodesPreview ? m_halfNodes.getPacked().size() : compiledTree.size();
+    m_BSPShader.setUniformArray("nodes", reinterpret_cast<const sf::Glsl::Vec4*>(nodes), count);
+}
+
+void Application_UVBSP::updateNodeTexture(int firstIndex, const bsp::Vec4* nodes, size_t count)
+{
+    // node bytes go as they are, 4 RGBA8 texels per node, the shader rebuilds little endian ints
+    static_assert(sizeof(bsp::Vec4) == 4 * 4, "a node is 4 texels");
+    UVBSPNodeTexture::forEachRect(firstIndex, count, [&](size_t nodeOffset, unsigned x, unsigned y, unsigned width, unsigned height) {
+        m_nodeTexture.update(reinterpret_cast<const sf::Uint8*>(nodes + nodeOffset), width, height, x, y);
+    });
+}
+
+void Application_UVBSP::setHalfNodesPreview(bool enabled)
+{
+    if (enabled && m_isLargeTree) {
+        m_window.setTitle("Half nodes preview is for trees up to " + std::to_string(s_uniformNodeCapacity) + " nodes");
+        return;
+    }
+    m_isHalfNodesPreview = enabled;
+    uploadAllNodes();
+    if (m_isHalfNodesPreview) {
+        // samples are checked here only, as the export packs them, edits repack the changed nodes
+        UVBSPHalfNodes exported;
+        UVBSPHalfNodes::Report report;
+        exported.pack(m_uvSplit, UVBSPHalfNodes::Settings(), &report);
+        m_window.setTitle("Half nodes preview: " + std::to_string(m_halfNodes.getNodeCount()) + " nodes in "
+            + std::to_string(m_halfNodes.getPacked().size()) + " vectors   " + report.getInfo());
+    }
+}
+
+void Application_UVBSP::verifyPreview()
+{
+    constexpr unsigned resolution = 1024; // power of two, see indexOutput in BSPshader.frag
+    sf::RenderTexture target;
+    if (!target.create(resolution, resolution)) {
+        m_window.setTitle("Failed to create preview check target");
+        return;
+    }
+    sf::Sprite sprite(m_texture);
+    sprite.setScale(float(resolution) / m_texture.getSize().x, float(resolution) / m_texture.getSize().y);
+    sf::RenderStates states(&m_BSPShader);
+    states.blendMode = sf::BlendNone;
+
+    m_BSPShader.setUniform("indexOutput", true);
+    m_BSPShader.setUniform("indexResolution", float(resolution));
+    target.clear();
+    target.draw(sprite, states);
+    target.display();
+    m_BSPShader.setUniform("indexOutput", false);
+    const sf::Image image = target.getTexture().copyToImage();
+
+    std::vector<bsp::vec2> samples(resolution * resolution);
+    for (unsigned y = 0; y < resolution; ++y)
+        for (unsigned x = 0; x < resolution; ++x)
+            samples[y * resolution + x] = getTexelCenter(x, y, resolution, resolution);
+    std::vector<int> expected(samples.size());
+    if (m_isHalfNodesPreview) {
+        for (size_t i = 0; i < samples.size(); ++i)
+            expected[i] = m_halfNodes.evaluate(samples[i]);
+    } else {
+        m_uvSplit.classify(samples.data(), samples.size(), expected.data());
+    }
+
+    size_t mismatches = 0;
+    for (unsigned y = 0; y < resolution; ++y)
+        for (unsigned x = 0; x < resolution; ++x) {
+            const sf::Color color = image.getPixel(x, y);
+            mismatches += (color.r | color.g << 8 | color.b << 16) != expected[y * resolution + x];
+        }
+
+    const std::string info = "Preview check: " + std::to_string(mismatches) + "/" + std::to_string(samples.size())
+        + " texels differ from the CPU" + (m_isLargeTree ? "   (node texture)" : "");
+    LOG(info);
+    m_window.setTitle(info);
+}
+
+void Application_UVBSP::setHoverReadout(bool enabled)
+{
+    if (!enabled) {
+        m_hoverMousePos.reset();
+        m_window.setMouseMoveEvent(sf::Mouse::Left, {});
+        m_window.requestRedraw();
+        return;
+    }
+    // move events run with any button, the handler is set only while the readout is on
+    m_hoverMousePos = sf::Mouse::getPosition(m_window);
+    m_window.setMouseMoveEvent(sf::Mouse::Left, [this](ivec2 currentPos, ivec2) { m_hoverMousePos = currentPos; });
+    m_window.requestRedraw();
+}
+
+void Application_UVBSP::showTreeStats()
+{
+    const UVBSPTreeStats& stats = m_uvSplit.getTreeStats();
+    ImGui::SetNextWindowSize(ImVec2(420, 480), ImGuiCond_FirstUseEver);
+    if (!ImGui::Begin("Tree stats", &m_isTreeStatsPanel)) {
+        ImGui::End();
+        return;
+    }
+    ImGui::Text("Nodes: %zu   Leaves: %d   Colors used: %d", m_uvSplit.getNumNodes(), stats.getLeafCount(), stats.getUsedColorCount());
+    ImGui::Text("Max depth: %d   Average leaf depth: %.2f", stats.getMaxDepth(), stats.getAverageLeafDepth());
+
+    // index 0 is never used, the root is at depth 1
+    const std::vector<int>& depthCounts = stats.getLeafDepthCounts();
+    std::vector<float> histogram;
+    for (size_t depth = 1; depth < depthCounts.size(); ++depth)
+        histogram.push_back(float(depthCounts[depth]));
+    ImGui::PlotHistogram("##leaf depths", histogram.data(), int(histogram.size()), 0, "leaves by depth",
+        0.f, FLT_MAX, ImVec2(ImGui::GetContentRegionAvail().x, 100.f));
+
+    const std::vector<int>& colorLeafCounts = stats.getColorLeafCounts();
+    if (ImGui::BeginTable("leaves by color", 2, ImGuiTableFlags_ScrollY | ImGuiTableFlags_RowBg)) {
+        ImGui::TableSetupScrollFreeze(0, 1);
+        ImGui::TableSetupColumn("color");
+        ImGui::TableSetupColumn("leaves");
+        ImGui::TableHeadersRow();
+        ImGuiListClipper clipper;
+        clipper.Begin(int(colorLeafCounts.size()));
+        while (clipper.Step())
+            for (int colorIndex = clipper.DisplayStart; colorIndex < clipper.DisplayEnd; ++colorIndex) {
+                ImGui::TableNextColumn();
+                ImGui::Text("%d", colorIndex);
+                ImGui::TableNextColumn();
+                if (colorLeafCounts[colorIndex])
+                    ImGui::Text("%d", colorLeafCounts[colorIndex]);
+                else
+                    ImGui::TextDisabled("0");
+            }
+        ImGui::EndTable();
+    }
+    ImGui::End();
 }
 
 void Application_UVBSP::bindActions()
@@ -70,9 +320,12 @@ void Application_UVBSP::bindActions()
 
     const static auto readUVBSPFileFunction =
         [this](const std::filesystem::path& fullPath) {
-            if (m_uvSplit.readFromFile(fullPath)) {
+            UVBSPEditorState state;
+            if (m_uvSplit.readFromFile(fullPath, &state)) {
                 LOG("File opened: RelativePath: " << m_currentDir.c_str());
-                m_uvSplit.updateUniforms(m_BSPShader);
+                updateUniforms();
+                m_splitActions.assign(state.history, state.historyIndex);
+                m_colorIndex = state.colorIndex;
 
                 m_currentDir = m_fsNavigator->getCurrentDir();
                 m_currentFileName = m_currentDir.filename();
@@ -87,7 +340,12 @@ void Application_UVBSP::bindActions()
         [this](const std::filesystem::path& fullPath) {
             fs::directory_entry entry(fullPath);
             if (entry.exists()) {
-                m_uvSplit.writeToFile(fullPath);
+                const UVBSPEditorState state { m_colorIndex, m_splitActions.getRecords(), m_splitActions.getCurrentIndex() };
+                const bool isWritten = fullPath.extension() == ".json"
+                    ? m_uvSplit.writeToJson(fullPath, &state)
+                    : m_uvSplit.writeToFile(fullPath, &state);
+                if (!isWritten)
+                    return false;
                 m_window.setTitle("Saved to: " + std::string(fullPath));
                 return true;
             }
@@ -106,6 +364,55 @@ void Application_UVBSP::bindActions()
             return validTexture;
         };
 
+    // every color of the mask becomes a color index, drawn splits are replaced
+    const static auto buildFromMaskFileFunction =
+        [this](const std::filesystem::path& fullPath) {
+            sf::Image mask;
+            if (!mask.loadFromFile(fullPath))
+                return false;
+            const UVBSPLabelImage labelImage = UVBSPLabelImage::fromRGBA(mask.getPixelsPtr(), mask.getSize().x, mask.getSize().y);
+            UVBSPMaskBuilder::Stats stats;
+            if (!UVBSPMaskBuilder(labelImage).build(m_uvSplit, {}, &stats)) {
+                m_window.setTitle("Not a mask (more than 65536 colors?): " + std::string(fullPath));
+                return false;
+            }
+            m_splitActions.clear();
+            m_colorIndex = uint32_t(m_uvSplit.getColorCount() + 1) & ~1u;
+            updateUniforms();
+            LOG("Built from mask: " << stats.getInfo());
+            m_window.setTitle(stats.getInfo());
+            return true;
+        };
+
+    // build tree from mask
+    m_window.addKeyDownEvent(sf::Keyboard::M, ModifierKey::Control, [this]() {
+        m_fsNavigator.reset(new ImguiUtils::FileReader(
+            "Build from mask", m_currentDir,
+            "bmp,png,tga,jpg,gif,psd,hdr,pic", buildFromMaskFileFunction));
+    });
+
+    const static auto buildFromMeshFileFunction =
+        [this](const std::filesystem::path& fullPath) {
+            UVBSPMesh mesh;
+            UVBSPMeshBuilder::Stats stats;
+            if (!mesh.loadObj(fullPath) || !UVBSPMeshBuilder(mesh).build(m_uvSplit, {}, &stats)) {
+                m_window.setTitle("No UV triangles: " + std::string(fullPath));
+                return false;
+            }
+            m_splitActions.clear();
+            m_colorIndex = uint32_t(m_uvSplit.getColorCount() + 1) & ~1u;
+            updateUniforms();
+            LOG("Built from mesh: " << stats.getInfo());
+            m_window.setTitle(stats.getInfo());
+            return true;
+        };
+
+    // build tree from UV islands of a mesh
+    m_window.addKeyDownEvent(sf::Keyboard::M, ModifierKey::Control | ModifierKey::Shift, [this]() {
+        m_fsNavigator.reset(new ImguiUtils::FileReader(
+            "Build from mesh UVs", m_currentDir, "obj", buildFromMeshFileFunction));
+    });
+
     // import image
     m_window.addKeyDownEvent(sf::Keyboard::I, ModifierKey::Control, [this]() {
         m_fsNavigator.reset(new ImguiUtils::FileReader(
@@ -116,7 +423,7 @@ void Application_UVBSP::bindActions()
     // open file
     m_window.addKeyDownEvent(sf::Keyboard::O, ModifierKey::Control, [this]() {
         m_fsNavigator.reset(new ImguiUtils::FileReader(
-            "Open file", m_currentDir, "uvbsp", readUVBSPFileFunction));
+            "Open file", m_currentDir, "uvbsp,json", readUVBSPFileFunction));
     });
 
     // save file
@@ -126,7 +433,7 @@ void Application_UVBSP::bindActions()
                 writeWithUVBSPFileFunction(m_currentDir / *m_currentFileName);
             } else {
                 m_fsNavigator.reset(new ImguiUtils::FileWriter(
-                    "Open file", m_currentDir, "uvbsp", writeWithUVBSPFileFunction));
+                    "Open file", m_currentDir, "uvbsp,json", writeWithUVBSPFileFunction));
             }
         });
 
@@ -150,16 +457,80 @@ void Application_UVBSP::bindActions()
         [this]() {
             if (m_splitActions.undo())
                 m_colorIndex -= 2;
-            m_uvSplit.updateUniforms(m_BSPShader);
+            updateUniforms();
 
             m_window.setTitle(m_uvSplit.getBasicInfo());
         });
 
+    // redo
+    const static auto redoFunction =
+        [this]() {
+            if (m_splitActions.redo())
+                m_colorIndex += 2;
+            updateUniforms();
+
+            m_window.setTitle(m_uvSplit.getBasicInfo());
+        };
+    m_window.addKeyDownEvent(sf::Keyboard::Y, ModifierKey::Control, redoFunction);
+    m_window.addKeyDownEvent(sf::Keyboard::Z, ModifierKey::Control | ModifierKey::Shift, redoFunction);
+
+    // toggle preview of the half node encoding, two nodes per vec4
+    m_window.addKeyDownEvent(sf::Keyboard::H, ModifierKey::Control,
+        [this]() { setHalfNodesPreview(!m_isHalfNodesPreview); });
+
+    // main loop numbers since the previous report: CPU use, merged mouse moves, input latency
+    m_window.addKeyDownEvent(sf::Keyboard::F2, ModifierKey::None,
+        [this]() {
+            const std::string info = m_window.takeSchedulerStats().getInfo();
+            LOG("Scheduler: " << info);
+            m_window.setTitle(info);
+        });
+
+    // frame time graph, per stage averages and p99s
+    m_window.addKeyDownEvent(sf::Keyboard::F3, ModifierKey::None,
+        [this]() { m_profiler.setEnabled(!m_profiler.isEnabled()); });
+
+    // leaf index and depth under the cursor
+    m_window.addKeyDownEvent(sf::Keyboard::F4, ModifierKey::None,
+        [this]() { setHoverReadout(!m_hoverMousePos); });
+
+    // depth histogram and leaves by color
+    m_window.addKeyDownEvent(sf::Keyboard::F5, ModifierKey::None,
+        [this]() { m_isTreeStatsPanel = !m_isTreeStatsPanel; });
+
+    // compare the preview with the CPU traversal
+    m_window.addKeyDownEvent(sf::Keyboard::V, ModifierKey::Control | ModifierKey::Shift,
+        [this]() { verifyPreview(); });
+
+    // rebalance tree, partition stays the same
+    m_window.addKeyDownEvent(sf::Keyboard::B, ModifierKey::Control,
+        [this]() {
+            UVBSPOptimizeReport report = m_uvSplit.rebalance();
+            if (report.applied)
+                m_splitActions.clear(); // node indices changed
+            updateUniforms();
+            LOG("Rebalance: " << report.getInfo());
+
+            m_window.setTitle(report.getInfo());
+        });
+
+    // drop splits that change nothing, partition stays the same
+    m_window.addKeyDownEvent(sf::Keyboard::B, ModifierKey::Control | ModifierKey::Shift,
+        [this]() {
+            UVBSPOptimizeReport report = m_uvSplit.simplify();
+            if (report.applied)
+                m_splitActions.clear(); // node indices changed
+            updateUniforms();
+            LOG("Simplify: " << report.getInfo());
+
+            m_window.setTitle(report.getInfo());
+        });
+
     // suggest export shader text
     m_window.addKeyDownEvent(sf::Keyboard::E, ModifierKey::Control | ModifierKey::Shift,
         [this]() {
             m_window.setAnyKeyReason("export file type");
-            m_window.setTitle("Export shader to: G-glsl, H-hlsl, U-unreal");
+            m_window.setTitle("Export shader to: G-glsl, H-hlsl, U-unreal (+Shift unrolled, +Alt half nodes), I-index map, A-antialiased image");
         });
 
     // export shader text
@@ -177,12 +548,46 @@ void Application_UVBSP::bindActions()
             case sf::Keyboard::U:
                 shaderExportType = UVBSP::ShaderType::UnrealCustomNode;
                 break;
+            case sf::Keyboard::I: {
+                UVBSPIndexBaker::Settings settings;
+                settings.width = m_texture.getSize().x;
+                settings.height = m_texture.getSize().y;
+                UVBSPIndexBaker::Stats stats;
+                const fs::path indexMapPath = m_currentDir / "index_map.png";
+                if (UVBSPIndexBaker(m_uvSplit).bake(indexMapPath, settings, &stats)) {
+                    LOG("Index map baked: " << stats.getInfo());
+                    m_window.setTitle("Index map saved to: " + std::string(indexMapPath));
+                } else {
+                    m_window.setTitle("Failed to bake index map");
+                }
+                return;
+            }
+            case sf::Keyboard::A: {
+                UVBSPAntialiasedExporter::Settings settings;
+                settings.width = m_texture.getSize().x;
+                settings.height = m_texture.getSize().y;
+                const fs::path imagePath = m_currentDir / "antialiased.png";
+                if (UVBSPAntialiasedExporter(m_uvSplit).exportImage(imagePath, settings))
+                    m_window.setTitle("Antialiased image saved to: " + std::string(imagePath));
+                else
+                    m_window.setTitle("Failed to export antialiased image");
+                return;
+            }
             default: {
-                m_window.setTitle("Invalid export letter, press 'G', 'H' or 'U' next time.");
+                m_window.setTitle("Invalid export letter, press 'G', 'H', 'U', 'I' or 'A' next time.");
                 return;
             }
             }
-            shaderText = m_uvSplit.generateShader(shaderExportType).str();
+            UVBSP::ShaderCodeForm codeForm = UVBSP::ShaderCodeForm::NodeArray;
+            if (int(key.mod) & int(ModifierKey::Shift))
+                codeForm = UVBSP::ShaderCodeForm::Unrolled;
+            else if (int(key.mod) & int(ModifierKey::Alt))
+                codeForm = UVBSP::ShaderCodeForm::HalfPacked;
+            shaderText = m_uvSplit.generateShader(shaderExportType, codeForm).str();
+            if (shaderText.empty()) {
+                m_window.setTitle("Half nodes refused: a split moves too far or an index needs more than 16 bits, see console");
+                return;
+            }
             std::cout << shaderText << std::endl;
             sf::Clipboard::setString(shaderText);
 
@@ -203,8 +608,8 @@ void Application_UVBSP::bindActions()
             if (!mouseDown) {
                 const UVBSPSplit* lastNode = m_uvSplit.getLastNode();
                 if (lastNode) {
-                    UVBSPSplit split(lastNode->pos, lastNode->dir, lastNode->l, lastNode->r);
-                    m_splitActions.add(split);
+                    m_splitActions.add(m_uvSplit.getLastAddRecord());
+                    m_uvSplit.finishSplit();
 
                     m_window.setTitle(m_uvSplit.getBasicInfo());
                 }
@@ -232,14 +637,16 @@ void Application_UVBSP::bindActions()
             vec2 uvCurrentPerp = perp(uvCurrentDir);
 
             if (dragState == DragState::StartDrag) { // create new split
-                UVBSPSplit split = { uvStartPos, uvCurrentPerp, m_colorIndex, ushort(m_colorIndex + 1) };
+                UVBSPSplit split = { toBSP(uvStartPos), toBSP(uvCurrentPerp), m_colorIndex, ushort(m_colorIndex + 1) };
                 m_uvSplit.addSplit(split);
-                m_uvSplit.updateUniforms(m_BSPShader);
+                updateUniforms();
 
                 m_colorIndex += 2;
             } else if (dragState == DragState::ContinueDrag) { // rotate new split
-                m_uvSplit.adjustSplit(uvCurrentPerp);
-                m_uvSplit.updateUniforms(m_BSPShader);
+                m_uvSplit.adjustSplit(toBSP(uvCurrentPerp));
+                updateUniforms();
+
+                m_window.setTitle(m_uvSplit.getBasicInfo() + "   " + m_frameUploadStats.getInfo());
             }
         });
 }
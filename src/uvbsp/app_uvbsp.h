@@ -3,6 +3,7 @@
 #include "app_abstract.h"
 #include "imgui_filesystem.h"
 #include "uvbsp.h"
+#include "uvbsp_half.h"
 
 #include <SFML/Graphics/Sprite.hpp>
 #include <memory>
@@ -17,24 +18,54 @@ class Shader;
 
 class Application_UVBSP : public Application {
 
+    static constexpr size_t s_uniformNodeCapacity = 512; // "nodes" array of BSPshader.frag
+    static constexpr size_t s_nodesPerTextureRow = UVBSPNodeTexture::s_nodesPerRow;
+
     sf::Shader m_BSPShader;
+    sf::Texture m_nodeTexture; // nodes of large trees
+    bool m_isLargeTree = false; // more nodes than s_uniformNodeCapacity, shader reads m_nodeTexture
     sf::Texture m_texture;
     sf::Sprite m_backgroundSprite;
 
     UVBSP m_uvSplit;
     UVBSPActionHistory m_splitActions;
+    UVBSPUploadStats m_frameUploadStats; // of the previous frame
+    UVBSPHalfNodes m_halfNodes;
+    bool m_isHalfNodesPreview = false; // shader gets m_halfNodes instead of the compiled tree
     ushort m_colorIndex = 0;
 
     std::unique_ptr<ImguiUtils::FileSystemNavigator> m_fsNavigator;
     std::filesystem::path m_currentDir;
     std::optional<std::filesystem::path> m_currentFileName;
     float m_backgroundTransparency = 0.5f;
+    std::optional<ivec2> m_hoverMousePos; // leaf under the cursor is shown while set
+    bool m_isTreeStatsPanel = false;
+
+    // profiler series, updateUniforms runs inside processEvents and is part of its time
+    const int m_updateUniformsStage = m_profiler.addStage("updateUniforms");
+    const int m_drawSceneStage = m_profiler.addStage("draw BSP shader");
+    const int m_drawImGuiStage = m_profiler.addStage("drawImGuiContext");
+    const int m_nodesCounter = m_profiler.addCounter("nodes");
+    const int m_depthCounter = m_profiler.addCounter("depth");
+    const int m_uploadedBytesCounter = m_profiler.addCounter("uniform bytes");
 
 public:
     Application_UVBSP();
     ~Application_UVBSP() = default;
 
     void bindActions();
+    // changed nodes of the tree to the shader
+    void updateUniforms();
+    void uploadAllNodes();
+    void updateNodeTexture(int firstIndex, const bsp::Vec4* nodes, size_t count);
+    // Falls back to full precision nodes when a split can't be packed
+    void setHalfNodesPreview(bool enabled);
+    // Renders color indices with the preview shader, compares them with the CPU traversal
+    void verifyPreview();
+    // Tooltip with leaf, color and depth under the cursor, mouse moves redraw only while it is on
+    void setHoverReadout(bool enabled);
+    // ImGui window: depth histogram of leaves and leaves by color
+    void showTreeStats();
 
     virtual void drawContext() override;
 };
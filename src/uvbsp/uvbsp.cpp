@@ -1,85 +1,197 @@
-#include "base64.hpp"
-#include <SFML/Graphics/Shader.hpp>
-#include <fstream>
+#include "base64_codec.h"
+#include "mapped_file.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
 #include <sstream>
 #include <uvbsp/uvbsp.h>
+#include <uvbsp/uvbsp_codegen.h>
+#include <uvbsp/uvbsp_file.h>
+#include <uvbsp/uvbsp_half.h>
+#include <uvbsp/uvbsp_traversal.h>
+
+#ifndef LOG
+#define LOG(x) std::cout << x << std::endl
+#endif
+
+static void printPackedNode(const bsp::Vec4& node, std::stringstream& outStream);
 
-static Vec4 packNodeToShader(UVBSPSplit node, std::stringstream* outStream = nullptr);
 void UVBSP::addSplit(UVBSPSplit split)
 {
+    m_currentNode = nullptr;
     if (!m_initialSet) {
         m_nodes[0] = UVBSPSplit(split.pos, split.dir, split.l, split.r);
         m_currentNode = &m_nodes[0];
         m_initialSet = true;
+        m_lastAddRecord = { -1, 0, 0, m_nodes[0] };
+        if (!m_compiledTreeDirty)
+            m_compiledTree.updateNode(m_nodes, 0);
+        m_pointGridDirty = true;
+        m_treeStatsDirty = true;
+        invalidateCells(0);
 
     } else {
-        int currentIndex = 0;
-        for (int iteration = 0; iteration < 64; ++iteration) {
-            bool isLeftPixel = dot(m_nodes[currentIndex].pos - split.pos, m_nodes[currentIndex].dir) < 0.0;
-            int& indexOfProperSide = isLeftPixel ? m_nodes[currentIndex].l : m_nodes[currentIndex].r;
+        const UVBSPPointLocation location = locate(split.pos);
+        int& indexOfProperSide = location.side == 0 ? m_nodes[location.nodeIndex].l : m_nodes[location.nodeIndex].r;
+        m_lastAddRecord = { location.nodeIndex, location.side, indexOfProperSide, split };
+        indexOfProperSide = -m_nodes.size();
+
+        m_nodes.emplace_back(UVBSPSplit(split.pos, split.dir, split.l, split.r));
+        m_currentNode = &m_nodes.back();
+        if (!m_compiledTreeDirty)
+            m_compiledTree.appendNode(m_nodes, location.nodeIndex);
+        if (!m_pointGridDirty)
+            m_pointGrid.appendNode(m_nodes, location.nodeIndex);
+        if (!m_treeStatsDirty)
+            m_treeStats.appendNode(m_nodes, location.nodeIndex, location.colorIndex);
+        invalidateCells(m_nodes.size() - 1);
+    }
+}
+
+bool UVBSP::undoAddSplit(const UVBSPAddRecord& record)
+{
+    if (record.parentIndex < 0) { // first split, back to the initial root
+        if (!m_initialSet || m_nodes.size() != 1)
+            return false;
+        reset();
+        return true;
+    }
 
-            if (indexOfProperSide < 0) {
-                currentIndex = -indexOfProperSide;
-            } else {
-                indexOfProperSide = -m_nodes.size();
+    const int nodeIndex = m_nodes.size() - 1;
+    if (record.parentIndex >= nodeIndex)
+        return false;
+    int& childIndex = record.side == 0 ? m_nodes[record.parentIndex].l : m_nodes[record.parentIndex].r;
+    if (childIndex != -nodeIndex)
+        return false;
 
-                m_nodes.emplace_back(UVBSPSplit(split.pos, split.dir, split.l, split.r));
-                m_currentNode = &m_nodes.back();
+    childIndex = record.previousChild;
+    if (!m_treeStatsDirty)
+        m_treeStats.removeLastNode(m_nodes, record.parentIndex, record.previousChild);
+    m_nodes.pop_back();
+    m_currentNode = nullptr;
+    if (!m_compiledTreeDirty && !m_compiledTree.removeLastNode(m_nodes, record.parentIndex))
+        m_compiledTreeDirty = true;
+    if (!m_pointGridDirty)
+        m_pointGrid.removeLastNode(record.parentIndex);
 
-                break;
-            }
-        }
+    // sides of the parent keep their polygons, only the child reference changed
+    if (m_cells.size() > m_nodes.size())
+        m_cells.resize(m_nodes.size());
+    m_cellsDirty = true;
+    return true;
+}
+
+bool UVBSP::redoAddSplit(const UVBSPAddRecord& record)
+{
+    if (record.parentIndex < 0) {
+        if (m_initialSet)
+            return false;
+        addSplit(record.split);
+        m_currentNode = nullptr;
+        return true;
     }
+
+    if (record.parentIndex >= (int)m_nodes.size())
+        return false;
+    int& childIndex = record.side == 0 ? m_nodes[record.parentIndex].l : m_nodes[record.parentIndex].r;
+    if (childIndex != record.previousChild)
+        return false;
+
+    childIndex = -m_nodes.size();
+    m_nodes.push_back(record.split);
+    if (!m_compiledTreeDirty)
+        m_compiledTree.appendNode(m_nodes, record.parentIndex);
+    if (!m_pointGridDirty)
+        m_pointGrid.appendNode(m_nodes, record.parentIndex);
+    if (!m_treeStatsDirty)
+        m_treeStats.appendNode(m_nodes, record.parentIndex, record.previousChild);
+    invalidateCells(m_nodes.size() - 1);
+    return true;
 }
 
-void UVBSP::updateUniforms(sf::Shader& shader)
+const UVBSPCompiledTree& UVBSP::getCompiledTree() const
 {
-    m_packedStructs.resize(m_nodes.size());
-    for (size_t i = 0; i < m_nodes.size(); ++i) {
-        m_packedStructs[i] = packNodeToShader(m_nodes[i]);
+    if (m_compiledTreeDirty) {
+        m_compiledTree.compile(m_nodes);
+        m_compiledTreeDirty = false;
     }
-    shader.setUniformArray("nodes", m_packedStructs.data(), m_packedStructs.size());
+    return m_compiledTree;
 }
 
-bool UVBSP::readFromFile(const std::string& path)
+bool UVBSP::readLegacyFile(const std::string& path)
 {
-    std::ifstream myfile(path);
-    std::string baseString((std::istreambuf_iterator<char>(myfile)), std::istreambuf_iterator<char>());
+    MappedFile file;
+    if (!file.open(path) || !file.size())
+        return false;
 
-    if (baseString.size()) {
-        reset();
-        std::string dataString = websocketpp::base64_decode(baseString);
-        size_t arraySize = dataString.size() / sizeof(UVBSPSplit);
+    // decoded straight into the node array, in fixed pieces of text
+    std::vector<UVBSPSplit> nodes(getBase64MaxDecodedSize(file.size()) / sizeof(UVBSPSplit) + 1);
+    uint8_t* nodeBytes = reinterpret_cast<uint8_t*>(nodes.data());
+    const size_t capacity = nodes.size() * sizeof(UVBSPSplit);
+    constexpr size_t pieceSize = 1 << 16;
 
-        m_nodes.resize(arraySize);
-        for (size_t i = 0; i < arraySize * sizeof(UVBSPSplit); ++i) {
-            ((uint8_t*)(void*)m_nodes.data())[i] = dataString[i];
-        }
-        printNodes();
-        return true;
+    Base64Decoder decoder;
+    size_t decodedSize = 0, written = 0;
+    for (size_t i = 0; i < file.size(); i += pieceSize) {
+        const char* text = reinterpret_cast<const char*>(file.data()) + i;
+        if (!decoder.decode(text, std::min(pieceSize, file.size() - i), nodeBytes + decodedSize, capacity - decodedSize, written))
+            return false;
+        decodedSize += written;
+    }
+    if (!decoder.finish(nodeBytes + decodedSize, capacity - decodedSize, written))
+        return false;
+    decodedSize += written;
+
+    size_t arraySize = decodedSize / sizeof(UVBSPSplit);
+    if (!arraySize)
+        return false;
+    nodes.resize(arraySize);
+    if (!isTreeValid(nodes)) {
+        LOG("Invalid node links in uvbsp file: " << path);
+        return false;
     }
-    return false;
+
+    reset();
+    m_nodes = std::move(nodes);
+    m_initialSet = true; // old files keep no flag, anything saved was drawn
+    m_compiledTreeDirty = true;
+    m_pointGridDirty = true;
+    m_treeStatsDirty = true;
+    m_cells.clear();
+    m_cellsDirty = true;
+    return true;
 }
 
-void UVBSP::writeToFile(const std::string& path)
+int UVBSP::getColorCount() const
 {
-    size_t arraySize = m_nodes.size() * sizeof(UVBSPSplit);
-    const uint8_t* data = (uint8_t*)(void*)m_nodes.data();
-    if (arraySize) {
-        std::ofstream myfile(path, std::ios::out);
-        myfile << websocketpp::base64_encode(data, arraySize);
-    }
+    int colorCount = 0;
+    for (const UVBSPSplit& node : m_nodes)
+        colorCount = std::max({ colorCount, node.l + 1, node.r + 1 });
+    return colorCount;
 }
 
 void UVBSP::reset()
 {
     m_nodes.clear();
-    m_nodes.push_back({ vec2(0.5f, 0.5f), vec2(1, 1), 0, 0 });
-    m_packedStructs.clear();
+    m_nodes.push_back({ bsp::vec2(0.5f, 0.5f), bsp::vec2(1, 1), 0, 0 });
+    m_compiledTreeDirty = true;
+    m_pointGridDirty = true;
+    m_treeStatsDirty = true;
+    m_cells.clear();
+    m_cellsDirty = true;
     m_currentNode = nullptr;
     m_initialSet = false;
 }
 
+void UVBSP::assignNodes(std::vector<UVBSPSplit> nodes)
+{
+    reset();
+    if (nodes.empty())
+        return;
+    m_nodes = std::move(nodes);
+    m_initialSet = true;
+}
+
 std::string UVBSP::printNodes()
 {
     std::string result;
@@ -92,12 +204,14 @@ std::string UVBSP::printNodes()
     return result;
 }
 
-static Vec4 packNodeToShader(UVBSPSplit node, std::stringstream* outStream)
+static constexpr float s_packThreshold = 1.f / (1 << 24); // almost vertical line
+
+bsp::Vec4 packNodeToShader(UVBSPSplit node)
 {
-    constexpr float threshold = 1.f / (1 << 24); // almost vertical line
-    if (abs(node.dir.x) < threshold)
+    constexpr float threshold = s_packThreshold;
+    if (std::abs(node.dir.x) < threshold)
         node.dir.x = threshold;
-    if (abs(node.dir.y) < threshold)
+    if (std::abs(node.dir.y) < threshold)
         node.dir.y = threshold;
 
     const float tangent = node.dir.x / node.dir.y;
@@ -107,25 +221,160 @@ static Vec4 packNodeToShader(UVBSPSplit node, std::stringstream* outStream)
 
     float normalizedPos = node.pos.x + node.pos.y / tangent;
 
-    if (outStream) {
-        (*outStream)
-            << "IVEC4("
-            << reinterpret_cast<const int&>(normalizedPos) << ", "
-            << reinterpret_cast<const int&>(tangent) << ", "
-            << node.l << ", "
-            << node.r << ")";
+    return bsp::Vec4(normalizedPos, tangent,
+        intBitsToFloat(node.l),
+        intBitsToFloat(node.r));
+}
+
+void setPackedSides(UVBSPSplit& split, int leftIndex, int rightIndex)
+{
+    // packNodeToShader() swaps sides for negative (not clamped) dir.y
+    bool swapped = !(std::abs(split.dir.y) < s_packThreshold) && split.dir.y < 0;
+    split.l = swapped ? rightIndex : leftIndex;
+    split.r = swapped ? leftIndex : rightIndex;
+}
+
+static void printPackedNode(const bsp::Vec4& node, std::stringstream& outStream)
+{
+    outStream
+        << "IVEC4("
+        << floatBitsToInt(node.x) << ", "
+        << floatBitsToInt(node.y) << ", "
+        << floatBitsToInt(node.z) << ", "
+        << floatBitsToInt(node.w) << ")";
+}
+
+void UVBSPCompiledTree::compile(const std::vector<UVBSPSplit>& nodes)
+{
+    // breadth first order, unreachable nodes are dropped
+    std::vector<int> order { 0 };
+    m_depths = { 1 };
+    m_compiledIndices.assign(nodes.size(), -1);
+    m_compiledIndices[0] = 0;
+    m_maxDepth = 1;
+
+    for (size_t head = 0; head < order.size(); ++head) {
+        const UVBSPSplit& node = nodes[order[head]];
+        for (int childIndex : { node.l, node.r }) {
+            if (childIndex < 0 && m_compiledIndices[-childIndex] < 0) {
+                m_compiledIndices[-childIndex] = order.size();
+                order.push_back(-childIndex);
+                m_depths.push_back(m_depths[head] + 1);
+                m_maxDepth = std::max(m_maxDepth, m_depths.back());
+            }
+        }
     }
 
-    return Vec4(normalizedPos, tangent,
-        reinterpret_cast<const float&>(node.l),
-        reinterpret_cast<const float&>(node.r));
+    m_depthCounts.assign(m_maxDepth + 1, 0);
+    for (int depth : m_depths)
+        m_depthCounts[depth]++;
+
+    m_sourceIndices = order;
+    m_nodes.resize(order.size());
+    for (size_t i = 0; i < order.size(); ++i)
+        packNode(nodes, i);
+
+    m_dirtyNodes.clear();
+    m_fullyDirty = true;
+}
+
+void UVBSPCompiledTree::packNode(const std::vector<UVBSPSplit>& nodes, int compiledIndex)
+{
+    UVBSPSplit node = nodes[m_sourceIndices[compiledIndex]];
+    if (node.l < 0)
+        node.l = -m_compiledIndices[-node.l];
+    if (node.r < 0)
+        node.r = -m_compiledIndices[-node.r];
+    m_nodes[compiledIndex] = packNodeToShader(node);
+    m_packedCount++;
+}
+
+void UVBSPCompiledTree::updateNode(const std::vector<UVBSPSplit>& nodes, int nodeIndex)
+{
+    const int compiledIndex = m_compiledIndices[nodeIndex];
+    if (compiledIndex < 0) // unreachable
+        return;
+    packNode(nodes, compiledIndex);
+    m_dirtyNodes.push_back(compiledIndex);
+}
+
+void UVBSPCompiledTree::appendNode(const std::vector<UVBSPSplit>& nodes, int parentIndex)
+{
+    const int parentCompiledIndex = m_compiledIndices[parentIndex];
+    const int compiledIndex = m_nodes.size();
+    m_compiledIndices.push_back(compiledIndex);
+    m_sourceIndices.push_back(nodes.size() - 1);
+    m_depths.push_back(m_depths[parentCompiledIndex] + 1);
+    m_maxDepth = std::max(m_maxDepth, m_depths.back());
+    m_depthCounts.resize(m_maxDepth + 1);
+    m_depthCounts[m_depths.back()]++;
+    m_nodes.emplace_back();
+
+    packNode(nodes, compiledIndex);
+    packNode(nodes, parentCompiledIndex); // child reference changed
+    m_dirtyNodes.push_back(parentCompiledIndex);
+    m_dirtyNodes.push_back(compiledIndex);
+}
+
+bool UVBSPCompiledTree::removeLastNode(const std::vector<UVBSPSplit>& nodes, int parentIndex)
+{
+    if (m_compiledIndices.size() != nodes.size() + 1 || m_compiledIndices.back() != int(m_nodes.size()) - 1)
+        return false; // moved by compile() or unreachable
+
+    m_compiledIndices.pop_back();
+    m_sourceIndices.pop_back();
+    m_nodes.pop_back();
+    m_depthCounts[m_depths.back()]--;
+    m_depths.pop_back();
+    while (m_maxDepth > 1 && m_depthCounts[m_maxDepth] == 0)
+        m_maxDepth--;
+
+    const int parentCompiledIndex = m_compiledIndices[parentIndex];
+    packNode(nodes, parentCompiledIndex);
+    m_dirtyNodes.push_back(parentCompiledIndex);
+    return true;
 }
 
-std::stringstream UVBSP::generateShader(ShaderType shaderType) const
+std::vector<std::pair<int, int>> UVBSPCompiledTree::takeDirtyRanges()
+{
+    std::vector<std::pair<int, int>> ranges;
+    if (m_fullyDirty) {
+        ranges.push_back({ 0, int(m_nodes.size()) });
+    } else {
+        std::sort(m_dirtyNodes.begin(), m_dirtyNodes.end());
+        for (int index : m_dirtyNodes) {
+            if (index >= int(m_nodes.size()))
+                break; // removed since
+            if (!ranges.empty() && index <= ranges.back().second)
+                ranges.back().second = std::max(ranges.back().second, index + 1);
+            else
+                ranges.push_back({ index, index + 1 });
+        }
+    }
+    m_dirtyNodes.clear();
+    m_fullyDirty = false;
+    return ranges;
+}
+
+std::stringstream UVBSP::generateShader(ShaderType shaderType, ShaderCodeForm codeForm) const
 {
     bool isHLSL = shaderType != ShaderType::GLSL;
-    const size_t arraySize = m_nodes.size();
+    const UVBSPCompiledTree& compiledTree = getCompiledTree();
+    const size_t arraySize = compiledTree.size();
     std::stringstream shaderText;
+    if (codeForm == ShaderCodeForm::Unrolled) {
+        UVBSPUnrolledShader(compiledTree).write(shaderText, shaderType);
+        return shaderText;
+    }
+    if (codeForm == ShaderCodeForm::HalfPacked) {
+        UVBSPHalfNodes halfNodes;
+        UVBSPHalfNodes::Report report;
+        const bool isPacked = halfNodes.pack(*this, UVBSPHalfNodes::Settings(), &report);
+        LOG(report.getInfo()); // texels that change side, or what was refused
+        if (isPacked)
+            halfNodes.write(shaderText, shaderType);
+        return shaderText;
+    }
     //"intBitsToFloat", "asfloat"
     shaderText << "/////// START_UVBSP_GENERATED_SHADER ////////\n\n";
 
@@ -145,7 +394,7 @@ std::stringstream UVBSP::generateShader(ShaderType shaderType) const
 
     for (size_t i = 0; i < arraySize; ++i) {
 
-        packNodeToShader(m_nodes[i], &shaderText);
+        printPackedNode(compiledTree.data()[i], shaderText);
         if (i != arraySize - 1)
             shaderText << ",";
         shaderText << "\n";
@@ -157,7 +406,7 @@ std::stringstream UVBSP::generateShader(ShaderType shaderType) const
         << "  int currentIndex = 0;\n"
 
            "  for(int iteration = 0; iteration < "
-        << getMaxDepth(0) << "; ++iteration) {\n";
+        << compiledTree.getMaxDepth() << "; ++iteration) {\n";
 
     shaderText
         << "    VEC2 pos = VEC2(REINTERPRET_TO_FLOAT(nodes[currentIndex].x), 0.0);\n"
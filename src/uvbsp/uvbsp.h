@@ -1,24 +1,275 @@
 #ifndef UVSPLIT_H
 #define UVSPLIT_H
 
-#include <SFML/Graphics/Shader.hpp>
+#include <algorithm>
 #include <bitset>
+#include <cstdint>
+#include <deque>
 #include <iostream>
-
+#include <sstream>
 #include <string>
-#include <vec2.h>
+#include <utility>
+#include <uvbsp/uvbsp_geometry.h>
+#include <uvbsp/uvbsp_math.h>
 #include <vector>
 
-typedef sf::Glsl::Vec4 Vec4;
+struct UVBSPEditorState;
+struct UVBSPProjectInfo;
 
 // clang-format off
 struct UVBSPSplit {
     UVBSPSplit() = default;
-    UVBSPSplit(vec2 pos, vec2 dir, ushort l, ushort r) : pos(pos), dir(dir), l(l), r(r) {}
-    vec2 pos, dir;
+    UVBSPSplit(bsp::vec2 pos, bsp::vec2 dir, int l, int r) : pos(pos), dir(dir), l(l), r(r) {}
+    bsp::vec2 pos, dir;
     int l, r;
 };
 // clang-format on
+
+// Shader representation of a split, see UVBSPCompiledTree
+bsp::Vec4 packNodeToShader(UVBSPSplit node);
+// Sets l, r so that after packing leftIndex is taken where dot(pos - uv, tangent) < 0
+void setPackedSides(UVBSPSplit& split, int leftIndex, int rightIndex);
+
+////////////////////////////////// UVBSP COMPILED TREE //////////////////////////////
+
+// Traversal layout generated from UVBSP nodes.
+// 16 byte nodes, the same as the shader "nodes" array: x - normalizedPos, y - tangent,
+// zw - left, right index bits. Breadth first order, so top levels visited
+// by every sample share cache lines. Root stays at index 0.
+// Edits repack only touched nodes, new nodes are appended at the end
+// (until the next compile()). Touched nodes are kept for partial uploads.
+class UVBSPCompiledTree {
+    std::vector<bsp::Vec4> m_nodes;
+    std::vector<int> m_compiledIndices; // UVBSP node index -> compiled node index
+    std::vector<int> m_sourceIndices; // compiled node index -> UVBSP node index
+    std::vector<int> m_depths; // by compiled node index, root is 1
+    std::vector<int> m_depthCounts; // number of nodes by depth, keeps m_maxDepth on removal
+    int m_maxDepth {};
+
+    std::vector<int> m_dirtyNodes; // compiled indices changed since takeDirtyRanges()
+    bool m_fullyDirty = true;
+    size_t m_packedCount {}; // since takePackedCount()
+
+    void packNode(const std::vector<UVBSPSplit>& nodes, int compiledIndex);
+
+public:
+    void compile(const std::vector<UVBSPSplit>& nodes);
+    // Node changed in place (pos, dir or colors)
+    void updateNode(const std::vector<UVBSPSplit>& nodes, int nodeIndex);
+    // nodes.back() was just linked as a child of parentIndex
+    void appendNode(const std::vector<UVBSPSplit>& nodes, int parentIndex);
+    // Last node was popped from nodes and unlinked from parentIndex.
+    // False if it is not the last compiled node, compile() is needed then.
+    bool removeLastNode(const std::vector<UVBSPSplit>& nodes, int parentIndex);
+
+    // [begin, end) runs of compiled nodes to upload, everything after compile()
+    std::vector<std::pair<int, int>> takeDirtyRanges();
+    size_t takePackedCount() { return std::exchange(m_packedCount, 0); }
+
+    const bsp::Vec4* data() const { return m_nodes.data(); }
+    size_t size() const { return m_nodes.size(); }
+    int getMaxDepth() const { return m_maxDepth; }
+    int getCompiledIndex(int nodeIndex) const { return m_compiledIndices[nodeIndex]; }
+    int getSourceIndex(int compiledIndex) const { return m_sourceIndices[compiledIndex]; }
+};
+
+////////////////////////////////// UVBSP NODE TEXTURE //////////////////////////////
+
+// Large trees reach the preview shader as a texture, compiled nodes as raw bytes:
+// 4 RGBA8 texels per node, s_nodesPerRow nodes per row (NODES_PER_ROW of BSPshader.frag).
+struct UVBSPNodeTexture {
+    static constexpr size_t s_nodesPerRow = 512;
+
+    // Calls update(nodeOffset, x, y, width, height) for the texel rectangles holding compiled
+    // nodes [firstIndex, firstIndex + count), nodeOffset counts from firstIndex
+    template <typename Update>
+    static void forEachRect(size_t firstIndex, size_t count, Update&& update)
+    {
+        size_t index = firstIndex;
+        while (count) {
+            const size_t column = index % s_nodesPerRow;
+            size_t width = std::min(count, s_nodesPerRow - column);
+            size_t height = 1;
+            if (column == 0 && count >= s_nodesPerRow) { // whole rows in one go
+                width = s_nodesPerRow;
+                height = count / s_nodesPerRow;
+            }
+            update(index - firstIndex, unsigned(column * 4), unsigned(index / s_nodesPerRow), unsigned(width * 4), unsigned(height));
+            index += width * height;
+            count -= width * height;
+        }
+    }
+};
+
+////////////////////////////////// UVBSP POINT GRID //////////////////////////////
+
+// Point location shortcut: uniform grid over the unit UV square, every grid cell keeps
+// the deepest node whose cell contains the whole grid cell, so a walk to the leaf
+// starts there instead of at the root. Containment is tested with the side test of
+// addSplit() and a margin over its float rounding, the walk ends in the same leaf.
+// Appending and removing the last node update only grid cells of its parent,
+// the grid is rebuilt at twice the resolution when the tree outgrows it.
+class UVBSPPointGrid {
+public:
+    static constexpr int s_maxResolution = 512; // grid cells per side
+
+    void build(const std::vector<UVBSPSplit>& nodes);
+    // nodes.back() was just linked as a child of parentIndex
+    void appendNode(const std::vector<UVBSPSplit>& nodes, int parentIndex);
+    // Last node was popped from nodes and unlinked from parentIndex
+    void removeLastNode(int parentIndex);
+
+    // Node to start the walk at, the root outside of the unit square
+    int getStartNode(bsp::vec2 uv) const;
+    int getDepth(int nodeIndex) const { return m_nodeInfos[nodeIndex].depth; }
+
+private:
+    struct NodeInfo {
+        int depth {}; // root is 1, 0 if unreachable
+        int minX = s_maxResolution, minY = s_maxResolution, maxX = -1, maxY = -1; // of grid cells pointing to the node
+    };
+
+    struct Block {
+        int nodeIndex, x, y, width, height; // rectangle of grid cells
+    };
+
+    // Grid cells of the rectangle pointing to fromNode go down the tree while they stay on one side
+    void moveDown(const std::vector<UVBSPSplit>& nodes, int fromNode, int x, int y, int width, int height);
+
+    int m_resolution = 1; // power of two, grows with the tree
+    std::vector<int> m_startNodes; // by grid cell, row major
+    std::vector<NodeInfo> m_nodeInfos; // by node index
+    std::vector<Block> m_blocks; // moveDown() stack, kept for its capacity
+};
+
+////////////////////////////////// UVBSP POINT LOCATION //////////////////////////////
+
+// Leaf reached from a UV position, sides as in UVBSPSplit: 0 - l, 1 - r
+struct UVBSPPointLocation {
+    int nodeIndex {}; // last node of the path
+    int side {};
+    int colorIndex {};
+    int depth {}; // of the node, root is 1
+    int startNodeIndex {}; // where the walk started, see UVBSPPointGrid
+
+    std::string getInfo() const
+    {
+        return "Leaf: node " + std::to_string(nodeIndex) + (side == 0 ? " left" : " right")
+            + "   Color: " + std::to_string(colorIndex)
+            + "   Depth: " + std::to_string(depth);
+    }
+};
+
+////////////////////////////////// UVBSP TREE STATS //////////////////////////////
+
+// Shape of the tree reachable from the root, kept up to date by addSplit() and undo / redo,
+// every query is O(1). A leaf is a color side of a node, at the depth of that node.
+// Inserting or removing the last node walks its ancestors only.
+class UVBSPTreeStats {
+public:
+    void build(const std::vector<UVBSPSplit>& nodes);
+    // nodes.back() replaced the previousColor side of parentIndex
+    void appendNode(const std::vector<UVBSPSplit>& nodes, int parentIndex, int previousColor);
+    // nodes.back() is about to be popped, parentIndex already has restoredColor in its place
+    void removeLastNode(const std::vector<UVBSPSplit>& nodes, int parentIndex, int restoredColor);
+
+    int getDepth(int nodeIndex) const { return m_nodeStats[nodeIndex].depth; } // root is 1, 0 if unreachable
+    int getHeight(int nodeIndex) const { return m_nodeStats[nodeIndex].height; } // nodes on the longest path down
+    int getLeafCount(int nodeIndex) const { return m_nodeStats[nodeIndex].leafCount; } // of the subtree
+
+    int getMaxDepth() const { return m_maxDepth; }
+    int getLeafCount() const { return m_nodeStats.empty() ? 0 : m_nodeStats[0].leafCount; }
+    double getAverageLeafDepth() const { return getLeafCount() ? double(m_leafDepthSum) / getLeafCount() : 0.0; }
+    const std::vector<int>& getLeafDepthCounts() const { return m_leafDepthCounts; } // by depth
+    const std::vector<int>& getColorLeafCounts() const { return m_colorLeafCounts; } // by color index
+    int getUsedColorCount() const { return m_usedColorCount; } // colors with a leaf
+
+private:
+    struct NodeStats {
+        int parent = -1;
+        int depth {}, height {}, leafCount {};
+    };
+
+    void addLeaves(int depth, int count);
+    void addColorLeaf(int colorIndex, int count);
+    int getChildHeight(int childIndex) const { return childIndex < 0 ? m_nodeStats[-childIndex].height : 0; }
+
+    std::vector<NodeStats> m_nodeStats; // by node index
+    std::vector<int> m_leafDepthCounts;
+    std::vector<int> m_colorLeafCounts;
+    long long m_leafDepthSum {};
+    int m_maxDepth {};
+    int m_usedColorCount {};
+};
+
+////////////////////////////////// UVBSP CELLS //////////////////////////////
+
+// Part of the unit UV square covered by a node, and its two sides.
+// Sides are in packed order: 0 - dot(pos - uv, tangent) < 0, 1 - the other one.
+struct UVBSPCell {
+    UVRegion region;
+    UVRegion sides[2];
+    int sideIndices[2] {}; // node(less than 0) or color(greater equal 0)
+    bool valid {};
+};
+
+struct UVBSPLeaf {
+    int nodeIndex;
+    int side;
+    int colorIndex;
+    const UVRegion* region;
+};
+
+////////////////////////////////// UVBSP ADD RECORD //////////////////////////////
+
+// Inverse of addSplit(): the one child reference replaced by the new node.
+// The new node is always the last one, so undo and redo are O(1).
+struct UVBSPAddRecord {
+    int parentIndex {}; // -1 if the split replaced the initial root
+    int side {}; // 0 - l, 1 - r of the parent
+    int previousChild {}; // color index before the split
+    UVBSPSplit split;
+};
+
+////////////////////////////////// UVBSP UPLOAD STATS //////////////////////////////
+
+struct UVBSPUploadStats {
+    size_t nodesPacked {};
+    size_t nodesUploaded {};
+    size_t bytesUploaded {};
+    size_t uploadCalls {};
+
+    std::string getInfo() const
+    {
+        return "Packed: " + std::to_string(nodesPacked)
+            + "   Uploaded: " + std::to_string(nodesUploaded) + " nodes, " + std::to_string(bytesUploaded) + " bytes"
+            + " in " + std::to_string(uploadCalls) + " calls";
+    }
+};
+
+////////////////////////////////// UVBSP OPTIMIZE REPORT //////////////////////////////
+
+struct UVBSPOptimizeReport {
+    int depthBefore {}, depthAfter {};
+    size_t nodesBefore {}, nodesAfter {};
+    size_t samplesChecked {}, mismatchedSamples {};
+    bool applied {}; // tree is kept only if every sample matched
+    // removed by simplify()
+    size_t linesOutsideCell {}, sameColorSplits {}, deadNodes {};
+
+    std::string getInfo() const
+    {
+        const bool isSimplified = linesOutsideCell || sameColorSplits || deadNodes;
+        return "Depth: " + std::to_string(depthBefore) + " -> " + std::to_string(depthAfter)
+            + "   Nodes: " + std::to_string(nodesBefore) + " -> " + std::to_string(nodesAfter)
+            + (isSimplified ? "   Removed: " + std::to_string(linesOutsideCell) + " outside of cell, "
+                       + std::to_string(sameColorSplits) + " same color, " + std::to_string(deadNodes) + " dead"
+                            : "")
+            + "   Mismatched samples: " + std::to_string(mismatchedSamples) + "/" + std::to_string(samplesChecked)
+            + (applied ? "" : "   (reverted)");
+    }
+};
+
 ////////////////////////////////// UVBSP //////////////////////////////
 
 class UVBSP {
@@ -29,10 +280,37 @@ public:
         UnrealCustomNode
     };
 
+    enum class ShaderCodeForm {
+        NodeArray, // constant node array and a loop, the smallest code
+        Unrolled, // nested branches and select networks with literal constants, see UVBSPUnrolledShader
+        HalfPacked // two nodes per vector, see UVBSPHalfNodes. Empty if a split can't be packed
+    };
+
+    enum class ClassifyMode {
+        Scalar,
+        Simd, // 8 (AVX2) or 4 (SSE2) samples per step, masked descent
+        Coherent // Morton sorted samples, reuses path of previous sample
+    };
+
+    enum class BalanceCost {
+        MaxDepth, // balance the number of lines on both sides
+        ExpectedDepth // weight sides by area, short paths where most of UV is
+    };
+
 private:
     std::vector<UVBSPSplit> m_nodes;
-    std::vector<Vec4> m_packedStructs;
+    mutable UVBSPCompiledTree m_compiledTree;
+    mutable bool m_compiledTreeDirty = true;
+    mutable std::vector<UVBSPCell> m_cells; // by node index, computed on demand
+    mutable bool m_cellsDirty = true;
+    static constexpr size_t s_pointGridMinNodes = 256;
+    mutable UVBSPPointGrid m_pointGrid; // built by locate() from s_pointGridMinNodes nodes
+    mutable bool m_pointGridDirty = true;
+    mutable UVBSPTreeStats m_treeStats;
+    mutable bool m_treeStatsDirty = true;
     UVBSPSplit* m_currentNode {};
+    UVBSPUploadStats m_uploadStats; // since takeUploadStats()
+    UVBSPAddRecord m_lastAddRecord;
 
     bool m_initialSet {};
 
@@ -41,34 +319,102 @@ public:
 
     UVBSP() { reset(); }
 
-    int getMaxDepth(int nodeIndex) const
-    {
-        int left {}, right {};
-        if (m_nodes[-nodeIndex].l < 0)
-            left = getMaxDepth(m_nodes[-nodeIndex].l);
-        if (m_nodes[-nodeIndex].r < 0)
-            right = getMaxDepth(m_nodes[-nodeIndex].r);
-        return std::max(left, right) + 1;
-    }
+    // Depth of the subtree, nodeIndex is a node reference (0 for the root, negative for others).
+    // 0 for nodes not reachable from the root.
+    int getMaxDepth(int nodeIndex) const { return getTreeStats().getHeight(-nodeIndex); }
 
     size_t getNumNodes() const { return m_nodes.size(); }
+    const std::vector<UVBSPSplit>& getNodes() const { return m_nodes; }
+    int getColorCount() const; // highest color index + 1
 
     void addSplit(UVBSPSplit split);
 
-    void adjustSplit(const vec2& uvDir)
+    void adjustSplit(const bsp::vec2& uvDir)
     {
-        if (m_currentNode)
+        if (m_currentNode) {
             m_currentNode->dir = uvDir;
+            if (!m_compiledTreeDirty)
+                m_compiledTree.updateNode(m_nodes, m_currentNode - m_nodes.data());
+            invalidateCells(m_currentNode - m_nodes.data());
+            // grid cells stop at the node while both sides are colors
+            if (m_currentNode->l < 0 || m_currentNode->r < 0)
+                m_pointGridDirty = true;
+        }
     }
 
-    void updateUniforms(sf::Shader& shader);
+    // Leaf under uv with the side test of addSplit(), the walk starts at the point grid
+    UVBSPPointLocation locate(bsp::vec2 uv) const;
+
+    // Compiled on demand, compile it before sharing the tree between threads
+    const UVBSPCompiledTree& getCompiledTree() const;
+    // Built on demand, then updated with every edit
+    const UVBSPTreeStats& getTreeStats() const;
+
+    // Calls upload(firstIndex, nodes, count) for every run of compiled nodes
+    // changed since the previous call, all of them after a full compile
+    template <typename Upload>
+    void updateUniforms(Upload&& upload)
+    {
+        const UVBSPCompiledTree& compiledTree = getCompiledTree();
+        m_uploadStats.nodesPacked += m_compiledTree.takePackedCount();
 
-    bool readFromFile(const std::string& path);
-    void writeToFile(const std::string& path);
+        for (auto [begin, end] : m_compiledTree.takeDirtyRanges()) {
+            upload(begin, compiledTree.data() + begin, size_t(end - begin));
+
+            m_uploadStats.nodesUploaded += end - begin;
+            m_uploadStats.bytesUploaded += (end - begin) * sizeof(bsp::Vec4);
+            m_uploadStats.uploadCalls++;
+        }
+    }
+    UVBSPUploadStats takeUploadStats() { return std::exchange(m_uploadStats, {}); }
+
+    // Same index as traverseTree() in BSPshader.frag and generateShader() output
+    int classify(bsp::vec2 uv) const;
+    void classify(const bsp::vec2* uvs, size_t count, int* out, ClassifyMode mode = ClassifyMode::Simd) const;
+
+    // Binary format of uvbsp_file.h, old base64 files and JSON projects are read too.
+    // Editor state (color, history) is optional.
+    bool readFromFile(const std::string& path, UVBSPEditorState* state = nullptr);
+    bool writeToFile(const std::string& path, const UVBSPEditorState* state = nullptr) const;
+    // JSON project of uvbsp_json.h, readFromFile() opens it too.
+    // Streamed with to_chars / from_chars, nodes are parsed straight into the tree.
+    bool readFromJson(const std::string& path, UVBSPEditorState* state = nullptr, UVBSPProjectInfo* info = nullptr);
+    bool writeToJson(const std::string& path, const UVBSPEditorState* state = nullptr, const UVBSPProjectInfo* info = nullptr) const;
 
     void reset();
+    // Whole tree at once, root first, child references as in UVBSPSplit. Undo history is not kept
+    void assignNodes(std::vector<UVBSPSplit> nodes);
 
     const UVBSPSplit* getLastNode() const { return m_currentNode; }
+    // adjustSplit() and getLastNode() are off until the next addSplit()
+    void finishSplit() { m_currentNode = nullptr; }
+
+    // Record of the last addSplit(), with adjustSplit() changes
+    UVBSPAddRecord getLastAddRecord() const
+    {
+        UVBSPAddRecord record = m_lastAddRecord;
+        if (m_currentNode)
+            record.split = *m_currentNode;
+        return record;
+    }
+    // False if record is not the last applied action
+    bool undoAddSplit(const UVBSPAddRecord& record);
+    bool redoAddSplit(const UVBSPAddRecord& record);
+
+    // Cell geometry, clipped from the unit UV square down the tree.
+    // Cached, addSplit() and adjustSplit() invalidate only the touched subtree.
+    const UVBSPCell& getCell(int nodeIndex) const;
+    std::vector<UVBSPLeaf> getLeaves() const;
+    double getColorArea(int colorIndex) const; // fraction of the unit UV square
+
+    // Rebuilds the same partition of the unit UV square with a shallower tree,
+    // splitting lines are picked by cost and clipped into sub-cells.
+    // Checked on verifyResolution^2 texel centers, the old tree is restored on any mismatch.
+    UVBSPOptimizeReport rebalance(BalanceCost cost = BalanceCost::MaxDepth, int verifyResolution = 1024);
+    // Same partition with fewer nodes: drops splits whose line misses their cell,
+    // splits with one color on both sides and subtrees no sample can reach.
+    // Checked and restored the same way as rebalance().
+    UVBSPOptimizeReport simplify(int verifyResolution = 1024);
 
     // STRINGS ! //
 public:
@@ -78,52 +424,99 @@ public:
     }
 
     std::string printNodes();
-    std::string getBasicInfo()
+    std::string getBasicInfo() const
     {
+        const UVBSPTreeStats& stats = getTreeStats();
         return "Node count: " + std::to_string(getNumNodes())
-            + "   Tree depth: " + std::to_string(getMaxDepth(0));
+            + "   Tree depth: " + std::to_string(stats.getMaxDepth())
+            + "   Leaves: " + std::to_string(stats.getLeafCount());
     }
-    std::stringstream generateShader(ShaderType shaderType) const;
+    std::stringstream generateShader(ShaderType shaderType, ShaderCodeForm codeForm = ShaderCodeForm::NodeArray) const;
+
+private:
+    bool readLegacyFile(const std::string& path);
+    // Swaps in newNodes if classify() agrees on verifyResolution^2 texel centers
+    bool replaceNodesIfSame(std::vector<UVBSPSplit>& newNodes, int verifyResolution, UVBSPOptimizeReport& report);
+    void invalidateCells(int nodeIndex);
+    void updateCells() const;
 };
 
 ////////////////////////////////// UVBSP HISTORY //////////////////////////////
 
 class UVBSPActionHistory {
 public:
-    UVBSPActionHistory(UVBSP& uvSplit)
-        : m_uvSplit(uvSplit)
+    static constexpr size_t s_defaultMemoryBudget = 32 << 20; // bytes, ~900k splits
+
+    UVBSPActionHistory(UVBSP& uvSplit, size_t memoryBudget = s_defaultMemoryBudget)
+        : m_memoryBudget(memoryBudget)
+        , m_uvSplit(uvSplit)
     {
     }
 
-    void add(const UVBSPSplit& action)
+    // Drops undone actions, and the oldest ones over the memory budget
+    void add(const UVBSPAddRecord& action)
     {
-        if (m_drawHistory.size() > m_currentIndex)
-            m_drawHistory[m_currentIndex] = action;
-        else
-            m_drawHistory.push_back(action);
-
-        // assert(false && "m_currentIndex is beyond drawHistory size");
-
+        m_drawHistory.resize(m_currentIndex);
+        m_drawHistory.push_back(action);
         m_currentIndex++;
+        trimToBudget();
     }
 
     bool undo()
     {
-        if (m_currentIndex > 0) {
-            m_uvSplit.reset();
-            for (int i = 0; i < m_currentIndex - 1; ++i) {
-                const auto& action = m_drawHistory[i];
-                m_uvSplit.addSplit(action);
-            }
+        if (m_currentIndex > 0 && m_uvSplit.undoAddSplit(m_drawHistory[m_currentIndex - 1])) {
             m_currentIndex--;
             return true;
         }
         return false;
     }
 
+    bool redo()
+    {
+        if (m_currentIndex < m_drawHistory.size() && m_uvSplit.redoAddSplit(m_drawHistory[m_currentIndex])) {
+            m_currentIndex++;
+            return true;
+        }
+        return false;
+    }
+
+    // Node indices of records are invalid after load or rebalance
+    void clear()
+    {
+        m_drawHistory.clear();
+        m_currentIndex = 0;
+    }
+
+    // Saved with the tree, see UVBSPEditorState
+    std::vector<UVBSPAddRecord> getRecords() const { return { m_drawHistory.begin(), m_drawHistory.end() }; }
+    size_t getCurrentIndex() const { return m_currentIndex; }
+    void assign(const std::vector<UVBSPAddRecord>& records, size_t currentIndex)
+    {
+        m_drawHistory.assign(records.begin(), records.end());
+        m_currentIndex = std::min(currentIndex, records.size());
+        trimToBudget();
+    }
+
+    void setMemoryBudget(size_t bytes)
+    {
+        m_memoryBudget = bytes;
+        trimToBudget();
+    }
+    size_t getMemoryUsage() const { return m_drawHistory.size() * sizeof(UVBSPAddRecord); }
+
 private:
-    std::vector<UVBSPSplit> m_drawHistory;
-    int m_currentIndex {};
+    void trimToBudget()
+    {
+        while (!m_drawHistory.empty() && getMemoryUsage() > m_memoryBudget) {
+            m_drawHistory.pop_front();
+            if (m_currentIndex > 0)
+                m_currentIndex--;
+        }
+    }
+
+    std::deque<UVBSPAddRecord> m_drawHistory;
+    size_t m_currentIndex {}; // actions before it are applied
+    size_t m_memoryBudget;
     UVBSP& m_uvSplit;
 };
 
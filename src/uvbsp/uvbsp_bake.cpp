@@ -0,0 +1,182 @@
+#include "image_writer.h"
+#include "parallel_for.h"
+#include <atomic>
+#include <chrono>
+#include <uvbsp/uvbsp_bake.h>
+#include <uvbsp/uvbsp_traversal.h>
+
+#ifndef LOG
+#define LOG(x) std::cout << x << std::endl
+#endif
+
+namespace {
+
+constexpr uint32_t s_minSplitArea = 16; // smaller mixed rects are traversed per texel
+constexpr size_t s_maxBandBytes = 16 << 20;
+
+template <typename T>
+struct BandContext {
+    const bsp::Vec4* nodes;
+    int maxDepth;
+    uint32_t width, height;
+    T* band; // rows [bandY, bandY + bandHeight)
+    uint32_t bandY;
+    size_t uniformTiles, traversedTexels;
+};
+
+// The side test is monotonic in u and in v (rounding included), so the texel
+// centers at the corners of a rect hold its min and max: when all corners
+// agree, every texel inside agrees, same as if they were traversed one by one.
+template <typename T>
+void fillRect(BandContext<T>& context, uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1, int nodeIndex, int depth)
+{
+    const bsp::vec2 corners[4] = {
+        getTexelCenter(x0, y0, context.width, context.height),
+        getTexelCenter(x1 - 1, y0, context.width, context.height),
+        getTexelCenter(x0, y1 - 1, context.width, context.height),
+        getTexelCenter(x1 - 1, y1 - 1, context.width, context.height)
+    };
+
+    for (; depth < context.maxDepth; ++depth) {
+        const bsp::Vec4& node = context.nodes[nodeIndex];
+        int leftCorners = 0;
+        for (const bsp::vec2& corner : corners)
+            leftCorners += isLeftPixel(node, corner);
+        if (leftCorners != 0 && leftCorners != 4)
+            break;
+
+        int indexOfProperSide = floatBitsToInt(leftCorners ? node.z : node.w);
+        if (indexOfProperSide < 0) {
+            nodeIndex = -indexOfProperSide;
+        } else {
+            for (uint32_t y = y0; y < y1; ++y)
+                std::fill_n(context.band + size_t(y - context.bandY) * context.width + x0, x1 - x0, T(indexOfProperSide));
+            context.uniformTiles++;
+            return;
+        }
+    }
+    if (depth == context.maxDepth) // same as traverseTree() running out of iterations
+        nodeIndex = -1;
+
+    const uint32_t width = x1 - x0, height = y1 - y0;
+    if (width * height <= s_minSplitArea || nodeIndex < 0) {
+        for (uint32_t y = y0; y < y1; ++y) {
+            T* row = context.band + size_t(y - context.bandY) * context.width;
+            for (uint32_t x = x0; x < x1; ++x) {
+                bsp::vec2 uv = getTexelCenter(x, y, context.width, context.height);
+                row[x] = T(nodeIndex < 0 ? 0 : traverseTree(context.nodes, context.maxDepth - depth, uv, nodeIndex));
+            }
+        }
+        context.traversedTexels += width * height;
+        return;
+    }
+
+    // quadrants, continuing from the node where corners disagreed
+    const uint32_t xm = x0 + (width + 1) / 2, ym = y0 + (height + 1) / 2;
+    fillRect(context, x0, y0, xm, ym, nodeIndex, depth);
+    if (xm < x1)
+        fillRect(context, xm, y0, x1, ym, nodeIndex, depth);
+    if (ym < y1) {
+        fillRect(context, x0, ym, xm, y1, nodeIndex, depth);
+        if (xm < x1)
+            fillRect(context, xm, ym, x1, y1, nodeIndex, depth);
+    }
+}
+
+} // namespace
+
+bool UVBSPIndexBaker::bake(const std::string& path, const Settings& settings, Stats* stats) const
+{
+    Stats localStats;
+    auto start = std::chrono::steady_clock::now();
+    bool result = settings.is16Bit
+        ? bakeToFile<uint16_t>(path, settings, localStats)
+        : bakeToFile<uint8_t>(path, settings, localStats);
+    localStats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    if (stats)
+        *stats = localStats;
+    return result;
+}
+
+void UVBSPIndexBaker::bakeRows(const Settings& settings, uint32_t y0, uint32_t rowCount, uint16_t* rows, Stats* stats) const
+{
+    const UVBSPCompiledTree& compiledTree = m_uvbsp.getCompiledTree();
+    const uint32_t tileSize = std::max(settings.tileSize, 1u);
+    const uint32_t y1 = std::min(y0 + rowCount, settings.height);
+    BandContext<uint16_t> context { compiledTree.data(), compiledTree.getMaxDepth(),
+        settings.width, settings.height, rows, y0, 0, 0 };
+    for (uint32_t tileY = y0; tileY < y1; tileY += tileSize)
+        for (uint32_t tileX = 0; tileX < settings.width; tileX += tileSize)
+            fillRect(context, tileX, tileY, std::min(tileX + tileSize, settings.width), std::min(tileY + tileSize, y1), 0, 0);
+
+    if (stats) {
+        stats->uniformTiles += context.uniformTiles;
+        stats->traversedTexels += context.traversedTexels;
+    }
+}
+
+int UVBSPIndexBaker::getMaxColorIndex() const
+{
+    const UVBSPCompiledTree& compiledTree = m_uvbsp.getCompiledTree();
+    int maxColorIndex = 0;
+    for (size_t i = 0; i < compiledTree.size(); ++i) {
+        const bsp::Vec4& node = compiledTree.data()[i];
+        maxColorIndex = std::max({ maxColorIndex, floatBitsToInt(node.z), floatBitsToInt(node.w) });
+    }
+    return maxColorIndex;
+}
+
+template <typename T>
+bool UVBSPIndexBaker::bakeToFile(const std::string& path, const Settings& settings, Stats& stats) const
+{
+    const UVBSPCompiledTree& compiledTree = m_uvbsp.getCompiledTree();
+    const uint32_t width = settings.width, height = settings.height;
+    const uint32_t tileSize = std::max(settings.tileSize, 1u);
+
+    const int maxColorIndex = getMaxColorIndex();
+    if (maxColorIndex > std::numeric_limits<T>::max()) {
+        LOG("Color index " << maxColorIndex << " does not fit into " << sizeof(T) * 8 << " bits");
+        return false;
+    }
+
+    StreamingImageWriter writer;
+    if (!writer.open(path, StreamingImageWriter::getFormatFromPath(path), width, height, 1, sizeof(T) * 8)) {
+        LOG("Failed to open image for writing: " << path);
+        return false;
+    }
+
+    // whole tile rows per band, bounded memory
+    const size_t rowBytes = size_t(width) * sizeof(T);
+    const uint32_t bandTileRows = std::max<uint32_t>(1, s_maxBandBytes / (rowBytes * tileSize));
+    const uint32_t bandHeight = std::min(height, bandTileRows * tileSize);
+    const uint32_t tilesX = (width + tileSize - 1) / tileSize;
+    std::vector<T> band(size_t(width) * bandHeight);
+
+    std::atomic<size_t> uniformTiles { 0 }, traversedTexels { 0 };
+    for (uint32_t bandY = 0; bandY < height; bandY += bandHeight) {
+        const uint32_t rows = std::min(bandHeight, height - bandY);
+        const uint32_t tilesY = (rows + tileSize - 1) / tileSize;
+
+        parallelFor(
+            size_t(tilesX) * tilesY, [&](size_t tileIndex) {
+                BandContext<T> context { compiledTree.data(), compiledTree.getMaxDepth(),
+                    width, height, band.data(), bandY, 0, 0 };
+                uint32_t x0 = uint32_t(tileIndex % tilesX) * tileSize;
+                uint32_t y0 = bandY + uint32_t(tileIndex / tilesX) * tileSize;
+                fillRect(context, x0, y0, std::min(x0 + tileSize, width), std::min(y0 + tileSize, bandY + rows), 0, 0);
+                uniformTiles += context.uniformTiles;
+                traversedTexels += context.traversedTexels;
+            },
+            settings.threadCount);
+
+        if (!writer.writeRows(band.data(), rows)) {
+            LOG("Failed to write image rows: " << path);
+            return false;
+        }
+    }
+
+    stats.uniformTiles = uniformTiles;
+    stats.traversedTexels = traversedTexels;
+    return writer.close();
+}
@@ -0,0 +1,58 @@
+#ifndef UVBSP_BAKE_H
+#define UVBSP_BAKE_H
+
+#include <uvbsp/uvbsp.h>
+
+////////////////////////////////// UVBSP INDEX BAKER //////////////////////////////
+
+// Bakes the partition into an R8/R16 image of color indices, for platforms
+// that prefer a texture lookup to the tree walk.
+// Tiles are classified by their corners first and filled in one go when they are
+// inside of one cell, texels are traversed one by one only along split lines.
+// Rows are written band by band, a band is the only part of the image in memory.
+
+class UVBSPIndexBaker {
+public:
+    struct Settings {
+        uint32_t width = 4096, height = 4096;
+        bool is16Bit = true;
+        uint32_t tileSize = 64;
+        unsigned threadCount = 0; // all cores
+    };
+
+    struct Stats {
+        size_t uniformTiles {}, traversedTexels {};
+        double seconds {};
+
+        std::string getInfo() const
+        {
+            return "Uniform tiles: " + std::to_string(uniformTiles)
+                + "   Traversed texels: " + std::to_string(traversedTexels)
+                + "   Time: " + std::to_string(seconds) + "s";
+        }
+    };
+
+    UVBSPIndexBaker(const UVBSP& uvbsp)
+        : m_uvbsp(uvbsp)
+    {
+    }
+
+    // Format by extension: png, tga (8 bit only), anything else is raw little endian
+    bool bake(const std::string& path, const Settings& settings, Stats* stats = nullptr) const;
+
+    // Rows [y0, y0 + rowCount) of the settings.width x height image into memory, one thread.
+    // Thread safe once the tree is compiled, callers run bands in parallel.
+    // Indices above 65535 are cut to 16 bits, see getMaxColorIndex()
+    void bakeRows(const Settings& settings, uint32_t y0, uint32_t rowCount, uint16_t* rows, Stats* stats = nullptr) const;
+
+    // Largest color index the tree can return
+    int getMaxColorIndex() const;
+
+private:
+    template <typename T>
+    bool bakeToFile(const std::string& path, const Settings& settings, Stats& stats) const;
+
+    const UVBSP& m_uvbsp;
+};
+
+#endif // UVBSP_BAKE_H
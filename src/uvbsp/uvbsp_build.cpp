@@ -0,0 +1,418 @@
+#include "image_reader.h"
+#include "parallel_for.h"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <queue>
+#include <unordered_map>
+#include <uvbsp/uvbsp_build.h>
+#include <uvbsp/uvbsp_traversal.h>
+
+#if defined(__GNUC__) && defined(__SSE2__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define UVBSP_X86_SIMD
+#endif
+
+namespace {
+
+constexpr size_t s_maxHistogramSize = 1 << 20; // bins x labels of one direction
+constexpr size_t s_minTexelsPerThread = 1 << 14; // fewer texels per thread do not pay for starting it
+constexpr size_t s_projectionChunk = 1024;
+constexpr double s_pi = 3.14159265358979323846;
+
+// Threads worth starting for texelCount texels, small cells run on the calling thread
+unsigned getCellThreadCount(size_t texelCount, unsigned threadCount)
+{
+    return unsigned(std::clamp<size_t>(texelCount / s_minTexelsPerThread, 1, getThreadCount(threadCount)));
+}
+
+// Texels of all cells, a cell is a range that is partitioned in place when it is split
+struct Texels {
+    std::vector<uint16_t> xs, ys, labels;
+
+    void swap(size_t a, size_t b)
+    {
+        std::swap(xs[a], xs[b]);
+        std::swap(ys[a], ys[b]);
+        std::swap(labels[a], labels[b]);
+    }
+};
+
+struct Cell {
+    size_t begin, end;
+    int depth;
+    int parentNode; // -1 for the root
+    int side; // packed side of the parent
+    int majorityLabel;
+    size_t misclassified;
+
+    bool operator<(const Cell& other) const { return misclassified < other.misclassified; }
+};
+
+// Line dot(uv, (cos, sin)) = threshold
+struct Candidate {
+    double score = -1; // sum of squared label counts by count of both sides, higher is purer
+    int angle {};
+    float threshold {};
+};
+
+struct Projection {
+    float cosA, sinA;
+    float invWidth, invHeight;
+    float tMin, scale, maxBin;
+};
+
+// Labels of one cell renumbered from 0, with counts and texel bounds
+struct CellLabels {
+    std::vector<uint16_t> localLabels; // by texel of the cell
+    std::vector<uint32_t> totals; // by local label
+    uint32_t xMin, xMax, yMin, yMax;
+};
+
+#ifdef UVBSP_X86_SIMD
+size_t projectToBinsSSE2(const uint16_t* xs, const uint16_t* ys, size_t count, const Projection& projection, int32_t* bins)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128 half = _mm_set1_ps(0.5f);
+    const __m128 invWidth = _mm_set1_ps(projection.invWidth), invHeight = _mm_set1_ps(projection.invHeight);
+    const __m128 cosA = _mm_set1_ps(projection.cosA), sinA = _mm_set1_ps(projection.sinA);
+    const __m128 tMin = _mm_set1_ps(projection.tMin), scale = _mm_set1_ps(projection.scale);
+    const __m128 minBin = _mm_setzero_ps(), maxBin = _mm_set1_ps(projection.maxBin);
+
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m128i x16 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(xs + i));
+        const __m128i y16 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ys + i));
+        const __m128i x32[2] = { _mm_unpacklo_epi16(x16, zero), _mm_unpackhi_epi16(x16, zero) };
+        const __m128i y32[2] = { _mm_unpacklo_epi16(y16, zero), _mm_unpackhi_epi16(y16, zero) };
+        for (int part = 0; part < 2; ++part) {
+            __m128 u = _mm_mul_ps(_mm_add_ps(_mm_cvtepi32_ps(x32[part]), half), invWidth);
+            __m128 v = _mm_mul_ps(_mm_add_ps(_mm_cvtepi32_ps(y32[part]), half), invHeight);
+            __m128 t = _mm_add_ps(_mm_mul_ps(u, cosA), _mm_mul_ps(v, sinA));
+            __m128 bin = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_sub_ps(t, tMin), scale), minBin), maxBin);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(bins + i + 4 * part), _mm_cvttps_epi32(bin));
+        }
+    }
+    return i;
+}
+#endif
+
+// Offset bin of every texel along the direction, the same math for the tail
+void projectToBins(const uint16_t* xs, const uint16_t* ys, size_t count, const Projection& projection, int32_t* bins)
+{
+    size_t processed = 0;
+#ifdef UVBSP_X86_SIMD
+    processed = projectToBinsSSE2(xs, ys, count, projection, bins);
+#endif
+    for (size_t i = processed; i < count; ++i) {
+        float u = (xs[i] + 0.5f) * projection.invWidth;
+        float v = (ys[i] + 0.5f) * projection.invHeight;
+        float bin = ((u * projection.cosA + v * projection.sinA) - projection.tMin) * projection.scale;
+        bins[i] = int32_t(std::min(std::max(bin, 0.f), projection.maxBin));
+    }
+}
+
+void getMajority(const Texels& texels, size_t begin, size_t end, std::vector<uint32_t>& counts, int& majorityLabel, size_t& misclassified)
+{
+    uint32_t majorityCount = 0;
+    majorityLabel = texels.labels[begin];
+    for (size_t i = begin; i < end; ++i) {
+        uint32_t count = ++counts[texels.labels[i]];
+        if (count > majorityCount) {
+            majorityCount = count;
+            majorityLabel = texels.labels[i];
+        }
+    }
+    for (size_t i = begin; i < end; ++i)
+        counts[texels.labels[i]] = 0;
+    misclassified = (end - begin) - majorityCount;
+}
+
+void getCellLabels(const Texels& texels, const Cell& cell, std::vector<int>& localIndices, CellLabels& cellLabels)
+{
+    cellLabels.localLabels.resize(cell.end - cell.begin);
+    cellLabels.totals.clear();
+    cellLabels.xMin = cellLabels.yMin = UINT32_MAX;
+    cellLabels.xMax = cellLabels.yMax = 0;
+    for (size_t i = cell.begin; i < cell.end; ++i) {
+        int& localIndex = localIndices[texels.labels[i]];
+        if (localIndex < 0) {
+            localIndex = cellLabels.totals.size();
+            cellLabels.totals.push_back(0);
+        }
+        cellLabels.totals[localIndex]++;
+        cellLabels.localLabels[i - cell.begin] = uint16_t(localIndex);
+        cellLabels.xMin = std::min<uint32_t>(cellLabels.xMin, texels.xs[i]);
+        cellLabels.xMax = std::max<uint32_t>(cellLabels.xMax, texels.xs[i]);
+        cellLabels.yMin = std::min<uint32_t>(cellLabels.yMin, texels.ys[i]);
+        cellLabels.yMax = std::max<uint32_t>(cellLabels.yMax, texels.ys[i]);
+    }
+    for (size_t i = cell.begin; i < cell.end; ++i)
+        localIndices[texels.labels[i]] = -1;
+}
+
+// Best offset along one direction, by label histograms of offset bins
+Candidate evaluateDirection(const Texels& texels, const Cell& cell, const CellLabels& cellLabels,
+    int angle, int angleCount, int binCount, uint32_t width, uint32_t height)
+{
+    Candidate best;
+    best.angle = angle;
+
+    const double radians = s_pi * angle / angleCount;
+    Projection projection;
+    projection.cosA = float(std::cos(radians));
+    projection.sinA = float(std::sin(radians));
+    projection.invWidth = 1.f / width;
+    projection.invHeight = 1.f / height;
+
+    float tMin = INFINITY, tMax = -INFINITY;
+    for (uint32_t x : { cellLabels.xMin, cellLabels.xMax }) {
+        for (uint32_t y : { cellLabels.yMin, cellLabels.yMax }) {
+            float t = (x + 0.5f) * projection.invWidth * projection.cosA + (y + 0.5f) * projection.invHeight * projection.sinA;
+            tMin = std::min(tMin, t);
+            tMax = std::max(tMax, t);
+        }
+    }
+    if (!(tMax > tMin))
+        return best;
+    projection.tMin = tMin;
+    projection.scale = binCount / (tMax - tMin);
+    projection.maxBin = float(binCount - 1);
+
+    const size_t labelCount = cellLabels.totals.size();
+    std::vector<uint32_t> histogram(size_t(binCount) * labelCount);
+    int32_t bins[s_projectionChunk];
+    for (size_t chunk = cell.begin; chunk < cell.end; chunk += s_projectionChunk) {
+        const size_t count = std::min(s_projectionChunk, cell.end - chunk);
+        projectToBins(texels.xs.data() + chunk, texels.ys.data() + chunk, count, projection, bins);
+        const uint16_t* localLabels = cellLabels.localLabels.data() + (chunk - cell.begin);
+        for (size_t i = 0; i < count; ++i)
+            histogram[size_t(bins[i]) * labelCount + localLabels[i]]++;
+    }
+
+    // sweep the offset, sums of squares are updated by the counts of one bin
+    std::vector<uint32_t> leftCounts(labelCount);
+    int64_t leftSquares = 0, rightSquares = 0;
+    for (uint32_t total : cellLabels.totals)
+        rightSquares += int64_t(total) * total;
+    size_t leftTexels = 0, rightTexels = cell.end - cell.begin;
+    for (int bin = 0; bin + 1 < binCount; ++bin) {
+        const uint32_t* binCounts = histogram.data() + size_t(bin) * labelCount;
+        for (size_t label = 0; label < labelCount; ++label) {
+            const int64_t count = binCounts[label];
+            if (!count)
+                continue;
+            const int64_t left = leftCounts[label], right = cellLabels.totals[label] - left;
+            leftSquares += 2 * left * count + count * count;
+            rightSquares += count * count - 2 * right * count;
+            leftCounts[label] += count;
+            leftTexels += count;
+            rightTexels -= count;
+        }
+        if (!leftTexels || !rightTexels)
+            continue;
+        const double score = double(leftSquares) / leftTexels + double(rightSquares) / rightTexels;
+        if (score > best.score) {
+            best.score = score;
+            best.threshold = tMin + (bin + 1) / projection.scale;
+        }
+    }
+    return best;
+}
+
+} // namespace
+
+////////////////////////////////// UVBSP LABEL IMAGE //////////////////////////////
+
+UVBSPLabelImage UVBSPLabelImage::fromRGBA(const uint8_t* pixels, uint32_t width, uint32_t height, std::vector<uint32_t>* colors)
+{
+    UVBSPLabelImage image;
+    std::unordered_map<uint32_t, uint16_t> indices;
+    std::vector<uint32_t> indexColors;
+    std::vector<uint16_t> labels(size_t(width) * height);
+
+    uint32_t lastColor = 0;
+    uint16_t lastIndex = 0;
+    for (size_t i = 0; i < labels.size(); ++i) {
+        uint32_t color;
+        std::memcpy(&color, pixels + 4 * i, sizeof(color));
+        if (i == 0 || color != lastColor) { // masks are mostly runs of one color
+            auto [it, isNew] = indices.emplace(color, uint16_t(indexColors.size()));
+            if (isNew) {
+                if (indexColors.size() > UINT16_MAX)
+                    return image; // not a mask, too many colors for 16 bit indices
+                indexColors.push_back(color);
+            }
+            lastColor = color;
+            lastIndex = it->second;
+        }
+        labels[i] = lastIndex;
+    }
+
+    image.width = width;
+    image.height = height;
+    image.labels = std::move(labels);
+    if (colors)
+        *colors = std::move(indexColors);
+    return image;
+}
+
+bool UVBSPLabelImage::readIndexMap(const std::string& path, UVBSPLabelImage& image)
+{
+    GrayImage grayImage;
+    if (!readGrayImage(path, grayImage))
+        return false;
+    image.width = grayImage.width;
+    image.height = grayImage.height;
+    image.labels = std::move(grayImage.samples);
+    return true;
+}
+
+////////////////////////////////// UVBSP MASK BUILDER //////////////////////////////
+
+bool UVBSPMaskBuilder::build(UVBSP& uvbsp, const Settings& settings, Stats* stats) const
+{
+    const auto startTime = std::chrono::steady_clock::now();
+    const uint32_t width = m_image.width, height = m_image.height;
+    if (!width || !height || width > UINT16_MAX + 1u || height > UINT16_MAX + 1u
+        || m_image.labels.size() != size_t(width) * height)
+        return false;
+
+    Stats localStats;
+    if (!stats)
+        stats = &localStats;
+    *stats = {};
+
+    Texels texels;
+    texels.labels = m_image.labels;
+    texels.xs.resize(texels.labels.size());
+    texels.ys.resize(texels.labels.size());
+    for (uint32_t y = 0; y < height; ++y) {
+        for (uint32_t x = 0; x < width; ++x) {
+            texels.xs[size_t(y) * width + x] = uint16_t(x);
+            texels.ys[size_t(y) * width + x] = uint16_t(y);
+        }
+    }
+    const int labelCount = *std::max_element(texels.labels.begin(), texels.labels.end()) + 1;
+    std::vector<uint32_t> counts(labelCount);
+    std::vector<int> localIndices(labelCount, -1);
+
+    std::vector<UVBSPSplit> nodes;
+    std::vector<std::array<int, 2>> sides; // packed order, as setPackedSides() takes them
+    std::priority_queue<Cell> queue;
+    UVBSPSplit rootLeaf { bsp::vec2(0.5f, 0.5f), bsp::vec2(1, 1), 0, 0 }; // used if the root is never split
+
+    auto setLeaf = [&](const Cell& cell) {
+        if (cell.parentNode < 0)
+            rootLeaf.l = rootLeaf.r = cell.majorityLabel;
+        else
+            sides[cell.parentNode][cell.side] = cell.majorityLabel;
+    };
+    auto addCell = [&](size_t begin, size_t end, int depth, int parentNode, int side) {
+        Cell cell { begin, end, depth, parentNode, side, 0, 0 };
+        getMajority(texels, begin, end, counts, cell.majorityLabel, cell.misclassified);
+        if (cell.misclassified == 0 || depth >= settings.maxDepth || end - begin < std::max<size_t>(settings.minTexels, 2))
+            setLeaf(cell);
+        else
+            queue.push(cell);
+    };
+    addCell(0, texels.labels.size(), 0, -1, 0);
+
+    const int angleCount = std::max(settings.angleCount, 1);
+    std::vector<Candidate> candidates(angleCount);
+    CellLabels cellLabels;
+    while (!queue.empty()) {
+        const Cell cell = queue.top();
+        queue.pop();
+        if (nodes.size() >= settings.maxNodes) {
+            setLeaf(cell);
+            continue;
+        }
+
+        getCellLabels(texels, cell, localIndices, cellLabels);
+        const size_t cellLabelCount = cellLabels.totals.size();
+        const int binCount = int(std::clamp<size_t>(s_maxHistogramSize / cellLabelCount, 2, std::max(settings.binCount, 2)));
+        const size_t texelCount = cell.end - cell.begin;
+        parallelFor(
+            angleCount, [&](size_t angle) {
+                candidates[angle] = evaluateDirection(texels, cell, cellLabels, int(angle), angleCount, binCount, width, height);
+            },
+            getCellThreadCount(texelCount, settings.threadCount));
+        stats->candidateLines += size_t(angleCount) * (binCount - 1);
+
+        Candidate best;
+        for (const Candidate& candidate : candidates) {
+            if (candidate.score > best.score)
+                best = candidate;
+        }
+        double cellScore = 0;
+        for (uint32_t total : cellLabels.totals)
+            cellScore += double(total) * total / texelCount;
+        if (best.score <= cellScore * (1 + 1e-12)) { // no line separates labels any better
+            setLeaf(cell);
+            continue;
+        }
+
+        const double radians = s_pi * best.angle / angleCount;
+        const float cosA = float(std::cos(radians)), sinA = float(std::sin(radians));
+        UVBSPSplit split;
+        split.pos = bsp::vec2(cosA * best.threshold, sinA * best.threshold);
+        split.dir = bsp::vec2(cosA, sinA); // normal of the line, as the packing takes it
+        split.l = split.r = 0;
+
+        // texels go where the traversal sends them, left ones first
+        const bsp::Vec4 packedNode = packNodeToShader(split);
+        size_t middle = cell.begin, end = cell.end;
+        while (middle < end) {
+            if (isLeftPixel(packedNode, getTexelCenter(texels.xs[middle], texels.ys[middle], width, height)))
+                middle++;
+            else
+                texels.swap(middle, --end);
+        }
+        if (middle == cell.begin || middle == cell.end) { // line on a texel row after rounding
+            setLeaf(cell);
+            continue;
+        }
+
+        const int nodeIndex = int(nodes.size());
+        nodes.push_back(split);
+        sides.push_back({ 0, 0 });
+        if (cell.parentNode >= 0)
+            sides[cell.parentNode][cell.side] = -nodeIndex;
+        addCell(cell.begin, middle, cell.depth + 1, nodeIndex, 0);
+        addCell(middle, cell.end, cell.depth + 1, nodeIndex, 1);
+    }
+
+    if (nodes.empty())
+        nodes.push_back(rootLeaf);
+    else
+        for (size_t i = 0; i < nodes.size(); ++i)
+            setPackedSides(nodes[i], sides[i][0], sides[i][1]);
+    uvbsp.assignNodes(std::move(nodes));
+
+    // misclassified texels as the traversal sees them
+    const UVBSPCompiledTree& compiledTree = uvbsp.getCompiledTree();
+    std::vector<size_t> rowErrors(height);
+    parallelFor(
+        height, [&](size_t y) {
+            std::vector<bsp::vec2> uvs(width);
+            std::vector<int> colors(width);
+            for (uint32_t x = 0; x < width; ++x)
+                uvs[x] = getTexelCenter(x, uint32_t(y), width, height);
+            uvbsp.classify(uvs.data(), width, colors.data());
+            const uint16_t* labels = m_image.labels.data() + y * width;
+            for (uint32_t x = 0; x < width; ++x)
+                rowErrors[y] += colors[x] != labels[x];
+        },
+        getCellThreadCount(m_image.labels.size(), settings.threadCount));
+
+    stats->nodes = uvbsp.getNumNodes();
+    stats->depth = compiledTree.getMaxDepth();
+    stats->texels = m_image.labels.size();
+    for (size_t errors : rowErrors)
+        stats->misclassifiedTexels += errors;
+    stats->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    return true;
+}
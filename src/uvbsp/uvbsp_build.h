@@ -0,0 +1,73 @@
+#ifndef UVBSP_BUILD_H
+#define UVBSP_BUILD_H
+
+#include <uvbsp/uvbsp.h>
+
+////////////////////////////////// UVBSP LABEL IMAGE //////////////////////////////
+
+// Color index of every texel, row y is v = (y + 0.5) / height as in UVBSPIndexBaker
+struct UVBSPLabelImage {
+    uint32_t width {}, height {};
+    std::vector<uint16_t> labels;
+
+    // Every distinct RGBA color gets the next index in order of first appearance,
+    // colors receives the RGBA value (R in the low byte) of each index
+    static UVBSPLabelImage fromRGBA(const uint8_t* pixels, uint32_t width, uint32_t height,
+        std::vector<uint32_t>* colors = nullptr);
+
+    // Index map as UVBSPIndexBaker writes it: gray png (8 or 16 bit) or tga, values are indices
+    static bool readIndexMap(const std::string& path, UVBSPLabelImage& image);
+};
+
+////////////////////////////////// UVBSP MASK BUILDER //////////////////////////////
+
+// Builds a tree from an ID mask instead of drawn splits. Greedy, top-down:
+// the cell with the most misclassified texels is split next, by the candidate
+// line (angleCount directions x binCount offsets) with the lowest Gini impurity
+// of labels on both sides. Directions are searched in parallel, texels are
+// projected 8 at a time with SSE2. Texels go to the side the traversal puts them,
+// so counts are exact. Stops when cells are pure or a budget is used up,
+// leaves take the most common label of their cell.
+
+class UVBSPMaskBuilder {
+public:
+    struct Settings {
+        size_t maxNodes = 512; // size of the shader node array
+        int maxDepth = 32;
+        int angleCount = 64; // candidate directions over 180 degrees
+        int binCount = 256; // candidate offsets per direction
+        size_t minTexels = 4; // smaller cells are left as they are
+        unsigned threadCount = 0; // all cores
+    };
+
+    struct Stats {
+        size_t nodes {}, texels {}, misclassifiedTexels {};
+        int depth {};
+        size_t candidateLines {};
+        double seconds {};
+
+        double getMisclassifiedPercent() const { return texels ? 100.0 * misclassifiedTexels / texels : 0.0; }
+
+        std::string getInfo() const
+        {
+            return "Nodes: " + std::to_string(nodes) + "   Depth: " + std::to_string(depth)
+                + "   Misclassified: " + std::to_string(misclassifiedTexels) + "/" + std::to_string(texels)
+                + " (" + std::to_string(getMisclassifiedPercent()) + "%)"
+                + "   Candidates: " + std::to_string(candidateLines)
+                + "   Time: " + std::to_string(seconds) + "s";
+        }
+    };
+
+    UVBSPMaskBuilder(const UVBSPLabelImage& image)
+        : m_image(image)
+    {
+    }
+
+    // Replaces the tree of uvbsp, false for an empty or inconsistent image
+    bool build(UVBSP& uvbsp, const Settings& settings, Stats* stats = nullptr) const;
+
+private:
+    const UVBSPLabelImage& m_image;
+};
+
+#endif // UVBSP_BUILD_H
@@ -0,0 +1,96 @@
+#include <cstring>
+#include <uvbsp/uvbsp.h>
+
+void UVBSP::invalidateCells(int nodeIndex)
+{
+    m_cellsDirty = true;
+    if (nodeIndex >= (int)m_cells.size())
+        return; // new node, cell is created on the next update
+
+    std::vector<int> stack { nodeIndex };
+    while (!stack.empty()) {
+        int index = stack.back();
+        stack.pop_back();
+        if (index >= (int)m_cells.size())
+            continue;
+        m_cells[index].valid = false;
+        for (int childIndex : { m_nodes[index].l, m_nodes[index].r })
+            if (childIndex < 0)
+                stack.push_back(-childIndex);
+    }
+}
+
+void UVBSP::updateCells() const
+{
+    if (!m_cellsDirty)
+        return;
+
+    m_cells.resize(m_nodes.size());
+    if (!m_cells[0].valid)
+        m_cells[0].region.setPolygon(makeUnitSquare());
+
+    // top-down, a cell is the side of its parent, sides are clipped by the node line
+    std::vector<int> stack { 0 };
+    UVPolygon clipped;
+    while (!stack.empty()) {
+        UVBSPCell& cell = m_cells[stack.back()];
+        const bsp::Vec4 packedNode = packNodeToShader(m_nodes[stack.back()]);
+        stack.pop_back();
+
+        std::memcpy(cell.sideIndices, &packedNode.z, sizeof(cell.sideIndices));
+        if (!cell.valid) {
+            const UVHalfPlane plane(packedNode.x, packedNode.y);
+            for (int side = 0; side < 2; ++side) {
+                clipPolygon(cell.region.polygon, plane, side == 0, clipped);
+                cell.sides[side].setPolygon(clipped);
+            }
+            cell.valid = true;
+        }
+
+        for (int side = 0; side < 2; ++side) {
+            const int childIndex = -cell.sideIndices[side];
+            if (childIndex > 0 && childIndex < (int)m_cells.size()) {
+                UVBSPCell& childCell = m_cells[childIndex];
+                if (!childCell.valid)
+                    childCell.region = cell.sides[side];
+                stack.push_back(childIndex);
+            }
+        }
+    }
+    m_cellsDirty = false;
+}
+
+const UVBSPCell& UVBSP::getCell(int nodeIndex) const
+{
+    updateCells();
+    return m_cells[nodeIndex];
+}
+
+std::vector<UVBSPLeaf> UVBSP::getLeaves() const
+{
+    updateCells();
+    std::vector<UVBSPLeaf> leaves;
+    for (size_t i = 0; i < m_cells.size(); ++i) {
+        const UVBSPCell& cell = m_cells[i];
+        if (!cell.valid)
+            continue; // not reachable from the root
+        for (int side = 0; side < 2; ++side)
+            if (cell.sideIndices[side] >= 0)
+                leaves.push_back({ int(i), side, cell.sideIndices[side], &cell.sides[side] });
+    }
+    return leaves;
+}
+
+double UVBSP::getColorArea(int colorIndex) const
+{
+    updateCells();
+    double area = 0;
+    for (const UVBSPCell& cell : m_cells) {
+        if (!cell.valid)
+            continue;
+        for (int side = 0; side < 2; ++side)
+            if (cell.sideIndices[side] == colorIndex)
+                area += cell.sides[side].area;
+    }
+    return area;
+}
@@ -0,0 +1,189 @@
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <cstring>
+#include <uvbsp/uvbsp_codegen.h>
+#include <uvbsp/uvbsp_traversal.h>
+
+static constexpr int s_maxIndent = 32; // deeper code stays at this column, text grows linearly
+
+// Shortest decimal that reads back as the same float, always with a point or exponent
+static std::string getFloatLiteral(float value)
+{
+    char text[32];
+    std::snprintf(text, sizeof(text), "%.9g", value);
+    std::string literal = text;
+    if (literal.find_first_of(".e") == std::string::npos)
+        literal += ".0";
+    return literal;
+}
+
+UVBSPUnrolledShader::UVBSPUnrolledShader(const UVBSPCompiledTree& tree, const Settings& settings)
+    : m_settings(settings)
+{
+    m_nodes.resize(tree.size());
+    for (size_t i = 0; i < tree.size(); ++i) {
+        const bsp::Vec4& packed = tree.data()[i];
+        Node& node = m_nodes[i];
+        node.posLiteral = getFloatLiteral(packed.x);
+        node.tangentLiteral = getFloatLiteral(packed.y);
+        node.pos = std::strtof(node.posLiteral.c_str(), nullptr);
+        node.tangent = std::strtof(node.tangentLiteral.c_str(), nullptr);
+        std::memcpy(node.sideIndices, &packed.z, sizeof(node.sideIndices));
+    }
+
+    // children always come after their parent in the compiled tree
+    for (size_t i = m_nodes.size(); i-- > 0;) {
+        Node& node = m_nodes[i];
+        node.subtreeSize = 1;
+        for (int sideIndex : node.sideIndices)
+            if (sideIndex < 0)
+                node.subtreeSize += m_nodes[-sideIndex].subtreeSize;
+    }
+}
+
+bool UVBSPUnrolledShader::isLeft(int nodeIndex, bsp::vec2 uv) const
+{
+    const Node& node = m_nodes[nodeIndex];
+    return (node.pos - uv.x) * node.tangent - uv.y < 0.f;
+}
+
+std::string UVBSPUnrolledShader::getSideTest(int nodeIndex) const
+{
+    const Node& node = m_nodes[nodeIndex];
+    return "(" + node.posLiteral + " - uv.x) * " + node.tangentLiteral + " - uv.y < 0.0";
+}
+
+void UVBSPUnrolledShader::write(std::ostream& out, UVBSP::ShaderType shaderType) const
+{
+    const bool isHLSL = shaderType != UVBSP::ShaderType::GLSL;
+    const bool isFunction = shaderType != UVBSP::ShaderType::UnrealCustomNode;
+
+    out << "/////// START_UVBSP_GENERATED_SHADER ////////\n\n"
+        << (isHLSL ? "#define VEC2 float2\n" : "#define VEC2 vec2\n")
+        << "\n// unrolled tree, side test: (pos - uv.x) * tangent - uv.y < 0.0 is left\n"
+        << (isFunction ? "int traverseTree(VEC2 uv){\n" : "\n");
+
+    if (isSelectNetwork(0))
+        writeSelectNetwork(out, 0, 1);
+    else
+        writeBranches(out, 0, 1);
+
+    out << (isFunction ? "}\n" : "\n")
+        << "#undef VEC2\n"
+        << "/////// END_UVBSP_GENERATED_SHADER ////////\n"
+        << std::endl;
+}
+
+void UVBSPUnrolledShader::writeBranches(std::ostream& out, int nodeIndex, int indent) const
+{
+    // explicit stack, a deep tree would overflow the call stack
+    struct Step {
+        int nodeIndex, indent;
+        int side; // next side to write, 2 - closing brace
+    };
+    std::vector<Step> stack { { nodeIndex, indent, 0 } };
+    while (!stack.empty()) {
+        Step& step = stack.back();
+        const std::string tab(std::min(step.indent, s_maxIndent) * 2, ' ');
+        if (step.side == 2) {
+            out << tab << "}\n";
+            stack.pop_back();
+            continue;
+        }
+        if (step.side == 0)
+            out << tab << "if (" << getSideTest(step.nodeIndex) << ") {\n";
+        else
+            out << tab << "} else {\n";
+
+        const int sideIndex = m_nodes[step.nodeIndex].sideIndices[step.side++];
+        const int childIndent = step.indent + 1;
+        if (sideIndex >= 0)
+            out << tab << "  return " << sideIndex << ";\n";
+        else if (isSelectNetwork(-sideIndex))
+            writeSelectNetwork(out, -sideIndex, childIndent);
+        else
+            stack.push_back({ -sideIndex, childIndent, 0 });
+    }
+}
+
+void UVBSPUnrolledShader::writeSelectNetwork(std::ostream& out, int nodeIndex, int indent) const
+{
+    const std::string tab(std::min(indent, s_maxIndent) * 2, ' ');
+    std::vector<int> stack { nodeIndex };
+    while (!stack.empty()) {
+        const int index = stack.back();
+        stack.pop_back();
+        out << tab << "bool s" << index << " = " << getSideTest(index) << ";\n";
+        for (int sideIndex : m_nodes[index].sideIndices)
+            if (sideIndex < 0)
+                stack.push_back(-sideIndex);
+    }
+    out << tab << "return " << getSelectExpression(nodeIndex) << ";\n";
+}
+
+std::string UVBSPUnrolledShader::getSelectExpression(int nodeIndex) const
+{
+    const Node& node = m_nodes[nodeIndex];
+    std::string sides[2];
+    for (int side = 0; side < 2; ++side) {
+        const int sideIndex = node.sideIndices[side];
+        sides[side] = sideIndex >= 0 ? std::to_string(sideIndex) : getSelectExpression(-sideIndex);
+    }
+    return "(s" + std::to_string(nodeIndex) + " ? " + sides[0] + " : " + sides[1] + ")";
+}
+
+int UVBSPUnrolledShader::evaluate(bsp::vec2 uv) const
+{
+    int nodeIndex = 0;
+    while (!isSelectNetwork(nodeIndex)) {
+        const int sideIndex = m_nodes[nodeIndex].sideIndices[isLeft(nodeIndex, uv) ? 0 : 1];
+        if (sideIndex >= 0)
+            return sideIndex;
+        nodeIndex = -sideIndex;
+    }
+    return evaluateSelectNetwork(nodeIndex, uv);
+}
+
+void UVBSPUnrolledShader::getPath(bsp::vec2 uv, std::vector<int>& path) const
+{
+    path.clear();
+    int nodeIndex = 0;
+    while (!isSelectNetwork(nodeIndex)) {
+        path.push_back(nodeIndex);
+        const int sideIndex = m_nodes[nodeIndex].sideIndices[isLeft(nodeIndex, uv) ? 0 : 1];
+        if (sideIndex >= 0)
+            return;
+        nodeIndex = -sideIndex;
+    }
+    path.push_back(nodeIndex);
+}
+
+int UVBSPUnrolledShader::evaluateSelectNetwork(int nodeIndex, bsp::vec2 uv) const
+{
+    // both sides are computed, like the emitted select network
+    const Node& node = m_nodes[nodeIndex];
+    int sides[2];
+    for (int side = 0; side < 2; ++side) {
+        const int sideIndex = node.sideIndices[side];
+        sides[side] = sideIndex >= 0 ? sideIndex : evaluateSelectNetwork(-sideIndex, uv);
+    }
+    return isLeft(nodeIndex, uv) ? sides[0] : sides[1];
+}
+
+size_t UVBSPUnrolledShader::countMismatches(const UVBSP& uvbsp, int resolution) const
+{
+    const uint32_t size = std::max(resolution, 1);
+    std::vector<bsp::vec2> samples(size * size);
+    for (uint32_t y = 0; y < size; ++y)
+        for (uint32_t x = 0; x < size; ++x)
+            samples[y * size + x] = getTexelCenter(x, y, size, size);
+
+    std::vector<int> expected(samples.size());
+    uvbsp.classify(samples.data(), samples.size(), expected.data());
+
+    size_t mismatches = 0;
+    for (size_t i = 0; i < samples.size(); ++i)
+        mismatches += evaluate(samples[i]) != expected[i];
+    return mismatches;
+}
@@ -0,0 +1,59 @@
+#ifndef UVBSP_CODEGEN_H
+#define UVBSP_CODEGEN_H
+
+#include <uvbsp/uvbsp.h>
+
+////////////////////////////////// UVBSP UNROLLED SHADER //////////////////////////////
+
+// Tree compiled into code instead of a node array, node constants are literals.
+// Big subtrees become nested if / else, small ones (selectNetworkMaxNodes) a select
+// network: every side test of the subtree is computed, then one ?: expression picks
+// the color, no branches for the GPU to diverge on.
+// evaluate() runs the same tests with the values of the printed literals,
+// so the emitted code can be checked against classify() on the CPU.
+
+class UVBSPUnrolledShader {
+public:
+    struct Settings {
+        int selectNetworkMaxNodes = 7;
+    };
+
+    explicit UVBSPUnrolledShader(const UVBSPCompiledTree& tree)
+        : UVBSPUnrolledShader(tree, Settings())
+    {
+    }
+    UVBSPUnrolledShader(const UVBSPCompiledTree& tree, const Settings& settings);
+
+    // The whole generated block, same markers and traverseTree(uv) signature as the node array form
+    void write(std::ostream& out, UVBSP::ShaderType shaderType) const;
+
+    int evaluate(bsp::vec2 uv) const;
+    // Nodes the emitted code tests for uv, in order: branches, then the select network reached.
+    // A branch costs one side test, a select network all tests of its subtree.
+    void getPath(bsp::vec2 uv, std::vector<int>& path) const;
+    int getCost(int nodeIndex) const { return isSelectNetwork(nodeIndex) ? m_nodes[nodeIndex].subtreeSize : 1; }
+    // Texel centers of resolution^2 grid where evaluate() differs from classify()
+    size_t countMismatches(const UVBSP& uvbsp, int resolution = 1024) const;
+
+private:
+    struct Node {
+        std::string posLiteral, tangentLiteral;
+        float pos, tangent; // parsed back from the literals
+        int sideIndices[2]; // node(less than 0) or color(greater equal 0), left first
+        int subtreeSize;
+    };
+
+    bool isSelectNetwork(int nodeIndex) const { return m_nodes[nodeIndex].subtreeSize <= m_settings.selectNetworkMaxNodes; }
+    bool isLeft(int nodeIndex, bsp::vec2 uv) const;
+    std::string getSideTest(int nodeIndex) const;
+
+    void writeBranches(std::ostream& out, int nodeIndex, int indent) const;
+    void writeSelectNetwork(std::ostream& out, int nodeIndex, int indent) const;
+    std::string getSelectExpression(int nodeIndex) const;
+    int evaluateSelectNetwork(int nodeIndex, bsp::vec2 uv) const;
+
+    std::vector<Node> m_nodes;
+    Settings m_settings;
+};
+
+#endif // UVBSP_CODEGEN_H
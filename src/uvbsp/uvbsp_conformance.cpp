@@ -0,0 +1,178 @@
+#include "image_writer.h"
+#include "parallel_for.h"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <unordered_map>
+#include <uvbsp/uvbsp_bake.h>
+#include <uvbsp/uvbsp_build.h>
+#include <uvbsp/uvbsp_conformance.h>
+#include <uvbsp/uvbsp_export.h>
+
+#ifndef LOG
+#define LOG(x) std::cout << x << std::endl
+#endif
+
+namespace {
+
+constexpr float s_unchangedBrightness = 0.35f; // of reference colors in the difference image
+constexpr int s_maxId = 0xFFFF;
+
+typedef std::unordered_map<uint32_t, size_t> ConfusionCounts; // reference << 16 | tested
+
+} // namespace
+
+std::vector<UVBSPConformanceChecker::Confusion> UVBSPConformanceChecker::Report::getLargestChanges(size_t count) const
+{
+    std::vector<Confusion> changes;
+    for (const Confusion& cell : confusion)
+        if (cell.reference != cell.tested)
+            changes.push_back(cell);
+    count = std::min(count, changes.size());
+    std::partial_sort(changes.begin(), changes.begin() + count, changes.end(), [](const Confusion& a, const Confusion& b) {
+        return a.texels != b.texels ? a.texels > b.texels
+                                    : a.reference < b.reference || (a.reference == b.reference && a.tested < b.tested);
+    });
+    changes.resize(count);
+    return changes;
+}
+
+bool UVBSPConformanceChecker::compare(const UVBSPLabelImage& reference, const Settings& settings, Report* report,
+    const std::string& differencePath) const
+{
+    if (reference.labels.size() != size_t(reference.width) * reference.height)
+        return false;
+    auto referenceRows = [&](uint32_t y0, uint32_t rowCount, uint16_t* rows) {
+        const uint16_t* source = reference.labels.data() + size_t(y0) * reference.width;
+        std::copy(source, source + size_t(rowCount) * reference.width, rows);
+    };
+    return compareRows(referenceRows, reference.width, reference.height, settings, report, differencePath);
+}
+
+bool UVBSPConformanceChecker::compare(const UVBSP& reference, const Settings& settings, Report* report,
+    const std::string& differencePath) const
+{
+    const UVBSPIndexBaker referenceBaker(reference);
+    if (referenceBaker.getMaxColorIndex() > s_maxId) {
+        LOG("Reference color index " << referenceBaker.getMaxColorIndex() << " does not fit into 16 bits");
+        return false;
+    }
+    UVBSPIndexBaker::Settings bakeSettings;
+    bakeSettings.width = settings.width;
+    bakeSettings.height = settings.height;
+    auto referenceRows = [&](uint32_t y0, uint32_t rowCount, uint16_t* rows) {
+        referenceBaker.bakeRows(bakeSettings, y0, rowCount, rows);
+    };
+    return compareRows(referenceRows, settings.width, settings.height, settings, report, differencePath);
+}
+
+template <typename ReferenceRows>
+bool UVBSPConformanceChecker::compareRows(ReferenceRows&& referenceRows, uint32_t width, uint32_t height,
+    const Settings& settings, Report* report, const std::string& differencePath) const
+{
+    const auto startTime = std::chrono::steady_clock::now();
+    Report localReport;
+    if (!report)
+        report = &localReport;
+    *report = {};
+    if (!width || !height)
+        return false;
+
+    const UVBSPIndexBaker baker(m_uvbsp); // compiles the tree before bands run in parallel
+    if (baker.getMaxColorIndex() > s_maxId) {
+        LOG("Color index " << baker.getMaxColorIndex() << " does not fit into 16 bits");
+        return false;
+    }
+    UVBSPIndexBaker::Settings bakeSettings;
+    bakeSettings.width = width;
+    bakeSettings.height = height;
+
+    const bool isWritingImage = !differencePath.empty();
+    StreamingImageWriter writer;
+    if (isWritingImage && !writer.open(differencePath, StreamingImageWriter::getFormatFromPath(differencePath), width, height, 3, 8)) {
+        LOG("Failed to open image for writing: " << differencePath);
+        return false;
+    }
+    std::vector<std::array<uint8_t, 3>> dimColors; // by reference id
+    if (isWritingImage) {
+        dimColors.resize(s_maxId + 1);
+        for (int id = 0; id <= s_maxId; ++id) {
+            const UVBSPColor color = getRainbowColor(id);
+            for (int c = 0; c < 3; ++c)
+                dimColors[id][c] = uint8_t(std::clamp(color[c] * s_unchangedBrightness, 0.f, 1.f) * 255.f + 0.5f);
+        }
+    }
+
+    // a group of bands is compared in parallel, then written, so memory stays bounded
+    const uint32_t bandHeight = std::max(settings.bandHeight, 1u);
+    const size_t bandCount = (height + bandHeight - 1) / bandHeight;
+    const size_t bandSize = size_t(width) * bandHeight;
+    const size_t bandsPerGroup = std::min<size_t>(4 * getThreadCount(settings.threadCount), bandCount);
+    std::vector<uint16_t> referenceIds(bandSize * bandsPerGroup), testedIds(bandSize * bandsPerGroup);
+    std::vector<uint8_t> rgb(isWritingImage ? bandSize * bandsPerGroup * 3 : 0);
+    std::vector<ConfusionCounts> bandCounts(bandsPerGroup);
+    ConfusionCounts counts;
+
+    for (size_t groupStart = 0; groupStart < bandCount; groupStart += bandsPerGroup) {
+        const size_t groupBands = std::min(bandsPerGroup, bandCount - groupStart);
+        parallelFor(
+            groupBands, [&](size_t i) {
+                const uint32_t y0 = uint32_t((groupStart + i) * bandHeight);
+                const uint32_t rowCount = std::min(bandHeight, height - y0);
+                const size_t texelCount = size_t(width) * rowCount;
+                uint16_t* reference = referenceIds.data() + bandSize * i;
+                uint16_t* tested = testedIds.data() + bandSize * i;
+                referenceRows(y0, rowCount, reference);
+                baker.bakeRows(bakeSettings, y0, rowCount, tested);
+
+                // segments are large, one map update per run of the same pair
+                ConfusionCounts& cells = bandCounts[i];
+                cells.clear();
+                for (size_t begin = 0; begin < texelCount;) {
+                    size_t end = begin + 1;
+                    while (end < texelCount && reference[end] == reference[begin] && tested[end] == tested[begin])
+                        ++end;
+                    cells[uint32_t(reference[begin]) << 16 | tested[begin]] += end - begin;
+                    begin = end;
+                }
+
+                if (isWritingImage) {
+                    uint8_t* pixels = rgb.data() + bandSize * 3 * i;
+                    for (size_t texel = 0; texel < texelCount; ++texel) {
+                        if (reference[texel] == tested[texel])
+                            std::copy_n(dimColors[reference[texel]].data(), 3, pixels + texel * 3);
+                        else
+                            std::fill_n(pixels + texel * 3, 3, uint8_t(255));
+                    }
+                }
+            },
+            settings.threadCount);
+
+        for (size_t i = 0; i < groupBands; ++i)
+            for (const auto& [key, texels] : bandCounts[i])
+                counts[key] += texels;
+
+        // bands of a group are consecutive in memory, only the last one can be shorter
+        const uint32_t y0 = uint32_t(groupStart * bandHeight);
+        const uint32_t rowCount = std::min<uint32_t>(uint32_t(groupBands * bandHeight), height - y0);
+        if (isWritingImage && !writer.writeRows(rgb.data(), rowCount)) {
+            LOG("Failed to write image rows: " << differencePath);
+            return false;
+        }
+    }
+
+    report->width = width;
+    report->height = height;
+    report->texels = size_t(width) * height;
+    report->confusion.reserve(counts.size());
+    for (const auto& [key, texels] : counts) {
+        report->confusion.push_back({ int(key >> 16), int(key & 0xFFFF), texels });
+        if (key >> 16 != (key & 0xFFFF))
+            report->changedTexels += texels;
+    }
+    std::sort(report->confusion.begin(), report->confusion.end(), [](const Confusion& a, const Confusion& b) {
+        return a.reference < b.reference || (a.reference == b.reference && a.tested < b.tested);
+    });
+    report->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    return !isWritingImage || writer.close();
+}
@@ -0,0 +1,72 @@
+#ifndef UVBSP_CONFORMANCE_H
+#define UVBSP_CONFORMANCE_H
+
+#include <uvbsp/uvbsp.h>
+
+struct UVBSPLabelImage;
+
+////////////////////////////////// UVBSP CONFORMANCE CHECKER //////////////////////////////
+
+// Which texels changed segment: the tree is evaluated at every texel center of a
+// reference index map, or of a second tree baked at the same size, and the pair of ids
+// is counted into a confusion matrix. Texels are evaluated as UVBSPIndexBaker bakes them,
+// so a baked map of the same tree matches exactly. Bands of rows run on all cores,
+// pairs are counted per run of equal texels, the difference image is written band by band.
+
+class UVBSPConformanceChecker {
+public:
+    struct Settings {
+        uint32_t width = 4096, height = 4096; // against a tree, an index map has its own size
+        uint32_t bandHeight = 64;
+        unsigned threadCount = 0; // all cores
+    };
+
+    // Texels of one cell of the confusion matrix
+    struct Confusion {
+        int reference {}, tested {};
+        size_t texels {};
+    };
+
+    struct Report {
+        uint32_t width {}, height {};
+        size_t texels {}, changedTexels {};
+        std::vector<Confusion> confusion; // nonzero cells, by reference then tested id
+        double seconds {};
+
+        double getChangedPercent() const { return texels ? 100.0 * changedTexels / texels : 0.0; }
+
+        // Cells of changed texels, the largest count first
+        std::vector<Confusion> getLargestChanges(size_t count) const;
+
+        std::string getInfo() const
+        {
+            return "Texels: " + std::to_string(texels)
+                + "   Changed: " + std::to_string(changedTexels) + " (" + std::to_string(getChangedPercent()) + "%)"
+                + "   Confusion cells: " + std::to_string(confusion.size())
+                + "   Time: " + std::to_string(seconds) + "s";
+        }
+    };
+
+    UVBSPConformanceChecker(const UVBSP& uvbsp)
+        : m_uvbsp(uvbsp)
+    {
+    }
+
+    // differencePath: RGB image if not empty, reference colors dimmed, changed texels white.
+    // Format by extension: png, tga, anything else is raw RGB.
+    // False if an id does not fit into 16 bits or the image can't be written
+    bool compare(const UVBSPLabelImage& reference, const Settings& settings, Report* report,
+        const std::string& differencePath = "") const;
+    bool compare(const UVBSP& reference, const Settings& settings, Report* report,
+        const std::string& differencePath = "") const;
+
+private:
+    // referenceRows(y0, rowCount, rows) writes reference ids of rows [y0, y0 + rowCount)
+    template <typename ReferenceRows>
+    bool compareRows(ReferenceRows&& referenceRows, uint32_t width, uint32_t height, const Settings& settings,
+        Report* report, const std::string& differencePath) const;
+
+    const UVBSP& m_uvbsp;
+};
+
+#endif // UVBSP_CONFORMANCE_H
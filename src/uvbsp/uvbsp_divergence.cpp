@@ -0,0 +1,281 @@
+#include "image_writer.h"
+#include "parallel_for.h"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <uvbsp/uvbsp_codegen.h>
+#include <uvbsp/uvbsp_divergence.h>
+#include <uvbsp/uvbsp_mesh.h>
+#include <uvbsp/uvbsp_traversal.h>
+
+#ifndef LOG
+#define LOG(x) std::cout << x << std::endl
+#endif
+
+namespace {
+
+constexpr uint32_t s_rasterBandHeight = 64;
+constexpr uint32_t s_heatmapRows = 64; // written at once
+
+struct BlockRowTotals {
+    size_t activeTexels {}, blocks {}, divergentBlocks {};
+    double texelCost {}, blockCost {}, laneSlots {};
+    int maxBlockCost {};
+};
+
+// traverseTree() counting its iterations, endNode is the node it returns from
+int getLoopCost(const bsp::Vec4* nodes, int maxDepth, bsp::vec2 uv, int& endNode)
+{
+    int currentIndex = 0;
+    for (int iteration = 0; iteration < maxDepth; ++iteration) {
+        const bsp::Vec4& node = nodes[currentIndex];
+        int indexOfProperSide = floatBitsToInt(isLeftPixel(node, uv) ? node.z : node.w);
+        if (indexOfProperSide >= 0) {
+            endNode = currentIndex;
+            return iteration + 1;
+        }
+        currentIndex = -indexOfProperSide;
+    }
+    endNode = currentIndex;
+    return maxDepth;
+}
+
+// blue, cyan, green, yellow, red
+std::array<uint8_t, 3> getHeatColor(float value)
+{
+    static const float stops[5][3] = { { 0, 0, 1 }, { 0, 1, 1 }, { 0, 1, 0 }, { 1, 1, 0 }, { 1, 0, 0 } };
+    const float position = std::clamp(value, 0.f, 1.f) * 4.f;
+    const int stop = std::min(int(position), 3);
+    const float fraction = position - stop;
+    std::array<uint8_t, 3> color;
+    for (int c = 0; c < 3; ++c)
+        color[c] = uint8_t((stops[stop][c] * (1.f - fraction) + stops[stop + 1][c] * fraction) * 255.f + 0.5f);
+    return color;
+}
+
+double cross(double ax, double ay, double bx, double by, double px, double py)
+{
+    return (bx - ax) * (py - ay) - (by - ay) * (px - ax);
+}
+
+} // namespace
+
+std::vector<uint8_t> UVBSPDivergenceSimulator::rasterize(const UVBSPMesh& mesh, const Settings& settings)
+{
+    const uint32_t width = settings.width, height = settings.height;
+    std::vector<uint8_t> mask(size_t(width) * height);
+
+    // texel rows whose centers are inside of the triangle v range, false if none
+    auto getRows = [&](const std::array<uint32_t, 3>& triangle, uint32_t& y0, uint32_t& y1) {
+        float vMin = INFINITY, vMax = -INFINITY;
+        for (uint32_t vertex : triangle) {
+            vMin = std::min(vMin, mesh.uvs[vertex].y);
+            vMax = std::max(vMax, mesh.uvs[vertex].y);
+        }
+        const double first = std::max(std::ceil(double(vMin) * height - 0.5), 0.0);
+        const double last = std::min(std::floor(double(vMax) * height - 0.5), double(height) - 1);
+        if (!(first <= last))
+            return false;
+        y0 = uint32_t(first);
+        y1 = uint32_t(last);
+        return true;
+    };
+
+    // triangles binned by bands of rows, bands are filled in parallel
+    const uint32_t bandCount = (height + s_rasterBandHeight - 1) / s_rasterBandHeight;
+    std::vector<uint32_t> offsets(bandCount + 1);
+    uint32_t y0, y1;
+    for (const auto& triangle : mesh.triangles)
+        if (getRows(triangle, y0, y1))
+            for (uint32_t band = y0 / s_rasterBandHeight; band <= y1 / s_rasterBandHeight; ++band)
+                offsets[band + 1]++;
+    for (uint32_t band = 0; band < bandCount; ++band)
+        offsets[band + 1] += offsets[band];
+    std::vector<uint32_t> bandTriangles(offsets.back());
+    std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+    for (uint32_t i = 0; i < mesh.triangles.size(); ++i)
+        if (getRows(mesh.triangles[i], y0, y1))
+            for (uint32_t band = y0 / s_rasterBandHeight; band <= y1 / s_rasterBandHeight; ++band)
+                bandTriangles[fill[band]++] = i;
+
+    parallelFor(
+        bandCount, [&](size_t band) {
+            const uint32_t bandY0 = uint32_t(band) * s_rasterBandHeight;
+            const uint32_t bandY1 = std::min(bandY0 + s_rasterBandHeight, height) - 1;
+            uint32_t y0, y1;
+            for (uint32_t i = offsets[band]; i < offsets[band + 1]; ++i) {
+                const auto& triangle = mesh.triangles[bandTriangles[i]];
+                const bsp::vec2 a = mesh.uvs[triangle[0]], b = mesh.uvs[triangle[1]], c = mesh.uvs[triangle[2]];
+                const double area = cross(a.x, a.y, b.x, b.y, c.x, c.y);
+                if (area == 0 || !getRows(triangle, y0, y1))
+                    continue;
+
+                // texel centers on the edges count, neighbours sharing an edge both cover it
+                const double sign = area > 0 ? 1.0 : -1.0;
+                const bsp::vec2 corners[3] = { a, b, c };
+                for (uint32_t y = std::max(y0, bandY0); y <= std::min(y1, bandY1); ++y) {
+                    // span of the row, one texel wider for rounding, the edge test decides
+                    const double v = getTexelCenter(0, y, width, height).y;
+                    double uMin = INFINITY, uMax = -INFINITY;
+                    for (int edge = 0; edge < 3; ++edge) {
+                        const bsp::vec2 p = corners[edge], q = corners[(edge + 1) % 3];
+                        if (v < std::min(p.y, q.y) || v > std::max(p.y, q.y))
+                            continue;
+                        const double u0 = p.y == q.y ? p.x : p.x + (v - p.y) * (q.x - p.x) / (q.y - p.y);
+                        const double u1 = p.y == q.y ? q.x : u0; // a horizontal edge covers its whole length
+                        uMin = std::min({ uMin, u0, u1 });
+                        uMax = std::max({ uMax, u0, u1 });
+                    }
+                    const double first = std::max(std::ceil(uMin * width - 0.5) - 1, 0.0);
+                    const double last = std::min(std::floor(uMax * width - 0.5) + 1, double(width) - 1);
+                    if (!(first <= last))
+                        continue;
+                    for (uint32_t x = uint32_t(first); x <= uint32_t(last); ++x) {
+                        const bsp::vec2 uv = getTexelCenter(x, y, width, height);
+                        if (sign * cross(a.x, a.y, b.x, b.y, uv.x, uv.y) >= 0
+                            && sign * cross(b.x, b.y, c.x, c.y, uv.x, uv.y) >= 0
+                            && sign * cross(c.x, c.y, a.x, a.y, uv.x, uv.y) >= 0)
+                            mask[size_t(y) * width + x] = 1;
+                    }
+                }
+            }
+        },
+        settings.threadCount);
+    return mask;
+}
+
+bool UVBSPDivergenceSimulator::simulate(const Settings& settings, Stats* stats, const std::string& heatmapPath) const
+{
+    const auto startTime = std::chrono::steady_clock::now();
+    if (!settings.width || !settings.height || !settings.blockWidth || !settings.blockHeight)
+        return false;
+    Stats localStats;
+    if (!stats)
+        stats = &localStats;
+    *stats = {};
+
+    const UVBSPCompiledTree& compiledTree = m_uvbsp.getCompiledTree();
+    const bsp::Vec4* nodes = compiledTree.data();
+    const int maxDepth = compiledTree.getMaxDepth();
+    const bool isUnrolled = settings.codeForm == UVBSP::ShaderCodeForm::Unrolled;
+    std::unique_ptr<UVBSPUnrolledShader> unrolledShader;
+    std::vector<int> parents(compiledTree.size(), -1); // path of an unrolled block is the union of end node ancestors
+    if (isUnrolled) {
+        unrolledShader.reset(new UVBSPUnrolledShader(compiledTree));
+        for (size_t i = 0; i < compiledTree.size(); ++i)
+            for (float side : { nodes[i].z, nodes[i].w })
+                if (floatBitsToInt(side) < 0)
+                    parents[-floatBitsToInt(side)] = int(i);
+    }
+
+    const std::vector<uint8_t> mask = settings.mesh ? rasterize(*settings.mesh, settings) : std::vector<uint8_t>();
+    const uint32_t width = settings.width, height = settings.height;
+    const uint32_t blocksX = (width + settings.blockWidth - 1) / settings.blockWidth;
+    const uint32_t blocksY = (height + settings.blockHeight - 1) / settings.blockHeight;
+    std::vector<int> blockCosts(size_t(blocksX) * blocksY); // 0 - no active lane
+    std::vector<BlockRowTotals> rowTotals(blocksY);
+
+    parallelFor(
+        blocksY, [&](size_t blockY) {
+            BlockRowTotals& totals = rowTotals[blockY];
+            std::vector<int> path, endNodes, blockNodes;
+            const uint32_t y0 = uint32_t(blockY) * settings.blockHeight, y1 = std::min(y0 + settings.blockHeight, height);
+            for (uint32_t blockX = 0; blockX < blocksX; ++blockX) {
+                const uint32_t x0 = blockX * settings.blockWidth, x1 = std::min(x0 + settings.blockWidth, width);
+                size_t lanes = 0;
+                int blockCost = 0;
+                endNodes.clear();
+                for (uint32_t y = y0; y < y1; ++y) {
+                    for (uint32_t x = x0; x < x1; ++x) {
+                        if (!mask.empty() && !mask[size_t(y) * width + x])
+                            continue;
+                        const bsp::vec2 uv = getTexelCenter(x, y, width, height);
+                        int cost, endNode;
+                        if (isUnrolled) {
+                            unrolledShader->getPath(uv, path);
+                            endNode = path.back();
+                            cost = int(path.size()) - 1 + unrolledShader->getCost(endNode); // branches above it
+                        } else {
+                            cost = getLoopCost(nodes, maxDepth, uv, endNode);
+                            blockCost = std::max(blockCost, cost);
+                        }
+                        if (std::find(endNodes.begin(), endNodes.end(), endNode) == endNodes.end())
+                            endNodes.push_back(endNode);
+                        totals.texelCost += cost;
+                        lanes++;
+                    }
+                }
+                if (!lanes)
+                    continue;
+
+                if (isUnrolled) { // every node on the way to any end node runs once for the block
+                    blockNodes.clear();
+                    for (int node : endNodes)
+                        for (; node >= 0; node = parents[node])
+                            blockNodes.push_back(node);
+                    std::sort(blockNodes.begin(), blockNodes.end());
+                    blockNodes.erase(std::unique(blockNodes.begin(), blockNodes.end()), blockNodes.end());
+                    for (int node : blockNodes)
+                        blockCost += unrolledShader->getCost(node);
+                }
+                blockCosts[size_t(blockY) * blocksX + blockX] = blockCost;
+                totals.activeTexels += lanes;
+                totals.blocks++;
+                totals.divergentBlocks += endNodes.size() > 1;
+                totals.blockCost += blockCost;
+                totals.laneSlots += double(blockCost) * lanes;
+                totals.maxBlockCost = std::max(totals.maxBlockCost, blockCost);
+            }
+        },
+        settings.threadCount);
+
+    double texelCost = 0, blockCost = 0, laneSlots = 0;
+    for (const BlockRowTotals& totals : rowTotals) {
+        stats->activeTexels += totals.activeTexels;
+        stats->blocks += totals.blocks;
+        stats->divergentBlocks += totals.divergentBlocks;
+        stats->maxBlockCost = std::max(stats->maxBlockCost, totals.maxBlockCost);
+        texelCost += totals.texelCost;
+        blockCost += totals.blockCost;
+        laneSlots += totals.laneSlots;
+    }
+    if (stats->activeTexels) {
+        stats->meanTexelCost = texelCost / stats->activeTexels;
+        stats->meanBlockCost = blockCost / stats->blocks;
+        stats->divergenceRatio = laneSlots / texelCost;
+    }
+
+    bool success = true;
+    if (!heatmapPath.empty()) {
+        StreamingImageWriter writer;
+        if (!writer.open(heatmapPath, StreamingImageWriter::getFormatFromPath(heatmapPath), width, height, 3, 8)) {
+            LOG("Failed to open image for writing: " << heatmapPath);
+            return false;
+        }
+        const float scale = 1.f / std::max(settings.heatmapMaxCost > 0 ? settings.heatmapMaxCost : stats->maxBlockCost, 1);
+        std::vector<uint8_t> rows(size_t(width) * s_heatmapRows * 3);
+        for (uint32_t y0 = 0; y0 < height && success; y0 += s_heatmapRows) {
+            const uint32_t rowCount = std::min(s_heatmapRows, height - y0);
+            for (uint32_t y = y0; y < y0 + rowCount; ++y) {
+                uint8_t* row = rows.data() + size_t(y - y0) * width * 3;
+                const int* rowCosts = blockCosts.data() + size_t(y / settings.blockHeight) * blocksX;
+                for (uint32_t x = 0; x < width; ++x) {
+                    const bool isActive = mask.empty() || mask[size_t(y) * width + x];
+                    const std::array<uint8_t, 3> color = isActive
+                        ? getHeatColor(rowCosts[x / settings.blockWidth] * scale)
+                        : std::array<uint8_t, 3> { 0, 0, 0 };
+                    std::copy(color.begin(), color.end(), row + size_t(x) * 3);
+                }
+            }
+            success = writer.writeRows(rows.data(), rowCount);
+        }
+        success = writer.close() && success;
+        if (!success)
+            LOG("Failed to write image: " << heatmapPath);
+    }
+
+    stats->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    return success;
+}
@@ -0,0 +1,68 @@
+#ifndef UVBSP_DIVERGENCE_H
+#define UVBSP_DIVERGENCE_H
+
+#include <uvbsp/uvbsp.h>
+
+struct UVBSPMesh;
+
+////////////////////////////////// UVBSP DIVERGENCE SIMULATOR //////////////////////////////
+
+// Traversal cost of the generated shader as a GPU runs it: lanes of a block
+// (8x4 texels for a 32 wide wave, 2x2 for a pixel quad) run in lockstep, so a block
+// costs what its slowest lane costs, or the union of taken branches.
+// Node array and half packed forms: the loop runs until the deepest lane of the block
+// is done, cost of a texel is its leaf depth (half nodes walk the same tree).
+// Unrolled form: every branch taken by any lane runs for the whole block,
+// a select network costs all side tests of its subtree, see UVBSPUnrolledShader::getPath().
+// Lanes are texel centers of a width x height target, all of them or the ones covered
+// by the UV triangles of a mesh. Block rows run on all cores.
+
+class UVBSPDivergenceSimulator {
+public:
+    struct Settings {
+        uint32_t width = 2048, height = 2048;
+        uint32_t blockWidth = 8, blockHeight = 4; // texels of one wave
+        UVBSP::ShaderCodeForm codeForm = UVBSP::ShaderCodeForm::NodeArray;
+        const UVBSPMesh* mesh = nullptr; // lanes are texels inside of its UV triangles, all texels if null
+        int heatmapMaxCost = 0; // block cost drawn red, the largest one if 0 (fixed values compare images)
+        unsigned threadCount = 0; // all cores
+    };
+
+    struct Stats {
+        size_t activeTexels {}, blocks {}; // blocks with at least one active texel
+        size_t divergentBlocks {}; // lanes ending at different nodes, so taking different branches
+        double meanTexelCost {}; // side tests of a lane alone
+        double meanBlockCost {}; // side tests the block runs
+        int maxBlockCost {};
+        double divergenceRatio {}; // lane slots the blocks run / side tests lanes need, 1 - no divergence
+        double seconds {};
+
+        std::string getInfo() const
+        {
+            return "Active texels: " + std::to_string(activeTexels) + "   Blocks: " + std::to_string(blocks)
+                + "   Mean texel cost: " + std::to_string(meanTexelCost)
+                + "   Mean block cost: " + std::to_string(meanBlockCost)
+                + "   Max block cost: " + std::to_string(maxBlockCost)
+                + "   Divergence ratio: " + std::to_string(divergenceRatio)
+                + "   Divergent blocks: " + std::to_string(divergentBlocks)
+                + "   Time: " + std::to_string(seconds) + "s";
+        }
+    };
+
+    UVBSPDivergenceSimulator(const UVBSP& uvbsp)
+        : m_uvbsp(uvbsp)
+    {
+    }
+
+    // heatmapPath: RGB image of block costs if not empty, black where no lane is active.
+    // Format by extension: png, tga, anything else is raw RGB
+    bool simulate(const Settings& settings, Stats* stats, const std::string& heatmapPath = "") const;
+
+private:
+    // 1 for texels inside of the mesh UV triangles
+    static std::vector<uint8_t> rasterize(const UVBSPMesh& mesh, const Settings& settings);
+
+    const UVBSP& m_uvbsp;
+};
+
+#endif // UVBSP_DIVERGENCE_H
@@ -0,0 +1,242 @@
+#include "image_writer.h"
+#include "parallel_for.h"
+#include <chrono>
+#include <uvbsp/uvbsp_export.h>
+#include <uvbsp/uvbsp_traversal.h>
+
+#ifndef LOG
+#define LOG(x) std::cout << x << std::endl
+#endif
+
+namespace {
+
+constexpr double s_edgeEpsilon = 1e-7; // pixels
+
+// keeps the part where p[axis] <= value (keepLess) or p[axis] >= value
+void clipAxis(const UVPolygon& polygon, bool axisY, double value, bool keepLess, UVPolygon& result)
+{
+    result.clear();
+    const double sign = keepLess ? 1.0 : -1.0;
+    for (size_t i = 0; i < polygon.size(); ++i) {
+        const dvec2& a = polygon[i];
+        const dvec2& b = polygon[(i + 1) % polygon.size()];
+        double da = ((axisY ? a.y : a.x) - value) * sign;
+        double db = ((axisY ? b.y : b.x) - value) * sign;
+        if (da <= 0)
+            result.push_back(a);
+        if ((da <= 0) != (db <= 0)) {
+            dvec2 p = lerp(a, b, da / (da - db));
+            (axisY ? p.y : p.x) = value; // exactly on the texel edge
+            result.push_back(p);
+        }
+    }
+    if (result.size() < 3)
+        result.clear();
+}
+
+} // namespace
+
+UVBSPColor getRainbowColor(int colorIndex)
+{
+    // vec3 fastSin(vec3 x) { x = fract(x * 2.) - 1.; return (4. * x) * (1. - abs(x)); }
+    // rainbow(val) = fastSin(val * 0.313 + vec3(0, 0.33333, 0.66666))^2
+    const float val = 0.5f * colorIndex;
+    const float offsets[3] = { 0.f, 0.33333f, 0.66666f };
+    UVBSPColor color;
+    for (int i = 0; i < 3; ++i) {
+        float x = (val * 0.313f + offsets[i]) * 2.f;
+        x = x - std::floor(x) - 1.f;
+        float s = (4.f * x) * (1.f - std::abs(x));
+        color[i] = s * s;
+    }
+    return color;
+}
+
+std::vector<UVBSPAntialiasedExporter::PixelLeaf> UVBSPAntialiasedExporter::getPixelLeaves(const Settings& settings) const
+{
+    std::vector<PixelLeaf> leaves;
+    for (const UVBSPLeaf& leaf : m_uvbsp.getLeaves()) {
+        if (leaf.region->area <= 0)
+            continue;
+
+        PixelLeaf pixelLeaf;
+        for (const dvec2& p : leaf.region->polygon)
+            pixelLeaf.polygon.push_back({ p.x * settings.width, p.y * settings.height });
+        pixelLeaf.minY = leaf.region->boundsMin.y * settings.height;
+        pixelLeaf.maxY = leaf.region->boundsMax.y * settings.height;
+        pixelLeaf.color = (size_t)leaf.colorIndex < settings.palette.size()
+            ? settings.palette[leaf.colorIndex]
+            : getRainbowColor(leaf.colorIndex);
+        leaves.push_back(std::move(pixelLeaf));
+    }
+    return leaves;
+}
+
+std::vector<std::vector<int>> UVBSPAntialiasedExporter::getBandLeaves(const Settings& settings, const std::vector<PixelLeaf>& leaves) const
+{
+    const uint32_t bandHeight = std::max(settings.bandHeight, 1u);
+    std::vector<std::vector<int>> bandLeaves((settings.height + bandHeight - 1) / bandHeight);
+    for (size_t i = 0; i < leaves.size(); ++i) {
+        int firstBand = std::max(0, int(std::floor(leaves[i].minY)) / int(bandHeight));
+        int lastBand = std::min(int(bandLeaves.size()) - 1, int(std::ceil(leaves[i].maxY)) / int(bandHeight));
+        for (int band = firstBand; band <= lastBand; ++band)
+            bandLeaves[band].push_back(int(i));
+    }
+    return bandLeaves;
+}
+
+void UVBSPAntialiasedExporter::renderBand(const Settings& settings, const std::vector<PixelLeaf>& leaves,
+    const std::vector<int>& leafIndices, uint32_t y0, uint32_t rowCount, float* rgb) const
+{
+    const uint32_t width = settings.width;
+    std::fill_n(rgb, size_t(width) * rowCount * 3, 0.f);
+    UVPolygon clipped, strip, column;
+
+    for (int leafIndex : leafIndices) {
+        const PixelLeaf& leaf = leaves[leafIndex];
+        const uint32_t rowStart = std::max<int64_t>(y0, int64_t(std::floor(leaf.minY)));
+        const uint32_t rowEnd = std::min<int64_t>(y0 + rowCount, int64_t(std::ceil(leaf.maxY)));
+
+        for (uint32_t y = rowStart; y < rowEnd; ++y) {
+            clipAxis(leaf.polygon, true, y, false, clipped);
+            clipAxis(clipped, true, y + 1.0, true, strip);
+            if (strip.empty())
+                continue;
+
+            // strip is convex: a column is fully covered when it is inside
+            // of the polygon extent on both the top and the bottom texel edge
+            double minX = INFINITY, maxX = -INFINITY;
+            double topMin = INFINITY, topMax = -INFINITY, bottomMin = INFINITY, bottomMax = -INFINITY;
+            for (const dvec2& p : strip) {
+                minX = std::min(minX, p.x);
+                maxX = std::max(maxX, p.x);
+                if (p.y <= y + s_edgeEpsilon)
+                    topMin = std::min(topMin, p.x), topMax = std::max(topMax, p.x);
+                if (p.y >= y + 1.0 - s_edgeEpsilon)
+                    bottomMin = std::min(bottomMin, p.x), bottomMax = std::max(bottomMax, p.x);
+            }
+            const double fullStart = std::max(topMin, bottomMin) - s_edgeEpsilon;
+            const double fullEnd = std::min(topMax, bottomMax) + s_edgeEpsilon;
+
+            float* row = rgb + size_t(y - y0) * width * 3;
+            const uint32_t columnStart = std::max<int64_t>(0, int64_t(std::floor(minX)));
+            const uint32_t columnEnd = std::min<int64_t>(width, int64_t(std::ceil(maxX)));
+            for (uint32_t x = columnStart; x < columnEnd; ++x) {
+                float coverage = 1.f;
+                if (x < fullStart || x + 1.0 > fullEnd) {
+                    clipAxis(strip, false, x, false, clipped);
+                    clipAxis(clipped, false, x + 1.0, true, column);
+                    coverage = float(polygonArea(column));
+                }
+                for (int c = 0; c < 3; ++c)
+                    row[x * 3 + c] += coverage * leaf.color[c];
+            }
+        }
+    }
+}
+
+bool UVBSPAntialiasedExporter::exportImage(const std::string& path, const Settings& settings) const
+{
+    StreamingImageWriter writer;
+    if (!writer.open(path, StreamingImageWriter::getFormatFromPath(path), settings.width, settings.height, 3, 8)) {
+        LOG("Failed to open image for writing: " << path);
+        return false;
+    }
+
+    const std::vector<PixelLeaf> leaves = getPixelLeaves(settings);
+    const std::vector<std::vector<int>> bandLeaves = getBandLeaves(settings, leaves);
+    const uint32_t bandHeight = std::max(settings.bandHeight, 1u);
+    const size_t bandSize = size_t(settings.width) * bandHeight * 3;
+
+    // a group of bands is rendered in parallel, then written, so memory stays bounded
+    const size_t bandsPerGroup = 4 * getThreadCount(settings.threadCount);
+    std::vector<float> rgb(bandSize * bandsPerGroup);
+    std::vector<uint8_t> rows(bandSize * bandsPerGroup);
+
+    for (size_t groupStart = 0; groupStart < bandLeaves.size(); groupStart += bandsPerGroup) {
+        const size_t groupBands = std::min(bandsPerGroup, bandLeaves.size() - groupStart);
+        parallelFor(
+            groupBands, [&](size_t i) {
+                const size_t band = groupStart + i;
+                const uint32_t y0 = uint32_t(band * bandHeight);
+                const uint32_t rowCount = std::min(bandHeight, settings.height - y0);
+                float* bandRgb = rgb.data() + bandSize * i;
+                renderBand(settings, leaves, bandLeaves[band], y0, rowCount, bandRgb);
+
+                uint8_t* bandRows = rows.data() + bandSize * i;
+                for (size_t j = 0; j < size_t(settings.width) * rowCount * 3; ++j)
+                    bandRows[j] = uint8_t(std::clamp(bandRgb[j], 0.f, 1.f) * 255.f + 0.5f);
+            },
+            settings.threadCount);
+
+        // bands of a group are consecutive in memory, only the last one can be shorter
+        const uint32_t y0 = uint32_t(groupStart * bandHeight);
+        const uint32_t rowCount = std::min<uint32_t>(uint32_t(groupBands * bandHeight), settings.height - y0);
+        if (!writer.writeRows(rows.data(), rowCount)) {
+            LOG("Failed to write image rows: " << path);
+            return false;
+        }
+    }
+    return writer.close();
+}
+
+UVBSPAntialiasedExporter::Comparison UVBSPAntialiasedExporter::compareWithSupersampled(const Settings& settings, int samplesPerAxis) const
+{
+    Comparison comparison;
+    const uint32_t width = settings.width, height = settings.height;
+    const uint32_t bandHeight = std::max(settings.bandHeight, 1u);
+    samplesPerAxis = std::max(samplesPerAxis, 1);
+
+    auto start = std::chrono::steady_clock::now();
+    const std::vector<PixelLeaf> leaves = getPixelLeaves(settings);
+    const std::vector<std::vector<int>> bandLeaves = getBandLeaves(settings, leaves);
+    std::vector<float> analytic(size_t(width) * height * 3);
+    parallelFor(
+        bandLeaves.size(), [&](size_t band) {
+            const uint32_t y0 = uint32_t(band * bandHeight);
+            renderBand(settings, leaves, bandLeaves[band], y0, std::min(bandHeight, height - y0),
+                analytic.data() + size_t(y0) * width * 3);
+        },
+        settings.threadCount);
+    comparison.analyticSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    start = std::chrono::steady_clock::now();
+    m_uvbsp.getCompiledTree(); // compiled before threads share it
+    std::vector<float> supersampled(size_t(width) * height * 3);
+    parallelFor(
+        height, [&](size_t y) {
+            const int samplesPerTexel = samplesPerAxis * samplesPerAxis;
+            std::vector<bsp::vec2> samples(size_t(width) * samplesPerTexel);
+            std::vector<int> colorIndices(samples.size());
+            for (uint32_t x = 0; x < width; ++x)
+                for (int sy = 0; sy < samplesPerAxis; ++sy)
+                    for (int sx = 0; sx < samplesPerAxis; ++sx)
+                        samples[size_t(x) * samplesPerTexel + sy * samplesPerAxis + sx] = bsp::vec2(
+                            (x + (sx + 0.5f) / samplesPerAxis) / width,
+                            (y + (sy + 0.5f) / samplesPerAxis) / height);
+            m_uvbsp.classify(samples.data(), samples.size(), colorIndices.data());
+
+            for (uint32_t x = 0; x < width; ++x) {
+                float* texel = supersampled.data() + (size_t(y) * width + x) * 3;
+                for (int s = 0; s < samplesPerTexel; ++s) {
+                    int colorIndex = colorIndices[size_t(x) * samplesPerTexel + s];
+                    const UVBSPColor color = (size_t)colorIndex < settings.palette.size()
+                        ? settings.palette[colorIndex]
+                        : getRainbowColor(colorIndex);
+                    for (int c = 0; c < 3; ++c)
+                        texel[c] += color[c] / samplesPerTexel;
+                }
+            }
+        },
+        settings.threadCount);
+    comparison.supersampledSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    double errorSum = 0;
+    for (size_t i = 0; i < analytic.size(); ++i) {
+        double error = std::abs(double(analytic[i]) - supersampled[i]);
+        comparison.maxError = std::max(comparison.maxError, error);
+        errorSum += error;
+    }
+    comparison.meanError = errorSum / std::max<size_t>(analytic.size(), 1);
+    return comparison;
+}
@@ -0,0 +1,67 @@
+#ifndef UVBSP_EXPORT_H
+#define UVBSP_EXPORT_H
+
+#include <array>
+#include <uvbsp/uvbsp.h>
+
+typedef std::array<float, 3> UVBSPColor; // RGB 0..1
+
+// Same colors as the preview in BSPshader.frag: rainbow(0.5 * index)
+UVBSPColor getRainbowColor(int colorIndex);
+
+////////////////////////////////// UVBSP ANTIALIASED EXPORTER //////////////////////////////
+
+// Exports the segments as an antialiased RGB image. Every texel gets the exact
+// coverage of each leaf cell polygon (clipped against the texel square),
+// palette colors are blended by coverage. Scanline bands run on all cores.
+
+class UVBSPAntialiasedExporter {
+public:
+    struct Settings {
+        uint32_t width = 4096, height = 4096;
+        uint32_t bandHeight = 32;
+        unsigned threadCount = 0; // all cores
+        std::vector<UVBSPColor> palette; // by color index, rainbow for missing ones
+    };
+
+    struct Comparison {
+        double maxError {}, meanError {}; // per channel, 0..1
+        double analyticSeconds {}, supersampledSeconds {};
+
+        std::string getInfo() const
+        {
+            return "Max error: " + std::to_string(maxError) + "   Mean error: " + std::to_string(meanError)
+                + "   Analytic: " + std::to_string(analyticSeconds) + "s"
+                + "   Supersampled: " + std::to_string(supersampledSeconds) + "s";
+        }
+    };
+
+    UVBSPAntialiasedExporter(const UVBSP& uvbsp)
+        : m_uvbsp(uvbsp)
+    {
+    }
+
+    // Format by extension: png, tga, anything else is raw RGB
+    bool exportImage(const std::string& path, const Settings& settings) const;
+
+    // Renders the image both ways, reference is samplesPerAxis^2 classify() samples per texel
+    Comparison compareWithSupersampled(const Settings& settings, int samplesPerAxis = 8) const;
+
+private:
+    struct PixelLeaf {
+        UVPolygon polygon; // in pixels
+        double minY, maxY;
+        UVBSPColor color;
+    };
+
+    std::vector<PixelLeaf> getPixelLeaves(const Settings& settings) const;
+    // Linear RGB floats of rows [y0, y0 + rowCount), leaves indices are the ones touching these rows
+    void renderBand(const Settings& settings, const std::vector<PixelLeaf>& leaves,
+        const std::vector<int>& leafIndices, uint32_t y0, uint32_t rowCount, float* rgb) const;
+    // Leaf indices per band of settings.bandHeight rows
+    std::vector<std::vector<int>> getBandLeaves(const Settings& settings, const std::vector<PixelLeaf>& leaves) const;
+
+    const UVBSP& m_uvbsp;
+};
+
+#endif // UVBSP_EXPORT_H
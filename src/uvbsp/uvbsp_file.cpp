@@ -0,0 +1,313 @@
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <uvbsp/uvbsp_file.h>
+#include <uvbsp/uvbsp_json.h>
+
+#ifndef LOG
+#define LOG(x) std::cout << x << std::endl
+#endif
+
+namespace {
+
+bool isLittleEndianHost()
+{
+    const uint16_t value = 1;
+    return *reinterpret_cast<const uint8_t*>(&value) == 1;
+}
+
+// node block is used in place only if it is exactly the UVBSPSplit memory
+constexpr bool s_splitLayoutMatches = sizeof(UVBSPSplit) == UVBSPFileHeader::s_nodeSize
+    && offsetof(UVBSPSplit, dir) == 8 && offsetof(UVBSPSplit, l) == 16 && offsetof(UVBSPSplit, r) == 20;
+
+uint64_t updateFnv1a(uint64_t hash, const uint8_t* data, size_t size)
+{
+    for (size_t i = 0; i < size; ++i)
+        hash = (hash ^ data[i]) * 0x100000001B3ull;
+    return hash;
+}
+constexpr uint64_t s_fnvOffsetBasis = 0xCBF29CE484222325ull;
+
+uint32_t readU32(const uint8_t* data)
+{
+    return uint32_t(data[0]) | uint32_t(data[1]) << 8 | uint32_t(data[2]) << 16 | uint32_t(data[3]) << 24;
+}
+
+uint64_t readU64(const uint8_t* data)
+{
+    return uint64_t(readU32(data)) | uint64_t(readU32(data + 4)) << 32;
+}
+
+float readFloat(const uint8_t* data)
+{
+    uint32_t bits = readU32(data);
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+void appendU32(std::vector<uint8_t>& out, uint32_t value)
+{
+    for (int i = 0; i < 4; ++i)
+        out.push_back(uint8_t(value >> (8 * i)));
+}
+
+void appendU64(std::vector<uint8_t>& out, uint64_t value)
+{
+    appendU32(out, uint32_t(value));
+    appendU32(out, uint32_t(value >> 32));
+}
+
+void appendFloat(std::vector<uint8_t>& out, float value)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    appendU32(out, bits);
+}
+
+void appendSplit(std::vector<uint8_t>& out, const UVBSPSplit& split)
+{
+    appendFloat(out, split.pos.x);
+    appendFloat(out, split.pos.y);
+    appendFloat(out, split.dir.x);
+    appendFloat(out, split.dir.y);
+    appendU32(out, uint32_t(split.l));
+    appendU32(out, uint32_t(split.r));
+}
+
+UVBSPSplit readSplit(const uint8_t* data)
+{
+    UVBSPSplit split;
+    split.pos = bsp::vec2(readFloat(data), readFloat(data + 4));
+    split.dir = bsp::vec2(readFloat(data + 8), readFloat(data + 12));
+    split.l = int(readU32(data + 16));
+    split.r = int(readU32(data + 20));
+    return split;
+}
+
+} // namespace
+
+bool isHistoryValid(const std::vector<UVBSPAddRecord>& history, size_t historyIndex, size_t nodeCount)
+{
+    if (historyIndex > history.size())
+        return false;
+    // nodes before the first record, the applied ones added one node each unless they replaced the root
+    int64_t currentCount = nodeCount;
+    for (size_t i = 0; i < historyIndex; ++i)
+        currentCount -= history[i].parentIndex >= 0;
+    if (currentCount < 1)
+        return false;
+
+    for (size_t i = 0; i < history.size(); ++i) {
+        const UVBSPAddRecord& record = history[i];
+        if ((record.side != 0 && record.side != 1) || record.previousChild < 0 || record.split.l < 0 || record.split.r < 0)
+            return false;
+        if (record.parentIndex < 0) {
+            if (record.parentIndex != -1 || i != 0 || currentCount != 1)
+                return false;
+        } else if (record.parentIndex >= currentCount) {
+            return false;
+        } else {
+            currentCount++;
+        }
+    }
+    return true;
+}
+
+bool isTreeValid(const std::vector<UVBSPSplit>& nodes)
+{
+    return isTreeValid(nodes.data(), nodes.size());
+}
+
+bool isTreeValid(const UVBSPSplit* nodes, size_t nodeCount)
+{
+    if (nodeCount == 0)
+        return false;
+    for (size_t i = 0; i < nodeCount; ++i)
+        for (int childIndex : { nodes[i].l, nodes[i].r })
+            if (childIndex < 0 && (childIndex == INT32_MIN || -childIndex >= int64_t(nodeCount)))
+                return false;
+
+    // no recursion, a file may hold a chain of any depth
+    std::vector<bool> visited(nodeCount);
+    std::vector<int> stack { 0 };
+    visited[0] = true;
+    while (!stack.empty()) {
+        const UVBSPSplit& node = nodes[stack.back()];
+        stack.pop_back();
+        for (int childIndex : { node.l, node.r }) {
+            if (childIndex >= 0)
+                continue;
+            if (visited[-childIndex])
+                return false;
+            visited[-childIndex] = true;
+            stack.push_back(-childIndex);
+        }
+    }
+    return true;
+}
+
+////////////////////////////////// UVBSP FILE VIEW //////////////////////////////
+
+bool UVBSPFileView::isBinaryFile(const std::string& path)
+{
+    char magic[sizeof(UVBSPFileHeader::s_magic)] {};
+    std::ifstream file(path, std::ios::binary);
+    return file.read(magic, sizeof(magic)) && std::memcmp(magic, UVBSPFileHeader::s_magic, sizeof(magic)) == 0;
+}
+
+bool UVBSPFileView::open(const std::string& path)
+{
+    m_nodes = nullptr;
+    m_swappedNodes.clear();
+    m_history.clear();
+    if (!m_file.open(path)) {
+        LOG("Failed to map file: " << path);
+        return false;
+    }
+
+    const uint8_t* data = m_file.data();
+    const size_t size = m_file.size();
+    if (size < UVBSPFileHeader::s_size || std::memcmp(data, UVBSPFileHeader::s_magic, sizeof(UVBSPFileHeader::s_magic)) != 0) {
+        LOG("Not a binary uvbsp file: " << path);
+        return false;
+    }
+
+    m_header.version = readU32(data + 8);
+    m_header.flags = readU32(data + 12);
+    m_header.nodeCount = readU32(data + 16);
+    m_header.maxDepth = readU32(data + 20);
+    m_header.colorCount = readU32(data + 24);
+    m_header.colorIndex = readU32(data + 28);
+    m_header.historyCount = readU32(data + 32);
+    m_header.historyIndex = readU32(data + 36);
+    // 40: reserved
+    m_header.nodeOffset = readU64(data + 48);
+    m_header.checksum = readU64(data + 56);
+
+    if (m_header.version == 0 || m_header.version > UVBSPFileHeader::s_version) {
+        LOG("Unsupported uvbsp file version " << m_header.version << ": " << path);
+        return false;
+    }
+
+    const uint64_t nodeBytes = uint64_t(m_header.nodeCount) * UVBSPFileHeader::s_nodeSize;
+    const uint64_t historyBytes = uint64_t(m_header.historyCount) * UVBSPFileHeader::s_recordSize;
+    if (m_header.nodeCount == 0 || m_header.nodeOffset < UVBSPFileHeader::s_size || m_header.nodeOffset % 4
+        || m_header.nodeOffset + nodeBytes + historyBytes > size || m_header.historyIndex > m_header.historyCount) {
+        LOG("Corrupted uvbsp file header: " << path);
+        return false;
+    }
+
+    const uint8_t* nodeData = data + m_header.nodeOffset;
+    if (updateFnv1a(s_fnvOffsetBasis, nodeData, nodeBytes + historyBytes) != m_header.checksum) {
+        LOG("Checksum mismatch in uvbsp file: " << path);
+        return false;
+    }
+
+    if (s_splitLayoutMatches && isLittleEndianHost()) {
+        m_nodes = reinterpret_cast<const UVBSPSplit*>(nodeData);
+    } else {
+        m_swappedNodes.resize(m_header.nodeCount);
+        for (size_t i = 0; i < m_header.nodeCount; ++i)
+            m_swappedNodes[i] = readSplit(nodeData + i * UVBSPFileHeader::s_nodeSize);
+        m_nodes = m_swappedNodes.data();
+    }
+
+    if (!isTreeValid(m_nodes, m_header.nodeCount)) {
+        LOG("Invalid node links in uvbsp file: " << path);
+        m_nodes = nullptr;
+        m_swappedNodes.clear();
+        return false;
+    }
+
+    // undo and redo write record links into the tree, they are checked the same way
+    m_history.resize(m_header.historyCount);
+    const uint8_t* recordData = nodeData + nodeBytes;
+    for (UVBSPAddRecord& record : m_history) {
+        record.parentIndex = int(readU32(recordData));
+        record.side = int(readU32(recordData + 4));
+        record.previousChild = int(readU32(recordData + 8));
+        record.split = readSplit(recordData + 12);
+        recordData += UVBSPFileHeader::s_recordSize;
+    }
+    if (!isHistoryValid(m_history, m_header.historyIndex, m_header.nodeCount)) {
+        LOG("Invalid history record in uvbsp file: " << path);
+        m_nodes = nullptr;
+        m_history.clear();
+        return false;
+    }
+    return true;
+}
+
+////////////////////////////////// UVBSP //////////////////////////////
+
+bool UVBSP::readFromFile(const std::string& path, UVBSPEditorState* state)
+{
+    if (!UVBSPFileView::isBinaryFile(path)) {
+        if (isUVBSPJsonFile(path)) // base64 text never starts with '{'
+            return readFromJson(path, state);
+        if (!readLegacyFile(path))
+            return false;
+        if (state) // next even color after the used ones, as drawn in pairs
+            *state = { uint32_t(getColorCount() + 1) & ~1u, {}, 0 };
+        return true;
+    }
+
+    UVBSPFileView view;
+    if (!view.open(path))
+        return false;
+
+    const UVBSPFileHeader& header = view.getHeader();
+    reset();
+    m_nodes.assign(view.getNodes(), view.getNodes() + header.nodeCount);
+    m_initialSet = header.flags & UVBSPFileHeader::InitialSplitSet;
+    m_compiledTreeDirty = true;
+    m_pointGridDirty = true;
+    m_treeStatsDirty = true;
+    m_cells.clear();
+    m_cellsDirty = true;
+
+    if (state)
+        *state = { header.colorIndex, view.getHistory(), header.historyIndex };
+    return true;
+}
+
+bool UVBSP::writeToFile(const std::string& path, const UVBSPEditorState* state) const
+{
+    const UVBSPEditorState emptyState;
+    if (!state)
+        state = &emptyState;
+
+    std::vector<uint8_t> blocks;
+    blocks.reserve(m_nodes.size() * UVBSPFileHeader::s_nodeSize + state->history.size() * UVBSPFileHeader::s_recordSize);
+    for (const UVBSPSplit& split : m_nodes)
+        appendSplit(blocks, split);
+    for (const UVBSPAddRecord& record : state->history) {
+        appendU32(blocks, uint32_t(record.parentIndex));
+        appendU32(blocks, uint32_t(record.side));
+        appendU32(blocks, uint32_t(record.previousChild));
+        appendSplit(blocks, record.split);
+    }
+
+    std::vector<uint8_t> header(UVBSPFileHeader::s_magic, UVBSPFileHeader::s_magic + sizeof(UVBSPFileHeader::s_magic));
+    appendU32(header, UVBSPFileHeader::s_version);
+    appendU32(header, m_initialSet ? uint32_t(UVBSPFileHeader::InitialSplitSet) : 0u);
+    appendU32(header, m_nodes.size());
+    appendU32(header, getCompiledTree().getMaxDepth());
+    appendU32(header, getColorCount());
+    appendU32(header, state->colorIndex);
+    appendU32(header, state->history.size());
+    appendU32(header, std::min(state->historyIndex, state->history.size()));
+    appendU64(header, 0); // reserved
+    appendU64(header, UVBSPFileHeader::s_size);
+    appendU64(header, updateFnv1a(s_fnvOffsetBasis, blocks.data(), blocks.size()));
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char*>(header.data()), header.size());
+    file.write(reinterpret_cast<const char*>(blocks.data()), blocks.size());
+    if (!file) {
+        LOG("Failed to write uvbsp file: " << path);
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,82 @@
+#ifndef UVBSP_FILE_H
+#define UVBSP_FILE_H
+
+#include "mapped_file.h"
+#include <uvbsp/uvbsp.h>
+
+// Binary .uvbsp file, all values little endian:
+//   header (64 bytes, UVBSPFileHeader)
+//   node block at nodeOffset: nodeCount x 24 bytes, the UVBSPSplit layout
+//     (pos.x, pos.y, dir.x, dir.y: float, l, r: int32), checked in place when mapped
+//   history block right after: historyCount x 36 bytes, UVBSPAddRecord
+//     (parentIndex, side, previousChild: int32, then the split as in the node block)
+// Checksum is 64 bit FNV-1a of both blocks.
+// Files without the magic are the old format: base64 of the node array.
+
+struct UVBSPFileHeader {
+    static constexpr char s_magic[8] = { 'U', 'V', 'B', 'S', 'P', 'B', 'I', 'N' };
+    static constexpr uint32_t s_version = 1;
+    static constexpr uint32_t s_size = 64;
+    static constexpr uint32_t s_nodeSize = 24;
+    static constexpr uint32_t s_recordSize = 36;
+
+    enum Flags : uint32_t {
+        InitialSplitSet = 1 // root is a drawn split, not the placeholder of reset()
+    };
+
+    uint32_t version = s_version;
+    uint32_t flags {};
+    uint32_t nodeCount {};
+    uint32_t maxDepth {};
+    uint32_t colorCount {}; // highest color index + 1
+    uint32_t colorIndex {}; // color of the next drawn split
+    uint32_t historyCount {};
+    uint32_t historyIndex {}; // actions before it are applied, the rest is redo
+    uint64_t nodeOffset = s_size;
+    uint64_t checksum {};
+};
+
+// Editor state saved with the tree
+struct UVBSPEditorState {
+    uint32_t colorIndex {};
+    std::vector<UVBSPAddRecord> history;
+    size_t historyIndex {};
+};
+
+// History read from a file must replay on its nodeCount nodes: undo of the applied
+// records and redo of the others keep every link inside of the tree. A record replaces
+// a color with a split of two colors, its parent exists when it is applied, only the
+// first one may replace the initial root. Checked by the binary and the JSON reader
+bool isHistoryValid(const std::vector<UVBSPAddRecord>& history, size_t historyIndex, size_t nodeCount);
+
+// Nodes read from a file must form a tree: every link stays inside of the array and
+// the walk from the root reaches no node twice, so no cycle and no shared child.
+// Checked by the binary, the JSON and the legacy base64 reader
+bool isTreeValid(const std::vector<UVBSPSplit>& nodes);
+bool isTreeValid(const UVBSPSplit* nodes, size_t nodeCount);
+
+////////////////////////////////// UVBSP FILE VIEW //////////////////////////////
+
+// Mapped binary file, checked on open: checksum, node links and history records.
+// Nodes are checked straight in the mapping on little endian hosts, swapped into
+// a copy otherwise. UVBSP copies them once into its editable node array.
+
+class UVBSPFileView {
+public:
+    static bool isBinaryFile(const std::string& path);
+
+    bool open(const std::string& path);
+
+    const UVBSPFileHeader& getHeader() const { return m_header; }
+    const UVBSPSplit* getNodes() const { return m_nodes; }
+    const std::vector<UVBSPAddRecord>& getHistory() const { return m_history; }
+
+private:
+    MappedFile m_file;
+    UVBSPFileHeader m_header;
+    const UVBSPSplit* m_nodes {};
+    std::vector<UVBSPSplit> m_swappedNodes;
+    std::vector<UVBSPAddRecord> m_history;
+};
+
+#endif // UVBSP_FILE_H
@@ -0,0 +1,130 @@
+#ifndef UVBSP_GEOMETRY_H
+#define UVBSP_GEOMETRY_H
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// Convex cells of the partition, in double precision.
+// Lines come from packed nodes, so sides agree with traverseTree().
+
+struct dvec2 {
+    double x {}, y {};
+};
+
+typedef std::vector<dvec2> UVPolygon; // convex, counter clockwise
+
+// Packed node side test: (normalizedPos - u) * tangent - v < 0 is the left side.
+// Normalized to unit length, so eval() is a signed distance in UV.
+struct UVHalfPlane {
+    UVHalfPlane() = default;
+    UVHalfPlane(double normalizedPos, double tangent)
+    {
+        double invLength = 1.0 / std::sqrt(tangent * tangent + 1.0);
+        a = -tangent * invLength;
+        b = -invLength;
+        c = normalizedPos * tangent * invLength;
+    }
+    double eval(dvec2 p) const { return a * p.x + b * p.y + c; }
+
+    double a {}, b {}, c {};
+};
+
+inline UVPolygon makeUnitSquare()
+{
+    return { { 0, 0 }, { 1, 0 }, { 1, 1 }, { 0, 1 } };
+}
+
+inline dvec2 lerp(dvec2 a, dvec2 b, double t)
+{
+    return { a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t };
+}
+
+// Sutherland-Hodgman against one line, keeps left (eval < 0) or right side
+inline void clipPolygon(const UVPolygon& polygon, const UVHalfPlane& plane, bool keepLeft, UVPolygon& result)
+{
+    result.clear();
+    const double sign = keepLeft ? -1.0 : 1.0;
+    for (size_t i = 0; i < polygon.size(); ++i) {
+        const dvec2& a = polygon[i];
+        const dvec2& b = polygon[(i + 1) % polygon.size()];
+        double da = plane.eval(a) * sign;
+        double db = plane.eval(b) * sign;
+        if (da >= 0)
+            result.push_back(a);
+        if ((da >= 0) != (db >= 0))
+            result.push_back(lerp(a, b, da / (da - db)));
+    }
+    if (result.size() < 3)
+        result.clear();
+}
+
+// Part of the line inside of polygon, false if the line misses it
+inline bool clipLineToPolygon(const UVPolygon& polygon, const UVHalfPlane& plane, dvec2& start, dvec2& end)
+{
+    int found = 0;
+    for (size_t i = 0; i < polygon.size() && found < 2; ++i) {
+        const dvec2& a = polygon[i];
+        const dvec2& b = polygon[(i + 1) % polygon.size()];
+        double da = plane.eval(a);
+        double db = plane.eval(b);
+        if ((da < 0) != (db < 0)) {
+            (found ? end : start) = lerp(a, b, da / (da - db));
+            found++;
+        }
+    }
+    return found == 2;
+}
+
+inline double polygonArea(const UVPolygon& polygon)
+{
+    double area = 0;
+    for (size_t i = 0; i < polygon.size(); ++i) {
+        const dvec2& a = polygon[i];
+        const dvec2& b = polygon[(i + 1) % polygon.size()];
+        area += a.x * b.y - b.x * a.y;
+    }
+    return std::abs(area) * 0.5;
+}
+
+inline dvec2 polygonCentroid(const UVPolygon& polygon)
+{
+    double area = 0;
+    dvec2 centroid;
+    for (size_t i = 0; i < polygon.size(); ++i) {
+        const dvec2& a = polygon[i];
+        const dvec2& b = polygon[(i + 1) % polygon.size()];
+        double cross = a.x * b.y - b.x * a.y;
+        area += cross;
+        centroid.x += (a.x + b.x) * cross;
+        centroid.y += (a.y + b.y) * cross;
+    }
+    if (area == 0) { // degenerate, average of vertices
+        for (const dvec2& p : polygon)
+            centroid.x += p.x, centroid.y += p.y;
+        double count = polygon.empty() ? 1.0 : double(polygon.size());
+        return { centroid.x / count, centroid.y / count };
+    }
+    return { centroid.x / (3 * area), centroid.y / (3 * area) };
+}
+
+// Polygon with cached measures
+struct UVRegion {
+    UVPolygon polygon;
+    double area {};
+    dvec2 centroid, boundsMin, boundsMax;
+
+    void setPolygon(const UVPolygon& newPolygon)
+    {
+        polygon = newPolygon;
+        area = polygonArea(polygon);
+        centroid = polygonCentroid(polygon);
+        boundsMin = boundsMax = polygon.empty() ? dvec2() : polygon[0];
+        for (const dvec2& p : polygon) {
+            boundsMin = { std::min(boundsMin.x, p.x), std::min(boundsMin.y, p.y) };
+            boundsMax = { std::max(boundsMax.x, p.x), std::max(boundsMax.y, p.y) };
+        }
+    }
+};
+
+#endif // UVBSP_GEOMETRY_H
@@ -0,0 +1,166 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <uvbsp/uvbsp.h>
+
+// 0 or 1 if the whole square is on that side of the addSplit() test, -1 if it may cross the line
+static int getSquareSide(const UVBSPSplit& node, double x0, double y0, double x1, double y1)
+{
+    const double dirX = node.dir.x, dirY = node.dir.y;
+    // far over the rounding of dot(pos - uv, dir) in float, a square touching the line is undecided
+    const double margin = 1e-5 * ((std::fabs(node.pos.x) + 1.0) * std::fabs(dirX) + (std::fabs(node.pos.y) + 1.0) * std::fabs(dirY));
+    double minDot = std::numeric_limits<double>::max(), maxDot = std::numeric_limits<double>::lowest();
+    for (double x : { x0, x1 })
+        for (double y : { y0, y1 }) {
+            const double dot = (node.pos.x - x) * dirX + (node.pos.y - y) * dirY;
+            minDot = std::min(minDot, dot);
+            maxDot = std::max(maxDot, dot);
+        }
+    if (maxDot < -margin)
+        return 0;
+    if (minDot > margin)
+        return 1;
+    return -1;
+}
+
+void UVBSPPointGrid::moveDown(const std::vector<UVBSPSplit>& nodes, int fromNode, int x, int y, int width, int height)
+{
+    // rectangles of grid cells go down together, only the ones crossing a line are split in four
+    const double cellSize = 1.0 / m_resolution;
+    std::vector<Block>& blocks = m_blocks;
+    blocks.push_back({ fromNode, x, y, width, height });
+    while (!blocks.empty()) {
+        const Block block = blocks.back();
+        blocks.pop_back();
+        const UVBSPSplit& node = nodes[block.nodeIndex];
+        const int side = getSquareSide(node, block.x * cellSize, block.y * cellSize,
+            (block.x + block.width) * cellSize, (block.y + block.height) * cellSize);
+        const int childIndex = side == 0 ? node.l : node.r;
+        if (side >= 0 && childIndex < 0) {
+            blocks.push_back({ -childIndex, block.x, block.y, block.width, block.height });
+            continue;
+        }
+        if (side < 0 && (block.width > 1 || block.height > 1)) {
+            const int halfWidth = (block.width + 1) / 2, halfHeight = (block.height + 1) / 2;
+            for (int i = 0; i < 4; ++i) {
+                const int blockWidth = (i & 1) ? block.width - halfWidth : halfWidth;
+                const int blockHeight = (i >> 1) ? block.height - halfHeight : halfHeight;
+                if (blockWidth && blockHeight)
+                    blocks.push_back({ block.nodeIndex, block.x + (i & 1) * halfWidth, block.y + (i >> 1) * halfHeight, blockWidth, blockHeight });
+            }
+            continue;
+        }
+
+        if (block.nodeIndex == fromNode)
+            continue; // stays
+        NodeInfo& info = m_nodeInfos[block.nodeIndex];
+        for (int cellY = block.y; cellY < block.y + block.height; ++cellY)
+            for (int cellX = block.x; cellX < block.x + block.width; ++cellX) {
+                int& startNode = m_startNodes[cellY * m_resolution + cellX];
+                if (startNode != fromNode)
+                    continue; // deeper already
+                startNode = block.nodeIndex;
+                info.minX = std::min(info.minX, cellX);
+                info.minY = std::min(info.minY, cellY);
+                info.maxX = std::max(info.maxX, cellX);
+                info.maxY = std::max(info.maxY, cellY);
+            }
+    }
+}
+
+void UVBSPPointGrid::build(const std::vector<UVBSPSplit>& nodes)
+{
+    m_nodeInfos.assign(nodes.size(), NodeInfo());
+    m_nodeInfos[0].depth = 1;
+    std::vector<int> stack { 0 };
+    while (!stack.empty()) {
+        const int index = stack.back();
+        stack.pop_back();
+        for (int childIndex : { nodes[index].l, nodes[index].r })
+            if (childIndex < 0 && !m_nodeInfos[-childIndex].depth) {
+                m_nodeInfos[-childIndex].depth = m_nodeInfos[index].depth + 1;
+                stack.push_back(-childIndex);
+            }
+    }
+
+    // 1 to 16 nodes per grid cell until the next build, so appending costs about the same at any tree size
+    m_resolution = 1;
+    while (m_resolution < s_maxResolution && 4 * m_resolution * m_resolution < int(nodes.size()))
+        m_resolution *= 2;
+    m_startNodes.assign(m_resolution * m_resolution, 0);
+    m_nodeInfos[0] = { 1, 0, 0, m_resolution - 1, m_resolution - 1 };
+    moveDown(nodes, 0, 0, 0, m_resolution, m_resolution);
+}
+
+void UVBSPPointGrid::appendNode(const std::vector<UVBSPSplit>& nodes, int parentIndex)
+{
+    if (m_resolution < s_maxResolution && int(nodes.size()) > 16 * m_resolution * m_resolution) {
+        build(nodes); // twice the resolution
+        return;
+    }
+    m_nodeInfos.resize(nodes.size());
+    m_nodeInfos.back().depth = m_nodeInfos[parentIndex].depth + 1;
+
+    // only grid cells stopped at the parent can reach the new node
+    const NodeInfo& parent = m_nodeInfos[parentIndex];
+    if (parent.maxX >= 0)
+        moveDown(nodes, parentIndex, parent.minX, parent.minY, parent.maxX - parent.minX + 1, parent.maxY - parent.minY + 1);
+}
+
+void UVBSPPointGrid::removeLastNode(int parentIndex)
+{
+    const int nodeIndex = int(m_nodeInfos.size()) - 1;
+    const NodeInfo node = m_nodeInfos.back();
+    m_nodeInfos.pop_back();
+
+    NodeInfo& parent = m_nodeInfos[parentIndex];
+    for (int y = node.minY; y <= node.maxY; ++y)
+        for (int x = node.minX; x <= node.maxX; ++x)
+            if (m_startNodes[y * m_resolution + x] == nodeIndex)
+                m_startNodes[y * m_resolution + x] = parentIndex;
+    if (node.maxX >= 0) {
+        parent.minX = std::min(parent.minX, node.minX);
+        parent.minY = std::min(parent.minY, node.minY);
+        parent.maxX = std::max(parent.maxX, node.maxX);
+        parent.maxY = std::max(parent.maxY, node.maxY);
+    }
+}
+
+int UVBSPPointGrid::getStartNode(bsp::vec2 uv) const
+{
+    if (!(uv.x >= 0.f && uv.x <= 1.f && uv.y >= 0.f && uv.y <= 1.f))
+        return 0;
+    // exact, the resolution is a power of two
+    const int x = std::min(int(uv.x * m_resolution), m_resolution - 1);
+    const int y = std::min(int(uv.y * m_resolution), m_resolution - 1);
+    return m_startNodes[y * m_resolution + x];
+}
+
+UVBSPPointLocation UVBSP::locate(bsp::vec2 uv) const
+{
+    // small trees are walked from the root, keeping the grid would cost more
+    if (m_pointGridDirty && m_nodes.size() >= s_pointGridMinNodes) {
+        m_pointGrid.build(m_nodes);
+        m_pointGridDirty = false;
+    }
+
+    UVBSPPointLocation location;
+    location.depth = 1;
+    if (!m_pointGridDirty) {
+        location.startNodeIndex = m_pointGrid.getStartNode(uv);
+        location.nodeIndex = location.startNodeIndex;
+        location.depth = m_pointGrid.getDepth(location.startNodeIndex);
+    }
+    for (;;) { // every path ends with a color
+        const UVBSPSplit& node = m_nodes[location.nodeIndex];
+        const bool isLeftPixel = bsp::dot(node.pos - uv, node.dir) < 0.0;
+        const int indexOfProperSide = isLeftPixel ? node.l : node.r;
+        if (indexOfProperSide >= 0) {
+            location.side = isLeftPixel ? 0 : 1;
+            location.colorIndex = indexOfProperSide;
+            return location;
+        }
+        location.nodeIndex = -indexOfProperSide;
+        location.depth++;
+    }
+}
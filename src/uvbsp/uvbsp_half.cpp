@@ -0,0 +1,275 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <uvbsp/uvbsp_half.h>
+#include <uvbsp/uvbsp_traversal.h>
+
+using DecodedNode = UVBSPHalfNodes::DecodedNode;
+
+static constexpr double s_fixedScale = 32768.0; // steps per unit of direction and offset
+// |dot(uv - 0.5, normal)| <= 0.5 inside the square, farther lines only have to keep their side
+static constexpr double s_maxOffset = 0.75;
+
+// Fixed point values of a line, direction in [0, 65535], offset in int16.
+// Offsets decode to half steps, so lines through texel centers (u = 0.5) stay off them
+struct LineCode {
+    int direction {}, offset {};
+};
+
+// Line of a compiled node with the normal scaled to |x| + |y| = 1, as the fixed point form has it
+struct ExactLine {
+    double normalX {}, normalY {}, offset {};
+};
+
+static ExactLine getExactLine(const bsp::Vec4& node)
+{
+    // left of (pos, tangent) is dot(uv, (tangent, 1)) > pos * tangent
+    const double tangent = node.y, scale = 1.0 / (std::fabs(tangent) + 1.0);
+    return { tangent * scale, scale, ((double(node.x) - 0.5) * tangent - 0.5) * scale };
+}
+
+static LineCode getNearestCode(const ExactLine& line)
+{
+    const double direction = line.normalX >= 0.0 ? line.normalY : 1.0 - line.normalX;
+    return { int(std::clamp(std::nearbyint(direction * s_fixedScale), 0.0, 65535.0)),
+        int(std::floor(std::clamp(line.offset, -s_maxOffset, s_maxOffset) * s_fixedScale)) };
+}
+
+static DecodedNode decodeLine(const LineCode& code, const bsp::Vec4& node)
+{
+    const float direction = float(code.direction) * (1.f / 32768);
+    DecodedNode decoded;
+    decoded.normal = bsp::vec2(1.f - direction, direction < 1.f ? direction : 2.f - direction);
+    decoded.offset = (float(code.offset) + 0.5f) * (1.f / 32768);
+    decoded.left = floatBitsToInt(node.z);
+    decoded.right = floatBitsToInt(node.w);
+    return decoded;
+}
+
+// Same operations in the same order as the generated shader
+static bool isLeftOfLine(const DecodedNode& node, bsp::vec2 uv)
+{
+    return (uv.x - 0.5f) * node.normal.x + (uv.y - 0.5f) * node.normal.y > node.offset;
+}
+
+static bool areIndicesInRange(const DecodedNode& node)
+{
+    return std::max(std::abs(node.left), std::abs(node.right)) <= UVBSPHalfNodes::s_maxIndex;
+}
+
+// Largest difference of the signed distances to both lines at the unit square corners,
+// 0 when both leave the whole square on the same side
+static float getLineOffset(const ExactLine& line, const DecodedNode& decoded)
+{
+    const double offset = decoded.offset;
+    if ((line.offset >= 0.5 && offset >= 0.5) || (line.offset <= -0.5 && offset <= -0.5))
+        return 0.f;
+    const double exactLength = std::hypot(line.normalX, line.normalY);
+    const double decodedLength = std::hypot(double(decoded.normal.x), double(decoded.normal.y));
+    double result = 0;
+    for (double u : { -0.5, 0.5 })
+        for (double v : { -0.5, 0.5 }) {
+            const double before = (u * line.normalX + v * line.normalY - line.offset) / exactLength;
+            const double after = (u * decoded.normal.x + v * decoded.normal.y - offset) / decodedLength;
+            result = std::max(result, std::fabs(after - before));
+        }
+    return float(result);
+}
+
+static void setPackedNode(bsp::Vec4& pair, bool isSecond, const LineCode& code, const DecodedNode& decoded)
+{
+    const uint32_t words[2] = { uint32_t(code.direction) | uint32_t(uint16_t(code.offset)) << 16,
+        uint16_t(decoded.left) | uint32_t(uint16_t(decoded.right)) << 16 };
+    std::memcpy(&(isSecond ? pair.z : pair.x), &words[0], sizeof(uint32_t));
+    std::memcpy(&(isSecond ? pair.w : pair.y), &words[1], sizeof(uint32_t));
+}
+
+bool UVBSPHalfNodes::pack(const UVBSP& uvbsp, const Settings& settings, Report* report)
+{
+    const UVBSPCompiledTree& tree = uvbsp.getCompiledTree();
+    const size_t nodeCount = tree.size();
+    Report localReport;
+    Report& result = report ? *report : localReport;
+    result = Report();
+    result.nodes.resize(nodeCount);
+    m_packed.clear();
+    m_decoded.clear();
+
+    const uint32_t resolution = uint32_t(std::max(settings.checkResolution, 0));
+    std::vector<bsp::vec2> samples(size_t(resolution) * resolution);
+    for (uint32_t y = 0; y < resolution; ++y)
+        for (uint32_t x = 0; x < resolution; ++x)
+            samples[y * resolution + x] = getTexelCenter(x, y, resolution, resolution);
+    result.samplesChecked = samples.size();
+
+    // samples reaching each node in the original tree, children come after their parent
+    std::vector<std::vector<uint32_t>> nodeSamples(nodeCount);
+    if (nodeCount) {
+        nodeSamples[0].resize(samples.size());
+        for (uint32_t i = 0; i < samples.size(); ++i)
+            nodeSamples[0][i] = i;
+    }
+
+    std::vector<bsp::Vec4> packed((nodeCount + 1) / 2, bsp::Vec4(0.f, 0.f, 0.f, 0.f));
+    std::vector<DecodedNode> decoded(nodeCount);
+    std::vector<uint32_t> ownSamples;
+    std::vector<bool> isLeft;
+    std::vector<size_t> nearSamples; // of ownSamples
+    auto countChanged = [&](const DecodedNode& candidate) {
+        size_t changed = 0;
+        for (size_t s : nearSamples)
+            changed += isLeftOfLine(candidate, samples[ownSamples[s]]) != isLeft[s];
+        return changed;
+    };
+    for (size_t i = 0; i < nodeCount; ++i) {
+        const bsp::Vec4& node = tree.data()[i];
+        const int sideIndices[2] = { floatBitsToInt(node.z), floatBitsToInt(node.w) };
+
+        ownSamples = std::move(nodeSamples[i]);
+        isLeft.resize(ownSamples.size());
+        for (size_t s = 0; s < ownSamples.size(); ++s) {
+            isLeft[s] = isLeftPixel(node, samples[ownSamples[s]]);
+            const int sideIndex = sideIndices[isLeft[s] ? 0 : 1];
+            if (sideIndex < 0)
+                nodeSamples[-sideIndex].push_back(ownSamples[s]);
+        }
+
+        // nearest values, then neighbours that move fewer samples without moving the line too far.
+        // Those move the line by maxLineOffset at most, only samples that near it can change
+        const ExactLine line = getExactLine(node);
+        const double lineLength = std::hypot(line.normalX, line.normalY);
+        const double nearDistance = (settings.maxLineOffset + 1e-6) * lineLength;
+        const LineCode nearest = getNearestCode(line);
+        LineCode best = nearest;
+        DecodedNode bestDecoded = decodeLine(nearest, node);
+        size_t bestChanged = 0;
+        nearSamples.clear();
+        for (size_t s = 0; s < ownSamples.size(); ++s) {
+            const bsp::vec2 uv = samples[ownSamples[s]];
+            bestChanged += isLeftOfLine(bestDecoded, uv) != isLeft[s];
+            if (std::fabs((uv.x - 0.5) * line.normalX + (uv.y - 0.5) * line.normalY - line.offset) <= nearDistance)
+                nearSamples.push_back(s);
+        }
+        float bestOffset = getLineOffset(line, bestDecoded);
+        const size_t farChanged = bestChanged - countChanged(bestDecoded);
+        for (int dd = -settings.searchRadius; dd <= settings.searchRadius && bestChanged; ++dd)
+            for (int de = -settings.searchRadius; de <= settings.searchRadius; ++de) {
+                const LineCode code = { std::clamp(nearest.direction + dd, 0, 65535), std::clamp(nearest.offset + de, -32768, 32767) };
+                const DecodedNode candidate = decodeLine(code, node);
+                const float offset = getLineOffset(line, candidate);
+                if (offset > settings.maxLineOffset)
+                    continue;
+                const size_t changed = farChanged + countChanged(candidate);
+                if (changed < bestChanged || (changed == bestChanged && offset < bestOffset)) {
+                    best = code;
+                    bestDecoded = candidate;
+                    bestChanged = changed;
+                    bestOffset = offset;
+                }
+            }
+
+        decoded[i] = bestDecoded;
+        setPackedNode(packed[i / 2], i % 2, best, bestDecoded);
+
+        NodeError& error = result.nodes[i];
+        error.lineOffset = bestOffset;
+        error.changedSamples = bestChanged;
+        result.changedSamples += bestChanged;
+        result.maxLineOffset = std::max(result.maxLineOffset, bestOffset);
+        if (bestOffset > settings.maxLineOffset || !areIndicesInRange(bestDecoded))
+            result.refusedNodes.push_back(int(i));
+    }
+
+    if (!result.refusedNodes.empty())
+        return false;
+
+    m_packed = std::move(packed);
+    m_decoded = std::move(decoded);
+    m_maxDepth = tree.getMaxDepth();
+    result.packed = true;
+    return true;
+}
+
+bool UVBSPHalfNodes::packRange(const UVBSPCompiledTree& tree, size_t firstIndex, size_t count, const Settings& settings)
+{
+    const size_t nodeCount = tree.size();
+    m_decoded.resize(nodeCount);
+    m_packed.resize((nodeCount + 1) / 2, bsp::Vec4(0.f, 0.f, 0.f, 0.f));
+    if (nodeCount % 2) // no second node left over from a larger tree
+        m_packed.back().z = m_packed.back().w = 0.f;
+    m_maxDepth = tree.getMaxDepth();
+
+    bool isPacked = true;
+    for (size_t i = firstIndex; i < std::min(firstIndex + count, nodeCount); ++i) {
+        const ExactLine line = getExactLine(tree.data()[i]);
+        const LineCode code = getNearestCode(line);
+        m_decoded[i] = decodeLine(code, tree.data()[i]);
+        setPackedNode(m_packed[i / 2], i % 2, code, m_decoded[i]);
+        isPacked = isPacked && getLineOffset(line, m_decoded[i]) <= settings.maxLineOffset && areIndicesInRange(m_decoded[i]);
+    }
+    return isPacked;
+}
+
+int UVBSPHalfNodes::evaluate(bsp::vec2 uv) const
+{
+    if (m_decoded.empty())
+        return 0;
+    int currentIndex = 0;
+    for (int iteration = 0; iteration < m_maxDepth; ++iteration) {
+        const DecodedNode& node = m_decoded[currentIndex];
+        const int indexOfProperSide = isLeftOfLine(node, uv) ? node.left : node.right;
+        if (indexOfProperSide >= 0)
+            return indexOfProperSide;
+        currentIndex = -indexOfProperSide;
+    }
+    return 0;
+}
+
+void UVBSPHalfNodes::write(std::ostream& out, UVBSP::ShaderType shaderType) const
+{
+    const bool isHLSL = shaderType != UVBSP::ShaderType::GLSL;
+    const bool isFunction = shaderType != UVBSP::ShaderType::UnrealCustomNode;
+
+    out << "/////// START_UVBSP_GENERATED_SHADER ////////\n\n"
+        << (isHLSL ? "#define IVEC4 int4\n" : "#define IVEC4 ivec4\n")
+        << (isHLSL ? "#define VEC2 float2\n" : "#define VEC2 vec2\n");
+
+    out << "\n// two nodes per IVEC4, xy - node 2k, zw - node 2k + 1:\n"
+           "// direction | offset << 16 (16 bit fixed point), int16 left | int16 right << 16,\n"
+           "// node(less than 0) or color(greater equal 0)\n";
+    const size_t arraySize = std::max<size_t>(m_packed.size(), 1);
+    out << "IVEC4 nodes[" << arraySize << "] = " << (isHLSL ? "{\n" : "IVEC4[](\n");
+    for (size_t i = 0; i < arraySize; ++i) {
+        const bsp::Vec4 node = i < m_packed.size() ? m_packed[i] : bsp::Vec4(0.f, 0.f, 0.f, 0.f);
+        out << "IVEC4(" << floatBitsToInt(node.x) << ", " << floatBitsToInt(node.y) << ", "
+            << floatBitsToInt(node.z) << ", " << floatBitsToInt(node.w) << ")"
+            << (i != arraySize - 1 ? ",\n" : "\n");
+    }
+    out << (isHLSL ? "};\n\n" : ");\n\n");
+
+    out << (isFunction ? "int traverseTree(VEC2 uv){\n" : "\n")
+        << "  int currentIndex = 0;\n"
+           "  for(int iteration = 0; iteration < "
+        << m_maxDepth << "; ++iteration) {\n";
+    out << "    IVEC4 pair = nodes[currentIndex >> 1];\n"
+           "    bool isFirst = (currentIndex & 1) == 0;\n"
+           "    int line = isFirst ? pair.x : pair.z;\n"
+           "    int sides = isFirst ? pair.y : pair.w;\n"
+           "    float direction = float(line & 65535) * (1.0 / 32768.0);\n"
+           "    VEC2 normal = VEC2(1.0 - direction, direction < 1.0 ? direction : 2.0 - direction);\n"
+           "    float offset = (float(line >> 16) + 0.5) * (1.0 / 32768.0);\n"
+           "    bool isLeftPixel = (uv.x - 0.5) * normal.x + (uv.y - 0.5) * normal.y > offset;\n"
+           "    int indexOfProperSide = isLeftPixel ? (sides << 16) >> 16 : sides >> 16;\n\n"
+           "    if(indexOfProperSide < 0) {\n"
+           "      currentIndex = -indexOfProperSide;\n"
+           "    } else {\n"
+           "      return indexOfProperSide;\n"
+           "    }\n"
+           "  }\n"
+           "  return 0;\n";
+    out << (isFunction ? "}\n" : "\n")
+        << "#undef IVEC4\n"
+           "#undef VEC2\n"
+           "/////// END_UVBSP_GENERATED_SHADER ////////\n"
+        << std::endl;
+}
@@ -0,0 +1,78 @@
+#ifndef UVBSP_HALF_H
+#define UVBSP_HALF_H
+
+#include <uvbsp/uvbsp.h>
+
+////////////////////////////////// UVBSP HALF NODES //////////////////////////////
+
+// Compact node encoding, two nodes per vec4, so the same constant buffer holds twice the splits.
+// Vec4 k holds node 2k in xy and node 2k + 1 in zw, a node is two 32 bit words:
+// direction | offset << 16 and int16(left) | int16(right) << 16.
+// The line is 16 bit fixed point around the center of the unit square, the same step
+// everywhere in it (a half float of the normalized pos loses a texel near 1.0):
+// direction p = bits / 32768 in [0, 2) walks the normals (1, 0) -> (0, 1) -> (-1, 0) as
+// (1 - p, p < 1 ? p : 2 - p), offset = (int16 + 0.5) / 32768, and uv is left of the line when
+// dot(uv - 0.5, normal) > offset. Steps are about 3e-5 of the unit square, so lines move
+// by a fraction of a texel and a few texel centers next to them may change side:
+// the report counts them, a split moving further than maxLineOffset is refused.
+
+class UVBSPHalfNodes {
+public:
+    static constexpr int s_maxIndex = 32767; // of nodes and colors, int16 child references
+
+    struct Settings {
+        int checkResolution = 1024; // checkResolution^2 texel centers, 0 packs the nearest values unchecked
+        int searchRadius = 2; // fixed point steps around the nearest values, per component
+        float maxLineOffset = 1.f / 4096; // a quarter texel at 1024^2
+    };
+
+    struct NodeError {
+        float lineOffset {}; // largest move of the split line inside the unit UV square
+        size_t changedSamples {}; // of the best values found
+    };
+
+    struct Report {
+        std::vector<NodeError> nodes; // by compiled index
+        std::vector<int> refusedNodes; // compiled indices, moved past maxLineOffset or indices out of int16
+        size_t samplesChecked {}, changedSamples {};
+        float maxLineOffset {};
+        bool packed {};
+
+        std::string getInfo() const
+        {
+            return "Half nodes: " + std::to_string(nodes.size())
+                + "   Max line offset: " + std::to_string(maxLineOffset)
+                + "   Changed samples: " + std::to_string(changedSamples) + "/" + std::to_string(samplesChecked)
+                + "   Refused nodes: " + std::to_string(refusedNodes.size())
+                + (packed ? "" : "   (not packed)");
+        }
+    };
+
+    // False and nothing packed if any split is refused
+    bool pack(const UVBSP& uvbsp, const Settings& settings, Report* report = nullptr);
+    // Repacks compiled nodes [firstIndex, firstIndex + count) with the nearest values, unchecked,
+    // for the runs UVBSP::updateUniforms() reports. False if one of them is refused
+    bool packRange(const UVBSPCompiledTree& tree, size_t firstIndex, size_t count, const Settings& settings);
+
+    const std::vector<bsp::Vec4>& getPacked() const { return m_packed; }
+    size_t getNodeCount() const { return m_decoded.size(); }
+
+    // traverseTree() over the unpacked values, what the shader computes
+    int evaluate(bsp::vec2 uv) const;
+
+    // Same markers and traverseTree(uv) signature as the node array form
+    void write(std::ostream& out, UVBSP::ShaderType shaderType) const;
+
+    struct DecodedNode {
+        bsp::vec2 normal;
+        float offset {};
+        int left {}, right {};
+    };
+
+private:
+    std::vector<bsp::Vec4> m_packed;
+    std::vector<DecodedNode> m_decoded; // by compiled index
+    int m_maxDepth {};
+};
+
+#endif // UVBSP_HALF_H
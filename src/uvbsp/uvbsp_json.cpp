@@ -0,0 +1,618 @@
+#include "mapped_file.h"
+#include <algorithm>
+#include <cfloat>
+#include <charconv>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <string_view>
+#include <uvbsp/uvbsp_json.h>
+
+#ifndef LOG
+#define LOG(x) std::cout << x << std::endl
+#endif
+
+namespace {
+
+constexpr int s_jsonVersion = 1;
+constexpr int s_maxSkipDepth = 64; // nesting of unknown values
+
+////////////////////////////////// JSON WRITER //////////////////////////////
+
+// Text goes into a fixed buffer that is flushed to the file when full,
+// numbers are written with to_chars straight into it.
+class JsonWriter {
+public:
+    static constexpr size_t s_maxNumberSize = 32;
+
+    explicit JsonWriter(std::ofstream& file)
+        : m_file(file)
+        , m_buffer(s_bufferSize)
+    {
+    }
+    ~JsonWriter() { flush(); }
+
+    void raw(std::string_view text)
+    {
+        reserve(text.size());
+        std::memcpy(m_buffer.data() + m_size, text.data(), text.size());
+        m_size += text.size();
+    }
+
+    void number(float value) { commit(appendNumber(run(s_maxNumberSize), value)); }
+    void number(int64_t value) { commit(appendNumber(run(s_maxNumberSize), value)); }
+
+    // Room for size chars, filled directly and closed with commit()
+    char* run(size_t size)
+    {
+        reserve(size);
+        return m_buffer.data() + m_size;
+    }
+    void commit(char* end) { m_size = end - m_buffer.data(); }
+
+    static char* appendNumber(char* out, float value)
+    {
+        if (!std::isfinite(value)) {
+            std::memcpy(out, "null", 4);
+            return out + 4;
+        }
+        return std::to_chars(out, out + s_maxNumberSize, value).ptr;
+    }
+    static char* appendNumber(char* out, int64_t value)
+    {
+        return std::to_chars(out, out + s_maxNumberSize, value).ptr;
+    }
+
+    void string(std::string_view text)
+    {
+        static const char s_hexDigits[] = "0123456789abcdef";
+        raw("\"");
+        for (char c : text) {
+            reserve(6);
+            char* out = m_buffer.data() + m_size;
+            if (c == '"' || c == '\\') {
+                *out++ = '\\';
+                *out++ = c;
+            } else if (uint8_t(c) < 0x20) {
+                *out++ = '\\';
+                *out++ = 'u';
+                *out++ = '0';
+                *out++ = '0';
+                *out++ = s_hexDigits[uint8_t(c) >> 4];
+                *out++ = s_hexDigits[uint8_t(c) & 15];
+            } else {
+                *out++ = c;
+            }
+            m_size = out - m_buffer.data();
+        }
+        raw("\"");
+    }
+
+    void flush()
+    {
+        m_file.write(m_buffer.data(), m_size);
+        m_size = 0;
+    }
+
+private:
+    static constexpr size_t s_bufferSize = 1 << 20;
+
+    void reserve(size_t size)
+    {
+        if (m_size + size > m_buffer.size())
+            flush();
+        if (size > m_buffer.size())
+            m_buffer.resize(size);
+    }
+
+    std::ofstream& m_file;
+    std::vector<char> m_buffer;
+    size_t m_size {};
+};
+
+// pos.x, pos.y, dir.x, dir.y, l, r
+constexpr size_t s_maxSplitSize = 6 * (JsonWriter::s_maxNumberSize + 1);
+
+char* appendSplitValues(char* out, const UVBSPSplit& split)
+{
+    for (float value : { split.pos.x, split.pos.y, split.dir.x, split.dir.y }) {
+        out = JsonWriter::appendNumber(out, value);
+        *out++ = ',';
+    }
+    out = JsonWriter::appendNumber(out, int64_t(split.l));
+    *out++ = ',';
+    return JsonWriter::appendNumber(out, int64_t(split.r));
+}
+
+////////////////////////////////// JSON READER //////////////////////////////
+
+// Pull parser over the whole text, values are read in place as keys come.
+// Every function returns false on malformed input and leaves the position at the error.
+class JsonReader {
+public:
+    JsonReader(const char* begin, const char* end)
+        : m_begin(begin)
+        , m_pos(begin)
+        , m_end(end)
+    {
+    }
+
+    size_t getOffset() const { return m_pos - m_begin; }
+
+    bool peek(char c)
+    {
+        skipSpaces();
+        return m_pos < m_end && *m_pos == c;
+    }
+
+    bool consume(char c)
+    {
+        if (!peek(c))
+            return false;
+        ++m_pos;
+        return true;
+    }
+
+    bool isAtEnd()
+    {
+        skipSpaces();
+        return m_pos == m_end;
+    }
+
+    // Calls readItem() for every element of the array
+    template <typename ReadItem>
+    bool readArray(ReadItem&& readItem)
+    {
+        if (!consume('['))
+            return false;
+        if (consume(']'))
+            return true;
+        do {
+            if (!readItem())
+                return false;
+        } while (consume(','));
+        return consume(']');
+    }
+
+    // Calls readValue(key) for every member of the object
+    template <typename ReadValue>
+    bool readObject(ReadValue&& readValue)
+    {
+        if (!consume('{'))
+            return false;
+        if (consume('}'))
+            return true;
+        std::string key;
+        do {
+            if (!readString(key) || !consume(':') || !readValue(key))
+                return false;
+        } while (consume(','));
+        return consume('}');
+    }
+
+    bool readNumber(float& value)
+    {
+        skipSpaces();
+        if (readLiteral("null")) {
+            value = NAN;
+            return true;
+        }
+        auto [ptr, error] = std::from_chars(m_pos, m_end, value);
+        if (error == std::errc::result_out_of_range)
+            value = getOutOfRangeFloat(m_pos, ptr);
+        else if (error != std::errc())
+            return false;
+        m_pos = ptr;
+        return true;
+    }
+
+    // Integral values written as floats ("3.0", "3e0") are accepted, fractions are not
+    bool readNumber(int& value)
+    {
+        skipSpaces();
+        auto [ptr, error] = std::from_chars(m_pos, m_end, value);
+        if (error == std::errc() && (ptr == m_end || (*ptr != '.' && *ptr != 'e' && *ptr != 'E'))) {
+            m_pos = ptr;
+            return true;
+        }
+        double wide;
+        auto [widePtr, wideError] = std::from_chars(m_pos, m_end, wide);
+        if (wideError != std::errc() || wide != std::trunc(wide) || wide < INT_MIN || wide > INT_MAX)
+            return false;
+        value = int(wide);
+        m_pos = widePtr;
+        return true;
+    }
+
+    bool readBool(bool& value)
+    {
+        skipSpaces();
+        if (readLiteral("true"))
+            value = true;
+        else if (readLiteral("false"))
+            value = false;
+        else
+            return false;
+        return true;
+    }
+
+    bool readString(std::string& value)
+    {
+        if (!consume('"'))
+            return false;
+        value.clear();
+        while (m_pos < m_end) {
+            const char* run = m_pos;
+            while (m_pos < m_end && *m_pos != '"' && *m_pos != '\\' && uint8_t(*m_pos) >= 0x20)
+                ++m_pos;
+            value.append(run, m_pos);
+            if (m_pos == m_end || uint8_t(*m_pos) < 0x20)
+                return false;
+            if (*m_pos++ == '"')
+                return true;
+            if (m_pos == m_end)
+                return false;
+            switch (char c = *m_pos++) {
+            case '"':
+            case '\\':
+            case '/':
+                value += c;
+                break;
+            case 'b':
+                value += '\b';
+                break;
+            case 'f':
+                value += '\f';
+                break;
+            case 'n':
+                value += '\n';
+                break;
+            case 'r':
+                value += '\r';
+                break;
+            case 't':
+                value += '\t';
+                break;
+            case 'u': {
+                uint32_t codePoint;
+                if (!readHex4(codePoint))
+                    return false;
+                if (codePoint >= 0xD800 && codePoint < 0xDC00) { // surrogate pair
+                    uint32_t low;
+                    if (m_end - m_pos < 2 || m_pos[0] != '\\' || m_pos[1] != 'u')
+                        return false;
+                    m_pos += 2;
+                    if (!readHex4(low) || low < 0xDC00 || low >= 0xE000)
+                        return false;
+                    codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (low - 0xDC00);
+                } else if (codePoint >= 0xDC00 && codePoint < 0xE000) {
+                    return false;
+                }
+                appendUtf8(value, codePoint);
+            } break;
+            default:
+                return false;
+            }
+        }
+        return false;
+    }
+
+    // Any value, for keys this version does not know
+    bool skipValue(int depth = 0)
+    {
+        if (depth > s_maxSkipDepth)
+            return false;
+        skipSpaces();
+        if (m_pos == m_end)
+            return false;
+        switch (*m_pos) {
+        case '{':
+            return readObject([&](const std::string&) { return skipValue(depth + 1); });
+        case '[':
+            return readArray([&]() { return skipValue(depth + 1); });
+        case '"': {
+            std::string ignored;
+            return readString(ignored);
+        }
+        case 't':
+        case 'f': {
+            bool ignored;
+            return readBool(ignored);
+        }
+        case 'n':
+            return readLiteral("null");
+        default: {
+            double ignored;
+            auto [ptr, error] = std::from_chars(m_pos, m_end, ignored);
+            if (error != std::errc())
+                return false;
+            m_pos = ptr;
+            return true;
+        }
+        }
+    }
+
+private:
+    // Number of [begin, end) past the float range, as other writers print them or
+    // a from_chars without denormals reads them: tiny values go to zero, huge ones are clamped
+    static float getOutOfRangeFloat(const char* begin, const char* end)
+    {
+        double wide;
+        if (std::from_chars(begin, end, wide).ec == std::errc())
+            return float(std::clamp(wide, -double(FLT_MAX), double(FLT_MAX)));
+
+        // past the double range too: a negative exponent, or no integer digits, is an underflow
+        const bool isNegative = *begin == '-';
+        const char* digits = begin + isNegative;
+        const char* exponent = std::find_if(digits, end, [](char c) { return c == 'e' || c == 'E'; });
+        const bool isTiny = exponent != end ? exponent + 1 < end && exponent[1] == '-'
+                                            : std::all_of(digits, std::find(digits, end, '.'), [](char c) { return c == '0'; });
+        const float magnitude = isTiny ? 0.f : FLT_MAX;
+        return isNegative ? -magnitude : magnitude;
+    }
+
+    void skipSpaces()
+    {
+        while (m_pos < m_end && (*m_pos == ' ' || *m_pos == '\n' || *m_pos == '\r' || *m_pos == '\t'))
+            ++m_pos;
+    }
+
+    bool readLiteral(std::string_view literal)
+    {
+        if (size_t(m_end - m_pos) < literal.size() || std::memcmp(m_pos, literal.data(), literal.size()) != 0)
+            return false;
+        m_pos += literal.size();
+        return true;
+    }
+
+    bool readHex4(uint32_t& value)
+    {
+        if (m_end - m_pos < 4)
+            return false;
+        auto [ptr, error] = std::from_chars(m_pos, m_pos + 4, value, 16);
+        if (error != std::errc() || ptr != m_pos + 4)
+            return false;
+        m_pos = ptr;
+        return true;
+    }
+
+    static void appendUtf8(std::string& out, uint32_t codePoint)
+    {
+        if (codePoint < 0x80) {
+            out += char(codePoint);
+        } else if (codePoint < 0x800) {
+            out += char(0xC0 | codePoint >> 6);
+            out += char(0x80 | (codePoint & 0x3F));
+        } else if (codePoint < 0x10000) {
+            out += char(0xE0 | codePoint >> 12);
+            out += char(0x80 | (codePoint >> 6 & 0x3F));
+            out += char(0x80 | (codePoint & 0x3F));
+        } else {
+            out += char(0xF0 | codePoint >> 18);
+            out += char(0x80 | (codePoint >> 12 & 0x3F));
+            out += char(0x80 | (codePoint >> 6 & 0x3F));
+            out += char(0x80 | (codePoint & 0x3F));
+        }
+    }
+
+    const char* m_begin;
+    const char* m_pos;
+    const char* m_end;
+};
+
+bool readSplitValues(JsonReader& reader, UVBSPSplit& split)
+{
+    return reader.readNumber(split.pos.x) && reader.consume(',')
+        && reader.readNumber(split.pos.y) && reader.consume(',')
+        && reader.readNumber(split.dir.x) && reader.consume(',')
+        && reader.readNumber(split.dir.y) && reader.consume(',')
+        && reader.readNumber(split.l) && reader.consume(',')
+        && reader.readNumber(split.r);
+}
+
+} // namespace
+
+bool isUVBSPJsonFile(const std::string& path)
+{
+    std::ifstream file(path, std::ios::binary);
+    char c;
+    while (file.get(c)) {
+        if (c != ' ' && c != '\n' && c != '\r' && c != '\t')
+            return c == '{';
+    }
+    return false;
+}
+
+////////////////////////////////// UVBSP //////////////////////////////
+
+bool UVBSP::readFromJson(const std::string& path, UVBSPEditorState* state, UVBSPProjectInfo* info)
+{
+    MappedFile file;
+    if (!file.open(path)) {
+        LOG("Failed to map file: " << path);
+        return false;
+    }
+    const char* text = reinterpret_cast<const char*>(file.data());
+    JsonReader reader(text, text + file.size());
+
+    std::vector<UVBSPSplit> nodes;
+    nodes.reserve(file.size() / 64); // about the text size of a node
+    UVBSPEditorState newState;
+    UVBSPProjectInfo newInfo;
+    std::string format;
+    int version = 0;
+    bool initialSet = false;
+
+    bool isValid = reader.readObject([&](const std::string& key) {
+        if (key == "format")
+            return reader.readString(format);
+        if (key == "version")
+            return reader.readNumber(version);
+        if (key == "initialSplitSet")
+            return reader.readBool(initialSet);
+        if (key == "colorIndex") {
+            int colorIndex;
+            if (!reader.readNumber(colorIndex) || colorIndex < 0)
+                return false;
+            newState.colorIndex = colorIndex;
+            return true;
+        }
+        if (key == "historyIndex") {
+            int historyIndex;
+            if (!reader.readNumber(historyIndex) || historyIndex < 0)
+                return false;
+            newState.historyIndex = historyIndex;
+            return true;
+        }
+        if (key == "metadata") {
+            return reader.readObject([&](const std::string& name) {
+                newInfo.metadata.emplace_back(name, std::string());
+                return reader.readString(newInfo.metadata.back().second);
+            });
+        }
+        if (key == "palette") {
+            return reader.readArray([&]() {
+                UVBSPColor& color = newInfo.palette.emplace_back();
+                return reader.consume('[')
+                    && reader.readNumber(color[0]) && reader.consume(',')
+                    && reader.readNumber(color[1]) && reader.consume(',')
+                    && reader.readNumber(color[2]) && reader.consume(']');
+            });
+        }
+        if (key == "nodes") {
+            return reader.readArray([&]() {
+                return reader.consume('[') && readSplitValues(reader, nodes.emplace_back()) && reader.consume(']');
+            });
+        }
+        if (key == "history") {
+            return reader.readArray([&]() {
+                UVBSPAddRecord& record = newState.history.emplace_back();
+                return reader.consume('[')
+                    && reader.readNumber(record.parentIndex) && reader.consume(',')
+                    && reader.readNumber(record.side) && reader.consume(',')
+                    && reader.readNumber(record.previousChild) && reader.consume(',')
+                    && readSplitValues(reader, record.split) && reader.consume(']');
+            });
+        }
+        return reader.skipValue();
+    });
+
+    if (!isValid || !reader.isAtEnd()) {
+        LOG("JSON syntax error at byte " << reader.getOffset() << ": " << path);
+        return false;
+    }
+    if (format != "uvbsp" || version <= 0 || version > s_jsonVersion) {
+        LOG("Unsupported uvbsp JSON format \"" << format << "\" version " << version << ": " << path);
+        return false;
+    }
+    if (nodes.empty() || newState.historyIndex > newState.history.size()) {
+        LOG("Corrupted uvbsp JSON project: " << path);
+        return false;
+    }
+    if (!isTreeValid(nodes)) {
+        LOG("Invalid node links in uvbsp JSON project: " << path);
+        return false;
+    }
+    if (!isHistoryValid(newState.history, newState.historyIndex, nodes.size())) {
+        LOG("Invalid history record in uvbsp JSON project: " << path);
+        return false;
+    }
+
+    reset();
+    m_nodes = std::move(nodes);
+    m_initialSet = initialSet;
+    m_compiledTreeDirty = true;
+    m_pointGridDirty = true;
+    m_treeStatsDirty = true;
+    m_cells.clear();
+    m_cellsDirty = true;
+
+    if (state)
+        *state = std::move(newState);
+    if (info)
+        *info = std::move(newInfo);
+    return true;
+}
+
+bool UVBSP::writeToJson(const std::string& path, const UVBSPEditorState* state, const UVBSPProjectInfo* info) const
+{
+    const UVBSPEditorState emptyState;
+    if (!state)
+        state = &emptyState;
+    const UVBSPProjectInfo emptyInfo;
+    if (!info)
+        info = &emptyInfo;
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    {
+        JsonWriter writer(file);
+        writer.raw("{\n  \"format\": \"uvbsp\",\n  \"version\": ");
+        writer.number(int64_t(s_jsonVersion));
+        writer.raw(",\n  \"initialSplitSet\": ");
+        writer.raw(m_initialSet ? "true" : "false");
+        writer.raw(",\n  \"colorCount\": ");
+        writer.number(int64_t(getColorCount()));
+        writer.raw(",\n  \"colorIndex\": ");
+        writer.number(int64_t(state->colorIndex));
+
+        writer.raw(",\n  \"metadata\": {");
+        for (size_t i = 0; i < info->metadata.size(); ++i) {
+            writer.raw(i ? ",\n    " : "\n    ");
+            writer.string(info->metadata[i].first);
+            writer.raw(": ");
+            writer.string(info->metadata[i].second);
+        }
+        writer.raw(info->metadata.empty() ? "}" : "\n  }");
+
+        writer.raw(",\n  \"palette\": [");
+        for (size_t i = 0; i < info->palette.size(); ++i) {
+            const UVBSPColor& color = info->palette[i];
+            writer.raw(i ? ",\n    [" : "\n    [");
+            writer.number(color[0]);
+            writer.raw(",");
+            writer.number(color[1]);
+            writer.raw(",");
+            writer.number(color[2]);
+            writer.raw("]");
+        }
+        writer.raw(info->palette.empty() ? "]" : "\n  ]");
+
+        // one node per line, so projects diff line by line
+        writer.raw(",\n  \"nodes\": [");
+        for (size_t i = 0; i < m_nodes.size(); ++i) {
+            const std::string_view prefix = i ? ",\n    [" : "\n    [";
+            char* out = writer.run(prefix.size() + s_maxSplitSize + 1);
+            std::memcpy(out, prefix.data(), prefix.size());
+            out = appendSplitValues(out + prefix.size(), m_nodes[i]);
+            *out++ = ']';
+            writer.commit(out);
+        }
+        writer.raw("\n  ]");
+
+        writer.raw(",\n  \"history\": [");
+        for (size_t i = 0; i < state->history.size(); ++i) {
+            const UVBSPAddRecord& record = state->history[i];
+            writer.raw(i ? ",\n    [" : "\n    [");
+            writer.number(int64_t(record.parentIndex));
+            writer.raw(",");
+            writer.number(int64_t(record.side));
+            writer.raw(",");
+            writer.number(int64_t(record.previousChild));
+            writer.raw(",");
+            char* out = appendSplitValues(writer.run(s_maxSplitSize + 1), record.split);
+            *out++ = ']';
+            writer.commit(out);
+        }
+        writer.raw(state->history.empty() ? "]" : "\n  ]");
+
+        writer.raw(",\n  \"historyIndex\": ");
+        writer.number(int64_t(std::min(state->historyIndex, state->history.size())));
+        writer.raw("\n}\n");
+    }
+    if (!file) {
+        LOG("Failed to write uvbsp JSON project: " << path);
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,28 @@
+#ifndef UVBSP_JSON_H
+#define UVBSP_JSON_H
+
+#include <uvbsp/uvbsp_export.h>
+#include <uvbsp/uvbsp_file.h>
+
+// JSON project, same content as the binary .uvbsp file plus palette and metadata:
+// {
+//   "format": "uvbsp", "version": 1,
+//   "initialSplitSet": true, "colorCount": 13, "colorIndex": 14,
+//   "metadata": { "author": "...", ... },          // strings only
+//   "palette": [ [r, g, b], ... ],                  // by color index, 0..1
+//   "nodes": [ [pos.x, pos.y, dir.x, dir.y, l, r], ... ],
+//   "history": [ [parentIndex, side, previousChild, pos.x, pos.y, dir.x, dir.y, l, r], ... ],
+//   "historyIndex": 30
+// }
+// Floats are written shortest round trip, so text and binary load the same tree.
+// NaN and infinity are written as null. Unknown keys are skipped on read,
+// "colorCount" is informative only.
+
+struct UVBSPProjectInfo {
+    std::vector<UVBSPColor> palette;
+    std::vector<std::pair<std::string, std::string>> metadata; // in file order
+};
+
+bool isUVBSPJsonFile(const std::string& path); // first non-space character is '{'
+
+#endif // UVBSP_JSON_H
@@ -0,0 +1,44 @@
+#ifndef UVBSP_MATH_H
+#define UVBSP_MATH_H
+
+// Small math types of the core library, so it builds without SFML.
+// The editor converts with toBSP() / fromBSP() from vec2.h.
+
+namespace bsp {
+
+struct vec2 {
+    vec2() = default;
+    vec2(float x, float y)
+        : x(x)
+        , y(y)
+    {
+    }
+
+    float x {}, y {};
+};
+
+inline vec2 operator+(const vec2& a, const vec2& b) { return { a.x + b.x, a.y + b.y }; }
+inline vec2 operator-(const vec2& a, const vec2& b) { return { a.x - b.x, a.y - b.y }; }
+inline vec2 operator*(const vec2& a, float b) { return { a.x * b, a.y * b }; }
+inline bool operator==(const vec2& a, const vec2& b) { return a.x == b.x && a.y == b.y; }
+inline bool operator!=(const vec2& a, const vec2& b) { return !(a == b); }
+
+inline float dot(const vec2& a, const vec2& b) { return a.x * b.x + a.y * b.y; }
+
+// Same layout as a GLSL vec4 uniform
+struct Vec4 {
+    Vec4() = default;
+    Vec4(float x, float y, float z, float w)
+        : x(x)
+        , y(y)
+        , z(z)
+        , w(w)
+    {
+    }
+
+    float x {}, y {}, z {}, w {};
+};
+
+} // namespace bsp
+
+#endif // UVBSP_MATH_H
@@ -0,0 +1,872 @@
+#include "mapped_file.h"
+#include "parallel_for.h"
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+#include <queue>
+#include <unordered_map>
+#include <uvbsp/uvbsp_geometry.h>
+#include <uvbsp/uvbsp_mesh.h>
+
+#ifndef LOG
+#define LOG(x) std::cout << x << std::endl
+#endif
+
+namespace {
+
+constexpr double s_pi = 3.14159265358979323846;
+constexpr double s_epsilon = 1e-12; // UV distance, anything closer lies on the line
+constexpr size_t s_candidatesPerAngle = 4;
+constexpr double s_cutPenalty = 2.0; // in impurity, pieces of other groups sharing a cell
+constexpr double s_gapWeight = 0.5; // bonus of the empty gap around the line, relative to the cell
+constexpr double s_tangentMargin = 1e-3; // of a tangent line to its piece, relative to the cell
+constexpr double s_balanceWeight = 0.5; // bonus of the smaller side, relative to the pieces of the cell
+constexpr int s_maxGridResolution = 2048;
+
+////////////////////////////////// OBJ //////////////////////////////
+
+const char* skipSpaces(const char* pos, const char* end)
+{
+    while (pos < end && (*pos == ' ' || *pos == '\t'))
+        ++pos;
+    return pos;
+}
+
+// 1 based, negative counts from the last one
+bool parseIndex(const char*& pos, const char* end, size_t count, uint32_t& index)
+{
+    long value;
+    auto [ptr, error] = std::from_chars(pos, end, value);
+    if (error != std::errc() || value == 0)
+        return false;
+    pos = ptr;
+    const long resolved = value > 0 ? value - 1 : long(count) + value;
+    if (resolved < 0 || size_t(resolved) >= count)
+        return false;
+    index = uint32_t(resolved);
+    return true;
+}
+
+////////////////////////////////// GEOMETRY //////////////////////////////
+
+struct UnionFind {
+    std::vector<uint32_t> parents, sizes;
+
+    explicit UnionFind(size_t count)
+        : parents(count)
+        , sizes(count, 1)
+    {
+        std::iota(parents.begin(), parents.end(), 0u);
+    }
+
+    uint32_t find(uint32_t index)
+    {
+        while (parents[index] != index) {
+            parents[index] = parents[parents[index]]; // path halving
+            index = parents[index];
+        }
+        return index;
+    }
+
+    void unite(uint32_t a, uint32_t b)
+    {
+        a = find(a);
+        b = find(b);
+        if (a == b)
+            return;
+        if (sizes[a] < sizes[b])
+            std::swap(a, b);
+        parents[b] = a;
+        sizes[a] += sizes[b];
+    }
+};
+
+double cross(dvec2 origin, dvec2 a, dvec2 b)
+{
+    return (a.x - origin.x) * (b.y - origin.y) - (a.y - origin.y) * (b.x - origin.x);
+}
+
+// Andrew's monotone chain, counter clockwise, points are sorted in place
+std::vector<dvec2> getConvexHull(std::vector<dvec2>& points)
+{
+    std::sort(points.begin(), points.end(), [](dvec2 a, dvec2 b) { return a.x < b.x || (a.x == b.x && a.y < b.y); });
+    if (points.size() < 3)
+        return points;
+    std::vector<dvec2> hull(2 * points.size());
+    size_t size = 0;
+    for (size_t i = 0; i < points.size(); ++i) {
+        while (size >= 2 && cross(hull[size - 2], hull[size - 1], points[i]) <= 0)
+            size--;
+        hull[size++] = points[i];
+    }
+    for (size_t i = points.size() - 1, lower = size + 1; i > 0; --i) {
+        while (size >= lower && cross(hull[size - 2], hull[size - 1], points[i - 1]) <= 0)
+            size--;
+        hull[size++] = points[i - 1];
+    }
+    hull.resize(size - 1);
+    return hull;
+}
+
+bool segmentsIntersect(dvec2 a, dvec2 b, dvec2 c, dvec2 d)
+{
+    const double abc = cross(a, b, c), abd = cross(a, b, d);
+    const double cda = cross(c, d, a), cdb = cross(c, d, b);
+    return ((abc <= 0 && abd >= 0) || (abc >= 0 && abd <= 0)) && ((cda <= 0 && cdb >= 0) || (cda >= 0 && cdb <= 0));
+}
+
+bool isPointInTriangle(dvec2 p, dvec2 a, dvec2 b, dvec2 c)
+{
+    const double ab = cross(a, b, p), bc = cross(b, c, p), ca = cross(c, a, p);
+    return (ab >= 0 && bc >= 0 && ca >= 0) || (ab <= 0 && bc <= 0 && ca <= 0);
+}
+
+bool segmentHitsTriangle(dvec2 a, dvec2 b, dvec2 t0, dvec2 t1, dvec2 t2)
+{
+    return isPointInTriangle(a, t0, t1, t2) || isPointInTriangle(b, t0, t1, t2)
+        || segmentsIntersect(a, b, t0, t1) || segmentsIntersect(a, b, t1, t2) || segmentsIntersect(a, b, t2, t0);
+}
+
+// Liang-Barsky, false if the segment misses the box
+bool clipSegmentToBox(dvec2& a, dvec2& b, dvec2 boxMin, dvec2 boxMax)
+{
+    double t0 = 0, t1 = 1;
+    const double delta[2] = { b.x - a.x, b.y - a.y };
+    const double start[2] = { a.x, a.y };
+    const double low[2] = { boxMin.x, boxMin.y }, high[2] = { boxMax.x, boxMax.y };
+    for (int axis = 0; axis < 2; ++axis) {
+        if (delta[axis] == 0) {
+            if (start[axis] < low[axis] || start[axis] > high[axis])
+                return false;
+            continue;
+        }
+        double tLow = (low[axis] - start[axis]) / delta[axis];
+        double tHigh = (high[axis] - start[axis]) / delta[axis];
+        if (tLow > tHigh)
+            std::swap(tLow, tHigh);
+        t0 = std::max(t0, tLow);
+        t1 = std::min(t1, tHigh);
+        if (t0 > t1)
+            return false;
+    }
+    const dvec2 clippedStart = lerp(a, b, t0);
+    b = lerp(a, b, t1);
+    a = clippedStart;
+    return true;
+}
+
+////////////////////////////////// TRIANGLE GRID //////////////////////////////
+
+// Square cells over the UV bounds, every triangle is listed in the cells of its bounding box
+class TriangleGrid {
+public:
+    void build(const std::vector<dvec2>& points, const std::vector<std::array<uint32_t, 3>>& triangles, dvec2 boundsMin, dvec2 boundsMax)
+    {
+        m_resolution = std::clamp(int(std::sqrt(double(triangles.size()))), 1, s_maxGridResolution);
+        m_origin = boundsMin;
+        m_cellSize = std::max({ boundsMax.x - boundsMin.x, boundsMax.y - boundsMin.y, 1e-9 }) / m_resolution;
+
+        m_offsets.assign(size_t(m_resolution) * m_resolution + 1, 0);
+        auto forEachCell = [&](const std::array<uint32_t, 3>& triangle, auto&& func) {
+            int x0 = m_resolution, y0 = m_resolution, x1 = 0, y1 = 0;
+            for (uint32_t vertex : triangle) {
+                x0 = std::min(x0, getCell(points[vertex].x - m_origin.x));
+                x1 = std::max(x1, getCell(points[vertex].x - m_origin.x));
+                y0 = std::min(y0, getCell(points[vertex].y - m_origin.y));
+                y1 = std::max(y1, getCell(points[vertex].y - m_origin.y));
+            }
+            for (int y = y0; y <= y1; ++y)
+                for (int x = x0; x <= x1; ++x)
+                    func(size_t(y) * m_resolution + x);
+        };
+        for (const auto& triangle : triangles)
+            forEachCell(triangle, [&](size_t cell) { m_offsets[cell + 1]++; });
+        std::partial_sum(m_offsets.begin(), m_offsets.end(), m_offsets.begin());
+        m_triangles.resize(m_offsets.back());
+        std::vector<uint32_t> fill(m_offsets.begin(), m_offsets.end() - 1);
+        for (uint32_t i = 0; i < triangles.size(); ++i)
+            forEachCell(triangles[i], [&](size_t cell) { m_triangles[fill[cell]++] = i; });
+    }
+
+    // visit(triangleIndex) for triangles of cells along the segment, stops when it returns true
+    template <typename Visit>
+    bool walkSegment(dvec2 a, dvec2 b, Visit&& visit) const
+    {
+        const int y0 = getCell(std::min(a.y, b.y) - m_origin.y), y1 = getCell(std::max(a.y, b.y) - m_origin.y);
+        for (int y = y0; y <= y1; ++y) {
+            // part of the segment inside of the row
+            double bandLow = m_origin.y + y * m_cellSize, bandHigh = bandLow + m_cellSize;
+            double xLow = std::min(a.x, b.x), xHigh = std::max(a.x, b.x);
+            if (b.y != a.y) {
+                double t0 = std::clamp((bandLow - a.y) / (b.y - a.y), 0.0, 1.0);
+                double t1 = std::clamp((bandHigh - a.y) / (b.y - a.y), 0.0, 1.0);
+                double xa = a.x + (b.x - a.x) * t0, xb = a.x + (b.x - a.x) * t1;
+                xLow = std::min(xa, xb);
+                xHigh = std::max(xa, xb);
+            }
+            const int x0 = getCell(xLow - m_origin.x), x1 = getCell(xHigh - m_origin.x);
+            for (int x = x0; x <= x1; ++x) {
+                const size_t cell = size_t(y) * m_resolution + x;
+                for (uint32_t i = m_offsets[cell]; i < m_offsets[cell + 1]; ++i)
+                    if (visit(m_triangles[i]))
+                        return true;
+            }
+        }
+        return false;
+    }
+
+private:
+    int getCell(double offset) const { return std::clamp(int(offset / m_cellSize), 0, m_resolution - 1); }
+
+    dvec2 m_origin;
+    double m_cellSize {};
+    int m_resolution {};
+    std::vector<uint32_t> m_offsets, m_triangles; // triangles of cell i: [offsets[i], offsets[i + 1])
+};
+
+////////////////////////////////// BUILD //////////////////////////////
+
+// Island, or the part of it inside of a cell once a line cut it
+struct Piece {
+    int island;
+    std::vector<uint32_t> triangles; // empty: every triangle of the island
+    std::vector<dvec2> hull; // empty: hull of the island
+};
+
+struct BuildCell {
+    UVPolygon polygon;
+    std::vector<Piece> pieces;
+    int depth;
+    int parentNode; // -1 for the root
+    int side; // packed side of the parent
+    int fallbackColor; // of a cell without triangles
+};
+
+// Line dot(uv, (cos, sin)) = offset
+struct LineCandidate {
+    double score = -INFINITY;
+    int angle {};
+    double offset {};
+    double relativeGap {}; // empty space around the line, kept by the exact score
+};
+
+struct MeshContext {
+    std::vector<dvec2> points;
+    const std::vector<std::array<uint32_t, 3>>* triangles;
+    std::vector<int> islands; // by triangle
+    std::vector<uint32_t> islandOffsets, islandTriangles; // triangles of island i: [offsets[i], offsets[i + 1])
+    std::vector<std::vector<dvec2>> islandHulls;
+    std::vector<dvec2> islandMin, islandMax;
+    std::vector<int> islandColors;
+    TriangleGrid grid;
+
+    const std::vector<dvec2>& getHull(const Piece& piece) const { return piece.hull.empty() ? islandHulls[piece.island] : piece.hull; }
+
+    size_t getTriangleCount(const Piece& piece) const
+    {
+        return piece.triangles.empty() ? islandOffsets[piece.island + 1] - islandOffsets[piece.island] : piece.triangles.size();
+    }
+
+    template <typename Func>
+    void forEachTriangle(const Piece& piece, Func&& func) const
+    {
+        if (!piece.triangles.empty()) {
+            for (uint32_t triangle : piece.triangles)
+                func(triangle);
+        } else {
+            for (uint32_t i = islandOffsets[piece.island]; i < islandOffsets[piece.island + 1]; ++i)
+                func(islandTriangles[i]);
+        }
+    }
+};
+
+dvec2 getDirection(int angle, int angleCount)
+{
+    const double radians = s_pi * angle / angleCount;
+    return { std::cos(radians), std::sin(radians) };
+}
+
+// Pieces of every group on one side of a line, Gini impurity in pieces
+struct SideCounts {
+    std::vector<int> counts; // by group
+    int total {}, groups {};
+    double squares {};
+
+    explicit SideCounts(int groupCount)
+        : counts(groupCount)
+    {
+    }
+
+    void add(int group)
+    {
+        squares += 2 * counts[group] + 1;
+        groups += !counts[group]++;
+        total++;
+    }
+
+    void remove(int group)
+    {
+        squares -= 2 * counts[group] - 1;
+        groups -= !--counts[group];
+        total--;
+    }
+
+    double getImpurity() const { return total ? total - squares / total : 0.0; }
+};
+
+// Impurity removed, a cut piece counts on both sides. Valid lines leave something
+// on both sides and, if they cut, lower impurity or keep a group off a side.
+// Interleaved groups gain little from any line, balance keeps the tree shallow then.
+double scoreLine(double parentImpurity, const SideCounts& left, const SideCounts& right, int groupCount, size_t cuts, double relativeGap)
+{
+    if (!left.groups || !right.groups)
+        return -INFINITY;
+    const double gain = parentImpurity - left.getImpurity() - right.getImpurity();
+    if (cuts && gain <= 1e-9 && left.groups == groupCount && right.groups == groupCount)
+        return -INFINITY;
+    const double pieceCount = left.total + right.total - double(cuts);
+    return gain - s_cutPenalty * cuts + s_gapWeight * relativeGap
+        + s_balanceWeight * std::min(left.total, right.total) / pieceCount;
+}
+
+double getImpurity(const std::vector<int>& pieceGroups, int groupCount)
+{
+    SideCounts counts(groupCount);
+    for (int group : pieceGroups)
+        counts.add(group);
+    return counts.getImpurity();
+}
+
+// Most triangles, or the fallback of an empty cell
+int getMajorityColor(const MeshContext& context, const BuildCell& cell)
+{
+    std::unordered_map<int, size_t> counts;
+    int color = cell.fallbackColor;
+    size_t best = 0;
+    for (const Piece& piece : cell.pieces) {
+        size_t& count = counts[context.islandColors[piece.island]];
+        count += context.getTriangleCount(piece);
+        if (count > best) {
+            best = count;
+            color = context.islandColors[piece.island];
+        }
+    }
+    return color;
+}
+
+// Estimates from hull projections, at the middle of every gap between hull intervals.
+// One sweep: pieces join the left side at their low end and leave the right one at their high end.
+void estimateDirection(const MeshContext& context, const BuildCell& cell, const std::vector<int>& pieceGroups,
+    int groupCount, double parentImpurity, int angle, int angleCount, std::vector<LineCandidate>& candidates)
+{
+    const dvec2 normal = getDirection(angle, angleCount);
+    auto project = [&](dvec2 p) { return p.x * normal.x + p.y * normal.y; };
+
+    double cellLow = INFINITY, cellHigh = -INFINITY;
+    for (const dvec2& vertex : cell.polygon) {
+        cellLow = std::min(cellLow, project(vertex));
+        cellHigh = std::max(cellHigh, project(vertex));
+    }
+    if (!(cellHigh - cellLow > s_epsilon))
+        return;
+
+    const size_t pieceCount = cell.pieces.size();
+    std::vector<std::pair<double, int>> lows(pieceCount), highs(pieceCount); // with group
+    std::vector<std::pair<double, bool>> endpoints(2 * pieceCount); // true for a high end
+    for (size_t i = 0; i < pieceCount; ++i) {
+        double low = INFINITY, high = -INFINITY;
+        for (const dvec2& vertex : context.getHull(cell.pieces[i])) {
+            low = std::min(low, project(vertex));
+            high = std::max(high, project(vertex));
+        }
+        lows[i] = { std::max(low, cellLow), pieceGroups[i] };
+        highs[i] = { std::min(high, cellHigh), pieceGroups[i] };
+        endpoints[2 * i] = { lows[i].first, false };
+        endpoints[2 * i + 1] = { highs[i].first, true };
+    }
+    std::sort(lows.begin(), lows.end());
+    std::sort(highs.begin(), highs.end());
+    std::sort(endpoints.begin(), endpoints.end());
+
+    SideCounts left(groupCount), right(groupCount);
+    for (int group : pieceGroups)
+        right.add(group);
+    size_t lowIndex = 0, highIndex = 0;
+    const size_t first = candidates.size();
+    auto addCandidate = [&](double score, double x, double relativeGap) { // best few of this direction
+        if (candidates.size() - first < s_candidatesPerAngle) {
+            candidates.push_back({ score, angle, x, relativeGap });
+        } else {
+            auto worst = std::min_element(candidates.begin() + first, candidates.end(),
+                [](const LineCandidate& a, const LineCandidate& b) { return a.score < b.score; });
+            if (score > worst->score)
+                *worst = { score, angle, x, relativeGap };
+        }
+    };
+    for (size_t i = 0; i + 1 < endpoints.size(); ++i) {
+        const double gap = endpoints[i + 1].first - endpoints[i].first;
+        if (gap <= s_epsilon)
+            continue;
+        const double x = endpoints[i].first + 0.5 * gap;
+        for (; lowIndex < pieceCount && lows[lowIndex].first < x; ++lowIndex)
+            left.add(lows[lowIndex].second);
+        for (; highIndex < pieceCount && highs[highIndex].first <= x; ++highIndex)
+            right.remove(highs[highIndex].second);
+        const size_t cuts = lowIndex - highIndex;
+        const double relativeGap = gap / (cellHigh - cellLow);
+        const double score = scoreLine(parentImpurity, left, right, groupCount, cuts, relativeGap);
+        if (score == -INFINITY)
+            continue;
+
+        // a line cutting anyway is best tangent to the piece it isolates, not in the middle of the cut one
+        const bool isTangentLow = cuts && !endpoints[i + 1].second, isTangentHigh = cuts && endpoints[i].second;
+        const double margin = std::min(0.5 * gap, s_tangentMargin * (cellHigh - cellLow));
+        if (isTangentLow)
+            addCandidate(score, endpoints[i + 1].first - margin, relativeGap);
+        if (isTangentHigh)
+            addCandidate(score, endpoints[i].first + margin, relativeGap);
+        if (!isTangentLow && !isTangentHigh)
+            addCandidate(score, x, relativeGap);
+    }
+}
+
+UVBSPSplit makeSplit(int angle, int angleCount, double offset)
+{
+    const dvec2 normal = getDirection(angle, angleCount);
+    UVBSPSplit split;
+    split.pos = bsp::vec2(float(normal.x * offset), float(normal.y * offset));
+    split.dir = bsp::vec2(float(normal.x), float(normal.y)); // normal of the line, as the packing takes it
+    split.l = split.r = 0;
+    return split;
+}
+
+enum PieceSide {
+    Left = 1,
+    Right = 2,
+    Cut = Left | Right
+};
+
+// Exact side of a piece: hull first, then the triangles along the line
+PieceSide getPieceSide(const MeshContext& context, const Piece& piece, const UVHalfPlane& plane, dvec2 segmentStart, dvec2 segmentEnd)
+{
+    int sides = 0;
+    double farthest = 0;
+    for (const dvec2& vertex : context.getHull(piece)) {
+        const double distance = plane.eval(vertex);
+        sides |= distance < -s_epsilon ? Left : distance > s_epsilon ? Right : 0;
+        if (std::abs(distance) > std::abs(farthest))
+            farthest = distance;
+    }
+    if (sides != Cut)
+        return farthest > 0 ? Right : Left;
+
+    const std::vector<std::array<uint32_t, 3>>& triangles = *context.triangles;
+    if (!piece.triangles.empty()) { // cut before, the part is tested triangle by triangle
+        sides = 0;
+        for (uint32_t triangle : piece.triangles) {
+            for (uint32_t vertex : triangles[triangle]) {
+                const double distance = plane.eval(context.points[vertex]);
+                sides |= distance < -s_epsilon ? Left : distance > s_epsilon ? Right : 0;
+            }
+            if (sides == Cut)
+                return Cut;
+        }
+        return sides == Right ? Right : Left;
+    }
+
+    // whole island lies inside of the cell, so it touches the line only along the segment
+    dvec2 a = segmentStart, b = segmentEnd;
+    const bool isHit = clipSegmentToBox(a, b, context.islandMin[piece.island], context.islandMax[piece.island])
+        && context.grid.walkSegment(a, b, [&](uint32_t triangle) {
+               if (context.islands[triangle] != piece.island)
+                   return false;
+               const auto& vertices = triangles[triangle];
+               return segmentHitsTriangle(a, b, context.points[vertices[0]], context.points[vertices[1]], context.points[vertices[2]]);
+           });
+    if (isHit)
+        return Cut;
+    return farthest > 0 ? Right : Left;
+}
+
+} // namespace
+
+////////////////////////////////// UVBSP MESH //////////////////////////////
+
+bool UVBSPMesh::loadObj(const std::string& path, bool flipV)
+{
+    MappedFile file;
+    if (!file.open(path)) {
+        LOG("Failed to map file: " << path);
+        return false;
+    }
+    uvs.clear();
+    triangles.clear();
+    triangleMaterials.clear();
+    materialNames.clear();
+
+    std::unordered_map<std::string, int> materialIndices;
+    int currentMaterial = -1;
+    std::vector<uint32_t> face;
+    const char* pos = reinterpret_cast<const char*>(file.data());
+    const char* const end = pos + file.size();
+    size_t lineNumber = 0;
+    while (pos < end) {
+        const char* lineEnd = static_cast<const char*>(std::memchr(pos, '\n', end - pos));
+        if (!lineEnd)
+            lineEnd = end;
+        lineNumber++;
+        const char* p = skipSpaces(pos, lineEnd);
+        const char* next = lineEnd + 1;
+
+        if (lineEnd - p > 3 && p[0] == 'v' && p[1] == 't' && (p[2] == ' ' || p[2] == '\t')) {
+            float u, v;
+            p = skipSpaces(p + 3, lineEnd);
+            auto [uEnd, uError] = std::from_chars(p, lineEnd, u);
+            auto [vEnd, vError] = std::from_chars(skipSpaces(uEnd, lineEnd), lineEnd, v);
+            if (uError != std::errc() || vError != std::errc()) {
+                LOG("Invalid vt in line " << lineNumber << ": " << path);
+                return false;
+            }
+            uvs.emplace_back(u, flipV ? 1.f - v : v);
+        } else if (lineEnd - p > 2 && p[0] == 'f' && (p[1] == ' ' || p[1] == '\t')) {
+            face.clear();
+            p = skipSpaces(p + 2, lineEnd);
+            bool hasUVs = true;
+            while (p < lineEnd && *p != '\r' && *p != '#') {
+                // v/vt/vn, v/vt, v//vn or v: vertex index is checked by syntax only
+                long vertexIndex;
+                auto [vertexEnd, error] = std::from_chars(p, lineEnd, vertexIndex);
+                if (error != std::errc()) {
+                    LOG("Invalid face in line " << lineNumber << ": " << path);
+                    return false;
+                }
+                p = vertexEnd;
+                uint32_t uvIndex;
+                if (p < lineEnd && *p == '/' && p + 1 < lineEnd && p[1] != '/') {
+                    ++p;
+                    if (!parseIndex(p, lineEnd, uvs.size(), uvIndex)) {
+                        LOG("Invalid vt index in line " << lineNumber << ": " << path);
+                        return false;
+                    }
+                    face.push_back(uvIndex);
+                } else {
+                    hasUVs = false;
+                }
+                while (p < lineEnd && *p != ' ' && *p != '\t' && *p != '\r')
+                    ++p; // normal index
+                p = skipSpaces(p, lineEnd);
+            }
+            if (hasUVs && face.size() >= 3) {
+                if (currentMaterial < 0) { // faces before any usemtl
+                    currentMaterial = int(materialNames.size());
+                    materialIndices.emplace("", currentMaterial);
+                    materialNames.emplace_back();
+                }
+                for (size_t i = 1; i + 1 < face.size(); ++i) {
+                    triangles.push_back({ face[0], face[i], face[i + 1] });
+                    triangleMaterials.push_back(currentMaterial);
+                }
+            }
+        } else if (lineEnd - p > 7 && std::memcmp(p, "usemtl", 6) == 0 && (p[6] == ' ' || p[6] == '\t')) {
+            const char* nameBegin = skipSpaces(p + 7, lineEnd);
+            const char* nameEnd = lineEnd;
+            while (nameEnd > nameBegin && (nameEnd[-1] == '\r' || nameEnd[-1] == ' ' || nameEnd[-1] == '\t'))
+                --nameEnd;
+            auto [it, isNew] = materialIndices.emplace(std::string(nameBegin, nameEnd), int(materialNames.size()));
+            if (isNew)
+                materialNames.push_back(it->first);
+            currentMaterial = it->second;
+        }
+        pos = next;
+    }
+    return !triangles.empty();
+}
+
+std::vector<int> UVBSPMesh::findIslands(int* islandCount) const
+{
+    UnionFind unionFind(uvs.size());
+    for (const auto& triangle : triangles) {
+        unionFind.unite(triangle[0], triangle[1]);
+        unionFind.unite(triangle[0], triangle[2]);
+    }
+
+    // numbered in order of first triangle
+    std::vector<int> rootIslands(uvs.size(), -1);
+    std::vector<int> islands(triangles.size());
+    int count = 0;
+    for (size_t i = 0; i < triangles.size(); ++i) {
+        int& island = rootIslands[unionFind.find(triangles[i][0])];
+        if (island < 0)
+            island = count++;
+        islands[i] = island;
+    }
+    if (islandCount)
+        *islandCount = count;
+    return islands;
+}
+
+////////////////////////////////// UVBSP MESH BUILDER //////////////////////////////
+
+bool UVBSPMeshBuilder::build(UVBSP& uvbsp, const Settings& settings, Stats* stats) const
+{
+    const auto startTime = std::chrono::steady_clock::now();
+    if (m_mesh.triangles.empty())
+        return false;
+
+    Stats localStats;
+    if (!stats)
+        stats = &localStats;
+    *stats = {};
+
+    MeshContext context;
+    context.triangles = &m_mesh.triangles;
+    context.points.resize(m_mesh.uvs.size());
+    dvec2 boundsMin { 0, 0 }, boundsMax { 1, 1 }; // unit square at least, the tree covers all of it
+    for (size_t i = 0; i < m_mesh.uvs.size(); ++i) {
+        context.points[i] = { m_mesh.uvs[i].x, m_mesh.uvs[i].y };
+        boundsMin = { std::min(boundsMin.x, context.points[i].x), std::min(boundsMin.y, context.points[i].y) };
+        boundsMax = { std::max(boundsMax.x, context.points[i].x), std::max(boundsMax.y, context.points[i].y) };
+    }
+
+    int islandCount = 0;
+    context.islands = m_mesh.findIslands(&islandCount);
+    context.islandOffsets.assign(islandCount + 1, 0);
+    for (int island : context.islands)
+        context.islandOffsets[island + 1]++;
+    std::partial_sum(context.islandOffsets.begin(), context.islandOffsets.end(), context.islandOffsets.begin());
+    context.islandTriangles.resize(m_mesh.triangles.size());
+    {
+        std::vector<uint32_t> fill(context.islandOffsets.begin(), context.islandOffsets.end() - 1);
+        for (uint32_t i = 0; i < m_mesh.triangles.size(); ++i)
+            context.islandTriangles[fill[context.islands[i]]++] = i;
+    }
+
+    // group color of every island
+    context.islandColors.resize(islandCount);
+    int groupCount = islandCount;
+    if (settings.groupBy == GroupBy::Material) {
+        std::vector<size_t> materialCounts(m_mesh.materialNames.size());
+        for (int island = 0; island < islandCount; ++island) {
+            std::fill(materialCounts.begin(), materialCounts.end(), 0);
+            for (uint32_t i = context.islandOffsets[island]; i < context.islandOffsets[island + 1]; ++i)
+                materialCounts[m_mesh.triangleMaterials[context.islandTriangles[i]]]++;
+            context.islandColors[island] = int(std::max_element(materialCounts.begin(), materialCounts.end()) - materialCounts.begin());
+        }
+        std::vector<int> sortedColors(context.islandColors);
+        std::sort(sortedColors.begin(), sortedColors.end());
+        groupCount = int(std::unique(sortedColors.begin(), sortedColors.end()) - sortedColors.begin());
+    } else {
+        std::iota(context.islandColors.begin(), context.islandColors.end(), 0);
+    }
+
+    context.islandHulls.resize(islandCount);
+    context.islandMin.resize(islandCount);
+    context.islandMax.resize(islandCount);
+    parallelFor(
+        islandCount, [&](size_t island) {
+            std::vector<dvec2> points;
+            for (uint32_t i = context.islandOffsets[island]; i < context.islandOffsets[island + 1]; ++i)
+                for (uint32_t vertex : m_mesh.triangles[context.islandTriangles[i]])
+                    points.push_back(context.points[vertex]);
+            context.islandHulls[island] = getConvexHull(points);
+            context.islandMin[island] = points.front(); // sorted by x
+            context.islandMax[island] = points.back();
+            for (const dvec2& p : context.islandHulls[island]) {
+                context.islandMin[island].y = std::min(context.islandMin[island].y, p.y);
+                context.islandMax[island].y = std::max(context.islandMax[island].y, p.y);
+            }
+        },
+        settings.threadCount);
+    context.grid.build(context.points, m_mesh.triangles, boundsMin, boundsMax);
+
+    std::vector<UVBSPSplit> nodes;
+    std::vector<std::array<int, 2>> sides; // packed order, as setPackedSides() takes them
+    UVBSPSplit rootLeaf { bsp::vec2(0.5f, 0.5f), bsp::vec2(1, 1), 0, 0 }; // used if the root is never split
+
+    std::vector<BuildCell> cells;
+    std::priority_queue<std::pair<int, size_t>> queue; // most groups first
+    auto setLeaf = [&](const BuildCell& cell, int color) {
+        if (cell.parentNode < 0)
+            rootLeaf.l = rootLeaf.r = color;
+        else
+            sides[cell.parentNode][cell.side] = color;
+    };
+    std::vector<int> pieceGroups;
+    std::unordered_map<int, int> groupIndices; // color -> dense index in the cell
+    auto getGroups = [&](const BuildCell& cell) {
+        groupIndices.clear();
+        pieceGroups.resize(cell.pieces.size());
+        for (size_t i = 0; i < cell.pieces.size(); ++i)
+            pieceGroups[i] = groupIndices.emplace(context.islandColors[cell.pieces[i].island], int(groupIndices.size())).first->second;
+        return int(groupIndices.size());
+    };
+    auto addCell = [&](BuildCell&& cell) {
+        const int cellGroups = getGroups(cell);
+        if (cellGroups <= 1 || cell.depth >= settings.maxDepth) {
+            setLeaf(cell, getMajorityColor(context, cell));
+        } else {
+            queue.push({ cellGroups, cells.size() });
+            cells.push_back(std::move(cell));
+        }
+    };
+
+    BuildCell root { { boundsMin, { boundsMax.x, boundsMin.y }, boundsMax, { boundsMin.x, boundsMax.y } }, {}, 0, -1, 0, 0 };
+    for (int island = 0; island < islandCount; ++island)
+        root.pieces.push_back({ island, {}, {} });
+    addCell(std::move(root));
+
+    const int angleCount = std::max(settings.angleCount, 1);
+    std::vector<std::vector<LineCandidate>> angleCandidates(angleCount);
+    while (!queue.empty()) {
+        BuildCell cell = std::move(cells[queue.top().second]);
+        queue.pop();
+        const int majorityColor = getMajorityColor(context, cell);
+        if (nodes.size() >= settings.maxNodes) {
+            setLeaf(cell, majorityColor);
+            continue;
+        }
+
+        // estimates of all directions, then the best ones exactly
+        const int cellGroups = getGroups(cell);
+        const double impurity = getImpurity(pieceGroups, cellGroups);
+        parallelFor(
+            angleCount, [&](size_t angle) {
+                angleCandidates[angle].clear();
+                estimateDirection(context, cell, pieceGroups, cellGroups, impurity, int(angle), angleCount, angleCandidates[angle]);
+            },
+            cell.pieces.size() < 64 ? 1 : settings.threadCount);
+        std::vector<LineCandidate> candidates;
+        for (const auto& candidatesOfAngle : angleCandidates)
+            candidates.insert(candidates.end(), candidatesOfAngle.begin(), candidatesOfAngle.end());
+        const size_t exactCount = std::min(std::max<size_t>(settings.exactCandidates, 1), candidates.size());
+        std::partial_sort(candidates.begin(), candidates.begin() + exactCount, candidates.end(),
+            [](const LineCandidate& a, const LineCandidate& b) { return a.score > b.score; });
+        candidates.resize(exactCount);
+
+        std::vector<std::vector<uint8_t>> candidateSides(exactCount);
+        parallelFor(
+            exactCount, [&](size_t i) {
+                LineCandidate& candidate = candidates[i];
+                const bsp::Vec4 packedNode = packNodeToShader(makeSplit(candidate.angle, angleCount, candidate.offset));
+                const UVHalfPlane plane(packedNode.x, packedNode.y);
+                dvec2 segmentStart, segmentEnd;
+                if (!clipLineToPolygon(cell.polygon, plane, segmentStart, segmentEnd)) {
+                    candidate.score = -INFINITY;
+                    return;
+                }
+
+                std::vector<uint8_t>& pieceSides = candidateSides[i];
+                pieceSides.resize(cell.pieces.size());
+                SideCounts left(cellGroups), right(cellGroups);
+                size_t cuts = 0;
+                for (size_t piece = 0; piece < cell.pieces.size(); ++piece) {
+                    pieceSides[piece] = getPieceSide(context, cell.pieces[piece], plane, segmentStart, segmentEnd);
+                    if (pieceSides[piece] & Left)
+                        left.add(pieceGroups[piece]);
+                    if (pieceSides[piece] & Right)
+                        right.add(pieceGroups[piece]);
+                    cuts += pieceSides[piece] == Cut;
+                }
+                candidate.score = scoreLine(impurity, left, right, cellGroups, cuts, candidate.relativeGap);
+            },
+            settings.threadCount);
+
+        size_t bestIndex = exactCount;
+        for (size_t i = 0; i < exactCount; ++i)
+            if (candidates[i].score > -INFINITY && (bestIndex == exactCount || candidates[i].score > candidates[bestIndex].score))
+                bestIndex = i;
+        if (bestIndex == exactCount) { // nothing separates, groups are interleaved beyond the budget
+            setLeaf(cell, majorityColor);
+            continue;
+        }
+
+        const LineCandidate& best = candidates[bestIndex];
+        const UVBSPSplit split = makeSplit(best.angle, angleCount, best.offset);
+        const bsp::Vec4 packedNode = packNodeToShader(split);
+        const UVHalfPlane plane(packedNode.x, packedNode.y);
+
+        const int nodeIndex = int(nodes.size());
+        nodes.push_back(split);
+        sides.push_back({ 0, 0 });
+        if (cell.parentNode >= 0)
+            sides[cell.parentNode][cell.side] = -nodeIndex;
+
+        BuildCell children[2];
+        for (int side = 0; side < 2; ++side) {
+            children[side] = { {}, {}, cell.depth + 1, nodeIndex, side, majorityColor };
+            clipPolygon(cell.polygon, plane, side == 0, children[side].polygon);
+            if (children[side].polygon.empty())
+                children[side].polygon = cell.polygon;
+        }
+        const std::vector<uint8_t>& pieceSides = candidateSides[bestIndex];
+        for (size_t i = 0; i < cell.pieces.size(); ++i) {
+            Piece& piece = cell.pieces[i];
+            if (pieceSides[i] != Cut) {
+                children[pieceSides[i] == Left ? 0 : 1].pieces.push_back(std::move(piece));
+                continue;
+            }
+
+            // triangles touching a side go to it, the ones on the line to both
+            stats->cutIslands++;
+            Piece parts[2] = { { piece.island, {}, {} }, { piece.island, {}, {} } };
+            context.forEachTriangle(piece, [&](uint32_t triangle) {
+                bool isLeft = false, isRight = false;
+                for (uint32_t vertex : m_mesh.triangles[triangle]) {
+                    const double distance = plane.eval(context.points[vertex]);
+                    isLeft |= distance < s_epsilon;
+                    isRight |= distance > -s_epsilon;
+                }
+                if (isLeft)
+                    parts[0].triangles.push_back(triangle);
+                if (isRight)
+                    parts[1].triangles.push_back(triangle);
+            });
+            for (int side = 0; side < 2; ++side) {
+                if (parts[side].triangles.empty())
+                    continue;
+                std::vector<dvec2> points;
+                for (uint32_t triangle : parts[side].triangles)
+                    for (uint32_t vertex : m_mesh.triangles[triangle])
+                        points.push_back(context.points[vertex]);
+                parts[side].hull = getConvexHull(points);
+                if (parts[side].hull.empty()) // parts are never whole islands
+                    parts[side].hull.push_back(points.front());
+                children[side].pieces.push_back(std::move(parts[side]));
+            }
+        }
+        cell.pieces.clear();
+        cell.pieces.shrink_to_fit();
+        addCell(std::move(children[0]));
+        addCell(std::move(children[1]));
+    }
+
+    if (nodes.empty())
+        nodes.push_back(rootLeaf);
+    else
+        for (size_t i = 0; i < nodes.size(); ++i)
+            setPackedSides(nodes[i], sides[i][0], sides[i][1]);
+    uvbsp.assignNodes(std::move(nodes));
+
+    // triangles whose centroid lands in a leaf of another group
+    std::vector<bsp::vec2> centroids(m_mesh.triangles.size());
+    for (size_t i = 0; i < m_mesh.triangles.size(); ++i) {
+        const auto& vertices = m_mesh.triangles[i];
+        centroids[i] = bsp::vec2((m_mesh.uvs[vertices[0]].x + m_mesh.uvs[vertices[1]].x + m_mesh.uvs[vertices[2]].x) / 3.f,
+            (m_mesh.uvs[vertices[0]].y + m_mesh.uvs[vertices[1]].y + m_mesh.uvs[vertices[2]].y) / 3.f);
+    }
+    std::vector<int> colors(centroids.size());
+    uvbsp.classify(centroids.data(), centroids.size(), colors.data());
+    for (size_t i = 0; i < colors.size(); ++i)
+        stats->misplacedTriangles += colors[i] != context.islandColors[context.islands[i]];
+
+    stats->triangles = m_mesh.triangles.size();
+    stats->islands = islandCount;
+    stats->groups = groupCount;
+    stats->nodes = uvbsp.getNumNodes();
+    stats->depth = uvbsp.getCompiledTree().getMaxDepth();
+    stats->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    return true;
+}
@@ -0,0 +1,79 @@
+#ifndef UVBSP_MESH_H
+#define UVBSP_MESH_H
+
+#include <array>
+#include <uvbsp/uvbsp.h>
+
+////////////////////////////////// UVBSP MESH //////////////////////////////
+
+// UV triangles of a mesh, positions and normals are not needed
+struct UVBSPMesh {
+    std::vector<bsp::vec2> uvs;
+    std::vector<std::array<uint32_t, 3>> triangles; // indices of uvs
+    std::vector<int> triangleMaterials; // by triangle, index of materialNames
+    std::vector<std::string> materialNames; // usemtl names in order of first use
+
+    // Wavefront OBJ: vt, f (polygons as fans, faces without vt are skipped), usemtl.
+    // flipV turns OBJ's v-up into the editor's v-down, row 0 of the texture is v = 0.
+    bool loadObj(const std::string& path, bool flipV = true);
+
+    // Island of every triangle: triangles sharing a uv vertex are one island (union-find)
+    std::vector<int> findIslands(int* islandCount = nullptr) const;
+};
+
+////////////////////////////////// UVBSP MESH BUILDER //////////////////////////////
+
+// Builds a tree whose leaves separate UV islands, or groups of islands by material.
+// Top-down: candidate lines come from gaps between island hulls projected on
+// angleCount directions, scored by impurity of groups on both sides, balance and
+// empty UV space around them; the best few are checked exactly, against the
+// triangles along the line only (triangles are indexed in a uniform grid).
+// An island is cut only if no clean line separates its cell, the cut parts go on
+// as triangle lists. Color index is island or material index.
+
+class UVBSPMeshBuilder {
+public:
+    enum class GroupBy {
+        Island,
+        Material // an island spanning materials takes the one of most triangles
+    };
+
+    struct Settings {
+        GroupBy groupBy = GroupBy::Island;
+        size_t maxNodes = 512; // size of the shader node array
+        int maxDepth = 32;
+        int angleCount = 64; // candidate directions over 180 degrees
+        size_t exactCandidates = 16; // best estimates checked against triangles, per cell
+        unsigned threadCount = 0; // all cores
+    };
+
+    struct Stats {
+        size_t triangles {}, islands {}, groups {};
+        size_t nodes {}, cutIslands {};
+        int depth {};
+        size_t misplacedTriangles {}; // centroid classified as another group
+        double seconds {};
+
+        std::string getInfo() const
+        {
+            return "Triangles: " + std::to_string(triangles) + "   Islands: " + std::to_string(islands)
+                + "   Groups: " + std::to_string(groups) + "   Nodes: " + std::to_string(nodes)
+                + "   Depth: " + std::to_string(depth) + "   Cut islands: " + std::to_string(cutIslands)
+                + "   Misplaced triangles: " + std::to_string(misplacedTriangles)
+                + "   Time: " + std::to_string(seconds) + "s";
+        }
+    };
+
+    UVBSPMeshBuilder(const UVBSPMesh& mesh)
+        : m_mesh(mesh)
+    {
+    }
+
+    // Replaces the tree of uvbsp, false for a mesh without UV triangles
+    bool build(UVBSP& uvbsp, const Settings& settings, Stats* stats = nullptr) const;
+
+private:
+    const UVBSPMesh& m_mesh;
+};
+
+#endif // UVBSP_MESH_H
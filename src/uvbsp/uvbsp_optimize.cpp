@@ -0,0 +1,385 @@
+#include <algorithm>
+#include <cstring>
+#include <uvbsp/uvbsp.h>
+#include <uvbsp/uvbsp_geometry.h>
+
+namespace {
+
+// Part of a packed line (index of compiled node) that still separates something
+struct Segment {
+    int line;
+    dvec2 start, end;
+};
+
+// Child references like UVBSPSplit: color (greater equal 0) or -index of build node
+struct BuildNode {
+    int line;
+    int left, right;
+    int parent;
+    bool isLeftChild;
+};
+
+struct BuildTask {
+    UVPolygon cell;
+    std::vector<Segment> segments;
+    int parent;
+    bool isLeftChild;
+};
+
+struct SegmentSplit {
+    int left {}, right {}, crossing {};
+};
+
+constexpr double s_epsilon = 1e-9; // UV distance, anything closer lies on the line
+constexpr size_t s_maxCandidates = 64;
+
+enum class SegmentSide {
+    Left,
+    Right,
+    Crossing,
+    OnLine
+};
+
+SegmentSide getSegmentSide(const UVHalfPlane& plane, const Segment& segment, double& startDist, double& endDist)
+{
+    startDist = plane.eval(segment.start);
+    endDist = plane.eval(segment.end);
+    if (std::abs(startDist) <= s_epsilon && std::abs(endDist) <= s_epsilon)
+        return SegmentSide::OnLine;
+    if (std::max(startDist, endDist) <= s_epsilon)
+        return SegmentSide::Left;
+    if (std::min(startDist, endDist) >= -s_epsilon)
+        return SegmentSide::Right;
+    return SegmentSide::Crossing;
+}
+
+// Segment of every node line inside of its own cell
+std::vector<Segment> collectSegments(const UVBSPCompiledTree& tree, const std::vector<UVHalfPlane>& planes)
+{
+    std::vector<Segment> segments;
+    std::vector<std::pair<int, UVPolygon>> stack { { 0, makeUnitSquare() } };
+    UVPolygon clipped;
+
+    while (!stack.empty()) {
+        auto [nodeIndex, cell] = std::move(stack.back());
+        stack.pop_back();
+
+        const UVHalfPlane& plane = planes[nodeIndex];
+        Segment segment { nodeIndex, {}, {} };
+        if (clipLineToPolygon(cell, plane, segment.start, segment.end)
+            && std::hypot(segment.end.x - segment.start.x, segment.end.y - segment.start.y) > s_epsilon)
+            segments.push_back(segment);
+
+        const bsp::Vec4& node = tree.data()[nodeIndex];
+        int childIndices[2];
+        std::memcpy(childIndices, &node.z, sizeof(childIndices));
+        for (int side = 0; side < 2; ++side) {
+            if (childIndices[side] < 0) {
+                clipPolygon(cell, plane, side == 0, clipped);
+                if (!clipped.empty())
+                    stack.push_back({ -childIndices[side], clipped });
+            }
+        }
+    }
+    return segments;
+}
+
+SegmentSplit countSegmentSplit(const UVHalfPlane& plane, const std::vector<Segment>& segments)
+{
+    SegmentSplit split;
+    double startDist, endDist;
+    for (const Segment& segment : segments) {
+        switch (getSegmentSide(plane, segment, startDist, endDist)) {
+        case SegmentSide::Left:
+            split.left++;
+            break;
+        case SegmentSide::Right:
+            split.right++;
+            break;
+        case SegmentSide::Crossing:
+            split.crossing++;
+            break;
+        case SegmentSide::OnLine:
+            break;
+        }
+    }
+    return split;
+}
+
+} // namespace
+
+UVBSPOptimizeReport UVBSP::rebalance(BalanceCost cost, int verifyResolution)
+{
+    const UVBSPCompiledTree& compiledTree = getCompiledTree();
+
+    UVBSPOptimizeReport report;
+    report.depthBefore = report.depthAfter = compiledTree.getMaxDepth();
+    report.nodesBefore = report.nodesAfter = m_nodes.size();
+    if (!m_initialSet)
+        return report;
+
+    std::vector<UVHalfPlane> planes(compiledTree.size());
+    for (size_t i = 0; i < compiledTree.size(); ++i)
+        planes[i] = UVHalfPlane(compiledTree.data()[i].x, compiledTree.data()[i].y);
+
+    std::vector<BuildNode> buildNodes;
+    std::vector<BuildTask> stack;
+    stack.push_back({ makeUnitSquare(), collectSegments(compiledTree, planes), -1, false });
+
+    UVPolygon leftCell, rightCell;
+    while (!stack.empty()) {
+        BuildTask task = std::move(stack.back());
+        stack.pop_back();
+
+        auto setParentIndex = [&](int index) {
+            if (task.parent >= 0) {
+                BuildNode& parent = buildNodes[task.parent];
+                (task.isLeftChild ? parent.left : parent.right) = index;
+            }
+        };
+
+        if (task.segments.empty()) {
+            dvec2 center = polygonCentroid(task.cell);
+            int colorIndex = classify(bsp::vec2(float(center.x), float(center.y)));
+            if (task.parent < 0) // no lines at all, root is a single cell
+                buildNodes.push_back({ 0, colorIndex, colorIndex, -1, false });
+            setParentIndex(colorIndex);
+            continue;
+        }
+
+        // pick the cheapest splitting line among candidates
+        const size_t step = std::max<size_t>(1, task.segments.size() / s_maxCandidates);
+        int bestLine = task.segments[0].line;
+        double bestCost = INFINITY;
+        for (size_t i = 0; i < task.segments.size(); i += step) {
+            const int line = task.segments[i].line;
+            SegmentSplit split = countSegmentSplit(planes[line], task.segments);
+
+            double lineCost;
+            if (cost == BalanceCost::MaxDepth) {
+                lineCost = std::max(split.left, split.right) + split.crossing
+                    + 1e-3 * std::min(split.left, split.right); // prefer fewer lines in total
+            } else {
+                clipPolygon(task.cell, planes[line], true, leftCell);
+                clipPolygon(task.cell, planes[line], false, rightCell);
+                lineCost = polygonArea(leftCell) * (split.left + split.crossing)
+                    + polygonArea(rightCell) * (split.right + split.crossing);
+            }
+            if (lineCost < bestCost) {
+                bestCost = lineCost;
+                bestLine = line;
+            }
+        }
+
+        const UVHalfPlane& plane = planes[bestLine];
+        BuildTask leftTask { {}, {}, int(buildNodes.size()), true };
+        BuildTask rightTask { {}, {}, int(buildNodes.size()), false };
+        clipPolygon(task.cell, plane, true, leftTask.cell);
+        clipPolygon(task.cell, plane, false, rightTask.cell);
+        if (leftTask.cell.empty())
+            leftTask.cell = task.cell;
+        if (rightTask.cell.empty())
+            rightTask.cell = task.cell;
+
+        double startDist, endDist;
+        for (const Segment& segment : task.segments) {
+            switch (getSegmentSide(plane, segment, startDist, endDist)) {
+            case SegmentSide::Left:
+                leftTask.segments.push_back(segment);
+                break;
+            case SegmentSide::Right:
+                rightTask.segments.push_back(segment);
+                break;
+            case SegmentSide::Crossing: {
+                dvec2 middle = lerp(segment.start, segment.end, startDist / (startDist - endDist));
+                bool startIsLeft = startDist < 0;
+                (startIsLeft ? leftTask : rightTask).segments.push_back({ segment.line, segment.start, middle });
+                (startIsLeft ? rightTask : leftTask).segments.push_back({ segment.line, middle, segment.end });
+            } break;
+            case SegmentSide::OnLine:
+                break;
+            }
+        }
+
+        setParentIndex(-int(buildNodes.size()));
+        buildNodes.push_back({ bestLine, 0, 0, task.parent, task.isLeftChild });
+        stack.push_back(std::move(rightTask));
+        stack.push_back(std::move(leftTask));
+    }
+
+    // children are always created after parents, so reverse order is bottom-up
+    for (size_t i = buildNodes.size() - 1; i > 0; --i) {
+        const BuildNode& node = buildNodes[i];
+        if (node.left >= 0 && node.left == node.right) {
+            BuildNode& parent = buildNodes[node.parent];
+            (node.isLeftChild ? parent.left : parent.right) = node.left;
+        }
+    }
+
+    // compact reachable nodes, root first
+    std::vector<UVBSPSplit> newNodes;
+    std::vector<int> newIndices(buildNodes.size(), -1);
+    std::vector<int> order { 0 };
+    newIndices[0] = 0;
+    for (size_t head = 0; head < order.size(); ++head) {
+        const BuildNode& node = buildNodes[order[head]];
+        for (int childIndex : { node.left, node.right }) {
+            if (childIndex < 0) {
+                newIndices[-childIndex] = order.size();
+                order.push_back(-childIndex);
+            }
+        }
+    }
+    for (int buildIndex : order) {
+        const BuildNode& node = buildNodes[buildIndex];
+        UVBSPSplit split = m_nodes[compiledTree.getSourceIndex(node.line)];
+        setPackedSides(split,
+            node.left < 0 ? -newIndices[-node.left] : node.left,
+            node.right < 0 ? -newIndices[-node.right] : node.right);
+        newNodes.push_back(split);
+    }
+
+    replaceNodesIfSame(newNodes, verifyResolution, report);
+    return report;
+}
+
+UVBSPOptimizeReport UVBSP::simplify(int verifyResolution)
+{
+    UVBSPOptimizeReport report;
+    report.depthBefore = report.depthAfter = getCompiledTree().getMaxDepth();
+    report.nodesBefore = report.nodesAfter = m_nodes.size();
+    if (!m_initialSet)
+        return report;
+
+    struct Visit {
+        int sideIndices[2]; // packed order, references of m_nodes, then of the simplified tree
+        bool isSideEmpty[2];
+        bool isKept;
+    };
+    std::vector<Visit> visits(m_nodes.size());
+    std::vector<bool> isVisited(m_nodes.size());
+
+    // top-down with cells, a side without any cell vertex clearly on it is dead
+    std::vector<int> order;
+    std::vector<std::pair<int, UVPolygon>> stack { { 0, makeUnitSquare() } };
+    UVPolygon clipped;
+    while (!stack.empty()) {
+        auto [nodeIndex, cell] = std::move(stack.back());
+        stack.pop_back();
+        if (isVisited[nodeIndex])
+            continue; // shared child of a broken file, keeps its first cell
+        isVisited[nodeIndex] = true;
+        order.push_back(nodeIndex);
+
+        const bsp::Vec4 packedNode = packNodeToShader(m_nodes[nodeIndex]);
+        const UVHalfPlane plane(packedNode.x, packedNode.y);
+        Visit& visit = visits[nodeIndex];
+        std::memcpy(visit.sideIndices, &packedNode.z, sizeof(visit.sideIndices));
+        for (int side = 0; side < 2; ++side) {
+            const double sign = side == 0 ? -1.0 : 1.0;
+            visit.isSideEmpty[side] = std::all_of(cell.begin(), cell.end(),
+                [&](const dvec2& vertex) { return plane.eval(vertex) * sign <= s_epsilon; });
+        }
+        if (visit.isSideEmpty[0] && visit.isSideEmpty[1]) // sliver along the line, left as it is
+            visit.isSideEmpty[0] = visit.isSideEmpty[1] = false;
+
+        for (int side = 0; side < 2; ++side) {
+            if (visit.sideIndices[side] < 0 && !visit.isSideEmpty[side]) {
+                clipPolygon(cell, plane, side == 0, clipped);
+                stack.push_back({ -visit.sideIndices[side], clipped.empty() ? cell : clipped });
+            }
+        }
+    }
+    report.deadNodes = m_nodes.size() - order.size();
+
+    // bottom-up, a node is replaced by its only live side or by the color of both sides
+    std::vector<int> replacements(m_nodes.size()); // child reference taking the place of a removed node
+    for (auto it = order.rbegin(); it != order.rend(); ++it) {
+        Visit& visit = visits[*it];
+        int sides[2];
+        for (int side = 0; side < 2; ++side) {
+            const int childIndex = visit.sideIndices[side];
+            sides[side] = childIndex < 0 && !visits[-childIndex].isKept ? replacements[-childIndex] : childIndex;
+        }
+
+        visit.isKept = false;
+        if (visit.isSideEmpty[0] != visit.isSideEmpty[1]) {
+            replacements[*it] = sides[visit.isSideEmpty[0] ? 1 : 0];
+            report.linesOutsideCell++;
+        } else if (sides[0] >= 0 && sides[0] == sides[1]) {
+            replacements[*it] = sides[0];
+            report.sameColorSplits++;
+        } else {
+            visit.isKept = true;
+            std::copy(std::begin(sides), std::end(sides), visit.sideIndices);
+        }
+    }
+
+    // compact kept nodes, root first
+    std::vector<UVBSPSplit> newNodes;
+    const int rootIndex = visits[0].isKept ? 0 : replacements[0] < 0 ? -replacements[0] : -1;
+    if (rootIndex < 0) { // one color everywhere
+        UVBSPSplit split = m_nodes[0];
+        split.l = split.r = replacements[0];
+        newNodes.push_back(split);
+    } else {
+        std::vector<int> newIndices(m_nodes.size(), -1);
+        std::vector<int> keptOrder { rootIndex };
+        newIndices[rootIndex] = 0;
+        for (size_t head = 0; head < keptOrder.size(); ++head) {
+            for (int childIndex : visits[keptOrder[head]].sideIndices) {
+                if (childIndex < 0) {
+                    newIndices[-childIndex] = keptOrder.size();
+                    keptOrder.push_back(-childIndex);
+                }
+            }
+        }
+        for (int nodeIndex : keptOrder) {
+            const int* sides = visits[nodeIndex].sideIndices;
+            UVBSPSplit split = m_nodes[nodeIndex];
+            setPackedSides(split,
+                sides[0] < 0 ? -newIndices[-sides[0]] : sides[0],
+                sides[1] < 0 ? -newIndices[-sides[1]] : sides[1]);
+            newNodes.push_back(split);
+        }
+    }
+
+    replaceNodesIfSame(newNodes, verifyResolution, report);
+    return report;
+}
+
+bool UVBSP::replaceNodesIfSame(std::vector<UVBSPSplit>& newNodes, int verifyResolution, UVBSPOptimizeReport& report)
+{
+    // verify on texel centers, keep the old tree on any difference
+    const size_t resolution = std::max(verifyResolution, 1);
+    std::vector<bsp::vec2> samples(resolution * resolution);
+    for (size_t y = 0; y < resolution; ++y)
+        for (size_t x = 0; x < resolution; ++x)
+            samples[y * resolution + x] = bsp::vec2((x + 0.5f) / resolution, (y + 0.5f) / resolution);
+
+    std::vector<int> before(samples.size()), after(samples.size());
+    classify(samples.data(), samples.size(), before.data());
+
+    std::swap(m_nodes, newNodes);
+    m_compiledTreeDirty = true;
+    classify(samples.data(), samples.size(), after.data());
+
+    report.samplesChecked = samples.size();
+    for (size_t i = 0; i < samples.size(); ++i)
+        report.mismatchedSamples += before[i] != after[i];
+
+    report.applied = report.mismatchedSamples == 0;
+    if (report.applied) {
+        m_currentNode = nullptr;
+        m_pointGridDirty = true;
+        m_treeStatsDirty = true;
+        m_cells.clear();
+        m_cellsDirty = true;
+        report.nodesAfter = m_nodes.size();
+        report.depthAfter = getCompiledTree().getMaxDepth();
+    } else {
+        std::swap(m_nodes, newNodes);
+        m_compiledTreeDirty = true;
+    }
+    return report.applied;
+}
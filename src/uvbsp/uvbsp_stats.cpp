@@ -0,0 +1,114 @@
+#include <algorithm>
+#include <uvbsp/uvbsp.h>
+
+void UVBSPTreeStats::addLeaves(int depth, int count)
+{
+    if (depth >= int(m_leafDepthCounts.size()))
+        m_leafDepthCounts.resize(depth + 1);
+    m_leafDepthCounts[depth] += count;
+    m_leafDepthSum += (long long)depth * count;
+    if (count > 0) {
+        m_maxDepth = std::max(m_maxDepth, depth);
+    } else {
+        // no empty buckets past the deepest leaf, as build() makes them
+        while (m_leafDepthCounts.size() > 2 && m_leafDepthCounts.back() == 0)
+            m_leafDepthCounts.pop_back();
+        m_maxDepth = std::max(int(m_leafDepthCounts.size()) - 1, 1);
+    }
+}
+
+void UVBSPTreeStats::addColorLeaf(int colorIndex, int count)
+{
+    if (colorIndex >= int(m_colorLeafCounts.size()))
+        m_colorLeafCounts.resize(colorIndex + 1);
+    int& leafCount = m_colorLeafCounts[colorIndex];
+    m_usedColorCount += (leafCount + count > 0) - (leafCount > 0);
+    leafCount += count;
+    while (!m_colorLeafCounts.empty() && m_colorLeafCounts.back() == 0)
+        m_colorLeafCounts.pop_back();
+}
+
+void UVBSPTreeStats::build(const std::vector<UVBSPSplit>& nodes)
+{
+    m_nodeStats.assign(nodes.size(), NodeStats());
+    m_leafDepthCounts.clear();
+    m_colorLeafCounts.clear();
+    m_leafDepthSum = 0;
+    m_maxDepth = 1;
+    m_usedColorCount = 0;
+
+    // top-down for depths and leaves, then children before parents for heights and leaf counts
+    std::vector<int> order { 0 };
+    m_nodeStats[0].depth = 1;
+    for (size_t head = 0; head < order.size(); ++head) {
+        const int index = order[head];
+        NodeStats& stats = m_nodeStats[index];
+        for (int childIndex : { nodes[index].l, nodes[index].r }) {
+            if (childIndex >= 0) {
+                addLeaves(stats.depth, 1);
+                addColorLeaf(childIndex, 1);
+            } else if (!m_nodeStats[-childIndex].depth) {
+                m_nodeStats[-childIndex] = { index, stats.depth + 1, 0, 0 };
+                order.push_back(-childIndex);
+            }
+        }
+    }
+    for (auto it = order.rbegin(); it != order.rend(); ++it) {
+        const UVBSPSplit& node = nodes[*it];
+        NodeStats& stats = m_nodeStats[*it];
+        stats.height = 1 + std::max(getChildHeight(node.l), getChildHeight(node.r));
+        for (int childIndex : { node.l, node.r })
+            stats.leafCount += childIndex < 0 ? m_nodeStats[-childIndex].leafCount : 1;
+    }
+}
+
+void UVBSPTreeStats::appendNode(const std::vector<UVBSPSplit>& nodes, int parentIndex, int previousColor)
+{
+    const UVBSPSplit& node = nodes.back();
+    const int depth = m_nodeStats[parentIndex].depth + 1;
+    m_nodeStats.push_back({ parentIndex, depth, 1, 2 });
+
+    addLeaves(depth - 1, -1);
+    addLeaves(depth, 2);
+    addColorLeaf(previousColor, -1);
+    addColorLeaf(node.l, 1);
+    addColorLeaf(node.r, 1);
+
+    // one leaf became two, heights grow until an ancestor has a higher side
+    int height = 1;
+    for (int index = parentIndex; index >= 0; index = m_nodeStats[index].parent) {
+        NodeStats& stats = m_nodeStats[index];
+        stats.leafCount++;
+        height++;
+        stats.height = std::max(stats.height, height);
+        height = stats.height;
+    }
+}
+
+void UVBSPTreeStats::removeLastNode(const std::vector<UVBSPSplit>& nodes, int parentIndex, int restoredColor)
+{
+    const UVBSPSplit& removed = nodes.back();
+    const int depth = m_nodeStats.back().depth;
+    m_nodeStats.pop_back();
+
+    addLeaves(depth, -2);
+    addLeaves(depth - 1, 1);
+    addColorLeaf(removed.l, -1);
+    addColorLeaf(removed.r, -1);
+    addColorLeaf(restoredColor, 1);
+
+    for (int index = parentIndex; index >= 0; index = m_nodeStats[index].parent) {
+        NodeStats& stats = m_nodeStats[index];
+        stats.leafCount--;
+        stats.height = 1 + std::max(getChildHeight(nodes[index].l), getChildHeight(nodes[index].r));
+    }
+}
+
+const UVBSPTreeStats& UVBSP::getTreeStats() const
+{
+    if (m_treeStatsDirty) {
+        m_treeStats.build(m_nodes);
+        m_treeStatsDirty = false;
+    }
+    return m_treeStats;
+}
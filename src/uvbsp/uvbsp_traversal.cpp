@@ -0,0 +1,217 @@
+#include <algorithm>
+#include <uvbsp/uvbsp_traversal.h>
+
+#if defined(__GNUC__) && defined(__SSE2__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define UVBSP_X86_SIMD
+#endif
+
+////////////////////////////////// SIMD //////////////////////////////
+
+#ifdef UVBSP_X86_SIMD
+
+// 8 samples per step, every lane gathers its own node and drops out of the mask on a leaf
+__attribute__((target("avx2"))) static size_t classifyAVX2(
+    const bsp::Vec4* nodes, int maxDepth, const bsp::vec2* uvs, size_t count, int* out)
+{
+    const float* base = &nodes[0].x;
+    const int* baseInt = reinterpret_cast<const int*>(base);
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256i zeroInt = _mm256_setzero_si256();
+    const __m256i minusOne = _mm256_set1_epi32(-1);
+
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        // u0 v0 u1 v1 u2 v2 u3 v3 | u4 v4 ... -> u0..u7, v0..v7
+        __m256 a = _mm256_loadu_ps(&uvs[i].x);
+        __m256 b = _mm256_loadu_ps(&uvs[i + 4].x);
+        __m256 u = _mm256_castpd_ps(_mm256_permute4x64_pd(
+            _mm256_castps_pd(_mm256_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0))), _MM_SHUFFLE(3, 1, 2, 0)));
+        __m256 v = _mm256_castpd_ps(_mm256_permute4x64_pd(
+            _mm256_castps_pd(_mm256_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1))), _MM_SHUFFLE(3, 1, 2, 0)));
+
+        __m256i currentIndex = zeroInt;
+        __m256i result = zeroInt;
+        __m256i active = minusOne;
+
+        for (int iteration = 0; iteration < maxDepth; ++iteration) {
+            __m256i offset = _mm256_slli_epi32(currentIndex, 2); // 4 floats per node
+            __m256 activeMask = _mm256_castsi256_ps(active);
+            __m256 pos = _mm256_mask_i32gather_ps(zero, base, offset, activeMask, 4);
+            __m256 tangent = _mm256_mask_i32gather_ps(zero, base + 1, offset, activeMask, 4);
+            __m256i left = _mm256_mask_i32gather_epi32(zeroInt, baseInt + 2, offset, active, 4);
+            __m256i right = _mm256_mask_i32gather_epi32(zeroInt, baseInt + 3, offset, active, 4);
+
+            __m256 side = _mm256_sub_ps(_mm256_mul_ps(_mm256_sub_ps(pos, u), tangent), v);
+            __m256i isLeft = _mm256_castps_si256(_mm256_cmp_ps(side, zero, _CMP_LT_OQ));
+            __m256i indexOfProperSide = _mm256_blendv_epi8(right, left, isLeft);
+
+            __m256i isColor = _mm256_cmpgt_epi32(indexOfProperSide, minusOne);
+            result = _mm256_blendv_epi8(result, indexOfProperSide, _mm256_and_si256(active, isColor));
+            active = _mm256_andnot_si256(isColor, active);
+            currentIndex = _mm256_sub_epi32(zeroInt, indexOfProperSide);
+
+            if (_mm256_testz_si256(active, active))
+                break;
+        }
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), result);
+    }
+    return i;
+}
+
+// 4 samples per step, SSE2 has no gather so node fields are loaded per lane
+static size_t classifySSE2(const bsp::Vec4* nodes, int maxDepth, const bsp::vec2* uvs, size_t count, int* out)
+{
+    const __m128 zero = _mm_setzero_ps();
+    const __m128i minusOne = _mm_set1_epi32(-1);
+
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128 a = _mm_loadu_ps(&uvs[i].x);
+        __m128 b = _mm_loadu_ps(&uvs[i + 2].x);
+        __m128 u = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+        __m128 v = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+
+        alignas(16) int currentIndex[4] = {};
+        __m128i result = _mm_setzero_si128();
+        __m128i active = minusOne;
+
+        for (int iteration = 0; iteration < maxDepth; ++iteration) {
+            const bsp::Vec4& n0 = nodes[currentIndex[0]];
+            const bsp::Vec4& n1 = nodes[currentIndex[1]];
+            const bsp::Vec4& n2 = nodes[currentIndex[2]];
+            const bsp::Vec4& n3 = nodes[currentIndex[3]];
+            __m128 pos = _mm_setr_ps(n0.x, n1.x, n2.x, n3.x);
+            __m128 tangent = _mm_setr_ps(n0.y, n1.y, n2.y, n3.y);
+            __m128i left = _mm_castps_si128(_mm_setr_ps(n0.z, n1.z, n2.z, n3.z));
+            __m128i right = _mm_castps_si128(_mm_setr_ps(n0.w, n1.w, n2.w, n3.w));
+
+            __m128 side = _mm_sub_ps(_mm_mul_ps(_mm_sub_ps(pos, u), tangent), v);
+            __m128i isLeft = _mm_castps_si128(_mm_cmplt_ps(side, zero));
+            __m128i indexOfProperSide = _mm_or_si128(_mm_and_si128(isLeft, left), _mm_andnot_si128(isLeft, right));
+
+            __m128i isColor = _mm_cmpgt_epi32(indexOfProperSide, minusOne);
+            __m128i finished = _mm_and_si128(active, isColor);
+            result = _mm_or_si128(_mm_and_si128(finished, indexOfProperSide), _mm_andnot_si128(finished, result));
+            active = _mm_andnot_si128(isColor, active);
+
+            if (_mm_movemask_epi8(active) == 0)
+                break;
+
+            // finished lanes keep pointing to the root, their loads are harmless
+            __m128i next = _mm_and_si128(active, _mm_sub_epi32(_mm_setzero_si128(), indexOfProperSide));
+            _mm_store_si128(reinterpret_cast<__m128i*>(currentIndex), next);
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), result);
+    }
+    return i;
+}
+
+#endif // UVBSP_X86_SIMD
+
+////////////////////////////////// COHERENT //////////////////////////////
+
+static uint32_t mortonCode(bsp::vec2 uv)
+{
+    auto spreadBits = [](uint32_t x) {
+        x = (x | (x << 8)) & 0x00FF00FF;
+        x = (x | (x << 4)) & 0x0F0F0F0F;
+        x = (x | (x << 2)) & 0x33333333;
+        x = (x | (x << 1)) & 0x55555555;
+        return x;
+    };
+    // only used for ordering, out of range and NaN samples just land at the edges
+    auto quantize = [](float x) { return x >= 0.f ? uint32_t(std::min(x, 1.f) * 65535.f) : 0u; };
+    uint32_t x = quantize(uv.x);
+    uint32_t y = quantize(uv.y);
+    return spreadBits(x) | (spreadBits(y) << 1);
+}
+
+// Samples are visited in Morton order, so neighbours mostly end in the same leaf.
+// Nodes of the previous path are known in advance, so their side tests
+// do not wait for each other like the pointer chasing in traverseTree().
+// Descent restarts from the first node where the side changed.
+static void classifyCoherent(const bsp::Vec4* nodes, int maxDepth, const bsp::vec2* uvs, size_t count, int* out)
+{
+    std::vector<uint64_t> order(count);
+    for (size_t i = 0; i < count; ++i)
+        order[i] = uint64_t(mortonCode(uvs[i])) << 32 | uint32_t(i);
+    std::sort(order.begin(), order.end());
+
+    std::vector<int> pathNodes(maxDepth);
+    std::vector<bool> pathSides(maxDepth);
+    int pathLength = 0;
+    int pathResult = 0;
+
+    for (uint64_t key : order) {
+        const size_t sampleIndex = uint32_t(key);
+        const bsp::vec2 uv = uvs[sampleIndex];
+
+        int depth = 0;
+        while (depth < pathLength && isLeftPixel(nodes[pathNodes[depth]], uv) == pathSides[depth])
+            depth++;
+
+        if (depth < pathLength || pathLength == 0) {
+            int currentIndex = pathLength ? pathNodes[depth] : 0;
+            pathResult = 0;
+            for (; depth < maxDepth; ++depth) {
+                const bsp::Vec4& node = nodes[currentIndex];
+                bool isLeft = isLeftPixel(node, uv);
+                pathNodes[depth] = currentIndex;
+                pathSides[depth] = isLeft;
+
+                int indexOfProperSide = floatBitsToInt(isLeft ? node.z : node.w);
+                if (indexOfProperSide < 0) {
+                    currentIndex = -indexOfProperSide;
+                } else {
+                    pathResult = indexOfProperSide;
+                    depth++;
+                    break;
+                }
+            }
+            pathLength = depth;
+        }
+        out[sampleIndex] = pathResult;
+    }
+}
+
+////////////////////////////////// UVBSP //////////////////////////////
+
+int UVBSP::classify(bsp::vec2 uv) const
+{
+    const UVBSPCompiledTree& compiledTree = getCompiledTree();
+    return traverseTree(compiledTree.data(), compiledTree.getMaxDepth(), uv);
+}
+
+void UVBSP::classify(const bsp::vec2* uvs, size_t count, int* out, ClassifyMode mode) const
+{
+    if (!count)
+        return;
+
+    const UVBSPCompiledTree& compiledTree = getCompiledTree();
+    const bsp::Vec4* nodes = compiledTree.data();
+    const int maxDepth = compiledTree.getMaxDepth();
+
+    size_t processed = 0;
+    switch (mode) {
+    case ClassifyMode::Scalar:
+        break;
+
+    case ClassifyMode::Simd:
+#ifdef UVBSP_X86_SIMD
+        if (__builtin_cpu_supports("avx2"))
+            processed = classifyAVX2(nodes, maxDepth, uvs, count, out);
+        else
+            processed = classifySSE2(nodes, maxDepth, uvs, count, out);
+#endif
+        break;
+
+    case ClassifyMode::Coherent:
+        classifyCoherent(nodes, maxDepth, uvs, count, out);
+        processed = count;
+        break;
+    }
+
+    for (size_t i = processed; i < count; ++i)
+        out[i] = traverseTree(nodes, maxDepth, uvs[i]);
+}
@@ -0,0 +1,55 @@
+#ifndef UVBSP_TRAVERSAL_H
+#define UVBSP_TRAVERSAL_H
+
+#include <cstring>
+#include <uvbsp/uvbsp.h>
+
+// CPU mirror of traverseTree() from BSPshader.frag and generateShader().
+// Walks UVBSPCompiledTree, the same nodes the shader gets, so x = normalizedPos,
+// y = tangent, zw = left/right index bits, and the side test is evaluated in the same
+// order as the shader: dot(vec2(pos, 0) - uv, vec2(tangent, 1)) < 0.
+// Build with -ffp-contract=off, a fused multiply-add changes the decision near the line.
+
+inline int floatBitsToInt(float value)
+{
+    int result;
+    std::memcpy(&result, &value, sizeof(result));
+    return result;
+}
+
+inline float intBitsToFloat(int value)
+{
+    float result;
+    std::memcpy(&result, &value, sizeof(result));
+    return result;
+}
+
+inline bool isLeftPixel(const bsp::Vec4& node, bsp::vec2 uv)
+{
+    return (node.x - uv.x) * node.y - uv.y < 0.f;
+}
+
+// Texel center, the uv a fragment shader sees when drawing a width x height target
+inline bsp::vec2 getTexelCenter(uint32_t x, uint32_t y, uint32_t width, uint32_t height)
+{
+    return bsp::vec2((x + 0.5f) / width, (y + 0.5f) / height);
+}
+
+// Continues from startIndex, when the caller knows the path above it
+inline int traverseTree(const bsp::Vec4* nodes, int maxDepth, bsp::vec2 uv, int startIndex = 0)
+{
+    int currentIndex = startIndex;
+    for (int iteration = 0; iteration < maxDepth; ++iteration) {
+        const bsp::Vec4& node = nodes[currentIndex];
+        int indexOfProperSide = floatBitsToInt(isLeftPixel(node, uv) ? node.z : node.w);
+
+        if (indexOfProperSide < 0) {
+            currentIndex = -indexOfProperSide;
+        } else {
+            return indexOfProperSide;
+        }
+    }
+    return 0;
+}
+
+#endif // UVBSP_TRAVERSAL_H
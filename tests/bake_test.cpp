@@ -0,0 +1,94 @@
+// Baked index maps, in memory and written to every format, against classify()
+// at each texel center. Tiles filled in one go must agree with the walk too
+
+#include "image_reader.h"
+#include "test_utils.h"
+#include <filesystem>
+#include <fstream>
+#include <uvbsp/uvbsp_bake.h>
+
+namespace {
+
+std::vector<uint16_t> classifyTexels(const UVBSP& uvbsp, uint32_t width, uint32_t height)
+{
+    std::vector<uint16_t> expected(size_t(width) * height);
+    for (uint32_t y = 0; y < height; ++y)
+        for (uint32_t x = 0; x < width; ++x)
+            expected[size_t(y) * width + x] = uint16_t(uvbsp.classify(getTexelCenter(x, y, width, height)));
+    return expected;
+}
+
+size_t countMismatches(const std::vector<uint16_t>& a, const std::vector<uint16_t>& b)
+{
+    if (a.size() != b.size())
+        return std::max(a.size(), b.size());
+    size_t mismatches = 0;
+    for (size_t i = 0; i < a.size(); ++i)
+        mismatches += a[i] != b[i];
+    return mismatches;
+}
+
+void checkRows(const UVBSP& uvbsp, uint32_t width, uint32_t height, uint32_t tileSize)
+{
+    UVBSPIndexBaker::Settings settings;
+    settings.width = width;
+    settings.height = height;
+    settings.tileSize = tileSize;
+    std::vector<uint16_t> baked(size_t(width) * height);
+    // bands of odd heights, as callers cut them
+    for (uint32_t y0 = 0; y0 < height; y0 += 37)
+        UVBSPIndexBaker(uvbsp).bakeRows(settings, y0, std::min(37u, height - y0), baked.data() + size_t(y0) * width);
+    CHECK(countMismatches(baked, classifyTexels(uvbsp, width, height)) == 0);
+}
+
+void checkFile(const UVBSP& uvbsp, const std::string& path, bool is16Bit, uint32_t width, uint32_t height)
+{
+    UVBSPIndexBaker::Settings settings;
+    settings.width = width;
+    settings.height = height;
+    settings.is16Bit = is16Bit;
+    CHECK(UVBSPIndexBaker(uvbsp).bake(path, settings));
+
+    std::vector<uint16_t> baked;
+    if (std::filesystem::path(path).extension() == ".raw") {
+        std::ifstream file(path, std::ios::binary);
+        const std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        const size_t bytesPerTexel = is16Bit ? 2 : 1;
+        CHECK(bytes.size() == size_t(width) * height * bytesPerTexel);
+        for (size_t i = 0; i + bytesPerTexel <= bytes.size(); i += bytesPerTexel)
+            baked.push_back(is16Bit ? uint16_t(bytes[i] | bytes[i + 1] << 8) : bytes[i]);
+    } else {
+        GrayImage image;
+        CHECK(readGrayImage(path, image));
+        CHECK(image.width == width && image.height == height);
+        baked = std::move(image.samples);
+    }
+    CHECK(countMismatches(baked, classifyTexels(uvbsp, width, height)) == 0);
+    std::filesystem::remove(path);
+}
+
+} // namespace
+
+int main()
+{
+    for (size_t splitCount : { 1, 10, 200, 3000 }) {
+        const UVBSP uvbsp = makeRandomTree(splitCount, unsigned(splitCount) + 300);
+        for (uint32_t tileSize : { 1, 8, 64 })
+            checkRows(uvbsp, 517, 333, tileSize);
+        checkFile(uvbsp, "bake_test.png", true, 600, 401);
+        checkFile(uvbsp, "bake_test.raw", true, 256, 256);
+    }
+
+    // thin slivers: many nearly parallel lines, where tile corners are least reliable
+    UVBSP slivers;
+    for (int i = 0; i < 200; ++i)
+        slivers.addSplit(UVBSPSplit(bsp::vec2(0.3f + i * 0.0007f, 0.5f), bsp::vec2(1.f, 0.001f * (i % 7)), i % 250, (i + 1) % 250));
+    checkRows(slivers, 1024, 64, 64);
+
+    // 8 bit formats need colors below 256
+    const UVBSP fewColors = makeRandomTree(500, 9, 200);
+    checkFile(fewColors, "bake_test.png", false, 300, 200);
+    checkFile(fewColors, "bake_test.tga", false, 300, 200);
+    checkFile(fewColors, "bake_test.raw", false, 300, 200);
+    return finishTest("bake_test");
+}
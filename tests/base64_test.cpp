@@ -0,0 +1,110 @@
+// Base64 codec of old project files against websocketpp, which wrote them:
+// random buffers of odd lengths, text decoded in pieces of any size, legacy files
+// load the same nodes, and a legacy file whose links leave the array is refused
+
+#include "base64.hpp"
+#include "base64_codec.h"
+#include "test_utils.h"
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+namespace {
+
+const std::string s_path = "base64_test.uvbsp";
+
+// Decoded in pieces cut at random, each piece may end inside a quad
+bool decodeInPieces(const std::string& text, std::vector<uint8_t>& out, std::mt19937& random)
+{
+    out.assign(getBase64MaxDecodedSize(text.size()), 0);
+    Base64Decoder decoder;
+    size_t decodedSize = 0, written = 0;
+    for (size_t i = 0; i < text.size();) {
+        const size_t pieceSize = std::min<size_t>(text.size() - i, random() % 3 ? random() % 7 + 1 : random() % 300 + 1);
+        if (!decoder.decode(text.data() + i, pieceSize, out.data() + decodedSize, out.size() - decodedSize, written))
+            return false;
+        decodedSize += written;
+        i += pieceSize;
+    }
+    if (!decoder.finish(out.data() + decodedSize, out.size() - decodedSize, written))
+        return false;
+    out.resize(decodedSize + written);
+    return true;
+}
+
+void checkRoundTrips(unsigned seed)
+{
+    std::mt19937 random(seed);
+    int encodeMismatches = 0, decodeMismatches = 0;
+    for (size_t size : { 0, 1, 2, 3, 4, 11, 12, 13, 15, 16, 17, 47, 48, 49, 65537, 100003 }) {
+        for (int attempt = 0; attempt < (size < 1000 ? 20 : 2); ++attempt) {
+            std::vector<uint8_t> data(size);
+            for (uint8_t& byte : data)
+                byte = uint8_t(random());
+            const std::string expected = websocketpp::base64_encode(data.data(), data.size());
+            const std::string encoded = base64Encode(data.data(), data.size());
+            encodeMismatches += encoded != expected || encoded.size() != getBase64EncodedSize(size);
+
+            // padded, unpadded and with line breaks as some editors save text
+            std::string unpadded = expected, wrapped;
+            unpadded.erase(unpadded.find_last_not_of('=') + 1);
+            for (size_t i = 0; i < expected.size(); i += 76)
+                wrapped += expected.substr(i, 76) + "\r\n";
+            for (const std::string& text : { expected, unpadded, wrapped }) {
+                std::vector<uint8_t> decoded;
+                decodeMismatches += !decodeInPieces(text, decoded, random) || decoded != data;
+            }
+        }
+    }
+    CHECK(encodeMismatches == 0);
+    CHECK(decodeMismatches == 0);
+
+    // out of the alphabet, a cut inside of a byte, a buffer too small
+    std::vector<uint8_t> decoded;
+    CHECK(!decodeInPieces("QUJD*EVG", decoded, random));
+    CHECK(!decodeInPieces("QUJDR", decoded, random));
+    Base64Decoder decoder;
+    uint8_t small[2];
+    size_t written = 0;
+    CHECK(!decoder.decode("QUJDREVG", 8, small, sizeof(small), written));
+}
+
+void writeLegacyFile(const std::vector<UVBSPSplit>& nodes)
+{
+    std::ofstream(s_path, std::ios::binary | std::ios::trunc)
+        << websocketpp::base64_encode(reinterpret_cast<const unsigned char*>(nodes.data()), nodes.size() * sizeof(UVBSPSplit));
+}
+
+// Old files as the editor saved them, larger ones span several decoded pieces
+void checkLegacyFiles()
+{
+    for (size_t splitCount : { 1, 300, 5000 }) {
+        const UVBSP uvbsp = makeRandomTree(splitCount, unsigned(splitCount));
+        writeLegacyFile(uvbsp.getNodes());
+        UVBSP loaded;
+        CHECK(loaded.readFromFile(s_path));
+        CHECK(loaded.getNumNodes() == uvbsp.getNumNodes()
+            && std::memcmp(loaded.getNodes().data(), uvbsp.getNodes().data(), uvbsp.getNumNodes() * sizeof(UVBSPSplit)) == 0);
+    }
+
+    // one node, l = -1000
+    std::ofstream(s_path, std::ios::binary | std::ios::trunc) << "AAAAPwAAAD8AAIA/AAAAABj8//8BAAAA";
+    UVBSP refused;
+    CHECK(!refused.readFromFile(s_path));
+    CHECK(refused.getNumNodes() == 1);
+
+    // a cycle inside of the array
+    writeLegacyFile({ UVBSPSplit(bsp::vec2(0.5f, 0.5f), bsp::vec2(1.f, 0.f), -1, 1),
+        UVBSPSplit(bsp::vec2(0.5f, 0.5f), bsp::vec2(0.f, 1.f), -1, 2) });
+    CHECK(!refused.readFromFile(s_path));
+}
+
+} // namespace
+
+int main()
+{
+    checkRoundTrips(1);
+    checkLegacyFiles();
+    std::filesystem::remove(s_path);
+    return finishTest("base64_test");
+}
@@ -0,0 +1,59 @@
+// Mask builder: a mask of three labels separated by lines is rebuilt with no texel
+// misclassified, by the stats and by classify() at texel centers, the same tree on any thread count
+
+#include "test_utils.h"
+#include <cstring>
+#include <uvbsp/uvbsp_build.h>
+
+namespace {
+
+// Left band, a diagonal, the rest; not square so rows and columns can't be swapped
+UVBSPLabelImage makeLineMask(uint32_t width, uint32_t height)
+{
+    UVBSPLabelImage image;
+    image.width = width;
+    image.height = height;
+    image.labels.resize(size_t(width) * height);
+    for (uint32_t y = 0; y < height; ++y) {
+        for (uint32_t x = 0; x < width; ++x) {
+            const bsp::vec2 uv = getTexelCenter(x, y, width, height);
+            image.labels[size_t(y) * width + x] = uv.x < 0.3f ? 0 : uv.x + uv.y < 1.2f ? 1 : 2;
+        }
+    }
+    return image;
+}
+
+} // namespace
+
+int main()
+{
+    const UVBSPLabelImage image = makeLineMask(96, 64);
+    UVBSPMaskBuilder::Settings settings;
+    settings.maxNodes = 64;
+
+    UVBSP uvbsp;
+    UVBSPMaskBuilder::Stats stats;
+    CHECK(UVBSPMaskBuilder(image).build(uvbsp, settings, &stats));
+    CHECK(stats.texels == image.labels.size());
+    CHECK(stats.misclassifiedTexels == 0);
+    CHECK(stats.nodes == uvbsp.getNumNodes() && stats.nodes < 16);
+
+    size_t mismatches = 0;
+    for (uint32_t y = 0; y < image.height; ++y)
+        for (uint32_t x = 0; x < image.width; ++x)
+            mismatches += uvbsp.classify(getTexelCenter(x, y, image.width, image.height)) != image.labels[size_t(y) * image.width + x];
+    CHECK(mismatches == 0);
+
+    // the split search is parallel, its result is not
+    for (unsigned threadCount : { 1, 3 }) {
+        settings.threadCount = threadCount;
+        UVBSP other;
+        CHECK(UVBSPMaskBuilder(image).build(other, settings));
+        CHECK(other.getNumNodes() == uvbsp.getNumNodes()
+            && std::memcmp(other.getNodes().data(), uvbsp.getNodes().data(), uvbsp.getNumNodes() * sizeof(UVBSPSplit)) == 0);
+    }
+
+    // no labels, nothing to build
+    CHECK(!UVBSPMaskBuilder(UVBSPLabelImage()).build(uvbsp, settings));
+    return finishTest("build_test");
+}
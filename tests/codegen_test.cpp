@@ -0,0 +1,82 @@
+// Unrolled shader: evaluate() with the printed literals against classify() at texel centers,
+// branches only, select networks of up to 7 nodes and one network for the whole tree,
+// on drawn trees and after undo and redo. The emitted code tests every node once
+
+#include "test_utils.h"
+#include <climits>
+#include <sstream>
+#include <uvbsp/uvbsp_codegen.h>
+
+namespace {
+
+size_t countOccurrences(const std::string& text, const std::string& pattern)
+{
+    size_t count = 0;
+    for (size_t i = text.find(pattern); i != std::string::npos; i = text.find(pattern, i + 1))
+        count++;
+    return count;
+}
+
+void checkUnrolled(const UVBSP& uvbsp)
+{
+    const UVBSPCompiledTree& tree = uvbsp.getCompiledTree();
+    for (int selectNetworkMaxNodes : { 0, 7, INT_MAX }) {
+        UVBSPUnrolledShader::Settings settings;
+        settings.selectNetworkMaxNodes = selectNetworkMaxNodes;
+        const UVBSPUnrolledShader shader(tree, settings);
+
+        // a network of the whole tree computes every test per sample, fewer samples for large trees
+        const int resolution = selectNetworkMaxNodes == INT_MAX && tree.size() > 100 ? 128 : 512;
+        CHECK(shader.countMismatches(uvbsp, resolution) == 0);
+
+        for (UVBSP::ShaderType shaderType : { UVBSP::ShaderType::GLSL, UVBSP::ShaderType::HLSL }) {
+            std::stringstream code;
+            shader.write(code, shaderType);
+            const std::string text = code.str();
+            const size_t branches = countOccurrences(text, "if ("), selects = countOccurrences(text, "bool s");
+            CHECK(branches + selects == tree.size());
+            if (selectNetworkMaxNodes == 0)
+                CHECK(selects == 0);
+            if (selectNetworkMaxNodes == INT_MAX)
+                CHECK(branches == 0);
+        }
+    }
+}
+
+// Drawn split by split, part undone and redone, the compiled tree updated in place
+UVBSP makeEditedTree(unsigned seed)
+{
+    std::mt19937 random(seed);
+    std::uniform_real_distribution<float> unit(0.f, 1.f);
+    UVBSP uvbsp;
+    UVBSPActionHistory history(uvbsp);
+    uvbsp.getCompiledTree();
+    for (int i = 0; i < 400; ++i) {
+        const float angle = unit(random) * 6.2831853f;
+        uvbsp.addSplit(UVBSPSplit(bsp::vec2(unit(random), unit(random)), bsp::vec2(std::cos(angle), std::sin(angle)),
+            int(random() % 30), int(random() % 30)));
+        history.add(uvbsp.getLastAddRecord());
+        uvbsp.finishSplit();
+        uvbsp.getCompiledTree();
+    }
+    for (int i = 0; i < 150; ++i) {
+        history.undo();
+        uvbsp.getCompiledTree();
+    }
+    for (int i = 0; i < 60; ++i) {
+        history.redo();
+        uvbsp.getCompiledTree();
+    }
+    return uvbsp;
+}
+
+} // namespace
+
+int main()
+{
+    for (size_t splitCount : { 1, 20, 300, 3000 })
+        checkUnrolled(makeRandomTree(splitCount, unsigned(splitCount) + 40));
+    checkUnrolled(makeRandomTree(300, 7, 4)); // few colors
+    checkUnrolled(makeEditedTree(9));
+    return finishTest("codegen_test");
+}
@@ -0,0 +1,75 @@
+// Conformance checker: a tree against its own baked index map and against itself changes
+// no texel, a tree with one recolored leaf changes exactly the texels of that leaf
+
+#include "test_utils.h"
+#include <filesystem>
+#include <uvbsp/uvbsp_bake.h>
+#include <uvbsp/uvbsp_build.h>
+#include <uvbsp/uvbsp_conformance.h>
+
+namespace {
+
+const std::string s_path = "conformance_test.png";
+constexpr uint32_t s_width = 512, s_height = 384;
+
+UVBSPConformanceChecker::Settings getSettings()
+{
+    UVBSPConformanceChecker::Settings settings;
+    settings.width = s_width;
+    settings.height = s_height;
+    return settings;
+}
+
+} // namespace
+
+int main()
+{
+    // every leaf has a color of its own
+    const UVBSP uvbsp = makeRandomTree(300, 12);
+    UVBSPIndexBaker::Settings bakeSettings;
+    bakeSettings.width = s_width;
+    bakeSettings.height = s_height;
+    CHECK(UVBSPIndexBaker(uvbsp).bake(s_path, bakeSettings));
+    UVBSPLabelImage indexMap;
+    CHECK(UVBSPLabelImage::readIndexMap(s_path, indexMap));
+    CHECK(indexMap.width == s_width && indexMap.height == s_height);
+
+    UVBSPConformanceChecker::Report report;
+    CHECK(UVBSPConformanceChecker(uvbsp).compare(indexMap, getSettings(), &report));
+    CHECK(report.texels == size_t(s_width) * s_height && report.changedTexels == 0);
+    CHECK(UVBSPConformanceChecker(uvbsp).compare(uvbsp, getSettings(), &report));
+    CHECK(report.texels == size_t(s_width) * s_height && report.changedTexels == 0);
+
+    // the first leaf that covers texels gets a new color
+    std::vector<size_t> colorTexels(uvbsp.getColorCount());
+    for (uint16_t label : indexMap.labels)
+        colorTexels[label]++;
+    std::vector<UVBSPSplit> nodes = uvbsp.getNodes();
+    int oldColor = -1;
+    const int newColor = uvbsp.getColorCount();
+    for (size_t i = 0; i < nodes.size() && oldColor < 0; ++i) {
+        for (int* childIndex : { &nodes[i].l, &nodes[i].r }) {
+            if (*childIndex >= 0 && colorTexels[*childIndex] > 0) {
+                oldColor = *childIndex;
+                *childIndex = newColor;
+                break;
+            }
+        }
+    }
+    CHECK(oldColor >= 0);
+    UVBSP recolored;
+    recolored.assignNodes(nodes);
+
+    for (bool againstImage : { true, false }) {
+        const UVBSPConformanceChecker checker(recolored);
+        CHECK(againstImage ? checker.compare(indexMap, getSettings(), &report) : checker.compare(uvbsp, getSettings(), &report));
+        CHECK(oldColor >= 0 && report.changedTexels == colorTexels[oldColor]);
+        const std::vector<UVBSPConformanceChecker::Confusion> changes = report.getLargestChanges(8);
+        CHECK(changes.size() == 1);
+        CHECK(changes.size() == 1 && changes[0].reference == oldColor && changes[0].tested == newColor
+            && changes[0].texels == report.changedTexels);
+    }
+
+    std::filesystem::remove(s_path);
+    return finishTest("conformance_test");
+}
@@ -0,0 +1,216 @@
+// Binary and JSON files: round trip of nodes and history, and corrupted files,
+// which must be refused or load into a tree whose links, undone and redone, stay inside.
+// Crafted node links that leave no tree are refused
+
+#include "test_utils.h"
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <uvbsp/uvbsp_file.h>
+#include <uvbsp/uvbsp_json.h>
+
+namespace {
+
+const std::string s_binaryPath = "file_test.uvbsp";
+const std::string s_jsonPath = "file_test.json";
+
+bool isSameSplit(const UVBSPSplit& a, const UVBSPSplit& b)
+{
+    return a.pos.x == b.pos.x && a.pos.y == b.pos.y && a.dir.x == b.dir.x && a.dir.y == b.dir.y && a.l == b.l && a.r == b.r;
+}
+
+bool isSameRecord(const UVBSPAddRecord& a, const UVBSPAddRecord& b)
+{
+    return a.parentIndex == b.parentIndex && a.side == b.side && a.previousChild == b.previousChild && isSameSplit(a.split, b.split);
+}
+
+bool areLinksInside(const UVBSP& uvbsp)
+{
+    const std::vector<UVBSPSplit>& nodes = uvbsp.getNodes();
+    for (const UVBSPSplit& node : nodes)
+        for (int childIndex : { node.l, node.r })
+            if (childIndex < 0 && (childIndex == INT32_MIN || -childIndex >= int64_t(nodes.size())))
+                return false;
+    return true;
+}
+
+// Drawn with history, part of it undone so the file has redo records
+UVBSP makeEditedTree(UVBSPEditorState& state, unsigned seed)
+{
+    std::mt19937 random(seed);
+    std::uniform_real_distribution<float> unit(0.f, 1.f);
+    UVBSP uvbsp;
+    UVBSPActionHistory history(uvbsp);
+    for (int i = 0; i < 300; ++i) {
+        const float angle = unit(random) * 6.2831853f;
+        uvbsp.addSplit(UVBSPSplit(bsp::vec2(unit(random), unit(random)), bsp::vec2(std::cos(angle), std::sin(angle)),
+            int(random() % 20), int(random() % 20)));
+        history.add(uvbsp.getLastAddRecord());
+        uvbsp.finishSplit();
+    }
+    for (int i = 0; i < 100; ++i)
+        history.undo();
+    state = { 7, history.getRecords(), history.getCurrentIndex() };
+    return uvbsp;
+}
+
+void checkRoundTrip(const UVBSP& uvbsp, const UVBSPEditorState& state, const std::string& path, bool isJson)
+{
+    CHECK(isJson ? uvbsp.writeToJson(path, &state) : uvbsp.writeToFile(path, &state));
+    UVBSP loaded;
+    UVBSPEditorState loadedState;
+    CHECK(loaded.readFromFile(path, &loadedState));
+
+    CHECK(loaded.getNumNodes() == uvbsp.getNumNodes());
+    int nodeMismatches = 0;
+    for (size_t i = 0; i < std::min(loaded.getNumNodes(), uvbsp.getNumNodes()); ++i)
+        nodeMismatches += !isSameSplit(loaded.getNodes()[i], uvbsp.getNodes()[i]);
+    CHECK(nodeMismatches == 0);
+    CHECK(loadedState.colorIndex == state.colorIndex);
+    CHECK(loadedState.historyIndex == state.historyIndex);
+    CHECK(loadedState.history.size() == state.history.size());
+    int recordMismatches = 0;
+    for (size_t i = 0; i < std::min(loadedState.history.size(), state.history.size()); ++i)
+        recordMismatches += !isSameRecord(loadedState.history[i], state.history[i]);
+    CHECK(recordMismatches == 0);
+
+    // the loaded history replays: redo everything, then undo everything
+    UVBSPActionHistory history(loaded);
+    history.assign(loadedState.history, loadedState.historyIndex);
+    while (history.redo()) {
+    }
+    CHECK(history.getCurrentIndex() == loadedState.history.size());
+    while (history.undo()) {
+    }
+    CHECK(history.getCurrentIndex() == 0);
+    if (!state.history.empty()) // the history drew every node
+        CHECK(loaded.getNumNodes() == 1);
+}
+
+// Records a broken or crafted file could hold, written with a valid checksum
+void checkInvalidHistory(const UVBSP& uvbsp, const UVBSPEditorState& state)
+{
+    const size_t applied = state.historyIndex, redo = state.historyIndex + 1;
+    const std::vector<std::pair<size_t, std::function<void(UVBSPAddRecord&)>>> corruptions = {
+        { redo, [](UVBSPAddRecord& record) { record.split.l = -1000000; } }, // link out of the tree after redo
+        { redo, [](UVBSPAddRecord& record) { record.split.r = -1; } },
+        { redo, [](UVBSPAddRecord& record) { record.parentIndex = 1 << 30; } },
+        { redo, [](UVBSPAddRecord& record) { record.parentIndex = -5; } },
+        { redo, [](UVBSPAddRecord& record) { record.side = 7; } },
+        { applied - 1, [](UVBSPAddRecord& record) { record.previousChild = -1000000; } }, // written back by undo
+        { applied - 1, [](UVBSPAddRecord& record) { record.parentIndex = -1; } },
+    };
+    for (const auto& [recordIndex, corrupt] : corruptions) {
+        UVBSPEditorState badState = state;
+        corrupt(badState.history[recordIndex]);
+        CHECK(!isHistoryValid(badState.history, badState.historyIndex, uvbsp.getNumNodes()));
+        for (bool isJson : { false, true }) {
+            const std::string& path = isJson ? s_jsonPath : s_binaryPath;
+            CHECK(isJson ? uvbsp.writeToJson(path, &badState) : uvbsp.writeToFile(path, &badState));
+            UVBSP loaded;
+            UVBSPEditorState loadedState;
+            CHECK(!loaded.readFromFile(path, &loadedState));
+        }
+    }
+
+    // more applied records than the tree has nodes for
+    UVBSP small;
+    CHECK(!isHistoryValid(state.history, state.historyIndex, small.getNumNodes()));
+}
+
+// Links inside of the array that do not form a tree: a loaded file would hang locate() and updateCells()
+void checkInvalidTree()
+{
+    const UVBSPSplit split(bsp::vec2(0.5f, 0.5f), bsp::vec2(1.f, 0.f), 0, 1);
+    const auto withLinks = [&](int l, int r) { return UVBSPSplit(split.pos, split.dir, l, r); };
+    const std::vector<std::vector<UVBSPSplit>> trees = {
+        { withLinks(-1, 1), withLinks(-1, 2) }, // node 1 links to itself
+        { withLinks(-1, 1), withLinks(-2, 2), withLinks(3, -1) }, // 1 -> 2 -> 1
+        { withLinks(-1, -2), withLinks(-2, 2), withLinks(3, 4) }, // node 2 has two parents
+        { withLinks(-1, -1), withLinks(2, 3) }, // both sides of the root
+    };
+    for (const std::vector<UVBSPSplit>& nodes : trees) {
+        CHECK(!isTreeValid(nodes));
+        UVBSP uvbsp;
+        uvbsp.assignNodes(nodes);
+        CHECK(uvbsp.writeToFile(s_binaryPath));
+        UVBSP loaded;
+        CHECK(!loaded.readFromFile(s_binaryPath));
+        CHECK(loaded.getNumNodes() == 1);
+    }
+
+    // unreachable nodes are kept, as an edited tree can have them
+    CHECK(isTreeValid({ withLinks(-2, 1), withLinks(5, 6), withLinks(3, 4) }));
+    CHECK(isTreeValid(makeRandomTree(500, 5).getNodes()));
+}
+
+std::string readText(const std::string& path)
+{
+    std::ifstream file(path, std::ios::binary);
+    return std::string((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+}
+
+void writeText(const std::string& path, const std::string& text)
+{
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file << text;
+}
+
+// Random bytes changed, cut off files: refused, or loaded with links that stay inside
+void checkCorruptedBytes(const std::string& path, unsigned seed)
+{
+    const std::string original = readText(path);
+    std::mt19937 random(seed);
+    int refused = 0;
+    for (int attempt = 0; attempt < 300; ++attempt) {
+        std::string text = original;
+        if (attempt % 3 == 0)
+            text.resize(random() % text.size());
+        for (int change = random() % 4 + 1; change > 0 && !text.empty(); --change)
+            text[random() % text.size()] = "-0123456789.e,[]{}\" x"[random() % 21];
+        writeText(path, text);
+
+        UVBSP loaded;
+        UVBSPEditorState loadedState;
+        if (!loaded.readFromFile(path, &loadedState)) {
+            refused++;
+            continue;
+        }
+        CHECK(areLinksInside(loaded));
+        UVBSPActionHistory history(loaded);
+        history.assign(loadedState.history, loadedState.historyIndex);
+        while (history.redo()) {
+        }
+        CHECK(areLinksInside(loaded));
+        while (history.undo()) {
+        }
+        CHECK(areLinksInside(loaded));
+        loaded.classify(bsp::vec2(0.5f, 0.5f));
+    }
+    CHECK(refused > 0);
+}
+
+} // namespace
+
+int main()
+{
+    UVBSPEditorState state;
+    const UVBSP uvbsp = makeEditedTree(state, 1);
+    CHECK(isHistoryValid(state.history, state.historyIndex, uvbsp.getNumNodes()));
+    checkRoundTrip(uvbsp, state, s_binaryPath, false);
+    checkRoundTrip(uvbsp, state, s_jsonPath, true);
+    checkRoundTrip(makeRandomTree(2000, 2), {}, s_binaryPath, false);
+    checkRoundTrip(UVBSP(), {}, s_jsonPath, true);
+
+    checkInvalidHistory(uvbsp, state);
+    checkInvalidTree();
+
+    CHECK(uvbsp.writeToFile(s_binaryPath, &state));
+    checkCorruptedBytes(s_binaryPath, 3);
+    CHECK(uvbsp.writeToJson(s_jsonPath, &state));
+    checkCorruptedBytes(s_jsonPath, 4);
+
+    std::filesystem::remove(s_binaryPath);
+    std::filesystem::remove(s_jsonPath);
+    return finishTest("file_test");
+}
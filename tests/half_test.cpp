@@ -0,0 +1,123 @@
+// Half nodes: trees as drawn are packed, the packed walk stays next to classify(),
+// repacking the changed runs of an edited tree gives the same words as packing it whole
+
+#include "test_utils.h"
+#include <cstring>
+#include <uvbsp/uvbsp_half.h>
+
+namespace {
+
+size_t countEvaluateMismatches(const UVBSPHalfNodes& halfNodes, const UVBSP& uvbsp, uint32_t resolution)
+{
+    size_t mismatches = 0;
+    for (uint32_t y = 0; y < resolution; ++y)
+        for (uint32_t x = 0; x < resolution; ++x) {
+            const bsp::vec2 uv = getTexelCenter(x, y, resolution, resolution);
+            mismatches += halfNodes.evaluate(uv) != uvbsp.classify(uv);
+        }
+    return mismatches;
+}
+
+bool isSamePacked(const UVBSPHalfNodes& a, const UVBSPHalfNodes& b)
+{
+    return a.getPacked().size() == b.getPacked().size()
+        && std::memcmp(a.getPacked().data(), b.getPacked().data(), a.getPacked().size() * sizeof(bsp::Vec4)) == 0;
+}
+
+void checkAccepted(const UVBSP& uvbsp, int checkResolution)
+{
+    UVBSPHalfNodes::Settings settings;
+    settings.checkResolution = checkResolution;
+    UVBSPHalfNodes halfNodes;
+    UVBSPHalfNodes::Report report;
+    CHECK(halfNodes.pack(uvbsp, settings, &report));
+    CHECK(report.packed && report.refusedNodes.empty());
+    CHECK(report.maxLineOffset <= settings.maxLineOffset);
+    CHECK(halfNodes.getNodeCount() == uvbsp.getCompiledTree().size());
+    CHECK(halfNodes.getPacked().size() == (halfNodes.getNodeCount() + 1) / 2);
+
+    // the changed samples are all the report has, other texel centers move as rarely
+    const size_t checkedMismatches = countEvaluateMismatches(halfNodes, uvbsp, uint32_t(checkResolution));
+    CHECK(checkedMismatches <= report.changedSamples);
+    CHECK(report.changedSamples * 1000 < report.samplesChecked);
+    CHECK(countEvaluateMismatches(halfNodes, uvbsp, 733) * 200 < 733 * 733);
+}
+
+// Drawn split by split, repacked from updateUniforms() runs, also while undoing
+void checkPackRange(unsigned seed)
+{
+    std::mt19937 random(seed);
+    std::uniform_real_distribution<float> unit(0.f, 1.f);
+    UVBSP uvbsp;
+    UVBSPActionHistory history(uvbsp);
+    UVBSPHalfNodes incremental;
+    UVBSPHalfNodes::Settings settings;
+    settings.checkResolution = 0;
+    settings.searchRadius = 0;
+    int mismatchedSteps = 0, refusedSteps = 0;
+    auto repack = [&]() {
+        uvbsp.updateUniforms([&](int firstIndex, const bsp::Vec4*, size_t count) {
+            refusedSteps += !incremental.packRange(uvbsp.getCompiledTree(), size_t(firstIndex), count, settings);
+        });
+        UVBSPHalfNodes whole;
+        CHECK(whole.pack(uvbsp, settings));
+        mismatchedSteps += !isSamePacked(incremental, whole);
+    };
+    for (int i = 0; i < 300; ++i) {
+        const float angle = unit(random) * 6.2831853f;
+        uvbsp.addSplit(UVBSPSplit(bsp::vec2(unit(random), unit(random)), bsp::vec2(std::cos(angle), std::sin(angle)),
+            int(random() % 50), int(random() % 50)));
+        history.add(uvbsp.getLastAddRecord());
+        uvbsp.finishSplit();
+        repack();
+        if (i % 7 == 6) {
+            history.undo();
+            repack();
+            history.undo();
+            repack();
+            history.redo();
+            repack();
+        }
+    }
+    CHECK(mismatchedSteps == 0);
+    CHECK(refusedSteps == 0);
+}
+
+} // namespace
+
+int main()
+{
+    // single splits in every direction, small trees as drawn with the mouse, large trees
+    for (unsigned seed = 1; seed <= 8; ++seed)
+        checkAccepted(makeRandomTree(1, seed), 512);
+    checkAccepted(makeRandomTree(20, 100, 8), 1024); // export settings
+    for (unsigned seed = 1; seed <= 3; ++seed)
+        checkAccepted(makeRandomTree(20, seed + 100, 8), 512);
+    checkAccepted(makeRandomTree(3000, 8), 512);
+
+    // axis aligned lines and a line outside of the unit square, which keeps its side exactly
+    UVBSP axes;
+    axes.assignNodes({
+        UVBSPSplit(bsp::vec2(0.5f, 0.5f), bsp::vec2(1.f, 0.f), -1, -2),
+        UVBSPSplit(bsp::vec2(0.25f, 0.75f), bsp::vec2(0.f, 1.f), 1, 2),
+        UVBSPSplit(bsp::vec2(-1.f, 0.5f), bsp::vec2(1.f, 0.f), 3, 4),
+    });
+    checkAccepted(axes, 1024);
+
+    // the exported shader form
+    CHECK(!makeRandomTree(200, 3).generateShader(UVBSP::ShaderType::GLSL, UVBSP::ShaderCodeForm::HalfPacked).str().empty());
+
+    checkPackRange(11);
+
+    // colors past int16 are refused, by pack() and by packRange()
+    UVBSP manyColors;
+    manyColors.assignNodes({ UVBSPSplit(bsp::vec2(0.5f, 0.5f), bsp::vec2(1.f, 0.f), 40000, 1) });
+    UVBSPHalfNodes refused;
+    UVBSPHalfNodes::Report report;
+    CHECK(!refused.pack(manyColors, UVBSPHalfNodes::Settings(), &report));
+    CHECK(!report.packed && report.refusedNodes.size() == 1);
+    CHECK(refused.getNodeCount() == 0);
+    CHECK(!refused.packRange(manyColors.getCompiledTree(), 0, 1, UVBSPHalfNodes::Settings()));
+    CHECK(manyColors.generateShader(UVBSP::ShaderType::HLSL, UVBSP::ShaderCodeForm::HalfPacked).str().empty());
+    return finishTest("half_test");
+}
@@ -0,0 +1,98 @@
+// Caches updated by addSplit(), adjustSplit(), undo and redo (tree stats, point grid,
+// compiled tree, cells) against the same nodes built from scratch by assignNodes()
+
+#include "test_utils.h"
+
+namespace {
+
+void checkTreeStats(const UVBSPTreeStats& stats, const UVBSPTreeStats& fresh, size_t nodeCount)
+{
+    CHECK(stats.getMaxDepth() == fresh.getMaxDepth());
+    CHECK(stats.getLeafCount() == fresh.getLeafCount());
+    CHECK(stats.getAverageLeafDepth() == fresh.getAverageLeafDepth());
+    CHECK(stats.getLeafDepthCounts() == fresh.getLeafDepthCounts());
+    CHECK(stats.getColorLeafCounts() == fresh.getColorLeafCounts());
+    CHECK(stats.getUsedColorCount() == fresh.getUsedColorCount());
+    int nodeMismatches = 0;
+    for (size_t i = 0; i < nodeCount; ++i)
+        nodeMismatches += stats.getDepth(i) != fresh.getDepth(i) || stats.getHeight(i) != fresh.getHeight(i)
+            || stats.getLeafCount(i) != fresh.getLeafCount(i);
+    CHECK(nodeMismatches == 0);
+}
+
+void checkAgainstFresh(const UVBSP& uvbsp, std::mt19937& random)
+{
+    UVBSP fresh;
+    fresh.assignNodes(uvbsp.getNodes());
+    checkTreeStats(uvbsp.getTreeStats(), fresh.getTreeStats(), uvbsp.getNumNodes());
+
+    std::uniform_real_distribution<float> unit(0.f, 1.f);
+    int locateMismatches = 0, classifyMismatches = 0;
+    for (int i = 0; i < 2000; ++i) {
+        const bsp::vec2 uv(unit(random), unit(random));
+        const UVBSPPointLocation location = uvbsp.locate(uv), freshLocation = fresh.locate(uv);
+        locateMismatches += location.nodeIndex != freshLocation.nodeIndex || location.side != freshLocation.side
+            || location.colorIndex != freshLocation.colorIndex || location.depth != freshLocation.depth;
+        classifyMismatches += uvbsp.classify(uv) != classifyReference(fresh.getNodes(), uv);
+    }
+    CHECK(locateMismatches == 0);
+    CHECK(classifyMismatches == 0);
+
+    for (int colorIndex = 0; colorIndex < fresh.getColorCount(); colorIndex += 7)
+        CHECK(std::abs(uvbsp.getColorArea(colorIndex) - fresh.getColorArea(colorIndex)) < 1e-9);
+}
+
+// Splits drawn with history as the editor does: add, drag the direction, record.
+// Caches are queried before edits, so they are updated in place instead of rebuilt
+void checkEditing(size_t splitCount, int colorCount, unsigned seed)
+{
+    std::mt19937 random(seed);
+    std::uniform_real_distribution<float> unit(0.f, 1.f);
+    UVBSP uvbsp;
+    UVBSPActionHistory history(uvbsp);
+    uvbsp.getTreeStats();
+    uvbsp.getCompiledTree();
+
+    auto drawSplit = [&]() {
+        const float angle = unit(random) * 6.2831853f, dragAngle = angle + (unit(random) - 0.5f);
+        uvbsp.addSplit(UVBSPSplit(bsp::vec2(unit(random), unit(random)), bsp::vec2(std::cos(angle), std::sin(angle)),
+            int(random() % colorCount), int(random() % colorCount)));
+        uvbsp.adjustSplit(bsp::vec2(std::cos(dragAngle), std::sin(dragAngle)));
+        history.add(uvbsp.getLastAddRecord());
+        uvbsp.finishSplit();
+    };
+
+    for (size_t i = 0; i < splitCount; ++i)
+        drawSplit();
+    uvbsp.locate(bsp::vec2(0.5f, 0.5f)); // builds the point grid
+    checkAgainstFresh(uvbsp, random);
+
+    // undo deep enough to lower the max depth, redo part, draw a new branch
+    for (size_t i = 0; i < splitCount * 3 / 4; ++i)
+        CHECK(history.undo());
+    checkAgainstFresh(uvbsp, random);
+    for (size_t i = 0; i < splitCount / 4; ++i)
+        CHECK(history.redo());
+    checkAgainstFresh(uvbsp, random);
+    for (size_t i = 0; i < splitCount / 8; ++i)
+        drawSplit();
+    checkAgainstFresh(uvbsp, random);
+
+    while (history.undo()) {
+    }
+    checkAgainstFresh(uvbsp, random);
+    CHECK(uvbsp.getTreeStats().getLeafDepthCounts().size() == 2); // depth 0 and the root's two leaves
+    while (history.redo()) {
+    }
+    checkAgainstFresh(uvbsp, random);
+}
+
+} // namespace
+
+int main()
+{
+    checkEditing(40, 5, 1);
+    checkEditing(600, 16, 2); // past s_pointGridMinNodes
+    checkEditing(3000, 1000, 3);
+    return finishTest("incremental_test");
+}
@@ -0,0 +1,92 @@
+// JSON numbers: extreme floats written by the project writer read back bit exact,
+// numbers of other writers (past the float range, integers as "3.0") are accepted,
+// node links that form no tree are refused
+
+#include "test_utils.h"
+#include <cfloat>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <uvbsp/uvbsp_json.h>
+
+namespace {
+
+const std::string s_path = "json_test.json";
+
+bool isSameBits(float a, float b)
+{
+    return std::memcmp(&a, &b, sizeof(float)) == 0;
+}
+
+// Project of the nodes array, as text
+bool readNodes(const std::string& nodes, UVBSP& uvbsp)
+{
+    std::ofstream(s_path, std::ios::binary | std::ios::trunc)
+        << "{ \"format\": \"uvbsp\", \"version\": 1.0, \"initialSplitSet\": true, \"nodes\": [" << nodes << "] }";
+    return uvbsp.readFromJson(s_path);
+}
+
+// Project of one node, values as text
+bool readNode(const std::string& node, UVBSPSplit& split)
+{
+    UVBSP uvbsp;
+    if (!readNodes("[" + node + "]", uvbsp) || uvbsp.getNumNodes() != 1)
+        return false;
+    split = uvbsp.getNodes()[0];
+    return true;
+}
+
+} // namespace
+
+int main()
+{
+    // split positions at the ends of the float range
+    const float extremes[] = { std::numeric_limits<float>::denorm_min(), -std::numeric_limits<float>::denorm_min(),
+        1e-40f, FLT_MIN, FLT_MAX, -FLT_MAX, -0.f, 0.1f, 1.f / 3.f };
+    UVBSP uvbsp;
+    std::vector<UVBSPSplit> nodes;
+    for (float a : extremes)
+        for (float b : extremes)
+            nodes.push_back(UVBSPSplit(bsp::vec2(a, b), bsp::vec2(b, a), int(nodes.size()), 1));
+    uvbsp.assignNodes(nodes);
+    CHECK(uvbsp.writeToJson(s_path));
+    UVBSP loaded;
+    CHECK(loaded.readFromJson(s_path));
+    CHECK(loaded.getNumNodes() == nodes.size());
+    int bitMismatches = 0;
+    for (size_t i = 0; i < std::min(loaded.getNumNodes(), nodes.size()); ++i) {
+        const UVBSPSplit& split = loaded.getNodes()[i];
+        bitMismatches += !isSameBits(split.pos.x, nodes[i].pos.x) || !isSameBits(split.pos.y, nodes[i].pos.y)
+            || !isSameBits(split.dir.x, nodes[i].dir.x) || !isSameBits(split.dir.y, nodes[i].dir.y);
+    }
+    CHECK(bitMismatches == 0);
+
+    // past the float range: tiny values are flushed to zero, huge ones clamped, past the double range too
+    UVBSPSplit split;
+    CHECK(readNode("1e-50, -1e-46, 1e39, -3.4028236e38, 0, 1", split));
+    CHECK(isSameBits(split.pos.x, 0.f) && isSameBits(split.pos.y, -0.f));
+    CHECK(split.dir.x == FLT_MAX && split.dir.y == -FLT_MAX);
+    CHECK(readNode("1e-400, -0.0000000000000000000000000000000000000000000000000000001e-300, 1e400, -1e999, 0, 1", split));
+    CHECK(split.pos.x == 0.f && split.pos.y == 0.f && split.dir.x == FLT_MAX && split.dir.y == -FLT_MAX);
+
+    // integers written as floats, as other JSON writers do
+    CHECK(readNode("0.5, 0.5, 1, 0, 3.0, 4e0", split));
+    CHECK(split.l == 3 && split.r == 4);
+    CHECK(readNode("0.5, 0.5, 1, 0, -0.0, 1E1", split));
+    CHECK(split.l == 0 && split.r == 10);
+    CHECK(!readNode("0.5, 0.5, 1, 0, 2.5, 1", split)); // a fraction is not an index
+    CHECK(!readNode("0.5, 0.5, 1, 0, 3e9, 1", split)); // past int
+    CHECK(!readNode("0.5, 0.5, 1, 0, 1e999, 1", split));
+
+    // links inside of the array that form no tree, which would hang locate()
+    UVBSP crafted;
+    CHECK(readNodes("[0.5, 0.5, 1, 0, -1, 1], [0.5, 0.5, 0, 1, 2, 3]", crafted));
+    CHECK(!readNodes("[0.5, 0.5, 1, 0, -1, 1], [0.5, 0.5, 0, 1, -1, 2]", crafted)); // cycle
+    CHECK(!readNodes("[0.5, 0.5, 1, 0, -1, -2], [0.5, 0.5, 0, 1, -2, 2], [0.5, 0.5, 0, 1, 3, 4]", crafted)); // shared child
+    CHECK(!readNodes("[0.5, 0.5, 1, 0, -1, 1], [0.5, 0.5, 0, 1, -2, 2]", crafted)); // past the array
+    CHECK(crafted.getNumNodes() == 2);
+
+    std::filesystem::remove(s_path);
+    return finishTest("json_test");
+}
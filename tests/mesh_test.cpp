@@ -0,0 +1,69 @@
+// Mesh builder: a grid of separated quad islands is split between islands only,
+// islands - 1 nodes and no triangle misplaced, by the stats and by classify() at centroids
+
+#include "test_utils.h"
+#include <uvbsp/uvbsp_mesh.h>
+
+namespace {
+
+// columns x rows quads with gaps between them, two triangles each, one material per row
+UVBSPMesh makeQuadGrid(int columns, int rows)
+{
+    UVBSPMesh mesh;
+    const float cellWidth = 1.f / columns, cellHeight = 1.f / rows;
+    for (int row = 0; row < rows; ++row) {
+        mesh.materialNames.push_back("row" + std::to_string(row));
+        for (int column = 0; column < columns; ++column) {
+            const uint32_t first = uint32_t(mesh.uvs.size());
+            const float u0 = (column + 0.15f) * cellWidth, u1 = (column + 0.85f) * cellWidth;
+            const float v0 = (row + 0.15f) * cellHeight, v1 = (row + 0.85f) * cellHeight;
+            mesh.uvs.insert(mesh.uvs.end(), { bsp::vec2(u0, v0), bsp::vec2(u1, v0), bsp::vec2(u1, v1), bsp::vec2(u0, v1) });
+            mesh.triangles.push_back({ first, first + 1, first + 2 });
+            mesh.triangles.push_back({ first, first + 2, first + 3 });
+            mesh.triangleMaterials.insert(mesh.triangleMaterials.end(), { row, row });
+        }
+    }
+    return mesh;
+}
+
+size_t countMisplaced(const UVBSPMesh& mesh, const UVBSP& uvbsp, const std::vector<int>& groups)
+{
+    size_t misplaced = 0;
+    for (size_t i = 0; i < mesh.triangles.size(); ++i) {
+        const auto& triangle = mesh.triangles[i];
+        const bsp::vec2 centroid = (mesh.uvs[triangle[0]] + mesh.uvs[triangle[1]] + mesh.uvs[triangle[2]]) * (1.f / 3.f);
+        misplaced += uvbsp.classify(centroid) != groups[i];
+    }
+    return misplaced;
+}
+
+} // namespace
+
+int main()
+{
+    const int columns = 5, rows = 3;
+    const UVBSPMesh mesh = makeQuadGrid(columns, rows);
+    int islandCount = 0;
+    const std::vector<int> islands = mesh.findIslands(&islandCount);
+    CHECK(islandCount == columns * rows);
+
+    UVBSPMeshBuilder::Settings settings;
+    UVBSP uvbsp;
+    UVBSPMeshBuilder::Stats stats;
+    CHECK(UVBSPMeshBuilder(mesh).build(uvbsp, settings, &stats));
+    CHECK(stats.islands == size_t(islandCount) && stats.groups == size_t(islandCount));
+    CHECK(stats.misplacedTriangles == 0 && stats.cutIslands == 0);
+    CHECK(stats.nodes == size_t(islandCount - 1) && uvbsp.getNumNodes() == stats.nodes);
+    CHECK(countMisplaced(mesh, uvbsp, islands) == 0);
+
+    // by material, rows are the groups
+    settings.groupBy = UVBSPMeshBuilder::GroupBy::Material;
+    CHECK(UVBSPMeshBuilder(mesh).build(uvbsp, settings, &stats));
+    CHECK(stats.groups == size_t(rows));
+    CHECK(stats.misplacedTriangles == 0 && stats.cutIslands == 0);
+    CHECK(stats.nodes == size_t(rows - 1));
+    CHECK(countMisplaced(mesh, uvbsp, mesh.triangleMaterials) == 0);
+
+    CHECK(!UVBSPMeshBuilder(UVBSPMesh()).build(uvbsp, settings));
+    return finishTest("mesh_test");
+}
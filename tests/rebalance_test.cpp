@@ -0,0 +1,43 @@
+// rebalance() keeps the partition: the new tree is compared with the old one on
+// samples of its own, not the texel centers rebalance() verifies itself.
+// Lines are clipped, not moved, so even points next to them keep their color
+
+#include "test_utils.h"
+
+namespace {
+
+void checkRebalance(const UVBSP& original, UVBSP::BalanceCost cost, unsigned seed)
+{
+    UVBSP uvbsp;
+    uvbsp.assignNodes(original.getNodes());
+    const UVBSPOptimizeReport report = uvbsp.rebalance(cost);
+    CHECK(report.applied);
+    CHECK(report.mismatchedSamples == 0);
+    CHECK(report.depthBefore == original.getTreeStats().getMaxDepth());
+    CHECK(report.depthAfter <= report.depthBefore);
+    CHECK(uvbsp.getTreeStats().getMaxDepth() == report.depthAfter);
+    CHECK(countClassifyMismatches(original, uvbsp, seed) == 0);
+}
+
+} // namespace
+
+int main()
+{
+    // a chain of splits, each one in the last leaf, rebalances to about log2 depth
+    UVBSP chain;
+    for (int i = 0; i < 64; ++i)
+        chain.addSplit(UVBSPSplit(bsp::vec2((i + 0.5f) / 64.f, 0.5f), bsp::vec2(1.f, 0.f), i, i + 1));
+    UVBSP chainBalanced;
+    chainBalanced.assignNodes(chain.getNodes());
+    const UVBSPOptimizeReport chainReport = chainBalanced.rebalance();
+    CHECK(chainReport.applied);
+    CHECK(chainReport.depthAfter <= 8);
+    CHECK(countClassifyMismatches(chain, chainBalanced, 5) == 0);
+
+    for (size_t splitCount : { 1, 10, 100, 1000, 5000 }) {
+        const UVBSP tree = makeRandomTree(splitCount, unsigned(splitCount) + 100, 12);
+        checkRebalance(tree, UVBSP::BalanceCost::MaxDepth, 1);
+        checkRebalance(tree, UVBSP::BalanceCost::ExpectedDepth, 2);
+    }
+    return finishTest("rebalance_test");
+}
@@ -0,0 +1,267 @@
+// BSPshader.frag on an EGL device (Mesa llvmpipe will do) against the CPU: the uniform
+// array, the node texture of large trees over several rows and half nodes, uploaded whole
+// and in the runs edits report, the way Application_UVBSP uploads them.
+// Exits with 77 (skipped) when there is no device.
+
+#define GL_GLEXT_PROTOTYPES
+#include "test_utils.h"
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <GL/gl.h>
+#include <GL/glext.h>
+#include <fstream>
+#include <sstream>
+#include <uvbsp/uvbsp_bake.h>
+#include <uvbsp/uvbsp_half.h>
+
+namespace {
+
+constexpr unsigned s_resolution = 512; // power of two, see indexOutput in BSPshader.frag
+constexpr size_t s_uniformNodeCapacity = 512; // "nodes" array of BSPshader.frag
+
+// Uniforms and node texture of Application_UVBSP
+class PreviewShader {
+    GLuint m_program {}, m_nodeTexture {};
+    unsigned m_nodeTextureRows {};
+    bool m_isLargeTree {};
+
+public:
+    UVBSPHalfNodes halfNodes;
+    bool isHalfNodes {};
+
+    bool create(const std::string& fragmentSource)
+    {
+        const std::string vertexSource = "#version 120\n"
+                                         "void main() { gl_Position = gl_Vertex; gl_TexCoord[0] = gl_MultiTexCoord0; }\n";
+        m_program = glCreateProgram();
+        for (auto [type, source] : { std::make_pair(GL_VERTEX_SHADER, &vertexSource), std::make_pair(GL_FRAGMENT_SHADER, &fragmentSource) }) {
+            const GLuint shader = glCreateShader(type);
+            const char* text = source->c_str();
+            glShaderSource(shader, 1, &text, nullptr);
+            glCompileShader(shader);
+            GLint isCompiled = 0;
+            glGetShaderiv(shader, GL_COMPILE_STATUS, &isCompiled);
+            if (!isCompiled) {
+                char log[4096];
+                glGetShaderInfoLog(shader, sizeof(log), nullptr, log);
+                std::printf("%s\n", log);
+                return false;
+            }
+            glAttachShader(m_program, shader);
+        }
+        glLinkProgram(m_program);
+        GLint isLinked = 0;
+        glGetProgramiv(m_program, GL_LINK_STATUS, &isLinked);
+        if (!isLinked)
+            return false;
+        glUseProgram(m_program);
+
+        GLuint textures[2];
+        glGenTextures(2, textures);
+        const uint8_t grey[4] = { 33, 33, 33, 255 };
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, textures[0]);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, grey);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        m_nodeTexture = textures[1];
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, m_nodeTexture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glUniform1i(getLocation("texture"), 0);
+        glUniform1i(getLocation("nodeTexture"), 1);
+        glUniform1f(getLocation("transparency"), 0.5f);
+        return true;
+    }
+
+    GLint getLocation(const std::string& name) const { return glGetUniformLocation(m_program, name.c_str()); }
+
+    void setNodes(size_t firstIndex, const bsp::Vec4* nodes, size_t count) const
+    {
+        // location of "nodes[k]" is the k-th element, count continues from there
+        glUniform4fv(getLocation(firstIndex ? "nodes[" + std::to_string(firstIndex) + "]" : "nodes"), GLsizei(count), &nodes->x);
+    }
+
+    void updateNodeTexture(size_t firstIndex, const bsp::Vec4* nodes, size_t count) const
+    {
+        glBindTexture(GL_TEXTURE_2D, m_nodeTexture);
+        UVBSPNodeTexture::forEachRect(firstIndex, count, [&](size_t nodeOffset, unsigned x, unsigned y, unsigned width, unsigned height) {
+            glTexSubImage2D(GL_TEXTURE_2D, 0, GLint(x), GLint(y), GLsizei(width), GLsizei(height), GL_RGBA, GL_UNSIGNED_BYTE, nodes + nodeOffset);
+        });
+    }
+
+    void uploadAllNodes(UVBSP& uvbsp)
+    {
+        uvbsp.updateUniforms([](int, const bsp::Vec4*, size_t) {});
+        const UVBSPCompiledTree& compiledTree = uvbsp.getCompiledTree();
+        m_isLargeTree = compiledTree.size() > s_uniformNodeCapacity;
+        glUniform1i(getLocation("largeTree"), m_isLargeTree);
+        glUniform1i(getLocation("maxDepth"), compiledTree.getMaxDepth());
+        if (m_isLargeTree) {
+            isHalfNodes = false;
+            glUniform1i(getLocation("halfNodes"), false);
+            const size_t textureRows = (compiledTree.size() + UVBSPNodeTexture::s_nodesPerRow - 1) / UVBSPNodeTexture::s_nodesPerRow;
+            if (textureRows > m_nodeTextureRows) {
+                unsigned rows = std::max(1u, m_nodeTextureRows);
+                while (rows < textureRows)
+                    rows *= 2;
+                glBindTexture(GL_TEXTURE_2D, m_nodeTexture);
+                glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, GLsizei(UVBSPNodeTexture::s_nodesPerRow * 4), GLsizei(rows), 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+                m_nodeTextureRows = rows;
+            }
+            updateNodeTexture(0, compiledTree.data(), compiledTree.size());
+            return;
+        }
+        if (isHalfNodes) {
+            UVBSPHalfNodes::Settings settings;
+            settings.checkResolution = 0;
+            isHalfNodes = halfNodes.pack(uvbsp, settings);
+        }
+        glUniform1i(getLocation("halfNodes"), isHalfNodes);
+        if (isHalfNodes)
+            setNodes(0, halfNodes.getPacked().data(), halfNodes.getPacked().size());
+        else
+            setNodes(0, compiledTree.data(), compiledTree.size());
+    }
+
+    void updateUniforms(UVBSP& uvbsp)
+    {
+        const UVBSPCompiledTree& compiledTree = uvbsp.getCompiledTree();
+        const bool isLargeTree = compiledTree.size() > s_uniformNodeCapacity;
+        const size_t textureRows = (compiledTree.size() + UVBSPNodeTexture::s_nodesPerRow - 1) / UVBSPNodeTexture::s_nodesPerRow;
+        if (isLargeTree != m_isLargeTree || (isLargeTree && textureRows > m_nodeTextureRows)) {
+            uploadAllNodes(uvbsp);
+            return;
+        }
+        glUniform1i(getLocation("maxDepth"), compiledTree.getMaxDepth());
+        uvbsp.updateUniforms([&](int firstIndex, const bsp::Vec4* nodes, size_t count) {
+            if (m_isLargeTree) {
+                updateNodeTexture(firstIndex, nodes, count);
+            } else if (isHalfNodes) {
+                CHECK(halfNodes.packRange(uvbsp.getCompiledTree(), firstIndex, count, UVBSPHalfNodes::Settings()));
+                const size_t firstPair = firstIndex / 2, endPair = (firstIndex + count + 1) / 2;
+                setNodes(firstPair, halfNodes.getPacked().data() + firstPair, endPair - firstPair);
+            } else {
+                setNodes(firstIndex, nodes, count);
+            }
+        });
+    }
+
+    // Texel centers where the shader and the CPU bake (or the half nodes walk) differ
+    size_t countMismatches(const UVBSP& uvbsp) const
+    {
+        glUniform1i(getLocation("indexOutput"), true);
+        glUniform1f(getLocation("indexResolution"), float(s_resolution));
+        glClear(GL_COLOR_BUFFER_BIT);
+        glBegin(GL_QUADS); // texture v up, as the rows of glReadPixels
+        glTexCoord2f(0.f, 0.f);
+        glVertex2f(-1.f, -1.f);
+        glTexCoord2f(1.f, 0.f);
+        glVertex2f(1.f, -1.f);
+        glTexCoord2f(1.f, 1.f);
+        glVertex2f(1.f, 1.f);
+        glTexCoord2f(0.f, 1.f);
+        glVertex2f(-1.f, 1.f);
+        glEnd();
+        std::vector<uint8_t> pixels(size_t(s_resolution) * s_resolution * 4);
+        glReadPixels(0, 0, s_resolution, s_resolution, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+
+        UVBSPIndexBaker::Settings settings;
+        settings.width = settings.height = s_resolution;
+        std::vector<uint16_t> baked(size_t(s_resolution) * s_resolution);
+        UVBSPIndexBaker(uvbsp).bakeRows(settings, 0, s_resolution, baked.data());
+        size_t mismatches = 0;
+        for (uint32_t y = 0; y < s_resolution; ++y)
+            for (uint32_t x = 0; x < s_resolution; ++x) {
+                const size_t i = size_t(y) * s_resolution + x;
+                const int expected = isHalfNodes ? halfNodes.evaluate(getTexelCenter(x, y, s_resolution, s_resolution)) : baked[i];
+                mismatches += (pixels[i * 4] | pixels[i * 4 + 1] << 8 | pixels[i * 4 + 2] << 16) != expected;
+            }
+        return mismatches;
+    }
+};
+
+bool createContext()
+{
+    const EGLDisplay display = eglGetPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+    EGLint major, minor;
+    if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor) || !eglBindAPI(EGL_OPENGL_API))
+        return false;
+    const EGLContext context = eglCreateContext(display, EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, nullptr);
+    if (context == EGL_NO_CONTEXT || !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context))
+        return false;
+
+    GLuint framebuffer, renderbuffer;
+    glGenFramebuffers(1, &framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glGenRenderbuffers(1, &renderbuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, renderbuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, s_resolution, s_resolution);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderbuffer);
+    glViewport(0, 0, s_resolution, s_resolution);
+    return glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+}
+
+// Drawn split by split with undo and redo, uploaded in the runs every step reports
+void drawSplits(PreviewShader& shader, UVBSP& uvbsp, int splitCount, unsigned seed)
+{
+    std::mt19937 random(seed);
+    std::uniform_real_distribution<float> unit(0.f, 1.f);
+    UVBSPActionHistory history(uvbsp);
+    for (int i = 0; i < splitCount; ++i) {
+        const float angle = unit(random) * 6.2831853f;
+        uvbsp.addSplit(UVBSPSplit(bsp::vec2(unit(random), unit(random)), bsp::vec2(std::cos(angle), std::sin(angle)),
+            int(random() % 300), int(random() % 300)));
+        history.add(uvbsp.getLastAddRecord());
+        uvbsp.finishSplit();
+        if (i % 5 == 4) {
+            history.undo();
+            history.undo();
+            history.redo();
+        }
+        shader.updateUniforms(uvbsp);
+    }
+}
+
+} // namespace
+
+int main()
+{
+    if (!createContext()) {
+        std::printf("shader_test: no EGL device, skipped\n");
+        return 77;
+    }
+    std::printf("%s, %s\n", glGetString(GL_RENDERER), glGetString(GL_VERSION));
+    std::ifstream file(std::string(SHADER_DIR) + "/BSPshader.frag");
+    std::stringstream fragmentSource;
+    fragmentSource << file.rdbuf();
+    PreviewShader shader;
+    CHECK(shader.create(fragmentSource.str()));
+
+    // whole trees: the uniform array, the node texture with one row, a few, and rows to spare
+    for (size_t splitCount : { 300, 700, 3000, 9000 }) {
+        UVBSP uvbsp = makeRandomTree(splitCount, unsigned(splitCount));
+        shader.uploadAllNodes(uvbsp);
+        CHECK(shader.countMismatches(uvbsp) == 0);
+    }
+
+    // edits: runs of the uniform array, the switch to the texture, runs across rows as it grows
+    UVBSP edited;
+    shader.uploadAllNodes(edited);
+    drawSplits(shader, edited, 500, 1);
+    CHECK(shader.countMismatches(edited) == 0);
+    drawSplits(shader, edited, 2000, 2);
+    CHECK(edited.getCompiledTree().size() > 2 * UVBSPNodeTexture::s_nodesPerRow);
+    CHECK(shader.countMismatches(edited) == 0);
+
+    // half nodes, packed whole and repacked in runs
+    UVBSP half = makeRandomTree(400, 9, 40);
+    shader.isHalfNodes = true;
+    shader.uploadAllNodes(half);
+    CHECK(shader.isHalfNodes);
+    CHECK(shader.countMismatches(half) == 0);
+    drawSplits(shader, half, 80, 3);
+    CHECK(shader.isHalfNodes);
+    CHECK(shader.countMismatches(half) == 0);
+    return finishTest("shader_test");
+}
@@ -0,0 +1,52 @@
+// simplify() removes nodes without changing the partition, compared on
+// samples of its own, not the texel centers simplify() verifies itself
+
+#include "test_utils.h"
+
+namespace {
+
+void checkSimplify(const UVBSP& original, unsigned seed)
+{
+    UVBSP uvbsp;
+    uvbsp.assignNodes(original.getNodes());
+    const UVBSPOptimizeReport report = uvbsp.simplify();
+    CHECK(report.applied);
+    CHECK(report.mismatchedSamples == 0);
+    CHECK(report.nodesAfter == uvbsp.getNumNodes());
+    CHECK(report.nodesAfter + report.linesOutsideCell + report.sameColorSplits + report.deadNodes == report.nodesBefore);
+    CHECK(countClassifyMismatches(original, uvbsp, seed) == 0);
+
+    // nothing left to remove
+    const UVBSPOptimizeReport again = uvbsp.simplify();
+    CHECK(again.nodesAfter == again.nodesBefore);
+}
+
+} // namespace
+
+int main()
+{
+    // every kind of removal: lines outside of the unit square, one color on both sides, an unreachable node
+    UVBSP handmade;
+    handmade.assignNodes({
+        UVBSPSplit(bsp::vec2(0.5f, 0.5f), bsp::vec2(1.f, 0.f), -1, -2),
+        UVBSPSplit(bsp::vec2(-1.f, 0.5f), bsp::vec2(1.f, 0.f), 0, 1),
+        UVBSPSplit(bsp::vec2(0.5f, 0.3f), bsp::vec2(0.f, 1.f), -3, 2),
+        UVBSPSplit(bsp::vec2(0.5f, 0.2f), bsp::vec2(0.6f, 0.8f), 3, 3),
+        UVBSPSplit(bsp::vec2(0.1f, 0.1f), bsp::vec2(1.f, 0.f), 4, 5),
+    });
+    UVBSP handmadeSimplified;
+    handmadeSimplified.assignNodes(handmade.getNodes());
+    const UVBSPOptimizeReport report = handmadeSimplified.simplify();
+    CHECK(report.applied);
+    CHECK(report.linesOutsideCell == 1);
+    CHECK(report.sameColorSplits == 1);
+    CHECK(report.deadNodes == 1);
+    CHECK(report.nodesAfter == 2);
+    CHECK(countClassifyMismatches(handmade, handmadeSimplified, 3) == 0);
+
+    // two colors: many splits separate a color from itself
+    for (size_t splitCount : { 10, 100, 1000 })
+        checkSimplify(makeRandomTree(splitCount, unsigned(splitCount) + 200, 2), 1);
+    checkSimplify(makeRandomTree(1000, 5), 2); // distinct colors, nothing to remove
+    return finishTest("simplify_test");
+}
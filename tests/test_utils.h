@@ -0,0 +1,83 @@
+#ifndef UVBSP_TEST_UTILS_H
+#define UVBSP_TEST_UTILS_H
+
+// Checks of the core library, one executable per area, run by ctest.
+// A failed CHECK prints the expression and the test goes on, main() returns
+// getFailureCount() != 0, so one run lists every mismatch.
+
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <uvbsp/uvbsp.h>
+#include <uvbsp/uvbsp_traversal.h>
+
+inline int& getFailureCount()
+{
+    static int failureCount = 0;
+    return failureCount;
+}
+
+#define CHECK(condition)                                                                    \
+    do {                                                                                    \
+        if (!(condition)) {                                                                 \
+            std::printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition);       \
+            getFailureCount()++;                                                            \
+        }                                                                                   \
+    } while (0)
+
+inline int finishTest(const char* name)
+{
+    std::printf("%s: %s\n", name, getFailureCount() ? "FAILED" : "passed");
+    return getFailureCount() != 0;
+}
+
+// Splits at random points in random directions, as drawn in the editor.
+// colorCount 0 gives every split two new colors, otherwise colors repeat
+inline UVBSP makeRandomTree(size_t splitCount, unsigned seed, int colorCount = 0)
+{
+    std::mt19937 random(seed);
+    std::uniform_real_distribution<float> unit(0.f, 1.f);
+    UVBSP uvbsp;
+    for (size_t i = 0; i < splitCount; ++i) {
+        const float angle = unit(random) * 6.2831853f;
+        const int l = colorCount ? int(random() % colorCount) : int(2 * i);
+        const int r = colorCount ? int(random() % colorCount) : int(2 * i + 1);
+        uvbsp.addSplit(UVBSPSplit(bsp::vec2(unit(random), unit(random)), bsp::vec2(std::cos(angle), std::sin(angle)), l, r));
+    }
+    uvbsp.finishSplit();
+    return uvbsp;
+}
+
+// Color of traverseTree() in BSPshader.frag walking the uncompiled nodes, node by node
+inline int classifyReference(const std::vector<UVBSPSplit>& nodes, bsp::vec2 uv)
+{
+    for (int index = 0, iteration = 0; iteration <= int(nodes.size()); ++iteration) {
+        const bsp::Vec4 node = packNodeToShader(nodes[index]);
+        const int child = floatBitsToInt(isLeftPixel(node, uv) ? node.z : node.w);
+        if (child >= 0)
+            return child;
+        index = -child;
+    }
+    return 0;
+}
+
+// Samples where the trees disagree: random points and 1536^2 texel centers
+inline size_t countClassifyMismatches(const UVBSP& a, const UVBSP& b, unsigned seed)
+{
+    std::mt19937 random(seed);
+    std::uniform_real_distribution<float> unit(0.f, 1.f);
+    size_t mismatches = 0;
+    for (int i = 0; i < 200000; ++i) {
+        const bsp::vec2 uv(unit(random), unit(random));
+        mismatches += a.classify(uv) != b.classify(uv);
+    }
+    for (uint32_t y = 0; y < 1536; ++y) {
+        for (uint32_t x = 0; x < 1536; ++x) {
+            const bsp::vec2 uv = getTexelCenter(x, y, 1536, 1536);
+            mismatches += a.classify(uv) != b.classify(uv);
+        }
+    }
+    return mismatches;
+}
+
+#endif // UVBSP_TEST_UTILS_H
@@ -0,0 +1,53 @@
+// classify() of the compiled tree, single and batched in every mode,
+// against the node by node walk of the shader on the uncompiled tree
+
+#include "test_utils.h"
+
+namespace {
+
+void checkTree(const UVBSP& uvbsp, unsigned seed)
+{
+    std::mt19937 random(seed);
+    std::uniform_real_distribution<float> unit(0.f, 1.f);
+    std::vector<bsp::vec2> samples;
+    for (int i = 0; i < 20000; ++i)
+        samples.emplace_back(unit(random), unit(random));
+    // texel centers, and points on the lines, where rounding decides the side
+    for (uint32_t y = 0; y < 64; ++y)
+        for (uint32_t x = 0; x < 64; ++x)
+            samples.push_back(getTexelCenter(x, y, 64, 64));
+    for (const UVBSPSplit& node : uvbsp.getNodes())
+        samples.push_back(node.pos);
+
+    const std::vector<UVBSPSplit>& nodes = uvbsp.getNodes();
+    std::vector<int> expected(samples.size());
+    int singleMismatches = 0;
+    for (size_t i = 0; i < samples.size(); ++i) {
+        expected[i] = classifyReference(nodes, samples[i]);
+        singleMismatches += uvbsp.classify(samples[i]) != expected[i];
+    }
+    CHECK(singleMismatches == 0);
+
+    for (UVBSP::ClassifyMode mode : { UVBSP::ClassifyMode::Scalar, UVBSP::ClassifyMode::Simd, UVBSP::ClassifyMode::Coherent }) {
+        // odd counts leave a tail shorter than a SIMD step
+        for (size_t count : { samples.size(), size_t(1), size_t(7), size_t(13) }) {
+            std::vector<int> colors(count, -1);
+            uvbsp.classify(samples.data(), count, colors.data(), mode);
+            int mismatches = 0;
+            for (size_t i = 0; i < count; ++i)
+                mismatches += colors[i] != expected[i];
+            CHECK(mismatches == 0);
+        }
+    }
+}
+
+} // namespace
+
+int main()
+{
+    checkTree(UVBSP(), 1); // initial root only
+    for (size_t splitCount : { 1, 10, 100, 1000, 20000 })
+        checkTree(makeRandomTree(splitCount, unsigned(splitCount)), 7);
+    checkTree(makeRandomTree(2000, 3, 4), 11); // few colors
+    return finishTest("traversal_test");
+}